@@ -6,10 +6,174 @@
 #include <md5.h>
 
 #include <cstring>
+#include <cstdlib>
 
 using namespace std;
 
 
+size_t getHashSize ( HashType type )
+{
+    switch ( type )
+    {
+        case HashType::Md5:
+            return 16;
+
+        case HashType::Md5Short:
+        case HashType::Xxh64:
+            return 8;
+
+        default:
+            return 0;
+    }
+}
+
+void getHash ( HashType type, const char *bytes, size_t len, char *dst )
+{
+    switch ( type )
+    {
+        case HashType::Md5:
+            getMD5 ( bytes, len, dst );
+            break;
+
+        case HashType::Md5Short:
+        {
+            char tmp[16];
+            getMD5 ( bytes, len, tmp );
+            memcpy ( dst, tmp, 8 );
+            break;
+        }
+
+        case HashType::Xxh64:
+        {
+            const uint64_t hash = getXXH64 ( bytes, len );
+            memcpy ( dst, &hash, sizeof ( hash ) );
+            break;
+        }
+
+        default:
+            ASSERT_IMPOSSIBLE;
+            break;
+    }
+}
+
+bool checkHash ( HashType type, const char *bytes, size_t len, const char *hash )
+{
+    const size_t size = getHashSize ( type );
+
+    if ( ! size )
+        return false;
+
+    char tmp[MAX_HASH_SIZE];
+    getHash ( type, bytes, len, tmp );
+    return !memcmp ( tmp, hash, size );
+}
+
+
+// See https://github.com/Cyan4973/xxHash for the reference implementation
+static const uint64_t XXH_PRIME64_1 = 0x9E3779B185EBCA87ULL;
+static const uint64_t XXH_PRIME64_2 = 0xC2B2AE3D27D4EB4FULL;
+static const uint64_t XXH_PRIME64_3 = 0x165667B19E3779F9ULL;
+static const uint64_t XXH_PRIME64_4 = 0x85EBCA77C2B2AE63ULL;
+static const uint64_t XXH_PRIME64_5 = 0x27D4EB2F165667C5ULL;
+
+static inline uint64_t xxhRotl ( uint64_t x, int r )
+{
+    return ( x << r ) | ( x >> ( 64 - r ) );
+}
+
+static inline uint64_t xxhRead64 ( const char *p )
+{
+    uint64_t val;
+    memcpy ( &val, p, sizeof ( val ) );
+    return val;
+}
+
+static inline uint32_t xxhRead32 ( const char *p )
+{
+    uint32_t val;
+    memcpy ( &val, p, sizeof ( val ) );
+    return val;
+}
+
+static inline uint64_t xxhRound ( uint64_t acc, uint64_t input )
+{
+    acc += input * XXH_PRIME64_2;
+    acc = xxhRotl ( acc, 31 );
+    return acc * XXH_PRIME64_1;
+}
+
+static inline uint64_t xxhMergeRound ( uint64_t acc, uint64_t val )
+{
+    acc ^= xxhRound ( 0, val );
+    return acc * XXH_PRIME64_1 + XXH_PRIME64_4;
+}
+
+uint64_t getXXH64 ( const char *bytes, size_t len, uint64_t seed )
+{
+    const char *p = bytes;
+    const char *const end = bytes + len;
+    uint64_t hash;
+
+    if ( len >= 32 )
+    {
+        const char *const limit = end - 32;
+
+        uint64_t v1 = seed + XXH_PRIME64_1 + XXH_PRIME64_2;
+        uint64_t v2 = seed + XXH_PRIME64_2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - XXH_PRIME64_1;
+
+        do
+        {
+            v1 = xxhRound ( v1, xxhRead64 ( p ) );
+            v2 = xxhRound ( v2, xxhRead64 ( p + 8 ) );
+            v3 = xxhRound ( v3, xxhRead64 ( p + 16 ) );
+            v4 = xxhRound ( v4, xxhRead64 ( p + 24 ) );
+            p += 32;
+        }
+        while ( p <= limit );
+
+        hash = xxhRotl ( v1, 1 ) + xxhRotl ( v2, 7 ) + xxhRotl ( v3, 12 ) + xxhRotl ( v4, 18 );
+        hash = xxhMergeRound ( hash, v1 );
+        hash = xxhMergeRound ( hash, v2 );
+        hash = xxhMergeRound ( hash, v3 );
+        hash = xxhMergeRound ( hash, v4 );
+    }
+    else
+    {
+        hash = seed + XXH_PRIME64_5;
+    }
+
+    hash += ( uint64_t ) len;
+
+    for ( ; p + 8 <= end; p += 8 )
+    {
+        hash ^= xxhRound ( 0, xxhRead64 ( p ) );
+        hash = xxhRotl ( hash, 27 ) * XXH_PRIME64_1 + XXH_PRIME64_4;
+    }
+
+    if ( p + 4 <= end )
+    {
+        hash ^= ( uint64_t ) xxhRead32 ( p ) * XXH_PRIME64_1;
+        hash = xxhRotl ( hash, 23 ) * XXH_PRIME64_2 + XXH_PRIME64_3;
+        p += 4;
+    }
+
+    for ( ; p < end; ++p )
+    {
+        hash ^= ( uint64_t ) ( uint8_t ) ( *p ) * XXH_PRIME64_5;
+        hash = xxhRotl ( hash, 11 ) * XXH_PRIME64_1;
+    }
+
+    hash ^= hash >> 33;
+    hash *= XXH_PRIME64_2;
+    hash ^= hash >> 29;
+    hash *= XXH_PRIME64_3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+
 void getMD5 ( const char *bytes, size_t len, char dst[16] )
 {
     MD5_CTX md5;
@@ -27,7 +191,7 @@ bool checkMD5 ( const char *bytes, size_t len, const char md5[16] )
 {
     char tmp[16];
     getMD5 ( bytes, len, tmp );
-    return !strncmp ( tmp, md5, sizeof ( tmp ) );
+    return !memcmp ( tmp, md5, sizeof ( tmp ) );
 }
 
 bool checkMD5 ( const string& str, const char md5[16] )
@@ -62,3 +226,89 @@ size_t compressBound ( size_t srcLen )
 {
     return mz_compressBound ( srcLen );
 }
+
+
+namespace
+{
+
+// Output state for compressing with a preset dictionary
+struct DictOutput
+{
+    char *dst;
+    size_t dstLen;
+    size_t pos;
+    bool discard;
+};
+
+mz_bool putDictOutput ( const void *buffer, int len, void *user )
+{
+    DictOutput& output = * ( DictOutput * ) user;
+
+    // Output from the dictionary itself is thrown away
+    if ( output.discard )
+        return MZ_TRUE;
+
+    if ( output.pos + len > output.dstLen )
+        return MZ_FALSE;
+
+    memcpy ( output.dst + output.pos, buffer, len );
+    output.pos += len;
+    return MZ_TRUE;
+}
+
+} // namespace
+
+size_t compress ( const char *src, size_t srcLen, char *dst, size_t dstLen, const string& dict, int level )
+{
+    ASSERT ( dict.size() <= COMPRESSION_DICT_MAX_SIZE );
+
+    tdefl_compressor *comp = ( tdefl_compressor * ) malloc ( sizeof ( tdefl_compressor ) );
+
+    if ( ! comp )
+        return 0;
+
+    DictOutput output = { dst, dstLen, 0, true };
+
+    // Negative window bits for raw deflate, the message hash already covers integrity
+    const mz_uint flags = tdefl_create_comp_flags_from_zip_params ( level, -MZ_DEFAULT_WINDOW_BITS,
+                                                                    MZ_DEFAULT_STRATEGY );
+
+    size_t len = 0;
+
+    // Prime the window with the dictionary, then sync flush so the real output starts on a byte boundary
+    if ( tdefl_init ( comp, putDictOutput, &output, flags ) == TDEFL_STATUS_OKAY
+            && tdefl_compress_buffer ( comp, &dict[0], dict.size(), TDEFL_SYNC_FLUSH ) == TDEFL_STATUS_OKAY )
+    {
+        output.discard = false;
+
+        if ( tdefl_compress_buffer ( comp, src, srcLen, TDEFL_FINISH ) == TDEFL_STATUS_DONE )
+            len = output.pos;
+    }
+
+    free ( comp );
+
+    if ( ! len )
+        LOG ( "tdefl error" );
+
+    return len;
+}
+
+size_t uncompress ( const char *src, size_t srcLen, char *dst, size_t dictLen, size_t dstLen )
+{
+    tinfl_decompressor inflator;
+    tinfl_init ( &inflator );
+
+    size_t inLen = srcLen;
+    size_t outLen = dstLen;
+
+    // Back references into the dictionary are allowed because it is part of the non-wrapping output buffer
+    const tinfl_status status = tinfl_decompress ( &inflator, ( const mz_uint8 * ) src, &inLen,
+                                                   ( mz_uint8 * ) dst, ( mz_uint8 * ) dst + dictLen, &outLen,
+                                                   TINFL_FLAG_USING_NON_WRAPPING_OUTPUT_BUF );
+
+    if ( status == TINFL_STATUS_DONE )
+        return outLen;
+
+    LOG ( "[%d] tinfl error", status );
+    return 0;
+}
@@ -1,6 +1,37 @@
 #pragma once
 
 #include <string>
+#include <cstdint>
+
+
+// Message hash algorithms, the value is sent in the top 2 bits of the message compression level byte
+enum class HashType : uint8_t
+{
+    // 16 byte MD5, this is the only hash supported by older versions
+    Md5 = 0,
+
+    // MD5 truncated to 8 bytes
+    Md5Short,
+
+    // 8 byte xxHash64, much faster than MD5 but not cryptographic
+    Xxh64,
+
+    LastType
+};
+
+// Largest hash size in bytes
+#define MAX_HASH_SIZE ( 16 )
+
+// Get the size in bytes of the given hash type, returns 0 if the type is invalid
+size_t getHashSize ( HashType type );
+
+// Hash calculation using the given hash type, dst must hold at least getHashSize ( type ) bytes
+void getHash ( HashType type, const char *bytes, size_t len, char *dst );
+bool checkHash ( HashType type, const char *bytes, size_t len, const char *hash );
+
+
+// xxHash64 calculation
+uint64_t getXXH64 ( const char *bytes, size_t len, uint64_t seed = 0 );
 
 
 // MD5 calculation
@@ -14,3 +45,10 @@ bool checkMD5 ( const std::string& str, const char md5[16] );
 size_t compress ( const char *src, size_t srcLen, char *dst, size_t dstLen, int level = 9 );
 size_t uncompress ( const char *src, size_t srcLen, char *dst, size_t dstLen );
 size_t compressBound ( size_t srcLen );
+
+// Raw deflate with a preset dictionary, the dictionary must be at most COMPRESSION_DICT_MAX_SIZE bytes.
+// The same dictionary must be used to uncompress, dst must start with a copy of the dictionary,
+// and the uncompressed data is written directly after it.
+#define COMPRESSION_DICT_MAX_SIZE ( 32768 )
+size_t compress ( const char *src, size_t srcLen, char *dst, size_t dstLen, const std::string& dict, int level = 9 );
+size_t uncompress ( const char *src, size_t srcLen, char *dst, size_t dictLen, size_t dstLen );
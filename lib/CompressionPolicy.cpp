@@ -0,0 +1,192 @@
+#include "CompressionPolicy.hpp"
+#include "Compression.hpp"
+#include "Logger.hpp"
+
+using namespace std;
+
+
+static const string noDictionary;
+
+
+uint8_t CompressionPolicy::getLevel ( MsgType type, uint8_t requestedLevel, size_t size )
+{
+    if ( ! requestedLevel )
+        return 0;
+
+    Entry& entry = _entries[ ( uint8_t ) type];
+
+    if ( size < entry.minSize )
+    {
+        ++entry.stats.skipped;
+        return 0;
+    }
+
+    if ( ! _adaptive )
+        return requestedLevel;
+
+    const uint8_t level = entry.level;
+
+    if ( ! level )
+    {
+        if ( ++entry.skipsSinceDisabled < COMPRESSION_PROBE_INTERVAL )
+        {
+            ++entry.stats.skipped;
+            return 0;
+        }
+
+        // Periodically probe at the lowest level in case the messages have become compressible
+        entry.skipsSinceDisabled = 0;
+        return 1;
+    }
+
+    return min ( requestedLevel, level );
+}
+
+const string& CompressionPolicy::getDictionary ( MsgType type ) const
+{
+    const string *dictionary = _entries[ ( uint8_t ) type].dictionary;
+    return ( dictionary ? *dictionary : noDictionary );
+}
+
+void CompressionPolicy::update ( MsgType type, size_t size, size_t compressedSize, uint64_t microseconds )
+{
+    Entry& entry = _entries[ ( uint8_t ) type];
+
+    entry.stats.add ( size, compressedSize, microseconds );
+
+    const uint64_t numCompressed = entry.window.add ( size, compressedSize, microseconds );
+
+    if ( ! _adaptive )
+        return;
+
+    // Re-enable compression if the probe saved at least 10%
+    if ( ! entry.level )
+    {
+        if ( 10 * compressedSize <= 9 * size )
+        {
+            LOG ( "Re-enabling compression for %s", type );
+            entry.level = 1;
+        }
+
+        entry.window.reset();
+        return;
+    }
+
+    // Only the thread that completes the window adapts the level
+    if ( numCompressed == COMPRESSION_ADAPT_INTERVAL )
+        adapt ( entry );
+}
+
+void CompressionPolicy::adapt ( Entry& entry )
+{
+    const Stats window = entry.window.load();
+    const uint64_t avgTime = window.microseconds / max ( window.compressed, ( uint64_t ) 1 );
+    const uint8_t level = entry.level;
+
+    if ( 10 * window.bytesOut > 9 * window.bytesIn )
+    {
+        // Saving less than 10%, reduce the level quickly, eventually disabling compression
+        entry.level = ( level > 3 ? level - 3 : 0 );
+    }
+    else if ( avgTime > COMPRESSION_TIME_BUDGET )
+    {
+        // Too slow, but still worth compressing
+        if ( level > 1 )
+            entry.level = level - 1;
+    }
+    else if ( 2 * window.bytesOut < window.bytesIn && 2 * avgTime < COMPRESSION_TIME_BUDGET )
+    {
+        // Compressing well and fast enough, try a higher level
+        if ( level < 9 )
+            entry.level = level + 1;
+    }
+
+    entry.window.reset();
+    entry.skipsSinceDisabled = 0;
+}
+
+void CompressionPolicy::setDictionary ( MsgType type, const string& dictionary )
+{
+    ASSERT ( dictionary.size() <= COMPRESSION_DICT_MAX_SIZE );
+
+    if ( dictionary.empty() )
+    {
+        _entries[ ( uint8_t ) type].dictionary = 0;
+        return;
+    }
+
+    LOCK ( _mutex );
+
+    _dictionaries.emplace_back ( new string ( dictionary ) );
+    _entries[ ( uint8_t ) type].dictionary = _dictionaries.back().get();
+}
+
+CompressionPolicy::Stats CompressionPolicy::getStats ( MsgType type ) const
+{
+    return _entries[ ( uint8_t ) type].stats.load();
+}
+
+void CompressionPolicy::clear()
+{
+    for ( Entry& entry : _entries )
+        entry.reset();
+
+    _adaptive = true;
+}
+
+void CompressionPolicy::logStats() const
+{
+    for ( size_t i = 0; i < _entries.size(); ++i )
+    {
+        const Entry& entry = _entries[i];
+        const Stats stats = entry.stats.load();
+
+        if ( ! stats.compressed && ! stats.skipped )
+            continue;
+
+        LOG ( "%s: compressed=%llu; skipped=%llu; bytesIn=%llu; bytesOut=%llu; saved=%lld; time=%llu us; "
+              "level=%u; minSize=%u; dictionary=%u bytes",
+              ( MsgType ) i, stats.compressed, stats.skipped, stats.bytesIn, stats.bytesOut, stats.bytesSaved(),
+              stats.microseconds, entry.level.load(), entry.minSize.load(), getDictionary ( ( MsgType ) i ).size() );
+    }
+}
+
+uint64_t CompressionPolicy::AtomicStats::add ( size_t size, size_t compressedSize, uint64_t microseconds )
+{
+    bytesIn += size;
+    bytesOut += compressedSize;
+    this->microseconds += microseconds;
+    return ++compressed;
+}
+
+CompressionPolicy::Stats CompressionPolicy::AtomicStats::load() const
+{
+    Stats stats;
+    stats.compressed = compressed;
+    stats.skipped = skipped;
+    stats.bytesIn = bytesIn;
+    stats.bytesOut = bytesOut;
+    stats.microseconds = microseconds;
+    return stats;
+}
+
+void CompressionPolicy::AtomicStats::reset()
+{
+    compressed = skipped = bytesIn = bytesOut = microseconds = 0;
+}
+
+void CompressionPolicy::Entry::reset()
+{
+    minSize = DEFAULT_COMPRESSION_MIN_SIZE;
+    level = 9;
+    dictionary = 0;
+    stats.reset();
+    window.reset();
+    skipsSinceDisabled = 0;
+}
+
+CompressionPolicy& CompressionPolicy::get()
+{
+    static CompressionPolicy instance;
+    return instance;
+}
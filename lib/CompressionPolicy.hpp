@@ -0,0 +1,137 @@
+#pragma once
+
+#include "Protocol.hpp"
+#include "Thread.hpp"
+
+#include <array>
+#include <atomic>
+#include <string>
+#include <vector>
+#include <memory>
+
+
+// Messages smaller than this are never compressed by default
+#define DEFAULT_COMPRESSION_MIN_SIZE ( 64 )
+
+// Number of compressed messages per type between each adaptive level update
+#define COMPRESSION_ADAPT_INTERVAL ( 32 )
+
+// Number of skipped messages per type before trying to compress again after compression was disabled
+#define COMPRESSION_PROBE_INTERVAL ( 1024 )
+
+// Target time spent compressing a single message in microseconds
+#define COMPRESSION_TIME_BUDGET ( 100 )
+
+
+// Per message type compression policy.
+// Messages below a size threshold are skipped, and the compression level adapts to the measured ratio and time.
+// This is shared by every socket, and messages are encoded on both the main and network threads. The counters and
+// levels are atomic, so encoding never locks, and a level may adapt to a window that mixes both threads' messages.
+class CompressionPolicy
+{
+public:
+
+    // Compression statistics
+    struct Stats
+    {
+        // Number of messages compressed, and skipped without compressing
+        uint64_t compressed = 0, skipped = 0;
+
+        // Total input and output bytes of compressed messages
+        uint64_t bytesIn = 0, bytesOut = 0;
+
+        // Total time spent compressing in microseconds
+        uint64_t microseconds = 0;
+
+        int64_t bytesSaved() const { return ( int64_t ) bytesIn - ( int64_t ) bytesOut; }
+    };
+
+    // Get the level to compress a message of the given type and size, 0 if it should not be compressed
+    uint8_t getLevel ( MsgType type, uint8_t requestedLevel, size_t size );
+
+    // Get the preset dictionary for the given type, empty if none
+    const std::string& getDictionary ( MsgType type ) const;
+
+    // Update the policy after compressing a message.
+    // compressedSize should be the size actually sent, ie the original size if compression didn't help.
+    void update ( MsgType type, size_t size, size_t compressedSize, uint64_t microseconds );
+
+    // Set the size threshold below which the given type is not compressed
+    void setMinSize ( MsgType type, uint32_t minSize ) { _entries[ ( uint8_t ) type].minSize = minSize; }
+
+    // Set a preset dictionary, this changes the wire format so it must be identical on BOTH sides.
+    // Replaced dictionaries are kept until exit, since another thread may still be compressing with them.
+    void setDictionary ( MsgType type, const std::string& dictionary );
+
+    // Enable / disable adapting the compression level, if disabled the requested level is always used
+    void setAdaptive ( bool adaptive ) { _adaptive = adaptive; }
+
+    // Get a copy of the statistics for the given type
+    Stats getStats ( MsgType type ) const;
+
+    // Reset all policies and statistics
+    void clear();
+
+    // Log the statistics for all types with any compressed or skipped messages
+    void logStats() const;
+
+    // Get the singleton instance
+    static CompressionPolicy& get();
+
+private:
+
+    // Statistics that can be updated from any thread
+    struct AtomicStats
+    {
+        std::atomic<uint64_t> compressed { 0 }, skipped { 0 }, bytesIn { 0 }, bytesOut { 0 }, microseconds { 0 };
+
+        // Add a compressed message, returns the new number of compressed messages
+        uint64_t add ( size_t size, size_t compressedSize, uint64_t microseconds );
+
+        Stats load() const;
+        void reset();
+    };
+
+    struct Entry
+    {
+        // Messages smaller than this are not compressed
+        std::atomic<uint32_t> minSize { DEFAULT_COMPRESSION_MIN_SIZE };
+
+        // Current maximum compression level, 0 if compression is disabled
+        std::atomic<uint8_t> level { 9 };
+
+        // Preset dictionary, null if none, owned by _dictionaries
+        std::atomic<const std::string *> dictionary { 0 };
+
+        // Total statistics
+        AtomicStats stats;
+
+        // Statistics since the last level update
+        AtomicStats window;
+
+        // Number of messages skipped since compression was disabled
+        std::atomic<uint32_t> skipsSinceDisabled { 0 };
+
+        void reset();
+    };
+
+    // Policy for each message type
+    std::array<Entry, 256> _entries;
+
+    // Flag to indicate if the level should adapt
+    std::atomic<bool> _adaptive { true };
+
+    // Every dictionary that was set, kept until exit since they are read without locking
+    std::vector<std::unique_ptr<std::string>> _dictionaries;
+
+    // Mutex for _dictionaries, only locked when setting a dictionary
+    Mutex _mutex;
+
+    // Adjust the level for the given entry based on the last window of statistics
+    void adapt ( Entry& entry );
+
+    // Private constructor, etc. for singleton class
+    CompressionPolicy() {}
+    CompressionPolicy ( const CompressionPolicy& );
+    const CompressionPolicy& operator= ( const CompressionPolicy& );
+};
@@ -14,18 +14,22 @@ using namespace std;
 #define DEFAULT_TIMEOUT_MILLISECONDS ( 1000 )
 
 
-void EventManager::checkEvents ( uint64_t timeout )
+bool EventManager::checkEvents ( uint64_t timeout )
 {
     if ( ! _running )
-        return;
+        return false;
 
     ASSERT ( TimerManager::get().isInitialized() == true );
     ASSERT ( SocketManager::get().isInitialized() == true );
 
-    TimerManager::get().check();
+    // Flush what the timers sent before waiting
+    {
+        SocketManager::Batch batch;
+        TimerManager::get().check();
+    }
 
     if ( ! _running )
-        return;
+        return false;
 
     if ( TimerManager::get().getNextExpiry() != UINT64_MAX )
     {
@@ -40,7 +44,8 @@ void EventManager::checkEvents ( uint64_t timeout )
 
     ASSERT ( timeout > 0 );
 
-    SocketManager::get().check ( timeout );
+    // Blocks until a socket is ready, the next timer expires, or stop is called
+    return SocketManager::get().check ( timeout );
 }
 
 void EventManager::eventLoop()
@@ -50,10 +55,7 @@ void EventManager::eventLoop()
         timeBeginPeriod ( 1 ); // for select, see comment in SocketManager
 
         while ( _running )
-        {
-            Sleep ( 1 );
             checkEvents ( DEFAULT_TIMEOUT_MILLISECONDS );
-        }
 
         timeEndPeriod ( 1 ); // for select, see comment in SocketManager
     }
@@ -62,10 +64,7 @@ void EventManager::eventLoop()
         timeBeginPeriod ( 1 ); // for timeGetTime AND select
 
         while ( _running )
-        {
-            Sleep ( 1 );
             checkEvents ( DEFAULT_TIMEOUT_MILLISECONDS );
-        }
 
         timeEndPeriod ( 1 ); // for timeGetTime AND select
     }
@@ -83,11 +82,11 @@ bool EventManager::poll ( uint64_t timeout )
     uint64_t now = TimerManager::get().getNow ( true );
     const uint64_t end = now + timeout;
 
-    timeBeginPeriod ( 1 ); // for select, see comment in SocketManager
-
     while ( now < end )
     {
-        checkEvents ( end - now );
+        // Return as soon as any sockets are handled, so the caller can check for new data right away
+        if ( checkEvents ( end - now ) )
+            break;
 
         if ( ! _running )
             break;
@@ -95,11 +94,11 @@ bool EventManager::poll ( uint64_t timeout )
         now = TimerManager::get().getNow ( true );
     }
 
-    timeEndPeriod ( 1 ); // for select, see comment in SocketManager
-
     if ( _running )
         return true;
 
+    endTimerPeriod();
+
     LOG ( "Finished polling" );
 
     // LOG ( "Joining reaper thread" );
@@ -113,6 +112,9 @@ void EventManager::startPolling()
 {
     _running = true;
 
+    // Once for all the polls, instead of around each one
+    beginTimerPeriod();
+
     LOG ( "Starting polling" );
 }
 
@@ -135,6 +137,8 @@ void EventManager::stop()
 
     _running = false;
 
+    SocketManager::get().wakeup();
+
     // LOG ( "Joining reaper thread" );
     // _reaperThread.join();
     // LOG ( "Joined reaper thread" );
@@ -146,11 +150,31 @@ void EventManager::release()
 
     _running = false;
 
+    SocketManager::get().wakeup();
+
     LOG ( "Releasing reaper thread" );
 
     _reaperThread.release();
 }
 
+void EventManager::beginTimerPeriod()
+{
+    if ( _timerPeriod )
+        return;
+
+    timeBeginPeriod ( 1 ); // for select, see comment in SocketManager
+    _timerPeriod = true;
+}
+
+void EventManager::endTimerPeriod()
+{
+    if ( ! _timerPeriod )
+        return;
+
+    timeEndPeriod ( 1 ); // for select, see comment in SocketManager
+    _timerPeriod = false;
+}
+
 EventManager& EventManager::get()
 {
     static EventManager instance;
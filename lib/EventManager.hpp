@@ -21,7 +21,8 @@ public:
     // Start the EventManager for polling, doesn't block
     void startPolling();
 
-    // Poll for events instead of start / stop, returns false if the EventManager has been stopped
+    // Poll for events instead of start / stop, returns after the timeout or as soon as any sockets were handled.
+    // Returns false if the EventManager has been stopped.
     bool poll ( uint64_t timeout );
 
     // Start the EventManager, blocks until stop is called
@@ -58,8 +59,15 @@ private:
     // Flag to indicate the event loop is running
     volatile bool _running = false;
 
-    // Check for events
-    void checkEvents ( uint64_t timeout );
+    // Flag to indicate the timer period is raised for polling
+    bool _timerPeriod = false;
+
+    // Check for events, returns true if any sockets were handled
+    bool checkEvents ( uint64_t timeout );
+
+    // Raise the timer period for accurate polling timeouts, and restore it once polling is finished
+    void beginTimerPeriod();
+    void endTimerPeriod();
 
     // Main event loop
     void eventLoop();
@@ -1,15 +1,18 @@
 #include "GoBackN.hpp"
+#include "TimerManager.hpp"
 #include "Logger.hpp"
 
 #include <cereal/types/string.hpp>
 
 #include <string>
+#include <vector>
+#include <cmath>
 
 using namespace std;
 
 
-// TODO increase me
-#define MTU ( 256 )
+// Maximum number of messages to send together in a single datagram
+#define MAX_DATAGRAM_MESSAGES ( 64 )
 
 
 string formatSerializableSequence ( const MsgPtr& msg )
@@ -21,9 +24,16 @@ string formatSerializableSequence ( const MsgPtr& msg )
 
 void GoBackN::timerExpired ( Timer *timer )
 {
-    ASSERT ( timer == _sendTimer.get() );
     ASSERT ( owner != 0 );
 
+    if ( timer == _resendTimer.get() )
+    {
+        resendExpired();
+        return;
+    }
+
+    ASSERT ( timer == _sendTimer.get() );
+
     if ( _sendList.empty() && !_keepAlive )
     {
         return;
@@ -37,25 +47,22 @@ void GoBackN::timerExpired ( Timer *timer )
     }
     else
     {
-        if ( _sendListPos == _sendList.cend() )
-            _sendListPos = _sendList.cbegin();
+        checkDatagramSize();
 
-#ifndef DISABLE_LOGGING
-        logSendList();
-#endif
-
-        const MsgPtr& msg = *_sendListPos;
-
-        LOG ( "Sending '%s'; sequence=%u; sendSequence=%d",
-              msg, msg->getAs<SerializableSequence>().getSequence(), _sendSequence );
-
-        owner->goBackNSendRaw ( this, msg );
-        ++_sendListPos;
+        if ( _selectiveRepeat )
+        {
+            // Lost messages are resent by the resend timer, this only sends messages waiting for the window
+            fillSendWindow();
+        }
+        else
+        {
+            sendNextDatagram();
+        }
     }
 
     if ( _keepAlive )
     {
-        LOG ( "this=%08x; keepAlive=%llu; countDown=%d", this, _keepAlive, _countDown );
+        LOG_TRACE ( LOG_MODULE_GO_BACK_N, "this=%08x; keepAlive=%llu; countDown=%d", this, _keepAlive, _countDown );
 
         if ( _countDown )
         {
@@ -72,6 +79,116 @@ void GoBackN::timerExpired ( Timer *timer )
     _sendTimer->start ( _interval );
 }
 
+void GoBackN::sendNextDatagram()
+{
+    if ( _sendListPos == _sendList.cend() )
+        _sendListPos = _sendList.cbegin();
+
+    // Formatting the whole send list is slow, so only do it when it would be logged
+    if ( LOG_ENABLED ( LOG_LEVEL_TRACE, LOG_MODULE_GO_BACK_N ) )
+        logSendList();
+
+    // Send as many messages from the current position as fit in one datagram, without wrapping around
+    vector<MsgPtr> msgs;
+
+    for ( auto it = _sendListPos; it != _sendList.cend() && msgs.size() < MAX_DATAGRAM_MESSAGES; ++it )
+        msgs.push_back ( *it );
+
+    const size_t count = msgs.size();
+    const bool hasAck = appendAck ( msgs );
+
+    LOG_TRACE ( LOG_MODULE_GO_BACK_N, "Sending [ %u messages ] from '%s'; sequence=%u; sendSequence=%u", count,
+                msgs[0], msgs[0]->getAs<SerializableSequence>().getSequence(), _sendSequence );
+
+    const size_t sent = owner->goBackNSendBatch ( this, &msgs[0], msgs.size(), _datagramSize );
+
+    ASSERT ( sent > 0 && sent <= msgs.size() );
+
+    if ( hasAck && sent == msgs.size() )
+        _ackPending = false;
+
+    advance ( _sendListPos, min ( sent, count ) );
+}
+
+void GoBackN::sendBatch ( vector<MsgPtr>& msgs )
+{
+    if ( appendAck ( msgs ) )
+        _ackPending = false;
+
+    for ( size_t pos = 0; pos < msgs.size(); )
+        pos += owner->goBackNSendBatch ( this, &msgs[pos], msgs.size() - pos, _datagramSize );
+}
+
+bool GoBackN::appendAck ( vector<MsgPtr>& msgs ) const
+{
+    // The ACK goes last, so the messages being sent aren't displaced if it doesn't fit
+    if ( ! _ackPending )
+        return false;
+
+    msgs.push_back ( getAck() );
+    return true;
+}
+
+MsgPtr GoBackN::getAck() const
+{
+    if ( ! _selectiveRepeat )
+        return MsgPtr ( new AckSequence ( _recvSequence ) );
+
+    uint32_t mask = 0;
+
+    for ( uint32_t i = 0; i + 1 < SELECTIVE_REPEAT_WINDOW; ++i )
+    {
+        if ( _recvWindow[ ( _recvSequence + 2 + i ) % SELECTIVE_REPEAT_WINDOW] )
+            mask |= ( 1u << i );
+    }
+
+    return MsgPtr ( new SelectiveAck ( _recvSequence, mask ) );
+}
+
+void GoBackN::queueAck()
+{
+    if ( _ackPending )
+        return;
+
+    _ackPending = true;
+
+    owner->goBackNAckPending ( this );
+}
+
+void GoBackN::sendPendingAck()
+{
+    if ( ! _ackPending )
+        return;
+
+    _ackPending = false;
+
+    owner->goBackNSendRaw ( this, getAck() );
+}
+
+void GoBackN::checkDatagramSize()
+{
+    if ( ++_stalledIntervals < DATAGRAM_BLACK_HOLE_INTERVALS || _datagramSize <= MIN_DATAGRAM_SIZE )
+        return;
+
+    // Nothing has been ACKed for a while, assume large datagrams are being dropped somewhere along the path
+    LOG ( "datagramSize=%u; stalledIntervals=%u; falling back to %u bytes",
+          _datagramSize, _stalledIntervals, MIN_DATAGRAM_SIZE );
+
+    _datagramSize = MIN_DATAGRAM_SIZE;
+    _stalledIntervals = 0;
+    _probeCountDown = DATAGRAM_PROBE_ACKS;
+}
+
+void GoBackN::setMaxDatagramSize ( size_t size )
+{
+    ASSERT ( size >= MIN_DATAGRAM_SIZE );
+
+    _datagramSize = _maxDatagramSize = size;
+    _probeCountDown = 0;
+
+    LOG ( "maxDatagramSize=%u", _maxDatagramSize );
+}
+
 void GoBackN::checkAndStartTimer()
 {
     if ( ! _sendTimer )
@@ -89,48 +206,59 @@ void GoBackN::sendViaGoBackN ( SerializableSequence *message )
 
 void GoBackN::sendViaGoBackN ( const MsgPtr& msg )
 {
-    LOG ( "Adding '%s'; sendSequence=%d", msg, _sendSequence + 1 );
+    LOG_DEBUG ( LOG_MODULE_GO_BACK_N, "Adding '%s'; sendSequence=%d", msg, _sendSequence + 1 );
 
     ASSERT ( msg->getBaseType() == BaseType::SerializableSequence );
     ASSERT ( _sendList.empty() || _sendList.back()->getAs<SerializableSequence>().getSequence() == _sendSequence );
     ASSERT ( owner != 0 );
 
+    // New messages to send immediately
+    vector<MsgPtr> msgs;
+
     if ( msg->getAs<SerializableSequence>().getSequence() != 0 )
     {
         MsgPtr clone = msg->clone();
         clone->getAs<SerializableSequence>().setSequence ( ++_sendSequence );
 
-        owner->goBackNSendRaw ( this, clone );
-        _sendList.push_back ( clone );
+        msgs.push_back ( clone );
     }
     else
     {
         msg->getAs<SerializableSequence>().setSequence ( _sendSequence + 1 );
         string bytes = ::Protocol::encode ( msg );
 
-        if ( bytes.size() <= MTU )
+        if ( bytes.size() <= MIN_DATAGRAM_SIZE )
         {
             ++_sendSequence;
-            owner->goBackNSendRaw ( this, msg );
-            _sendList.push_back ( msg );
+            msgs.push_back ( msg );
         }
         else
         {
-            const uint32_t count = ( bytes.size() / MTU ) + ( bytes.size() % MTU == 0 ? 0 : 1 );
+            // Fragments always fit in the minimum datagram size, so they can be delivered even after the
+            // datagram size is lowered, larger datagrams are formed by sending several fragments together.
+            const uint32_t count = ( bytes.size() + MAX_FRAGMENT_SIZE - 1 ) / MAX_FRAGMENT_SIZE;
 
-            for ( uint32_t pos = 0, i = 0; pos < bytes.size(); pos += MTU, ++i )
+            for ( uint32_t pos = 0, i = 0; pos < bytes.size(); pos += MAX_FRAGMENT_SIZE, ++i )
             {
-                SplitMessage *splitMsg = new SplitMessage ( msg->getMsgType(), bytes.substr ( pos, MTU ), i, count );
+                SplitMessage *splitMsg = new SplitMessage ( msg->getMsgType(),
+                                                            bytes.substr ( pos, MAX_FRAGMENT_SIZE ), i, count );
                 splitMsg->setSequence ( ++_sendSequence );
 
-                MsgPtr msg ( splitMsg );
-                owner->goBackNSendRaw ( this, msg );
-                _sendList.push_back ( msg );
+                msgs.push_back ( MsgPtr ( splitMsg ) );
             }
         }
     }
 
-    logSendList();
+    _sendList.insert ( _sendList.end(), msgs.begin(), msgs.end() );
+
+    if ( LOG_ENABLED ( LOG_LEVEL_TRACE, LOG_MODULE_GO_BACK_N ) )
+        logSendList();
+
+    // Selective repeat sends the messages once they fit in the window
+    if ( _selectiveRepeat )
+        fillSendWindow();
+    else
+        sendBatch ( msgs );
 
     checkAndStartTimer();
 }
@@ -143,7 +271,7 @@ void GoBackN::recvFromSocket ( const MsgPtr& msg )
     {
         refreshKeepAlive();
 
-        LOG ( "this=%08x; keepAlive=%llu; countDown=%d", this, _keepAlive, _countDown );
+        LOG_TRACE ( LOG_MODULE_GO_BACK_N, "this=%08x; keepAlive=%llu; countDown=%d", this, _keepAlive, _countDown );
 
         checkAndStartTimer();
     }
@@ -155,7 +283,7 @@ void GoBackN::recvFromSocket ( const MsgPtr& msg )
     // Filter non-sequential messages
     if ( msg->getBaseType() != BaseType::SerializableSequence )
     {
-        LOG ( "Received '%s'", msg );
+        LOG_TRACE ( LOG_MODULE_GO_BACK_N, "Received '%s'", msg );
         owner->goBackNRecvRaw ( this, msg );
         return;
     }
@@ -165,32 +293,155 @@ void GoBackN::recvFromSocket ( const MsgPtr& msg )
     // Check for ACK messages
     if ( msg->getMsgType() == MsgType::AckSequence )
     {
-        if ( sequence > _ackSequence )
-            _ackSequence = sequence;
-
-        LOG ( "Got AckSequence; sequence=%u; sendSequence=%u", sequence, _sendSequence );
+        recvAck ( sequence, 0 );
+        return;
+    }
 
-        // Remove messages from sendList with sequence <= the ACKed sequence
-        while ( !_sendList.empty() && _sendList.front()->getAs<SerializableSequence>().getSequence() <= sequence )
-            _sendList.pop_front();
-        _sendListPos = _sendList.cend();
+    if ( msg->getMsgType() == MsgType::SelectiveAck )
+    {
+        recvAck ( sequence, msg->getAs<SelectiveAck>().mask );
+        return;
+    }
 
-        logSendList();
+    if ( _selectiveRepeat )
+    {
+        recvSelective ( msg, sequence );
         return;
     }
 
     if ( sequence != _recvSequence + 1 )
     {
-        owner->goBackNSendRaw ( this, MsgPtr ( new AckSequence ( _recvSequence ) ) );
+        queueAck();
         return;
     }
 
-    LOG ( "Received '%s'; sequence=%u; recvSequence=%u", msg, sequence, _recvSequence );
+    LOG_TRACE ( LOG_MODULE_GO_BACK_N, "Received '%s'; sequence=%u; recvSequence=%u", msg, sequence, _recvSequence );
 
     ++_recvSequence;
 
-    owner->goBackNSendRaw ( this, MsgPtr ( new AckSequence ( _recvSequence ) ) );
+    queueAck();
+
+    recvInOrder ( msg );
+}
+
+void GoBackN::recvAck ( uint32_t sequence, uint32_t mask )
+{
+    if ( sequence > _ackSequence )
+    {
+        // Probe the maximum datagram size again after enough messages were ACKed at the lower size
+        if ( _probeCountDown )
+        {
+            _probeCountDown -= min ( _probeCountDown, sequence - _ackSequence );
 
+            if ( ! _probeCountDown )
+            {
+                LOG ( "Probing datagramSize=%u", _maxDatagramSize );
+                _datagramSize = _maxDatagramSize;
+            }
+        }
+
+        _ackSequence = sequence;
+        _stalledIntervals = 0;
+    }
+
+    LOG_TRACE ( LOG_MODULE_GO_BACK_N, "Got ACK; sequence=%u; mask=%08x; sendSequence=%u",
+                sequence, mask, _sendSequence );
+
+    const uint64_t now = TimerManager::get().getNow();
+
+    // Remove messages from sendList with sequence <= the ACKed sequence
+    while ( !_sendList.empty() && _sendList.front()->getAs<SerializableSequence>().getSequence() <= sequence )
+    {
+        const uint32_t acked = _sendList.front()->getAs<SerializableSequence>().getSequence();
+
+        ackSlot ( acked, now );
+
+        if ( _sendWindow[acked % SELECTIVE_REPEAT_WINDOW].sequence == acked )
+            _sendWindow[acked % SELECTIVE_REPEAT_WINDOW] = SendSlot();
+
+        _sendList.pop_front();
+    }
+    _sendListPos = _sendList.cend();
+
+    if ( LOG_ENABLED ( LOG_LEVEL_TRACE, LOG_MODULE_GO_BACK_N ) )
+        logSendList();
+
+    if ( ! _selectiveRepeat )
+        return;
+
+    // Selectively ACKed messages stay in the sendList until they are cumulatively ACKed
+    uint32_t highest = 0;
+
+    for ( uint32_t i = 0; i + 1 < SELECTIVE_REPEAT_WINDOW; ++i )
+    {
+        if ( mask & ( 1u << i ) )
+        {
+            highest = sequence + 2 + i;
+            ackSlot ( highest, now );
+        }
+    }
+
+    // Messages sent before a selectively ACKed message were probably lost, so resend them without waiting for
+    // the retransmit timeout, but at most once per round trip.
+    const uint64_t roundTrip = max<uint64_t> ( _roundTripTime, MIN_RETRANSMIT_TIMEOUT );
+
+    vector<MsgPtr> msgs;
+
+    for ( uint32_t i = sequence + 1; i < highest; ++i )
+    {
+        SendSlot& slot = _sendWindow[i % SELECTIVE_REPEAT_WINDOW];
+
+        if ( slot.msg && slot.sequence == i && ! slot.acked && now >= slot.sentAt + roundTrip )
+            resend ( slot, now, msgs );
+    }
+
+    if ( ! msgs.empty() )
+        sendBatch ( msgs );
+
+    fillSendWindow();
+}
+
+void GoBackN::recvSelective ( const MsgPtr& msg, uint32_t sequence )
+{
+    // Buffer messages that fit in the receive window, ignoring duplicates
+    if ( sequence > _recvSequence && sequence <= _recvSequence + SELECTIVE_REPEAT_WINDOW )
+    {
+        LOG_TRACE ( LOG_MODULE_GO_BACK_N, "Received '%s'; sequence=%u; recvSequence=%u", msg, sequence, _recvSequence );
+
+        _recvWindow[sequence % SELECTIVE_REPEAT_WINDOW] = msg;
+    }
+
+    // Always ACK, in case the previous ACK was lost
+    queueAck();
+
+    // Messages received while the owner handles a delivered message are picked up by the outer loop,
+    // so they are still delivered in order.
+    if ( _deliveryDepth )
+        return;
+
+    const shared_ptr<uint32_t> generation = _generation;
+    const uint32_t current = *generation;
+
+    ++_deliveryDepth;
+
+    while ( _recvWindow[ ( _recvSequence + 1 ) % SELECTIVE_REPEAT_WINDOW] )
+    {
+        MsgPtr next;
+        next.swap ( _recvWindow[ ( _recvSequence + 1 ) % SELECTIVE_REPEAT_WINDOW] );
+        ++_recvSequence;
+
+        recvInOrder ( next );
+
+        // The owner reset or destroyed this while handling the message, so the rest are dropped
+        if ( *generation != current )
+            return;
+    }
+
+    --_deliveryDepth;
+}
+
+void GoBackN::recvInOrder ( const MsgPtr& msg )
+{
     if ( msg->getMsgType() == MsgType::SplitMessage )
     {
         const SplitMessage& splitMsg = msg->getAs<SplitMessage>();
@@ -212,7 +463,7 @@ void GoBackN::recvFromSocket ( const MsgPtr& msg )
 
             if ( msg )
             {
-                LOG ( "Recreated '%s'", msg );
+                LOG_TRACE ( LOG_MODULE_GO_BACK_N, "Recreated '%s'", msg );
                 owner->goBackNRecvMsg ( this, msg );
             }
         }
@@ -223,6 +474,178 @@ void GoBackN::recvFromSocket ( const MsgPtr& msg )
     owner->goBackNRecvMsg ( this, msg );
 }
 
+void GoBackN::fillSendWindow()
+{
+    if ( ! _selectiveRepeat )
+        return;
+
+    const uint64_t now = TimerManager::get().getNow();
+
+    vector<MsgPtr> msgs;
+
+    for ( const MsgPtr& msg : _sendList )
+    {
+        const uint32_t sequence = msg->getAs<SerializableSequence>().getSequence();
+
+        if ( sequence > _ackSequence + SELECTIVE_REPEAT_WINDOW )
+            break;
+
+        SendSlot& slot = _sendWindow[sequence % SELECTIVE_REPEAT_WINDOW];
+
+        if ( slot.msg && slot.sequence == sequence )
+            continue;
+
+        LOG_TRACE ( LOG_MODULE_GO_BACK_N, "Sending '%s'; sequence=%u; sendSequence=%u", msg, sequence, _sendSequence );
+
+        slot = SendSlot();
+        slot.msg = msg;
+        slot.sequence = sequence;
+        slot.sentAt = now;
+
+        msgs.push_back ( msg );
+    }
+
+    if ( ! msgs.empty() )
+        sendBatch ( msgs );
+
+    startResendTimer();
+}
+
+void GoBackN::resendExpired()
+{
+    const uint64_t now = TimerManager::get().getNow();
+
+    vector<MsgPtr> msgs;
+
+    for ( uint32_t i = _ackSequence + 1; i <= _ackSequence + SELECTIVE_REPEAT_WINDOW; ++i )
+    {
+        SendSlot& slot = _sendWindow[i % SELECTIVE_REPEAT_WINDOW];
+
+        if ( slot.msg && slot.sequence == i && ! slot.acked && now >= slot.sentAt + getRetransmitTimeout ( slot ) )
+            resend ( slot, now, msgs );
+    }
+
+    if ( ! msgs.empty() )
+        sendBatch ( msgs );
+
+    startResendTimer();
+}
+
+void GoBackN::startResendTimer()
+{
+    uint64_t next = UINT64_MAX;
+
+    for ( const SendSlot& slot : _sendWindow )
+    {
+        if ( slot.msg && ! slot.acked )
+            next = min ( next, slot.sentAt + getRetransmitTimeout ( slot ) );
+    }
+
+    if ( next == UINT64_MAX )
+    {
+        if ( _resendTimer )
+            _resendTimer->stop();
+        return;
+    }
+
+    if ( ! _resendTimer )
+        _resendTimer.reset ( new Timer ( this ) );
+
+    const uint64_t now = TimerManager::get().getNow();
+
+    _resendTimer->start ( next > now ? next - now : 1 );
+}
+
+void GoBackN::resend ( SendSlot& slot, uint64_t now, vector<MsgPtr>& msgs )
+{
+    LOG_DEBUG ( LOG_MODULE_GO_BACK_N, "Resending '%s'; sequence=%u; resends=%u; timeout=%llu",
+                slot.msg, slot.sequence, slot.resends, getRetransmitTimeout ( slot ) );
+
+    ++slot.resends;
+    slot.sentAt = now;
+
+    msgs.push_back ( slot.msg );
+}
+
+uint64_t GoBackN::getRetransmitTimeout ( const SendSlot& slot ) const
+{
+    return min<uint64_t> ( _retransmitTimeout << min<uint32_t> ( slot.resends, 8 ), MAX_RETRANSMIT_TIMEOUT );
+}
+
+void GoBackN::ackSlot ( uint32_t sequence, uint64_t now )
+{
+    SendSlot& slot = _sendWindow[sequence % SELECTIVE_REPEAT_WINDOW];
+
+    if ( ! slot.msg || slot.sequence != sequence || slot.acked )
+        return;
+
+    // Only messages that weren't resent give an unambiguous round trip time
+    if ( ! slot.resends )
+        addRoundTripSample ( now - slot.sentAt );
+
+    slot.acked = true;
+}
+
+void GoBackN::addRoundTripSample ( uint64_t rtt )
+{
+    // Smoothed round trip time and variation, as in RFC 6298
+    if ( ! _roundTripTime )
+    {
+        _roundTripTime = rtt;
+        _roundTripVar = rtt / 2.0;
+    }
+    else
+    {
+        _roundTripVar = 0.75 * _roundTripVar + 0.25 * fabs ( _roundTripTime - rtt );
+        _roundTripTime = 0.875 * _roundTripTime + 0.125 * rtt;
+    }
+
+    updateRetransmitTimeout();
+}
+
+void GoBackN::updateRetransmitTimeout()
+{
+    // Allow some slack for the timer granularity when the variation is small
+    const double timeout = _roundTripTime + max ( 4 * _roundTripVar, ( double ) MIN_RETRANSMIT_TIMEOUT / 2 );
+
+    _retransmitTimeout = min<uint64_t> ( max<uint64_t> ( timeout, MIN_RETRANSMIT_TIMEOUT ), MAX_RETRANSMIT_TIMEOUT );
+}
+
+void GoBackN::setLatency ( const Statistics& latency )
+{
+    if ( ! latency.getNumSamples() )
+        return;
+
+    // Pinger measures the one-way latency as half the round trip time
+    _roundTripTime = 2 * latency.getMean();
+    _roundTripVar = 2 * latency.getStdDev();
+
+    updateRetransmitTimeout();
+
+    LOG_TRACE ( LOG_MODULE_GO_BACK_N, "roundTripTime=%.2f; roundTripVar=%.2f; retransmitTimeout=%llu",
+                _roundTripTime, _roundTripVar, _retransmitTimeout );
+}
+
+void GoBackN::setSelectiveRepeat ( bool enabled )
+{
+    if ( enabled == _selectiveRepeat )
+        return;
+
+    LOG ( "selectiveRepeat=%u", enabled );
+
+    _selectiveRepeat = enabled;
+
+    // Messages in flight remain in the sendList, and buffered out-of-order messages will be resent
+    _sendWindow.fill ( SendSlot() );
+    _recvWindow.fill ( MsgPtr() );
+    _sendListPos = _sendList.cend();
+
+    if ( _resendTimer )
+        _resendTimer->stop();
+
+    fillSendWindow();
+}
+
 void GoBackN::setSendInterval ( uint64_t interval )
 {
     ASSERT ( interval > 0 );
@@ -247,11 +670,21 @@ void GoBackN::reset()
 {
     LOG ( "this=%08x; sendTimer=%08x", this, _sendTimer.get() );
 
-    _sendSequence = _recvSequence = 0;
+    _sendSequence = _recvSequence = _ackSequence = 0;
     _sendList.clear();
     _sendListPos = _sendList.cend();
     _sendTimer.reset();
     _recvBuffer.clear();
+
+    _sendWindow.fill ( SendSlot() );
+    _recvWindow.fill ( MsgPtr() );
+    _resendTimer.reset();
+
+    _ackPending = false;
+    _stalledIntervals = 0;
+
+    _deliveryDepth = 0;
+    ++*_generation;
 }
 
 GoBackN::GoBackN ( Owner *owner, uint64_t interval, uint64_t timeout )
@@ -286,6 +719,13 @@ GoBackN& GoBackN::operator= ( const GoBackN& other )
     _interval = other._interval;
     _keepAlive = other._keepAlive;
     _countDown = other._keepAlive;
+    _selectiveRepeat = other._selectiveRepeat;
+    _roundTripTime = other._roundTripTime;
+    _roundTripVar = other._roundTripVar;
+    _retransmitTimeout = other._retransmitTimeout;
+    _datagramSize = other._datagramSize;
+    _maxDatagramSize = other._maxDatagramSize;
+    _probeCountDown = other._probeCountDown;
 
     ASSERT ( _interval > 0 );
 
@@ -295,6 +735,8 @@ GoBackN& GoBackN::operator= ( const GoBackN& other )
 void GoBackN::save ( cereal::BinaryOutputArchive& ar ) const
 {
     ar ( _recvBuffer, _keepAlive, _sendSequence, _recvSequence, _ackSequence );
+    ar ( _selectiveRepeat, _roundTripTime, _roundTripVar, _retransmitTimeout );
+    ar ( _datagramSize, _maxDatagramSize, _probeCountDown );
 
     ar ( _sendList.size() );
 
@@ -305,6 +747,8 @@ void GoBackN::save ( cereal::BinaryOutputArchive& ar ) const
 void GoBackN::load ( cereal::BinaryInputArchive& ar )
 {
     ar ( _recvBuffer, _keepAlive, _sendSequence, _recvSequence, _ackSequence );
+    ar ( _selectiveRepeat, _roundTripTime, _roundTripVar, _retransmitTimeout );
+    ar ( _datagramSize, _maxDatagramSize, _probeCountDown );
 
     size_t size, consumed;
     ar ( size );
@@ -2,12 +2,42 @@
 
 #include "Protocol.hpp"
 #include "Timer.hpp"
+#include "Statistics.hpp"
 
 #include <list>
+#include <array>
+#include <vector>
+#include <memory>
 
 
 #define DEFAULT_SEND_INTERVAL ( 50 )
 
+// Largest datagram that can be sent over any IPv4 path without fragmentation: the 576 byte minimum MTU,
+// minus the maximum IP header and UDP header.
+#define MIN_DATAGRAM_SIZE ( 508 )
+
+// Default maximum datagram size, leaving room for tunnel and PPPoE headers on a 1500 byte MTU
+#define DEFAULT_DATAGRAM_SIZE ( 1200 )
+
+// Messages larger than the minimum datagram size are split into fragments of this size
+#define MAX_FRAGMENT_SIZE ( MIN_DATAGRAM_SIZE - 64 )
+
+// Number of send intervals without any ACK progress before assuming large datagrams are being dropped
+#define DATAGRAM_BLACK_HOLE_INTERVALS ( 10 )
+
+// Number of messages ACKed after lowering the datagram size, before trying the maximum size again
+#define DATAGRAM_PROBE_ACKS ( 1000 )
+
+// Maximum number of unACKed messages in flight when using selective repeat
+#define SELECTIVE_REPEAT_WINDOW ( 32 )
+
+// Retransmit timeout for selective repeat before there are any round trip time samples
+#define DEFAULT_RETRANSMIT_TIMEOUT ( 200 )
+
+// Bounds for the selective repeat retransmit timeout
+#define MIN_RETRANSMIT_TIMEOUT ( 20 )
+#define MAX_RETRANSMIT_TIMEOUT ( 2000 )
+
 
 struct AckSequence : public SerializableSequence
 {
@@ -17,6 +47,18 @@ struct AckSequence : public SerializableSequence
 };
 
 
+// Cumulative ACK of all messages up to the sequence, plus a bitmask of out-of-order messages received after it
+struct SelectiveAck : public SerializableSequence
+{
+    // Bit i is set if sequence + 2 + i has been received
+    uint32_t mask = 0;
+
+    SelectiveAck ( uint32_t sequence, uint32_t mask ) : SerializableSequence ( sequence ), mask ( mask ) {}
+
+    PROTOCOL_MESSAGE_BOILERPLATE ( SelectiveAck, mask )
+};
+
+
 struct SplitMessage : public SerializableSequence
 {
     MsgType origMsgType;
@@ -50,6 +92,15 @@ public:
         // Send a message via raw socket
         virtual void goBackNSendRaw ( GoBackN *gbn, const MsgPtr& msg ) = 0;
 
+        // Send as many of the messages, in order, as fit in a single datagram of at most maxBytes.
+        // Returns the number of messages sent, which must be at least one.
+        // The default sends only the first message.
+        virtual size_t goBackNSendBatch ( GoBackN *gbn, const MsgPtr *msgs, size_t count, size_t maxBytes )
+        {
+            goBackNSendRaw ( gbn, msgs[0] );
+            return 1;
+        }
+
         // Receive a raw non-sequenced message
         virtual void goBackNRecvRaw ( GoBackN *gbn, const MsgPtr& msg ) = 0;
 
@@ -58,12 +109,17 @@ public:
 
         // Timeout GoBackN if keep alive is enabled
         virtual void goBackNTimeout ( GoBackN *gbn ) = 0;
+
+        // An ACK should be sent. It is piggybacked on the next messages sent, until sendPendingAck is called.
+        // The default sends it immediately.
+        virtual void goBackNAckPending ( GoBackN *gbn ) { gbn->sendPendingAck(); }
     };
 
     Owner *owner = 0;
 
     // Constructors
     GoBackN ( const GoBackN& other );
+    ~GoBackN() { ++*_generation; }
     GoBackN ( Owner *owner, uint64_t interval = DEFAULT_SEND_INTERVAL, uint64_t timeout = 0 );
     GoBackN ( Owner *owner, const GoBackN& state );
     GoBackN& operator= ( const GoBackN& other );
@@ -83,6 +139,23 @@ public:
     uint64_t getKeepAlive() const { return _keepAlive; }
     void setKeepAlive ( uint64_t timeout );
 
+    // Get / set if lost messages are resent individually with selective repeat, instead of cycling through the
+    // whole send list. Out-of-order messages are buffered, and ACKed with SelectiveAck, so the remote must support it.
+    bool isSelectiveRepeat() const { return _selectiveRepeat; }
+    void setSelectiveRepeat ( bool enabled );
+
+    // Seed the selective repeat round trip time estimate with the one-way latency measured by Pinger
+    void setLatency ( const Statistics& latency );
+
+    // Get the current selective repeat retransmit timeout
+    uint64_t getRetransmitTimeout() const { return _retransmitTimeout; }
+
+    // Get / set the maximum size of the datagrams used to send several messages together.
+    // The current size falls back to MIN_DATAGRAM_SIZE if large datagrams appear to be dropped.
+    size_t getDatagramSize() const { return _datagramSize; }
+    size_t getMaxDatagramSize() const { return _maxDatagramSize; }
+    void setMaxDatagramSize ( size_t size );
+
     // Get the number of messages sent and received
     uint32_t getSendCount() const { return _sendSequence; }
     uint32_t getRecvCount() const { return _recvSequence; }
@@ -93,6 +166,9 @@ public:
     // Delay sending the next keep alive packet
     void delayKeepAliveOnce();
 
+    // Send the pending ACK by itself, if it wasn't piggybacked on other messages
+    void sendPendingAck();
+
     // Reset the state of GoBackN
     void reset();
 
@@ -133,6 +209,60 @@ private:
     // Delay sending the keep alive packet for one iteration
     bool _skipNextKeepAlive = false;
 
+    // In-flight message state for selective repeat
+    struct SendSlot
+    {
+        MsgPtr msg;
+
+        uint32_t sequence = 0;
+
+        // Last time the message was sent
+        uint64_t sentAt = 0;
+
+        // Number of times the message was resent
+        uint32_t resends = 0;
+
+        bool acked = false;
+    };
+
+    // Flag to indicate selective repeat mode
+    bool _selectiveRepeat = false;
+
+    // Selective repeat send window, indexed by sequence modulo the window size.
+    // Messages stay in the sendList until cumulatively ACKed, this only tracks the ones in flight.
+    std::array<SendSlot, SELECTIVE_REPEAT_WINDOW> _sendWindow;
+
+    // Selective repeat buffer for out-of-order messages, indexed by sequence modulo the window size
+    std::array<MsgPtr, SELECTIVE_REPEAT_WINDOW> _recvWindow;
+
+    // Smoothed round trip time and its variation in milliseconds, 0 if there are no samples yet
+    double _roundTripTime = 0, _roundTripVar = 0;
+
+    // Current selective repeat retransmit timeout
+    uint64_t _retransmitTimeout = DEFAULT_RETRANSMIT_TIMEOUT;
+
+    // Timer for resending selective repeat messages
+    TimerPtr _resendTimer;
+
+    // Number of nested calls delivering buffered messages, only the outermost one delivers
+    uint32_t _deliveryDepth = 0;
+
+    // Incremented when this is reset or destroyed, so delivery stops if the owner does that in a callback.
+    // This is shared so it can still be checked after this is destroyed.
+    std::shared_ptr<uint32_t> _generation = std::make_shared<uint32_t> ( 0 );
+
+    // Current and maximum datagram sizes
+    size_t _datagramSize = DEFAULT_DATAGRAM_SIZE, _maxDatagramSize = DEFAULT_DATAGRAM_SIZE;
+
+    // Number of send intervals since the last ACK progress
+    uint32_t _stalledIntervals = 0;
+
+    // Number of messages to ACK before trying the maximum datagram size again, 0 if not waiting
+    uint32_t _probeCountDown = 0;
+
+    // Flag to indicate an ACK should be sent
+    bool _ackPending = false;
+
     // Timer callback that sends the messages
     void timerExpired ( Timer *timer ) override;
 
@@ -141,4 +271,53 @@ private:
 
     // Refresh keep alive count down
     void refreshKeepAlive();
+
+    // Update the send list after an ACK
+    void recvAck ( uint32_t sequence, uint32_t mask );
+
+    // Send the next datagram of messages from the current position in the sendList
+    void sendNextDatagram();
+
+    // Send all the messages in as few datagrams as possible, plus any pending ACK
+    void sendBatch ( std::vector<MsgPtr>& msgs );
+
+    // Append the pending ACK to the messages, returns false if there is no pending ACK
+    bool appendAck ( std::vector<MsgPtr>& msgs ) const;
+
+    // Get the ACK for the messages received so far
+    MsgPtr getAck() const;
+
+    // Mark an ACK as pending, the owner decides when it is sent if it isn't piggybacked
+    void queueAck();
+
+    // Lower the datagram size if there has been no ACK progress for too long
+    void checkDatagramSize();
+
+    // Receive a message with selective repeat
+    void recvSelective ( const MsgPtr& msg, uint32_t sequence );
+
+    // Pass an in-order message to the owner, recreating split messages
+    void recvInOrder ( const MsgPtr& msg );
+
+    // Send any messages in the sendList that now fit in the selective repeat window
+    void fillSendWindow();
+
+    // Resend messages whose retransmit timeout has expired
+    void resendExpired();
+
+    // Start the resend timer for the earliest retransmit timeout, or stop it if nothing is in flight
+    void startResendTimer();
+
+    // Mark a selective repeat message as resent, and add it to the messages to send
+    void resend ( SendSlot& slot, uint64_t now, std::vector<MsgPtr>& msgs );
+
+    // Get the retransmit timeout for a message, which doubles each time it is resent
+    uint64_t getRetransmitTimeout ( const SendSlot& slot ) const;
+
+    // Mark a selective repeat message as ACKed, and sample the round trip time
+    void ackSlot ( uint32_t sequence, uint64_t now );
+
+    // Update the round trip time estimate and retransmit timeout
+    void addRoundTripSample ( uint64_t rtt );
+    void updateRetransmitTimeout();
 };
@@ -0,0 +1,281 @@
+#include "LaneHash.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#if defined ( __i386__ ) || defined ( __x86_64__ )
+#include <emmintrin.h>
+#define HAS_SSE2_LANES
+#endif
+
+using namespace std;
+
+
+#define STRIPE_SIZE ( LANE_HASH_LANES * 8 )
+
+#define BLOCK_SIZE ( STRIPE_SIZE * LANE_HASH_STRIPES_PER_BLOCK )
+
+static_assert ( LANE_HASH_CHUNK % BLOCK_SIZE == 0, "LANE_HASH_CHUNK must be a multiple of the block size" );
+
+#define PRIME32_1 ( 0x9E3779B1U )
+#define PRIME32_2 ( 0x85EBCA77U )
+#define PRIME32_3 ( 0xC2B2AE3DU )
+
+#define PRIME64_1 ( 0x9E3779B185EBCA87ULL )
+#define PRIME64_2 ( 0xC2B2AE3D27D4EB4FULL )
+#define PRIME64_3 ( 0x165667B19E3779F9ULL )
+#define PRIME64_4 ( 0x85EBCA77C2B2AE63ULL )
+#define PRIME64_5 ( 0x27D4EB2F165667C5ULL )
+
+// Fractional parts of the square roots of the first 8 primes
+static const uint64_t Keys[LANE_HASH_LANES] =
+{
+    0x6A09E667F3BCC908ULL, 0xBB67AE8584CAA73BULL, 0x3C6EF372FE94F82BULL, 0xA54FF53A5F1D36F1ULL,
+    0x510E527FADE682D1ULL, 0x9B05688C2B3E6C1FULL, 0x1F83D9ABFB41BD6BULL, 0x5BE0CD19137E2179ULL,
+};
+
+static const uint64_t InitialLanes[LANE_HASH_LANES] =
+{
+    PRIME32_3, PRIME64_1, PRIME64_2, PRIME64_3, PRIME64_4, PRIME32_2, PRIME64_5, PRIME32_1,
+};
+
+
+static inline uint64_t read64 ( const char *bytes )
+{
+    uint64_t value;
+    memcpy ( &value, bytes, sizeof ( value ) );
+    return value;
+}
+
+static inline uint64_t rotl64 ( uint64_t value, int bits )
+{
+    return ( value << bits ) | ( value >> ( 64 - bits ) );
+}
+
+static inline void accumulateStripe ( uint64_t *lanes, const char *stripe )
+{
+    for ( size_t i = 0; i < LANE_HASH_LANES; ++i )
+    {
+        const uint64_t value = read64 ( stripe + i * 8 );
+        const uint64_t keyed = value ^ Keys[i];
+
+        lanes[i ^ 1] += value;
+        lanes[i] += ( uint64_t ) ( uint32_t ) keyed * ( uint32_t ) ( keyed >> 32 );
+    }
+}
+
+static inline void scramble ( uint64_t *lanes )
+{
+    for ( size_t i = 0; i < LANE_HASH_LANES; ++i )
+    {
+        lanes[i] ^= lanes[i] >> 47;
+        lanes[i] ^= Keys[i];
+        lanes[i] *= PRIME32_1;
+    }
+}
+
+static void accumulateBlocks ( uint64_t *lanes, const char *bytes, size_t numBlocks )
+{
+    for ( size_t i = 0; i < numBlocks; ++i )
+    {
+        for ( size_t j = 0; j < LANE_HASH_STRIPES_PER_BLOCK; ++j, bytes += STRIPE_SIZE )
+            accumulateStripe ( lanes, bytes );
+
+        scramble ( lanes );
+    }
+}
+
+#ifdef HAS_SSE2_LANES
+
+// Same as accumulateBlocks, with two lanes per register
+__attribute__ ( ( target ( "sse2" ) ) )
+static void accumulateBlocksSse2 ( uint64_t *lanes, const char *bytes, size_t numBlocks )
+{
+    __m128i acc[LANE_HASH_LANES / 2], keys[LANE_HASH_LANES / 2];
+
+    for ( size_t i = 0; i < LANE_HASH_LANES / 2; ++i )
+    {
+        acc[i] = _mm_loadu_si128 ( ( const __m128i * ) &lanes[i * 2] );
+        keys[i] = _mm_loadu_si128 ( ( const __m128i * ) &Keys[i * 2] );
+    }
+
+    const __m128i prime = _mm_set1_epi32 ( PRIME32_1 );
+
+    for ( size_t i = 0; i < numBlocks; ++i )
+    {
+        for ( size_t j = 0; j < LANE_HASH_STRIPES_PER_BLOCK; ++j, bytes += STRIPE_SIZE )
+        {
+            for ( size_t k = 0; k < LANE_HASH_LANES / 2; ++k )
+            {
+                const __m128i value = _mm_loadu_si128 ( ( const __m128i * ) ( bytes + k * 16 ) );
+                const __m128i keyed = _mm_xor_si128 ( value, keys[k] );
+
+                // Multiply the low and high 32 bits of each keyed word
+                const __m128i product = _mm_mul_epu32 ( keyed, _mm_shuffle_epi32 ( keyed, _MM_SHUFFLE ( 0, 3, 0, 1 ) ) );
+
+                // Add each input word to the neighbouring lane
+                const __m128i swapped = _mm_shuffle_epi32 ( value, _MM_SHUFFLE ( 1, 0, 3, 2 ) );
+
+                acc[k] = _mm_add_epi64 ( acc[k], _mm_add_epi64 ( product, swapped ) );
+            }
+        }
+
+        for ( size_t k = 0; k < LANE_HASH_LANES / 2; ++k )
+        {
+            __m128i a = _mm_xor_si128 ( acc[k], _mm_srli_epi64 ( acc[k], 47 ) );
+            a = _mm_xor_si128 ( a, keys[k] );
+
+            // 64-bit by 32-bit multiply from two 32x32 bit products
+            const __m128i lo = _mm_mul_epu32 ( a, prime );
+            const __m128i hi = _mm_mul_epu32 ( _mm_srli_epi64 ( a, 32 ), prime );
+
+            acc[k] = _mm_add_epi64 ( lo, _mm_slli_epi64 ( hi, 32 ) );
+        }
+    }
+
+    for ( size_t i = 0; i < LANE_HASH_LANES / 2; ++i )
+        _mm_storeu_si128 ( ( __m128i * ) &lanes[i * 2], acc[i] );
+}
+
+#endif // HAS_SSE2_LANES
+
+static void accumulate ( uint64_t *lanes, const char *bytes, size_t numBlocks )
+{
+#ifdef HAS_SSE2_LANES
+    static const bool sse2 = ( __builtin_cpu_init(), __builtin_cpu_supports ( "sse2" ) );
+
+    if ( sse2 )
+    {
+        accumulateBlocksSse2 ( lanes, bytes, numBlocks );
+        return;
+    }
+#endif
+
+    accumulateBlocks ( lanes, bytes, numBlocks );
+}
+
+// Accumulate the bytes after the last whole block, and fold the lanes into the final hash
+static uint64_t finish ( uint64_t *lanes, const char *bytes, size_t len, size_t totalLen )
+{
+    for ( ; len >= STRIPE_SIZE; bytes += STRIPE_SIZE, len -= STRIPE_SIZE )
+        accumulateStripe ( lanes, bytes );
+
+    if ( len > 0 )
+    {
+        char stripe[STRIPE_SIZE] = { 0 };
+        memcpy ( stripe, bytes, len );
+        accumulateStripe ( lanes, stripe );
+    }
+
+    uint64_t hash = totalLen * PRIME64_1;
+
+    for ( size_t i = 0; i < LANE_HASH_LANES; ++i )
+    {
+        hash ^= rotl64 ( lanes[i] * PRIME64_2, 31 ) * PRIME64_1;
+        hash = hash * PRIME64_1 + PRIME64_4;
+    }
+
+    hash ^= hash >> 33;
+    hash *= PRIME64_2;
+    hash ^= hash >> 29;
+    hash *= PRIME64_3;
+    hash ^= hash >> 32;
+
+    return hash;
+}
+
+
+uint64_t LaneHash::hash ( const char *bytes, size_t len )
+{
+    uint64_t lanes[LANE_HASH_LANES];
+    memcpy ( lanes, InitialLanes, sizeof ( lanes ) );
+
+    const size_t numBlocks = len / BLOCK_SIZE;
+
+    accumulate ( lanes, bytes, numBlocks );
+
+    return finish ( lanes, bytes + numBlocks * BLOCK_SIZE, len % BLOCK_SIZE, len );
+}
+
+void LaneHash::compile ( const MemDumpList& list )
+{
+    clear();
+
+    size_t offset = 0;
+
+    for ( const MemDump& mem : list.addrs )
+        offset = compilePtrs ( mem, offset, offset + mem.size );
+
+    ASSERT ( offset == list.totalSize );
+
+    _dump.resize ( offset );
+}
+
+size_t LaneHash::compilePtrs ( const MemDumpBase& mem, size_t parentOffset, size_t offset )
+{
+    // Same pre-order layout as MemDumpBase::saveDump
+    for ( const MemDumpPtr& ptr : mem.ptrs )
+    {
+        _ptrOffsets.push_back ( parentOffset + ptr.srcOffset );
+
+        offset = compilePtrs ( ptr, offset, offset + ptr.size );
+    }
+
+    return offset;
+}
+
+void LaneHash::clear()
+{
+    _dump.clear();
+    _ptrOffsets.clear();
+    _position = 0;
+    _hashing = false;
+    _hash = 0;
+}
+
+void LaneHash::start()
+{
+    ASSERT ( ! _dump.empty() );
+
+    for ( size_t offset : _ptrOffsets )
+        memset ( &_dump[offset], 0, min ( sizeof ( char * ), _dump.size() - offset ) );
+
+    memcpy ( _lanes, InitialLanes, sizeof ( _lanes ) );
+
+    _position = 0;
+    _hashing = true;
+}
+
+bool LaneHash::update ( uint64_t budget )
+{
+    if ( ! _hashing )
+        return false;
+
+    const auto start = chrono::steady_clock::now();
+
+    // Only whole blocks are hashed incrementally, the rest is hashed when finishing
+    const size_t end = _dump.size() - _dump.size() % BLOCK_SIZE;
+
+    for ( ;; )
+    {
+        const size_t len = min ( end - _position, ( size_t ) LANE_HASH_CHUNK );
+
+        accumulate ( _lanes, _dump.data() + _position, len / BLOCK_SIZE );
+        _position += len;
+
+        if ( _position == end )
+            break;
+
+        const uint64_t microseconds = chrono::duration_cast<chrono::microseconds> (
+                                          chrono::steady_clock::now() - start ).count();
+
+        if ( microseconds >= budget )
+            return false;
+    }
+
+    _hash = finish ( _lanes, _dump.data() + _position, _dump.size() - _position, _dump.size() );
+    _position = _dump.size();
+    _hashing = false;
+    return true;
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "MemDump.hpp"
+
+#include <vector>
+
+
+// Number of 64-bit lanes, each stripe of input is one 64-bit word per lane
+#define LANE_HASH_LANES ( 8 )
+
+// Number of stripes accumulated before the lanes are scrambled
+#define LANE_HASH_STRIPES_PER_BLOCK ( 16 )
+
+// Bytes hashed between each check of the time budget, must be a multiple of the block size
+#define LANE_HASH_CHUNK ( 64 * 1024 )
+
+
+// Fast 64-bit hash of a flattened memory dump of a MemDumpList, for comparing the whole game state every frame.
+//
+// Each lane accumulates the 32x32 bit product of the two halves of its input word mixed with a key, plus the input
+// word of the neighbouring lane. The lanes are independent, so two lanes fit in one SSE2 register, and the only
+// multiply is a 32-bit one, which is cheap on x86 without 64-bit registers. The lanes are scrambled after every
+// block, and folded with an xxHash style avalanche at the end.
+//
+// A dump that takes longer than the time budget to hash is hashed incrementally over several calls to update.
+// The result is the same as hashing the dump in one go, since the dump is flattened once when the hash starts.
+//
+// The pointers themselves are not hashed, since the heap addresses can be different on each machine.
+class LaneHash
+{
+public:
+
+    // Hash the given bytes in one go
+    static uint64_t hash ( const char *bytes, size_t len );
+
+    // Compile the layout of the given list, the list can be changed or destroyed afterwards
+    void compile ( const MemDumpList& list );
+
+    void clear();
+
+    bool empty() const { return _dump.empty(); }
+
+    // Buffer to flatten the memory into before calling start
+    char *getDump() { return _dump.data(); }
+
+    size_t getTotalSize() const { return _dump.size(); }
+
+    // Start hashing the flattened dump, this cancels any hash in progress
+    void start();
+
+    // Continue hashing for up to the given number of microseconds, at least one chunk is hashed each call.
+    // Returns true when the hash is done.
+    bool update ( uint64_t budget );
+
+    bool isHashing() const { return _hashing; }
+
+    // Number of bytes of the dump hashed so far
+    size_t getPosition() const { return _position; }
+
+    // Get the hash of the last dump that was completely hashed
+    uint64_t getHash() const { return _hash; }
+
+private:
+
+    // Flattened dump with the pointers zeroed
+    std::vector<char> _dump;
+
+    // Positions of the pointers in the flattened dump
+    std::vector<size_t> _ptrOffsets;
+
+    uint64_t _lanes[LANE_HASH_LANES];
+
+    size_t _position = 0;
+
+    bool _hashing = false;
+
+    uint64_t _hash = 0;
+
+    size_t compilePtrs ( const MemDumpBase& mem, size_t parentOffset, size_t offset );
+};
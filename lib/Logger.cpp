@@ -2,20 +2,36 @@
 #include "Algorithms.hpp"
 #include "TimerManager.hpp"
 
+#include <cstring>
+
 using namespace std;
 
 
+atomic<uint32_t> Logger::_levelMasks[LOG_NUM_LEVELS] =
+{
+    { LOG_DEFAULT_LEVEL <= LOG_LEVEL_TRACE ? LOG_MODULE_ALL : 0 },
+    { LOG_DEFAULT_LEVEL <= LOG_LEVEL_DEBUG ? LOG_MODULE_ALL : 0 },
+    { LOG_DEFAULT_LEVEL <= LOG_LEVEL_INFO ? LOG_MODULE_ALL : 0 },
+    { LOG_DEFAULT_LEVEL <= LOG_LEVEL_WARN ? LOG_MODULE_ALL : 0 },
+};
+
+
 #ifdef DISABLE_LOGGING
 
 void Logger::initialize ( const string& filePath, uint32_t _options ) {}
 void Logger::deinitialize() {}
+void Logger::release() {}
 void Logger::flush() {}
 void Logger::log ( const char *srcFile, int srcLine, const char *srcFunc, const char *logMessage ) {}
+void Logger::WriterThread::run() {}
 
 #else
 
 void Logger::initialize ( const string& filePath, uint32_t _options )
 {
+    // Write everything in the ring buffers to the old file first
+    stopWriter();
+
 #ifdef LOGGER_MUTEXED
     LOCK ( _mutex );
 #endif
@@ -58,6 +74,12 @@ void Logger::initialize ( const string& filePath, uint32_t _options )
         _logId = generateRandomId();
 
     _initialized = true;
+
+    if ( _fd && ( _options & LOG_ASYNC ) )
+    {
+        _writing = _stopping = false;
+        _writer.start();
+    }
 }
 
 void Logger::deinitialize()
@@ -65,6 +87,8 @@ void Logger::deinitialize()
     if ( ! _initialized )
         return;
 
+    stopWriter();
+
 #ifdef LOGGER_MUTEXED
     LOCK ( _mutex );
 #endif
@@ -80,8 +104,45 @@ void Logger::deinitialize()
     _initialized = false;
 }
 
+void Logger::release()
+{
+    if ( ! _writer.isRunning() )
+        return;
+
+    _writer.release();
+    _options &= ~LOG_ASYNC;
+}
+
 void Logger::flush()
 {
+    if ( ! _fd )
+        return;
+
+    if ( _options & LOG_ASYNC )
+    {
+        const size_t numRings = _numRings.load ( memory_order_acquire );
+
+        size_t heads[LOG_ASYNC_MAX_THREADS];
+
+        for ( size_t i = 0; i < numRings; ++i )
+            heads[i] = _rings[i].head.load ( memory_order_acquire );
+
+        LOCK ( _mutex );
+
+        // The writer thread flushes after writing
+        for ( size_t i = 0; i < numRings; ++i )
+        {
+            while ( _rings[i].tail.load ( memory_order_acquire ) != heads[i] )
+            {
+                _writing = true;
+                _writeCond.signal();
+                _writtenCond.wait ( _mutex );
+            }
+        }
+
+        return;
+    }
+
 #ifdef LOGGER_MUTEXED
     LOCK ( _mutex );
 #endif
@@ -94,17 +155,43 @@ void Logger::log ( const char *srcFile, int srcLine, const char *srcFunc, const
     if ( ! _fd )
         return;
 
+    if ( _options & LOG_ASYNC )
+    {
+        if ( push ( srcFile, srcLine, srcFunc, logMessage ) )
+            return;
+
+        // Write the messages before this one first, since the writer thread only writes every interval
+        LOCK ( _mutex );
+        writeRecords();
+        writeNow ( srcFile, srcLine, srcFunc, logMessage );
+        return;
+    }
+
 #ifdef LOGGER_MUTEXED
     LOCK ( _mutex );
 #endif
 
+    writeNow ( srcFile, srcLine, srcFunc, logMessage );
+}
+
+void Logger::writeNow ( const char *srcFile, int srcLine, const char *srcFunc, const char *logMessage )
+{
+    time_t t;
+    time ( &t );
+
+    const uint64_t now = TimerManager::get().getNow ( true );
+
+    write ( t, now % 1000, srcFile, srcLine, srcFunc, logMessage );
+    fflush ( _fd );
+}
+
+void Logger::write ( time_t t, uint32_t milliseconds, const char *srcFile, int srcLine, const char *srcFunc,
+                     const char *logMessage )
+{
     bool hasPrefix = false;
 
     if ( _options & ( LOG_GM_TIME | LOG_LOCAL_TIME ) )
     {
-        time_t t;
-        time ( &t );
-
         tm *ts;
         if ( _options & LOG_GM_TIME )
             ts = gmtime ( &t );
@@ -113,9 +200,7 @@ void Logger::log ( const char *srcFile, int srcLine, const char *srcFunc, const
 
         strftime ( _buffer, sizeof ( _buffer ), "%H:%M:%S", ts );
 
-        const uint64_t now = TimerManager::get().getNow ( true );
-
-        fprintf ( _fd, "%s.%03u:", _buffer, ( uint32_t ) ( now % 1000 ) );
+        fprintf ( _fd, "%s.%03u:", _buffer, milliseconds );
         hasPrefix = true;
     }
 
@@ -127,14 +212,213 @@ void Logger::log ( const char *srcFile, int srcLine, const char *srcFunc, const
 
     if ( _options & LOG_FUNC_NAME )
     {
-        string shortFunc ( srcFunc );
-        shortFunc = shortFunc.substr ( 0, shortFunc.find ( '(' ) );
-        fprintf ( _fd, "%s:", shortFunc.c_str() );
+        const char *end = strchr ( srcFunc, '(' );
+        fprintf ( _fd, "%.*s:", ( int ) ( end ? end - srcFunc : strlen ( srcFunc ) ), srcFunc );
         hasPrefix = true;
     }
 
     fprintf ( _fd, ( hasPrefix ? " %s\n" : "%s\n" ), logMessage );
-    fflush ( _fd );
+}
+
+Logger::Ring *Logger::getRing()
+{
+    const pthread_t thread = pthread_self();
+
+    size_t numRings = _numRings.load ( memory_order_acquire );
+
+    for ( size_t i = 0; i < numRings; ++i )
+    {
+        if ( pthread_equal ( _rings[i].thread, thread ) )
+            return &_rings[i];
+    }
+
+    LOCK ( _mutex );
+
+    numRings = _numRings.load ( memory_order_relaxed );
+
+    if ( numRings == LOG_ASYNC_MAX_THREADS )
+        return 0;
+
+    // Rings are never removed, a new thread with the same ID as a finished one reuses its ring
+    Ring& ring = _rings[numRings];
+    ring.thread = thread;
+    ring.buffer.resize ( LOG_ASYNC_RING_SIZE );
+
+    _numRings.store ( numRings + 1, memory_order_release );
+    return &ring;
+}
+
+bool Logger::push ( const char *srcFile, int srcLine, const char *srcFunc, const char *logMessage )
+{
+    const size_t length = strlen ( logMessage );
+    const size_t size = ( sizeof ( Record ) + length + 1 + 7 ) & ~ ( size_t ) 7;
+
+    // Messages too long for the ring buffer are written synchronously
+    if ( size > LOG_ASYNC_RING_SIZE / 4 )
+        return false;
+
+    Ring *ring = getRing();
+
+    if ( ! ring )
+        return false;
+
+    const size_t mask = ring->buffer.size() - 1;
+
+    size_t head = ring->head.load ( memory_order_relaxed );
+    size_t offset = ( head & mask );
+
+    // Messages aren't split across the end of the ring buffer, the rest of it is padded instead
+    const size_t contiguous = ring->buffer.size() - offset;
+    const size_t needed = size + ( contiguous < size ? contiguous : 0 );
+
+    if ( ring->buffer.size() - ( head - ring->tail.load ( memory_order_acquire ) ) < needed )
+    {
+        LOCK ( _mutex );
+
+        ++_stalls;
+
+        while ( ring->buffer.size() - ( head - ring->tail.load ( memory_order_acquire ) ) < needed )
+        {
+            _writing = true;
+            _writeCond.signal();
+            _writtenCond.wait ( _mutex );
+        }
+    }
+
+    // Padding always runs to the end of the ring buffer, and isn't marked if there isn't room for a header
+    if ( contiguous < size )
+    {
+        if ( contiguous >= sizeof ( Record ) )
+            ( ( Record * ) &ring->buffer[offset] )->srcFile = 0;
+
+        head += contiguous;
+        offset = 0;
+    }
+
+    Record& record = * ( Record * ) &ring->buffer[offset];
+    record.size = size;
+    record.sequence = _sequence.fetch_add ( 1, memory_order_relaxed );
+    record.srcFile = srcFile;
+    record.srcFunc = srcFunc;
+    record.srcLine = srcLine;
+    record.milliseconds = TimerManager::get().getNow ( true ) % 1000;
+    time ( &record.time );
+
+    memcpy ( &ring->buffer [ offset + sizeof ( Record ) ], logMessage, length + 1 );
+
+    ring->head.store ( head + size, memory_order_release );
+
+    // Wake the writer thread early once the ring buffer is half full, so logging rarely has to wait for it
+    if ( head + size - ring->tail.load ( memory_order_relaxed ) > LOG_ASYNC_RING_SIZE / 2
+            && ! _woken.exchange ( true, memory_order_relaxed ) )
+    {
+        _writeCond.signal();
+    }
+
+    return true;
+}
+
+void Logger::WriterThread::run()
+{
+    logger.writeRings();
+}
+
+void Logger::writeRings()
+{
+    for ( ;; )
+    {
+        LOCK ( _mutex );
+
+        if ( ! _writing && ! _stopping )
+            _writeCond.wait ( _mutex, LOG_ASYNC_FLUSH_INTERVAL );
+
+        _writing = false;
+        _woken = false;
+
+        writeRecords();
+
+        _writtenCond.broadcast();
+
+        if ( _stopping )
+            return;
+    }
+}
+
+void Logger::writeRecords()
+{
+    const size_t numRings = _numRings.load ( memory_order_acquire );
+
+    size_t heads[LOG_ASYNC_MAX_THREADS], tails[LOG_ASYNC_MAX_THREADS];
+
+    for ( size_t i = 0; i < numRings; ++i )
+    {
+        heads[i] = _rings[i].head.load ( memory_order_acquire );
+        tails[i] = _rings[i].tail.load ( memory_order_relaxed );
+    }
+
+    auto front = [&] ( size_t i )
+    {
+        return ( const Record * ) &_rings[i].buffer [ tails[i] & ( LOG_ASYNC_RING_SIZE - 1 ) ];
+    };
+
+    bool written = false;
+
+    // Merge the messages from each ring buffer in the order they were logged
+    for ( ;; )
+    {
+        const Record *next = 0;
+        size_t nextRing = 0;
+
+        for ( size_t i = 0; i < numRings; ++i )
+        {
+            // Skip the padding at the end of the ring buffer
+            const size_t contiguous = LOG_ASYNC_RING_SIZE - ( tails[i] & ( LOG_ASYNC_RING_SIZE - 1 ) );
+
+            if ( tails[i] != heads[i] && ( contiguous < sizeof ( Record ) || ! front ( i )->srcFile ) )
+            {
+                tails[i] += contiguous;
+                _rings[i].tail.store ( tails[i], memory_order_release );
+            }
+
+            if ( tails[i] == heads[i] )
+                continue;
+
+            if ( ! next || int32_t ( front ( i )->sequence - next->sequence ) < 0 )
+            {
+                next = front ( i );
+                nextRing = i;
+            }
+        }
+
+        if ( ! next )
+            break;
+
+        write ( next->time, next->milliseconds, next->srcFile, next->srcLine, next->srcFunc,
+                ( const char * ) ( next + 1 ) );
+
+        tails[nextRing] += next->size;
+        _rings[nextRing].tail.store ( tails[nextRing], memory_order_release );
+
+        written = true;
+    }
+
+    if ( written )
+        fflush ( _fd );
+}
+
+void Logger::stopWriter()
+{
+    if ( ! _writer.isRunning() )
+        return;
+
+    {
+        LOCK ( _mutex );
+        _stopping = true;
+        _writeCond.signal();
+    }
+
+    // The writer thread writes everything left in the ring buffers before it stops
+    _writer.join();
 }
 
 #endif // DISABLE_LOGGING
@@ -144,3 +428,57 @@ Logger& Logger::get()
     static Logger instance;
     return instance;
 }
+
+void Logger::setLevel ( uint32_t modules, int level )
+{
+    for ( int i = 0; i < LOG_NUM_LEVELS; ++i )
+    {
+        if ( i < level )
+            _levelMasks[i] &= ~modules;
+        else
+            _levelMasks[i] |= modules;
+    }
+}
+
+bool Logger::setLevels ( const string& levels )
+{
+    static const vector<pair<string, uint32_t>> modules =
+    {
+        { "all", LOG_MODULE_ALL },
+        { "general", LOG_MODULE_GENERAL },
+        { "socket", LOG_MODULE_SOCKET },
+        { "gobackn", LOG_MODULE_GO_BACK_N },
+        { "timer", LOG_MODULE_TIMER },
+        { "netplay", LOG_MODULE_NETPLAY },
+    };
+
+    static const vector<string> levelNames = { "trace", "debug", "info", "warn" };
+
+    bool good = true;
+
+    for ( const string& entry : split ( levels, "," ) )
+    {
+        const vector<string> parts = split ( lowerCase ( trimmed ( entry ) ), "=" );
+
+        if ( parts.size() != 2 )
+        {
+            good = false;
+            continue;
+        }
+
+        const auto module = find_if ( modules.cbegin(), modules.cend(),
+                                      [&] ( const pair<string, uint32_t>& m ) { return m.first == parts[0]; } );
+
+        const auto level = find ( levelNames.cbegin(), levelNames.cend(), parts[1] );
+
+        if ( module == modules.cend() || level == levelNames.cend() )
+        {
+            good = false;
+            continue;
+        }
+
+        setLevel ( module->second, level - levelNames.cbegin() );
+    }
+
+    return good;
+}
@@ -4,6 +4,8 @@
 #include "StringUtils.hpp"
 
 #include <string>
+#include <vector>
+#include <atomic>
 #include <cstdio>
 #include <ctime>
 
@@ -13,9 +15,42 @@
 #define LOG_FILE_LINE   ( 0x04 )    // Log file:line per message
 #define LOG_FUNC_NAME   ( 0x08 )    // Log the function name per message
 #define PID_IN_FILENAME ( 0x10 )    // Add the PID to the log filename
+#define LOG_ASYNC       ( 0x20 )    // Write to the file on a background thread, see Logger::log
 
 #define LOG_DEFAULT_OPTIONS ( LOG_GM_TIME | LOG_FILE_LINE | LOG_FUNC_NAME )
 
+// Bytes in the ring buffer of each thread in async mode, must be a power of 2
+#define LOG_ASYNC_RING_SIZE         ( 256 * 1024 )
+
+// Maximum number of threads with a ring buffer in async mode, any other threads log synchronously
+#define LOG_ASYNC_MAX_THREADS       ( 16 )
+
+// Milliseconds between each write to the file in async mode
+#define LOG_ASYNC_FLUSH_INTERVAL    ( 50 )
+
+// Levels of the leveled LOG macros, from the most to the least verbose
+#define LOG_LEVEL_TRACE     ( 0 )   // Every message, datagram, or timer on the netcode paths
+#define LOG_LEVEL_DEBUG     ( 1 )   // Less frequent details that are useful to debug a module
+#define LOG_LEVEL_INFO      ( 2 )   // State changes, the same as LOG
+#define LOG_LEVEL_WARN      ( 3 )   // Unexpected conditions
+#define LOG_NUM_LEVELS      ( 4 )
+
+// Leveled messages below this level are compiled out, this can be set for the whole build
+#ifndef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL       ( LOG_LEVEL_TRACE )
+#endif
+
+// Modules of the leveled LOG macros, each level has a runtime mask of the modules that are logged
+#define LOG_MODULE_GENERAL  ( 0x01 )
+#define LOG_MODULE_SOCKET   ( 0x02 )
+#define LOG_MODULE_GO_BACK_N ( 0x04 )
+#define LOG_MODULE_TIMER    ( 0x08 )
+#define LOG_MODULE_NETPLAY  ( 0x10 )
+#define LOG_MODULE_ALL      ( 0xFFFFFFFF )
+
+// Modules are logged at this level and above unless changed with Logger::setLevel
+#define LOG_DEFAULT_LEVEL   ( LOG_LEVEL_INFO )
+
 
 class Logger
 {
@@ -27,24 +62,58 @@ public:
     // Basic constructor
     Logger() {}
 
-    // Initialize / deinitialize logging
+    // The writer thread in async mode must be stopped by deinitialize, it isn't joined here since the singleton is
+    // destroyed at exit, where threads can't always be joined (DLL_PROCESS_DETACH).
+    ~Logger() { release(); deinitialize(); }
+
+    // Initialize / deinitialize logging, deinitialize stops the writer thread in async mode
     void initialize ( const std::string& filePath = "", uint32_t options = LOG_DEFAULT_OPTIONS );
     void deinitialize();
 
-    // Flush to file
+    // Let go of the writer thread without joining it, for when threads can't be joined (DLL_PROCESS_DETACH).
+    // Messages still in the ring buffers are lost, and any later messages are written synchronously.
+    void release();
+
+    // Flush to file, in async mode this waits for everything logged so far to be written
     void flush();
 
     // Log the system version
     void logVersion();
 
-    // Log a message with source file, line, and function
+    // Get the system version lines that logVersion writes
+    static std::string formatVersion ( const std::string& logId, const std::string& sessionId );
+
+    // Log a message with source file, line, and function.
+    //
+    // In async mode the message is copied into a ring buffer for the calling thread, and the timestamp and prefix
+    // are formatted later on the writer thread, so the source file and function must be string literals, as they
+    // are from the LOG macros. The messages from each thread are merged in the order they were logged.
     void log ( const char *srcFile, int srcLine, const char *srcFunc, const char *logMessage );
 
+    // Number of times logging had to wait for the writer thread because a ring buffer was full
+    size_t getNumStalls() const { return _stalls; }
+
     // Get the singleton instance
     static Logger& get();
 
+    // Check if leveled messages of a module are logged at a level, this is checked before formatting
+    static bool isEnabled ( int level, uint32_t module )
+    {
+        return ( _levelMasks[level].load ( std::memory_order_relaxed ) & module );
+    }
+
+    // Log the given modules at a level and above, this applies to all loggers
+    static void setLevel ( uint32_t modules, int level );
+
+    // Set levels from a comma separated list of module=level, eg "socket=trace,gobackn=debug" or "all=warn".
+    // Returns false if any module or level is unknown, but still sets the rest.
+    static bool setLevels ( const std::string& levels );
+
 private:
 
+    // Bit mask of modules that are logged at each level
+    static std::atomic<uint32_t> _levelMasks[LOG_NUM_LEVELS];
+
     // Log file path
     std::string _filePath;
 
@@ -63,10 +132,91 @@ private:
     // Flag to indicate if initialized
     bool _initialized = false;
 
-    // Optionally mutexed logging
-#ifdef LOGGER_MUTEXED
+    // Mutex for optionally mutexed logging, and for writing to the file in async mode
     Mutex _mutex;
-#endif
+
+    // Header of each message in a ring buffer, messages are padded to a multiple of 8 bytes
+    struct Record
+    {
+        // Bytes of the message including the header and padding
+        uint32_t size;
+
+        // Order of the message across all threads
+        uint32_t sequence;
+
+        // Null for the padding at the end of the ring buffer
+        const char *srcFile;
+
+        const char *srcFunc;
+
+        int srcLine;
+
+        uint32_t milliseconds;
+
+        time_t time;
+    };
+
+    // Single producer single consumer ring buffer of messages from one thread
+    struct Ring
+    {
+        pthread_t thread;
+
+        std::vector<char> buffer;
+
+        // Total bytes ever written to and read from the ring buffer, the head is only written by the logging thread,
+        // and the tail only with the mutex locked.
+        std::atomic<size_t> head { 0 }, tail { 0 };
+    };
+
+    class WriterThread : public Thread
+    {
+    public:
+        WriterThread ( Logger& logger ) : logger ( logger ) {}
+        void run() override;
+
+    private:
+        Logger& logger;
+    };
+
+    WriterThread _writer { *this };
+
+    // Signalled to wake the writer thread, and by the writer thread after writing
+    CondVar _writeCond, _writtenCond;
+
+    bool _writing = false, _stopping = false;
+
+    Ring _rings[LOG_ASYNC_MAX_THREADS];
+
+    // Number of rings assigned to a thread, rings are only added while logging
+    std::atomic<size_t> _numRings { 0 };
+
+    std::atomic<uint32_t> _sequence { 0 };
+
+    // Set when the writer thread is woken because a ring buffer is half full, until it starts writing
+    std::atomic<bool> _woken { false };
+
+    size_t _stalls = 0;
+
+    // Write one message with the current time, and flush
+    void writeNow ( const char *srcFile, int srcLine, const char *srcFunc, const char *logMessage );
+
+    // Write one message with the prefix given by the options
+    void write ( time_t time, uint32_t milliseconds, const char *srcFile, int srcLine, const char *srcFunc,
+                 const char *logMessage );
+
+    // Get the ring buffer of the calling thread, adding one if needed, returns null if there are none left
+    Ring *getRing();
+
+    // Copy a message into the ring buffer of the calling thread, returns false if it should be written synchronously
+    bool push ( const char *srcFile, int srcLine, const char *srcFunc, const char *logMessage );
+
+    // Write the messages in all the ring buffers every interval, or when woken, until stopped
+    void writeRings();
+
+    // Write the messages that are in the ring buffers now, must be called with the mutex locked
+    void writeRecords();
+
+    void stopWriter();
 };
 
 
@@ -75,6 +225,13 @@ private:
 #define LOG_TO(...)
 #define LOG(...)
 #define LOG_LIST(...)
+#define LOG_ENABLED(...)    ( false )
+#define LOG_TO_AT(...)
+#define LOG_AT(...)
+#define LOG_TRACE(...)
+#define LOG_DEBUG(...)
+#define LOG_INFO(...)
+#define LOG_WARN(...)
 
 #else
 
@@ -98,6 +255,25 @@ private:
         LOG ( "this=%08x; "#LIST "=[%s]", this, list );                                                                \
     } while ( 0 )
 
+// Check if a leveled message would be logged, this is a compile-time false below LOG_MIN_LEVEL
+#define LOG_ENABLED(LEVEL, MODULE)                                                                                     \
+    ( ( LEVEL ) >= LOG_MIN_LEVEL && Logger::isEnabled ( LEVEL, MODULE ) )
+
+// Log a leveled message, the arguments are only formatted if the module is logged at the level
+#define LOG_TO_AT(LOGGER, LEVEL, MODULE, FORMAT, ...)                                                                  \
+    do {                                                                                                               \
+        if ( ! LOG_ENABLED ( LEVEL, MODULE ) )                                                                         \
+            break;                                                                                                     \
+        LOGGER.log ( __BASE_FILE__, __LINE__, __PRETTY_FUNCTION__, format ( FORMAT, ## __VA_ARGS__ ).c_str() );        \
+    } while ( 0 )
+
+#define LOG_AT(LEVEL, MODULE, FORMAT, ...)  LOG_TO_AT ( Logger::get(), LEVEL, MODULE, FORMAT, ## __VA_ARGS__ )
+
+#define LOG_TRACE(MODULE, FORMAT, ...)  LOG_AT ( LOG_LEVEL_TRACE, MODULE, FORMAT, ## __VA_ARGS__ )
+#define LOG_DEBUG(MODULE, FORMAT, ...)  LOG_AT ( LOG_LEVEL_DEBUG, MODULE, FORMAT, ## __VA_ARGS__ )
+#define LOG_INFO(MODULE, FORMAT, ...)   LOG_AT ( LOG_LEVEL_INFO, MODULE, FORMAT, ## __VA_ARGS__ )
+#define LOG_WARN(MODULE, FORMAT, ...)   LOG_AT ( LOG_LEVEL_WARN, MODULE, FORMAT, ## __VA_ARGS__ )
+
 #endif // DISABLE_LOGGING
 
 
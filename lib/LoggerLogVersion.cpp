@@ -4,33 +4,45 @@
 using namespace std;
 
 
-#ifdef DISABLE_LOGGING
-
-void Logger::logVersion() {}
-
-#else
-
-void Logger::logVersion()
+string Logger::formatVersion ( const string& logId, const string& sessionId )
 {
-    fprintf ( _fd, "LogId '%s'\n", _logId.c_str() );
-    fprintf ( _fd, "Version '%s' { '%s', '%s', '%s' }\n", LocalVersion.code.c_str(),
-              LocalVersion.major().c_str(), LocalVersion.minor().c_str(), LocalVersion.suffix().c_str() );
-    fprintf ( _fd, "Revision '%s' { isCustom=%d }\n", LocalVersion.revision.c_str(), LocalVersion.isCustom() );
-    fprintf ( _fd, "BuildTime '%s'\n", LocalVersion.buildTime.c_str() );
+    string str = format ( "LogId '%s'\n", logId );
+    str += format ( "Version '%s' { '%s', '%s', '%s' }\n", LocalVersion.code,
+                    LocalVersion.major(), LocalVersion.minor(), LocalVersion.suffix() );
+    str += format ( "Revision '%s' { isCustom=%d }\n", LocalVersion.revision, LocalVersion.isCustom() );
+    str += format ( "BuildTime '%s'\n", LocalVersion.buildTime );
 
 #if defined(DEBUG)
-    fprintf ( _fd, "BuildType 'debug'\n" );
+    str += "BuildType 'debug'\n";
 #elif defined(LOGGING)
-    fprintf ( _fd, "BuildType 'logging'\n" );
+    str += "BuildType 'logging'\n";
 #elif defined(RELEASE)
-    fprintf ( _fd, "BuildType 'release'\n" );
+    str += "BuildType 'release'\n";
 #else
-    fprintf ( _fd, "BuildType 'unknown'\n" );
+    str += "BuildType 'unknown'\n";
 #endif
 
     if ( ! sessionId.empty() )
-        fprintf ( _fd, "SessionId '%s'\n", sessionId.c_str() );
+        str += format ( "SessionId '%s'\n", sessionId );
+
+    return str;
+}
+
+
+#ifdef DISABLE_LOGGING
+
+void Logger::logVersion() {}
+
+#else
+
+void Logger::logVersion()
+{
+    // In async mode, write everything logged before this first
+    flush();
+
+    LOCK ( _mutex );
 
+    fputs ( formatVersion ( _logId, sessionId ).c_str(), _fd );
     fflush ( _fd );
 }
 
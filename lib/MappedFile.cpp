@@ -0,0 +1,93 @@
+#include "MappedFile.hpp"
+#include "Exceptions.hpp"
+#include "Logger.hpp"
+
+#include <windows.h>
+
+#include <algorithm>
+
+using namespace std;
+
+
+bool MappedFile::open ( const string& file )
+{
+    return open ( file, 0, SIZE_MAX );
+}
+
+bool MappedFile::open ( const string& file, uint64_t offset, size_t size )
+{
+    close();
+
+    _file = CreateFile ( file.c_str(), GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0 );
+
+    if ( _file == INVALID_HANDLE_VALUE )
+    {
+        LOG ( "CreateFile failed: %s", WinException::getLastError() );
+        _file = 0;
+        return false;
+    }
+
+    LARGE_INTEGER fileSize;
+
+    if ( ! GetFileSizeEx ( _file, &fileSize ) || ( uint64_t ) fileSize.QuadPart <= offset )
+    {
+        LOG ( "Invalid file size" );
+        close();
+        return false;
+    }
+
+    // The whole file must fit in the address space if no size was given
+    if ( size == SIZE_MAX && ( uint64_t ) fileSize.QuadPart > SIZE_MAX )
+    {
+        LOG ( "File is too large to map" );
+        close();
+        return false;
+    }
+
+    _mapping = CreateFileMapping ( _file, 0, PAGE_READONLY, 0, 0, 0 );
+
+    if ( ! _mapping )
+    {
+        LOG ( "CreateFileMapping failed: %s", WinException::getLastError() );
+        close();
+        return false;
+    }
+
+    const uint64_t viewOffset = offset - offset % MAPPED_FILE_GRANULARITY;
+    const size_t delta = offset - viewOffset;
+
+    size = min ( ( uint64_t ) size, ( uint64_t ) fileSize.QuadPart - offset );
+
+    _view = MapViewOfFile ( _mapping, FILE_MAP_READ, ( DWORD ) ( viewOffset >> 32 ), ( DWORD ) viewOffset,
+                            delta + size );
+
+    if ( ! _view )
+    {
+        LOG ( "MapViewOfFile failed: %s", WinException::getLastError() );
+        close();
+        return false;
+    }
+
+    _data = ( const char * ) _view + delta;
+    _size = size;
+    _offset = offset;
+    _fileSize = fileSize.QuadPart;
+    return true;
+}
+
+void MappedFile::close()
+{
+    if ( _view )
+        UnmapViewOfFile ( _view );
+
+    if ( _mapping )
+        CloseHandle ( _mapping );
+
+    if ( _file )
+        CloseHandle ( _file );
+
+    _file = _mapping = _view = 0;
+    _data = 0;
+    _size = 0;
+    _offset = _fileSize = 0;
+}
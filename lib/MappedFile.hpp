@@ -0,0 +1,55 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+
+
+// Offsets of views into a file must be a multiple of this, which is the allocation granularity on Windows
+#define MAPPED_FILE_GRANULARITY ( 64 * 1024 )
+
+
+// Read-only memory-mapped view of a whole file, the pages are only read from disk when they are accessed
+class MappedFile
+{
+public:
+
+    MappedFile() {}
+
+    ~MappedFile() { close(); }
+
+    MappedFile ( const MappedFile& ) = delete;
+    MappedFile& operator= ( const MappedFile& ) = delete;
+
+    // Map the given file, returns false if it can't be opened or is empty
+    bool open ( const std::string& file );
+
+    // Map up to size bytes of the given file starting at offset, for files too large to map all at once.
+    // Returns false if it can't be opened or the offset is past the end of the file.
+    bool open ( const std::string& file, uint64_t offset, size_t size );
+
+    void close();
+
+    bool isOpen() const { return _data != 0; }
+
+    const char *data() const { return _data; }
+
+    size_t size() const { return _size; }
+
+    // Offset of the mapped view in the file
+    uint64_t getOffset() const { return _offset; }
+
+    uint64_t getFileSize() const { return _fileSize; }
+
+private:
+
+    void *_file = 0, *_mapping = 0;
+
+    // Start of the view, which can be before the requested offset because of the granularity
+    void *_view = 0;
+
+    const char *_data = 0;
+
+    size_t _size = 0;
+
+    uint64_t _offset = 0, _fileSize = 0;
+};
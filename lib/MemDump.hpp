@@ -37,6 +37,11 @@ public:
     // Get the total size of this memory dump
     size_t getTotalSize() const;
 
+    // Call func ( addr, size ) for this memory dump and then each child pointer, in the same order as saveDump.
+    // The address is 0 if the memory is not currently mapped.
+    template<typename F>
+    void forEachDump ( F& func ) const;
+
     // Serialization
     virtual void save ( cereal::BinaryOutputArchive& ar ) const;
 
@@ -114,6 +119,15 @@ inline size_t MemDumpBase::getTotalSize() const
     return totalSize;
 }
 
+template<typename F>
+inline void MemDumpBase::forEachDump ( F& func ) const
+{
+    func ( getAddr(), size );
+
+    for ( const MemDumpPtr& ptr : ptrs )
+        ptr.forEachDump ( func );
+}
+
 
 class MemDump : public MemDumpBase
 {
@@ -0,0 +1,210 @@
+#include "MemDumpPlan.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined ( __i386__ ) || defined ( __x86_64__ )
+#include <emmintrin.h>
+#define HAS_STREAMING_COPY
+#endif
+
+using namespace std;
+
+
+#ifdef HAS_STREAMING_COPY
+
+// Copy with non-temporal stores, so large snapshots don't evict the game's working set from the cache
+__attribute__ ( ( target ( "sse2" ) ) )
+static void streamingCopy ( char *dst, const char *src, size_t size )
+{
+    // Copy the unaligned head normally
+    const size_t head = min ( size, ( 16 - ( ( uintptr_t ) dst & 15 ) ) & 15 );
+
+    memcpy ( dst, src, head );
+    dst += head;
+    src += head;
+    size -= head;
+
+    for ( ; size >= 64; dst += 64, src += 64, size -= 64 )
+    {
+        const __m128i a = _mm_loadu_si128 ( ( const __m128i * ) ( src ) );
+        const __m128i b = _mm_loadu_si128 ( ( const __m128i * ) ( src + 16 ) );
+        const __m128i c = _mm_loadu_si128 ( ( const __m128i * ) ( src + 32 ) );
+        const __m128i d = _mm_loadu_si128 ( ( const __m128i * ) ( src + 48 ) );
+
+        _mm_stream_si128 ( ( __m128i * ) ( dst ), a );
+        _mm_stream_si128 ( ( __m128i * ) ( dst + 16 ), b );
+        _mm_stream_si128 ( ( __m128i * ) ( dst + 32 ), c );
+        _mm_stream_si128 ( ( __m128i * ) ( dst + 48 ), d );
+    }
+
+    for ( ; size >= 16; dst += 16, src += 16, size -= 16 )
+        _mm_stream_si128 ( ( __m128i * ) dst, _mm_loadu_si128 ( ( const __m128i * ) src ) );
+
+    memcpy ( dst, src, size );
+}
+
+__attribute__ ( ( target ( "sse2" ) ) )
+static void streamingFence()
+{
+    _mm_sfence();
+}
+
+#endif // HAS_STREAMING_COPY
+
+// Most regions are a few bytes, so avoid calling memcpy for the common sizes
+static inline void copySmall ( char *dst, const char *src, size_t size )
+{
+    switch ( size )
+    {
+        case 1:
+            *dst = *src;
+            break;
+
+        case 2:
+            memcpy ( dst, src, 2 );
+            break;
+
+        case 4:
+            memcpy ( dst, src, 4 );
+            break;
+
+        case 8:
+            memcpy ( dst, src, 8 );
+            break;
+
+        default:
+            memcpy ( dst, src, size );
+            break;
+    }
+}
+
+
+void MemDumpPlan::compile ( const MemDumpList& list )
+{
+    clear();
+
+    _numFixed = list.addrs.size();
+
+    for ( const MemDump& mem : list.addrs )
+        _addrs.push_back ( mem.addr );
+
+    size_t offset = 0;
+
+    for ( size_t i = 0; i < list.addrs.size(); ++i )
+    {
+        const MemDump& mem = list.addrs[i];
+
+        ASSERT ( mem.addr != 0 );
+
+        const CopyOp op = { mem.addr, offset, mem.size };
+
+        if ( mem.size >= MEM_DUMP_LARGE_COPY )
+            _largeCopies.push_back ( op );
+        else
+            _smallCopies.push_back ( op );
+
+        offset = compilePtrs ( mem, i, offset + mem.size );
+    }
+
+    _addrs.resize ( _numFixed + _ptrs.size(), 0 );
+    _totalSize = offset;
+
+    ASSERT ( _totalSize == list.totalSize );
+
+#ifdef HAS_STREAMING_COPY
+    __builtin_cpu_init();
+    _streaming = __builtin_cpu_supports ( "sse2" );
+#endif
+}
+
+size_t MemDumpPlan::compilePtrs ( const MemDumpBase& mem, size_t parent, size_t offset )
+{
+    // Pre-order, so the layout matches MemDumpBase::saveDump, and each parent is resolved before its children
+    for ( const MemDumpPtr& ptr : mem.ptrs )
+    {
+        ASSERT ( ptr.srcOffset + 4 <= mem.size );
+
+        const size_t index = _numFixed + _ptrs.size();
+
+        _ptrs.push_back ( { parent, ptr.srcOffset, ptr.dstOffset, offset, ptr.size } );
+
+        offset = compilePtrs ( ptr, index, offset + ptr.size );
+    }
+
+    return offset;
+}
+
+void MemDumpPlan::clear()
+{
+    _smallCopies.clear();
+    _largeCopies.clear();
+    _ptrs.clear();
+    _addrs.clear();
+    _numFixed = 0;
+    _totalSize = 0;
+}
+
+void MemDumpPlan::saveDump ( char *dump ) const
+{
+    ASSERT ( dump != 0 );
+
+    for ( const CopyOp& op : _smallCopies )
+        copySmall ( dump + op.offset, op.addr, op.size );
+
+#ifdef HAS_STREAMING_COPY
+    if ( _streaming )
+    {
+        for ( const CopyOp& op : _largeCopies )
+            streamingCopy ( dump + op.offset, op.addr, op.size );
+    }
+    else
+#endif
+    {
+        for ( const CopyOp& op : _largeCopies )
+            memcpy ( dump + op.offset, op.addr, op.size );
+    }
+
+    for ( size_t i = 0; i < _ptrs.size(); ++i )
+    {
+        const PtrOp& op = _ptrs[i];
+        const char *addr = resolve ( i );
+
+        if ( ! addr )
+            memset ( dump + op.offset, 0, op.size );
+#ifdef HAS_STREAMING_COPY
+        else if ( _streaming && op.size >= MEM_DUMP_LARGE_COPY )
+            streamingCopy ( dump + op.offset, addr, op.size );
+#endif
+        else
+            copySmall ( dump + op.offset, addr, op.size );
+    }
+
+#ifdef HAS_STREAMING_COPY
+    if ( _streaming )
+        streamingFence();
+#endif
+}
+
+void MemDumpPlan::loadDump ( const char *dump ) const
+{
+    ASSERT ( dump != 0 );
+
+    // The game reads the loaded memory right away, so these are normal stores.
+    // The fixed regions must be loaded first, since they contain the pointers.
+    for ( const CopyOp& op : _smallCopies )
+        copySmall ( op.addr, dump + op.offset, op.size );
+
+    for ( const CopyOp& op : _largeCopies )
+        memcpy ( op.addr, dump + op.offset, op.size );
+
+    // Each pointer is resolved after its parent has been loaded
+    for ( size_t i = 0; i < _ptrs.size(); ++i )
+    {
+        const PtrOp& op = _ptrs[i];
+        char *addr = resolve ( i );
+
+        if ( addr )
+            copySmall ( addr, dump + op.offset, op.size );
+    }
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include "MemDump.hpp"
+
+#include <vector>
+
+
+// Regions at least this size are saved with streaming stores, which bypass the cache
+#define MEM_DUMP_LARGE_COPY ( 4096 )
+
+
+// A MemDumpList compiled into flat lists of copy operations, so saving and loading doesn't walk the list.
+//
+// The fixed regions are pre-resolved into (addr, offset, size) copies. Small regions are batched together in one
+// tight loop, and large regions are saved with SSE2 streaming stores when available.
+//
+// Regions behind pointers change every frame, so they are compiled into a flat array of pointer operations in
+// topological order. Each operation reads the pointer from its parent's already resolved address, then copies the
+// region, so the pointer trees are resolved in a single non-virtual loop.
+class MemDumpPlan
+{
+public:
+
+    // Compile the given list, the list can be changed or destroyed afterwards
+    void compile ( const MemDumpList& list );
+
+    void clear();
+
+    bool empty() const { return _totalSize == 0; }
+
+    // Total size of the memory dumps, same as MemDumpList::totalSize
+    size_t getTotalSize() const { return _totalSize; }
+
+    // Save / load all memory dumps to / from the given pointer, in the same layout as MemDumpBase::saveDump
+    void saveDump ( char *dump ) const;
+    void loadDump ( const char *dump ) const;
+
+    // Call func ( addr, offset, size ) for every region, where offset is the position in the dump.
+    // The address is 0 if the region is behind a null pointer. The regions are NOT in order of offset.
+    template<typename F>
+    void forEachDump ( F& func ) const
+    {
+        for ( const CopyOp& op : _smallCopies )
+            func ( op.addr, op.offset, op.size );
+
+        for ( const CopyOp& op : _largeCopies )
+            func ( op.addr, op.offset, op.size );
+
+        for ( size_t i = 0; i < _ptrs.size(); ++i )
+            func ( resolve ( i ), _ptrs[i].offset, _ptrs[i].size );
+    }
+
+private:
+
+    struct CopyOp
+    {
+        char *addr;
+        size_t offset, size;
+    };
+
+    struct PtrOp
+    {
+        // Index of the parent's address in _addrs
+        size_t parent;
+
+        // Location of the pointer in the parent, and the offset to add to the pointer
+        size_t srcOffset, dstOffset;
+
+        // Position in the dump and size of the region
+        size_t offset, size;
+    };
+
+    std::vector<CopyOp> _smallCopies, _largeCopies;
+
+    // Pointer operations, each parent comes before its children
+    std::vector<PtrOp> _ptrs;
+
+    // Address of each fixed region, followed by the address each pointer operation last resolved to
+    mutable std::vector<char *> _addrs;
+
+    size_t _numFixed = 0;
+
+    size_t _totalSize = 0;
+
+    // If the CPU supports SSE2 streaming stores
+    bool _streaming = false;
+
+    size_t compilePtrs ( const MemDumpBase& mem, size_t parent, size_t offset );
+
+    // Resolve the address of the given pointer operation, its parent must already be resolved
+    char *resolve ( size_t i ) const
+    {
+        const PtrOp& op = _ptrs[i];
+        const char *parent = _addrs[op.parent];
+
+        char *addr = ( parent ? * ( char ** ) ( parent + op.srcOffset ) : 0 );
+
+        if ( addr )
+            addr += op.dstOffset;
+
+        _addrs[_numFixed + i] = addr;
+        return addr;
+    }
+};
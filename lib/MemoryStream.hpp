@@ -0,0 +1,109 @@
+#pragma once
+
+#include <streambuf>
+#include <string>
+#include <cstring>
+#include <algorithm>
+
+
+// Stream buffer that writes to a growable byte array.
+// The storage is kept between uses, so once it has grown large enough, no further heap allocations are made.
+class MemoryOutputBuffer : public std::streambuf
+{
+public:
+
+    // Get the written bytes
+    char *data() { return ( _data.empty() ? 0 : &_data[0] ); }
+    const char *data() const { return ( _data.empty() ? 0 : &_data[0] ); }
+
+    // Get the number of written bytes
+    size_t size() const { return _size; }
+
+    // Get the number of bytes that can be written without reallocating
+    size_t capacity() const { return _data.size(); }
+
+    // Reset the number of written bytes, this keeps the storage
+    void clear() { _size = 0; }
+
+    // Resize the number of written bytes, any new bytes are uninitialized
+    void resize ( size_t size )
+    {
+        reserve ( size );
+        _size = size;
+    }
+
+    // Grow the storage so it can hold at least the given number of bytes
+    void reserve ( size_t size )
+    {
+        if ( size > _data.size() )
+            _data.resize ( std::max ( size, 2 * _data.size() ) );
+    }
+
+    // Append raw bytes
+    void append ( const void *bytes, size_t len )
+    {
+        reserve ( _size + len );
+        std::memcpy ( &_data[_size], bytes, len );
+        _size += len;
+    }
+
+    // Swap storage with another buffer
+    void swap ( MemoryOutputBuffer& other )
+    {
+        _data.swap ( other._data );
+        std::swap ( _size, other._size );
+    }
+
+    // Copy the written bytes to a string
+    std::string str() const { return std::string ( data(), _size ); }
+
+protected:
+
+    std::streamsize xsputn ( const char *bytes, std::streamsize len ) override
+    {
+        append ( bytes, len );
+        return len;
+    }
+
+    int_type overflow ( int_type ch ) override
+    {
+        if ( traits_type::eq_int_type ( ch, traits_type::eof() ) )
+            return traits_type::not_eof ( ch );
+
+        const char c = traits_type::to_char_type ( ch );
+        append ( &c, 1 );
+        return ch;
+    }
+
+private:
+
+    // Underlying storage, only the first _size bytes are valid
+    std::string _data;
+
+    // Number of written bytes
+    size_t _size = 0;
+};
+
+
+// Stream buffer that reads in place from an existing byte array, no bytes are copied
+class MemoryInputBuffer : public std::streambuf
+{
+public:
+
+    MemoryInputBuffer() {}
+
+    MemoryInputBuffer ( const char *bytes, size_t len ) { reset ( bytes, len ); }
+
+    // Point this buffer at a new byte array
+    void reset ( const char *bytes, size_t len )
+    {
+        char *begin = const_cast<char *> ( bytes );
+        setg ( begin, begin, begin + len );
+    }
+
+    // Get the number of bytes read so far
+    size_t consumed() const { return ( gptr() - eback() ); }
+
+    // Get the number of bytes not read yet
+    size_t remaining() const { return ( egptr() - gptr() ); }
+};
@@ -2,6 +2,8 @@
 #include "Protocol.include.hpp"
 #include "Protocol.inlineimpl.hpp"
 #include "Compression.hpp"
+#include "CompressionPolicy.hpp"
+#include "TimerManager.hpp"
 #include "Logger.hpp"
 #include "Enum.hpp"
 
@@ -20,35 +22,46 @@ using namespace cereal;
 Compressed:
 
     1 byte  message type
-    1 byte  compression level
+    1 byte  compression level | hash type
     4 byte  uncompressed size
     4 byte  compressed data size
     ...     compressed data
             ========================
             ...     raw data
-            16 byte hash
+            N byte  hash
             ========================
 
 Not compressed:
 
     1 byte  message type
-    1 byte  compression level
+    1 byte  compression level | hash type
     ========================
     ...     raw data
-    16 byte hash
+    N byte  hash
     ========================
 
+The top 2 bits of the compression level byte are the hash type, the hash size N depends on the hash type.
+The hash type is always 0 (16 byte MD5) for older versions, so they remain compatible.
+The hash type is negotiated per socket, decoding rejects any other hash type since a corrupt hash type would
+change where the hash and therefore the message ends.
+The next bit indicates the data was compressed with the preset dictionary for the message type.
+
 */
 
 
-// Encode with compression
-string encodeStageTwo ( const MsgPtr& msg, const string& msgData );
+// Size of the uncompressed header: message type + compression level
+#define HEADER_SIZE ( sizeof ( MsgType ) + sizeof ( uint8_t ) )
+
+// Size of the compressed header: HEADER_SIZE + uncompressed size + compressed data size
+#define COMPRESSED_HEADER_SIZE ( HEADER_SIZE + 2 * sizeof ( uint32_t ) )
 
-// Result of the decode
-ENUM ( DecodeResult, Failed, NotCompressed, Compressed );
+// Bits of the compression level byte that hold the hash type, dictionary flag, and actual compression level
+#define HASH_TYPE_SHIFT ( 6 )
+#define DICTIONARY_FLAG ( 0x20 )
+#define COMPRESSION_LEVEL_MASK ( DICTIONARY_FLAG - 1 )
 
-// Decode with compression. Must manually update the value of consumed if the data was not compressed.
-DecodeResult decodeStageTwo ( const char *bytes, size_t len, size_t& consumed, MsgType& type, string& msgData );
+// Maximum ratio of uncompressed to compressed size that deflate can achieve
+#define MAX_COMPRESSION_RATIO ( 1032 )
 
 
 string Protocol::encode ( const Serializable& message )
@@ -68,86 +81,240 @@ string Protocol::encode ( Serializable *message )
 
 string Protocol::encode ( const MsgPtr& msg )
 {
-    if ( ! msg.get() )
+    MsgBuffer buffer;
+
+    if ( ! encode ( msg, buffer ) )
         return "";
 
-    ostringstream ss ( stringstream::binary );
-    BinaryOutputArchive archive ( ss );
+    return buffer.str();
+}
+
+size_t Protocol::encode ( const MsgPtr& msg, MsgBuffer& buffer )
+{
+    MemoryOutputBuffer& bytes = buffer._bytes;
+    bytes.clear();
+
+    if ( ! msg.get() )
+        return 0;
+
+    // Leave space for the header, the message data is written directly after it
+    bytes.resize ( HEADER_SIZE );
+
+    {
+        BinaryOutputArchive archive ( buffer._out );
 
-    // Encode base message data
-    msg->saveBase ( archive );
+        // Encode base message data
+        msg->saveBase ( archive );
+
+        // Encode actual message data
+        msg->save ( archive );
+    }
 
-    // Encode actual message data
-    msg->save ( archive );
+    const HashType hashType = buffer.hashType;
+    const size_t hashSize = getHashSize ( hashType );
+
+    ASSERT ( hashSize > 0 );
 
 #ifndef DISABLE_UPDATE_HASH
-    // Update the hash
-    if ( msg->_hashValid )
+    // Update the hash, the cached hash is also invalid if it was calculated using a different hash type
+    if ( msg->_hashValid || msg->_hashType != hashType )
     {
-        getMD5 ( ss.str(), &msg->_hash[0] );
+        getHash ( hashType, bytes.data() + HEADER_SIZE, bytes.size() - HEADER_SIZE, &msg->_hash[0] );
+        msg->_hashType = hashType;
         msg->_hashValid = false;
 
 #ifdef LOG_PROTOCOL
         LOG ( "%s", msg->getMsgType() );
-        if ( ss.str().size() <= 256 )
-            LOG ( "data=[ %s ]", formatAsHex ( ss.str() ) );
-        LOG ( "hash=[ %s ]", formatAsHex ( msg->_hash, msg->_hash.size() ) );
+        if ( bytes.size() - HEADER_SIZE <= 256 )
+            LOG ( "data=[ %s ]", formatAsHex ( bytes.data() + HEADER_SIZE, bytes.size() - HEADER_SIZE ) );
+        LOG ( "hash=[ %s ]", formatAsHex ( &msg->_hash[0], hashSize ) );
 #endif
     }
 #endif // NOT DISABLE_UPDATE_HASH
 
     // Encode hash at the end of message data
-    archive ( msg->_hash );
+    bytes.append ( &msg->_hash[0], hashSize );
+
+    const uint32_t dataSize = bytes.size() - HEADER_SIZE;
+
+    const MsgType type = msg->getMsgType();
+
+    // Message type is always first and never compressed
+    bytes.data()[0] = ( char ) type;
+
+    CompressionPolicy& policy = CompressionPolicy::get();
+
+#ifdef FORCE_COMPRESSION
+    const uint8_t level = msg->compressionLevel;
+#else
+    const uint8_t level = policy.getLevel ( type, msg->compressionLevel, dataSize );
+#endif
+
+    // Compress message data if needed
+    if ( level )
+    {
+        const string& dictionary = policy.getDictionary ( type );
+
+        MemoryOutputBuffer& scratch = buffer._scratch;
+        scratch.resize ( COMPRESSED_HEADER_SIZE + compressBound ( dataSize ) );
+
+        const uint64_t start = TimerManager::getMicroseconds();
+
+        uint32_t compressedSize;
+
+        if ( dictionary.empty() )
+        {
+            compressedSize = compress ( bytes.data() + HEADER_SIZE, dataSize,
+                                        scratch.data() + COMPRESSED_HEADER_SIZE,
+                                        scratch.size() - COMPRESSED_HEADER_SIZE, level );
+        }
+        else
+        {
+            compressedSize = compress ( bytes.data() + HEADER_SIZE, dataSize,
+                                        scratch.data() + COMPRESSED_HEADER_SIZE,
+                                        scratch.size() - COMPRESSED_HEADER_SIZE, dictionary, level );
+        }
+
+        const uint64_t microseconds = TimerManager::getMicroseconds() - start;
+
+        // Only use compressed message data if actually smaller after the overhead
+#ifdef FORCE_COMPRESSION
+        const bool useCompressed = ( compressedSize != 0 );
+#else
+        const bool useCompressed = ( compressedSize && 2 * sizeof ( uint32_t ) + compressedSize < dataSize );
+#endif
 
-    // Encode with compression
-    return encodeStageTwo ( msg, ss.str() );
+        policy.update ( type, dataSize, useCompressed ? 2 * sizeof ( uint32_t ) + compressedSize : dataSize,
+                        microseconds );
+
+        if ( useCompressed )
+        {
+            char *header = scratch.data();
+            header[0] = bytes.data()[0];
+            header[1] = ( char ) ( level
+                                   | ( dictionary.empty() ? 0 : DICTIONARY_FLAG )
+                                   | ( ( uint8_t ) hashType << HASH_TYPE_SHIFT ) );
+            memcpy ( header + HEADER_SIZE, &dataSize, sizeof ( dataSize ) );
+            memcpy ( header + HEADER_SIZE + sizeof ( dataSize ), &compressedSize, sizeof ( compressedSize ) );
+
+            scratch.resize ( COMPRESSED_HEADER_SIZE + compressedSize );
+            bytes.swap ( scratch );
+            return bytes.size();
+        }
+
+        // Otherwise update compression level so we don't try to compress this again
+        msg->compressionLevel = 0;
+    }
+
+    // Uncompressed data does not include uncompressedSize or any other sizes
+    bytes.data()[1] = ( char ) ( ( uint8_t ) hashType << HASH_TYPE_SHIFT );
+    return bytes.size();
 }
 
 MsgPtr Protocol::decode ( const char *bytes, size_t len, size_t& consumed )
 {
-    MsgPtr msg;
+    MsgBuffer buffer;
+    return decode ( bytes, len, consumed, buffer );
+}
 
-    if ( len == 0 )
-    {
-        consumed = 0;
+MsgPtr Protocol::decode ( const char *bytes, size_t len, size_t& consumed, MsgBuffer& buffer )
+{
+    return decode ( bytes, len, consumed, buffer, buffer.hashType );
+}
+
+MsgPtr Protocol::decode ( const char *bytes, size_t len, size_t& consumed, MsgBuffer& buffer, HashType expected )
+{
+    consumed = 0;
+
+    if ( len < HEADER_SIZE )
         return NullMsg;
-    }
 
-    MsgType type;
-    string data;
+    // Decode message type first before decompression
+    const MsgType type = ( MsgType ) bytes[0];
+    const uint8_t compressionLevel = ( ( uint8_t ) bytes[1] & COMPRESSION_LEVEL_MASK );
+    const bool useDictionary = ( ( uint8_t ) bytes[1] & DICTIONARY_FLAG );
+    const HashType hashType = ( HashType ) ( ( uint8_t ) bytes[1] >> HASH_TYPE_SHIFT );
+    const size_t hashSize = getHashSize ( hashType );
+
+    if ( hashType != expected || ! hashSize )
+        return NullMsg;
+
+    const char *data = bytes + HEADER_SIZE;
+    size_t dataLen = len - HEADER_SIZE;
+    size_t compressedConsumed = 0;
+
+    // Only compressed data includes uncompressedSize + a compressed data buffer
+    if ( compressionLevel )
+    {
+        if ( len < COMPRESSED_HEADER_SIZE )
+            return NullMsg;
+
+        uint32_t uncompressedSize, compressedSize;
+        memcpy ( &uncompressedSize, bytes + HEADER_SIZE, sizeof ( uncompressedSize ) );
+        memcpy ( &compressedSize, bytes + HEADER_SIZE + sizeof ( uncompressedSize ), sizeof ( compressedSize ) );
+
+        if ( compressedSize > len - COMPRESSED_HEADER_SIZE || uncompressedSize == 0 )
+            return NullMsg;
+
+        // Reject sizes that deflate can't produce, so corrupt headers can't trigger huge allocations
+        if ( uncompressedSize > MAX_COMPRESSION_RATIO * ( uint64_t ) compressedSize )
+            return NullMsg;
+
+        MemoryOutputBuffer& scratch = buffer._scratch;
+        size_t size, dictSize = 0;
 
-    // Decode with compression
-    DecodeResult result = decodeStageTwo ( bytes, len, consumed, type, data );
+        if ( useDictionary )
+        {
+            const string& dictionary = CompressionPolicy::get().getDictionary ( type );
+
+            if ( dictionary.empty() )
+                return NullMsg;
+
+            // The dictionary is placed directly before the uncompressed data
+            dictSize = dictionary.size();
+            scratch.resize ( dictSize + uncompressedSize );
+            memcpy ( scratch.data(), &dictionary[0], dictSize );
+
+            size = uncompress ( bytes + COMPRESSED_HEADER_SIZE, compressedSize,
+                                scratch.data(), dictSize, uncompressedSize );
+        }
+        else
+        {
+            scratch.resize ( uncompressedSize );
+
+            size = uncompress ( bytes + COMPRESSED_HEADER_SIZE, compressedSize,
+                                scratch.data(), uncompressedSize );
+        }
 
 #ifdef LOG_PROTOCOL
-    LOG ( "decodeStageTwo: result=%s", result );
+        LOG ( "uncompress: size=%u; uncompressedSize=%u", size, uncompressedSize );
 #endif
 
-    if ( result == DecodeResult::Failed )
-    {
-        consumed = 0;
-        return NullMsg;
+        if ( size != uncompressedSize )
+            return NullMsg;
+
+        data = scratch.data() + dictSize;
+        dataLen = uncompressedSize;
+        compressedConsumed = COMPRESSED_HEADER_SIZE + compressedSize;
     }
 
 #ifdef LOG_PROTOCOL
-    if ( data.size() <= 256 )
-        LOG ( "decodeStageTwo: data=[ %s ]", formatAsHex ( data ) );
+    if ( dataLen <= 256 )
+        LOG ( "data=[ %s ]", formatAsHex ( data, dataLen ) );
 #endif
 
-    istringstream ss ( data, stringstream::binary );
-    BinaryInputArchive archive ( ss );
+    // Construct the correct message type
+    MsgPtr msg = create ( type );
+
+    if ( ! msg.get() )
+        return NullMsg;
+
+    buffer._input.reset ( data, dataLen );
+    buffer._in.clear();
 
     try
     {
-        // Construct the correct message type
-        switch ( type )
-        {
-#include "Protocol.switchdecode.hpp"
-
-            default:
-                consumed = 0;
-                return NullMsg;
-        }
+        BinaryInputArchive archive ( buffer._in );
 
         // Decode base message data
         msg->loadBase ( archive );
@@ -156,7 +323,8 @@ MsgPtr Protocol::decode ( const char *bytes, size_t len, size_t& consumed )
         msg->load ( archive );
 
         // Decode hash at end of message data
-        archive ( msg->_hash );
+        archive ( cereal::binary_data ( &msg->_hash[0], hashSize ) );
+        msg->_hashType = hashType;
         msg->_hashValid = false;
     }
     catch ( const cereal::Exception& exc )
@@ -182,36 +350,38 @@ MsgPtr Protocol::decode ( const char *bytes, size_t len, size_t& consumed )
     }
 
     if ( ! msg.get() )
-    {
-        consumed = 0;
         return NullMsg;
-    }
 
-    size_t dataSize = data.size();
+    // Compressed messages consume the whole compressed buffer, otherwise only the bytes that were read
+    size_t dataSize = dataLen;
+
+    if ( compressionLevel )
+    {
+        // The uncompressed data must contain exactly one message
+        if ( buffer._input.consumed() != dataLen )
+            return NullMsg;
 
-    // decodeStageTwo does not update the value of consumed if the data was not compressed
-    if ( result == DecodeResult::NotCompressed )
+        consumed = compressedConsumed;
+    }
+    else
     {
-        // Check for unread bytes
-        size_t remaining = ss.rdbuf()->in_avail();
-        ASSERT ( len >= remaining );
-        consumed = ( len - remaining );
-        dataSize = ( data.size() - remaining );
+        dataSize = buffer._input.consumed();
+        consumed = HEADER_SIZE + dataSize;
     }
 
 #ifndef DISABLE_UPDATE_HASH
     // Check if the hash is correct
-    if ( ! checkMD5 ( &data[0], dataSize - msg->_hash.size(), &msg->_hash[0] ) )
+    if ( ! checkHash ( hashType, data, dataSize - hashSize, &msg->_hash[0] ) )
     {
 #ifdef LOG_PROTOCOL
-        LOG ( "hash check failed for %s", type );
-        LOG ( "data=[ %s ]", formatAsHex ( &data[0], dataSize - msg->_hash.size() ) );
-        LOG ( "hash    =[ %s ]", formatAsHex ( msg->_hash, msg->_hash.size() ) );
+        LOG ( "hash check failed for %s; hashType=%u", type, ( uint8_t ) hashType );
+        LOG ( "data=[ %s ]", formatAsHex ( data, dataSize - hashSize ) );
+        LOG ( "hash    =[ %s ]", formatAsHex ( &msg->_hash[0], hashSize ) );
 
-        char hash[msg->_hash.size()];
-        gethash ( &data[0], dataSize - msg->_hash.size(), hash );
+        char hash[MAX_HASH_SIZE];
+        getHash ( hashType, data, dataSize - hashSize, hash );
 
-        LOG ( "expected=[ %s ]", formatAsHex ( hash, msg->_hash.size() ) );
+        LOG ( "expected=[ %s ]", formatAsHex ( hash, hashSize ) );
 #endif
         return NullMsg;
     }
@@ -220,113 +390,19 @@ MsgPtr Protocol::decode ( const char *bytes, size_t len, size_t& consumed )
     return msg;
 }
 
-string encodeStageTwo ( const MsgPtr& msg, const string& msgData )
+MsgPtr Protocol::create ( MsgType type )
 {
-    ostringstream ss ( stringstream::binary );
-    BinaryOutputArchive archive ( ss );
-
-    // Encode message type first without compression
-    archive ( msg->getMsgType() );
-
-    // Compress message data if needed
-    if ( msg->compressionLevel )
-    {
-        string buffer ( compressBound ( msgData.size() ), ( char ) 0 );
-        size_t size = compress ( &msgData[0], msgData.size(), &buffer[0], buffer.size(), msg->compressionLevel );
-        buffer.resize ( size );
-
-        // Only use compressed message data if actually smaller after the overhead
-#ifndef FORCE_COMPRESSION
-        if ( sizeof ( msgData.size() ) + sizeof ( buffer.size() ) + buffer.size() < msgData.size() )
-#endif
-        {
-            archive ( msg->compressionLevel );
-            archive ( msgData.size() );         // uncompressed size
-            archive ( buffer );                 // compressed size + compressed data
-            return ss.str();
-        }
-
-        // Otherwise update compression level so we don't try to compress this again
-        msg->compressionLevel = 0;
-    }
-
-    // uncompressed data does not include uncompressedSize or any other sizes
-    archive ( msg->compressionLevel );
-    return ss.str() + msgData;
-}
-
-DecodeResult decodeStageTwo ( const char *bytes, size_t len, size_t& consumed, MsgType& type, string& msgData )
-{
-    istringstream ss ( string ( bytes, len ), stringstream::binary );
-    BinaryInputArchive archive ( ss );
-
-    uint8_t compressionLevel;
-    uint32_t uncompressedSize;
-
-    try
-    {
-        // Decode message type first before decompression
-        archive ( type );
-        archive ( compressionLevel );
-
-        // Only compressed data includes uncompressedSize + a compressed data buffer
-        if ( compressionLevel )
-        {
-            archive ( uncompressedSize );       // uncompressed size
-            archive ( msgData );                // compressed size + compressed data
-        }
-    }
-    catch ( const cereal::Exception& exc )
-    {
-#ifdef LOG_PROTOCOL
-        LOG ( "cereal::Exception: '%s'", type, exc.what() );
-#endif
-        consumed = 0;
-        return DecodeResult::Failed;
-    }
-    catch ( const std::exception& exc )
-    {
-#ifdef LOG_PROTOCOL
-        LOG ( "std::exception: '%s'", type, exc.what() );
-#endif
-        consumed = 0;
-        return DecodeResult::Failed;
-    }
-    catch ( ... )
-    {
-#ifdef LOG_PROTOCOL
-        LOG ( "Unknown exception!" );
-#endif
-        consumed = 0;
-        return DecodeResult::Failed;
-    }
-
-    // Get remaining bytes
-    size_t remaining = ss.rdbuf()->in_avail();
-    ASSERT ( len >= remaining );
+    MsgPtr msg;
 
-    // Decompress message data if needed
-    if ( compressionLevel )
+    switch ( type )
     {
-        string buffer ( uncompressedSize, ( char ) 0 );
-        size_t size = uncompress ( &msgData[0], msgData.size(), &buffer[0], buffer.size() );
-
-        if ( size != uncompressedSize )
-        {
-            consumed = 0;
-            return DecodeResult::Failed;
-        }
+#include "Protocol.switchdecode.hpp"
 
-        // Update consumed bytes
-        consumed = len - remaining;
-        msgData = buffer;
-        return DecodeResult::Compressed;
+        default:
+            return NullMsg;
     }
 
-    // Get remaining bytes
-    msgData.resize ( remaining );
-    ss.rdbuf()->sgetn ( &msgData[0], remaining );
-    return DecodeResult::NotCompressed;
+    return msg;
 }
 
 
@@ -1,6 +1,8 @@
 #pragma once
 
 #include "Enum.hpp"
+#include "Compression.hpp"
+#include "MemoryStream.hpp"
 
 #include <cereal/archives/binary.hpp>
 
@@ -58,6 +60,55 @@ inline void ignoreMsgPtr ( Serializable * ) {}
 const MsgPtr NullMsg;
 
 
+// Reusable storage for encoding and decoding messages.
+// Once the buffers have grown to fit the largest message, encode / decode make no further heap allocations.
+class MsgBuffer
+{
+public:
+
+    MsgBuffer() : _out ( &_bytes ), _in ( &_input ) {}
+
+    // Get the encoded bytes
+    const char *data() const { return _bytes.data(); }
+
+    // Get the number of encoded bytes
+    size_t size() const { return _bytes.size(); }
+
+    // True if there are no encoded bytes
+    bool empty() const { return ( _bytes.size() == 0 ); }
+
+    // Get the total number of bytes allocated by this buffer
+    size_t capacity() const { return _bytes.capacity() + _scratch.capacity(); }
+
+    // Copy the encoded bytes to a string
+    std::string str() const { return _bytes.str(); }
+
+    // Negotiated hash type, used when encoding. Decoding rejects messages with any other hash type in the header.
+    HashType hashType = HashType::Md5;
+
+private:
+
+    // Encoded message bytes
+    MemoryOutputBuffer _bytes;
+
+    // Scratch space for compression / decompression
+    MemoryOutputBuffer _scratch;
+
+    // In place view of the bytes being decoded
+    MemoryInputBuffer _input;
+
+    // Streams for the archives, these are constructed once and reused
+    std::ostream _out;
+    std::istream _in;
+
+    // Not copyable
+    MsgBuffer ( const MsgBuffer& );
+    const MsgBuffer& operator= ( const MsgBuffer& );
+
+    friend class Protocol;
+};
+
+
 // Contains protocol methods
 class Protocol
 {
@@ -68,10 +119,24 @@ public:
     static std::string encode ( Serializable *message );
     static std::string encode ( const MsgPtr& msg );
 
+    // Encode a message into a reusable buffer, returns the number of bytes encoded, or 0 if the message is null
+    static size_t encode ( const MsgPtr& msg, MsgBuffer& buffer );
+
     // Decode a series of bytes into a message, consumed indicates the number of bytes read.
     // This returns null if the message failed to decode, NOTE consumed will still be updated.
+    // Only messages hashed with the default hash type are accepted.
     static MsgPtr decode ( const char *bytes, size_t len, size_t& consumed );
 
+    // Decode in place without copying the bytes, the buffer is only used as scratch space for decompression.
+    // Only messages hashed with buffer.hashType are accepted.
+    static MsgPtr decode ( const char *bytes, size_t len, size_t& consumed, MsgBuffer& buffer );
+
+    // Decode in place, only accepting messages hashed with the expected hash type instead of buffer.hashType
+    static MsgPtr decode ( const char *bytes, size_t len, size_t& consumed, MsgBuffer& buffer, HashType expected );
+
+    // Construct an empty message of the given type, returns null if the type is invalid
+    static MsgPtr create ( MsgType type );
+
     static bool checkMsgType ( MsgType type )
     {
         return ( type > MsgType::FirstType && type < MsgType::LastType );
@@ -114,10 +179,11 @@ public:
 
 private:
 
-    typedef std::array<char, 16> HashType;
+    typedef std::array<char, MAX_HASH_SIZE> HashBytes;
 
-    // Cached hash data
-    mutable HashType _hash;
+    // Cached hash data, only the first getHashSize ( _hashType ) bytes are used
+    mutable HashBytes _hash;
+    mutable HashType _hashType = HashType::Md5;
     mutable bool _hashValid = true;
 
     // Serialize and deserialize the base type
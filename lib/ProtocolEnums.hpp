@@ -32,3 +32,9 @@ VersionConfig,
 JoysticksChanged,
 TransitionIndex,
 PaletteManager,
+CompactBothInputs,
+CompactPlayerInputs,
+SelectiveAck,
+DesyncHashes,
+FullStateHash,
+FeatureConfig,
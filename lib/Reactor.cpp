@@ -0,0 +1,609 @@
+// Windows select takes an array of sockets, this sets the size of it, so it must be before any Windows headers
+#ifdef _WIN32
+#define FD_SETSIZE ( 1024 )
+#endif
+
+#include "Reactor.hpp"
+#include "Exceptions.hpp"
+#include "ErrorStrings.hpp"
+
+#include <unordered_map>
+#include <atomic>
+#include <climits>
+#include <cstring>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <windows.h>
+#else
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#endif
+
+using namespace std;
+
+
+#ifdef _WIN32
+
+typedef int SockLen;
+
+#define THROW_SOCKET_EXCEPTION(DEBUG) THROW_WIN_EXCEPTION ( WSAGetLastError(), DEBUG, ERROR_NETWORK_GENERIC )
+
+static bool isInterrupted() { return ( WSAGetLastError() == WSAEINTR ); }
+
+static void closeSocket ( int fd ) { closesocket ( fd ); }
+
+// WSAPoll is only in Vista and later, so the headers don't declare it for XP, and it's loaded when needed
+#ifndef POLLIN
+#define POLLRDNORM  ( 0x0100 )
+#define POLLRDBAND  ( 0x0200 )
+#define POLLIN      ( POLLRDNORM | POLLRDBAND )
+#define POLLWRNORM  ( 0x0010 )
+#define POLLOUT     ( POLLWRNORM )
+#define POLLERR     ( 0x0001 )
+#define POLLHUP     ( 0x0002 )
+#define POLLNVAL    ( 0x0004 )
+#endif
+
+// Same layout as WSAPOLLFD
+struct PollFd
+{
+    SOCKET fd;
+    short events;
+    short revents;
+};
+
+typedef int ( WSAAPI *WSAPollFunc ) ( PollFd *fds, ULONG count, INT timeout );
+
+static WSAPollFunc getWSAPoll()
+{
+    static const WSAPollFunc func = ( WSAPollFunc ) GetProcAddress ( GetModuleHandleA ( "ws2_32.dll" ), "WSAPoll" );
+    return func;
+}
+
+static int pollFds ( PollFd *fds, size_t count, int timeout ) { return getWSAPoll() ( fds, count, timeout ); }
+
+#else
+
+typedef socklen_t SockLen;
+
+#define INVALID_SOCKET  ( -1 )
+#define SOCKET_ERROR    ( -1 )
+
+#define THROW_SOCKET_EXCEPTION(DEBUG) THROW_EXCEPTION ( "%s: %s", ERROR_NETWORK_GENERIC, DEBUG, strerror ( errno ) )
+
+static bool isInterrupted() { return ( errno == EINTR ); }
+
+static void closeSocket ( int fd ) { close ( fd ); }
+
+typedef pollfd PollFd;
+
+static int pollFds ( PollFd *fds, size_t count, int timeout ) { return ::poll ( fds, count, timeout ); }
+
+#endif // _WIN32
+
+
+// Reactor that wakes up by sending a datagram to a loopback UDP socket, which is always waited on
+class LoopbackWakeupReactor : public Reactor
+{
+public:
+
+    void wakeup() override
+    {
+        // Only one wakeup datagram is needed until the next wait drains it
+        if ( _woken.exchange ( true ) )
+            return;
+
+        const char byte = 0;
+        ::send ( _wakeupFd, &byte, 1, 0 );
+    }
+
+protected:
+
+    // Loopback UDP socket that is connected to itself
+    int _wakeupFd = 0;
+
+    // Set until the wakeup datagram is drained
+    atomic<bool> _woken { false };
+
+    LoopbackWakeupReactor()
+    {
+        _wakeupFd = ::socket ( AF_INET, SOCK_DGRAM, IPPROTO_UDP );
+
+        if ( _wakeupFd == INVALID_SOCKET )
+            THROW_SOCKET_EXCEPTION ( "socket failed" );
+
+        sockaddr_in addr;
+        memset ( &addr, 0, sizeof ( addr ) );
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl ( INADDR_LOOPBACK );
+
+        SockLen len = sizeof ( addr );
+
+        if ( ::bind ( _wakeupFd, ( sockaddr * ) &addr, sizeof ( addr ) ) == SOCKET_ERROR
+                || ::getsockname ( _wakeupFd, ( sockaddr * ) &addr, &len ) == SOCKET_ERROR
+                || ::connect ( _wakeupFd, ( sockaddr * ) &addr, sizeof ( addr ) ) == SOCKET_ERROR )
+        {
+            closeSocket ( _wakeupFd );
+            THROW_SOCKET_EXCEPTION ( "Failed to create wakeup socket" );
+        }
+
+#ifdef _WIN32
+        u_long nonBlocking = 1;
+        ioctlsocket ( _wakeupFd, FIONBIO, &nonBlocking );
+#else
+        fcntl ( _wakeupFd, F_SETFL, fcntl ( _wakeupFd, F_GETFL ) | O_NONBLOCK );
+#endif
+    }
+
+    ~LoopbackWakeupReactor()
+    {
+        closeSocket ( _wakeupFd );
+    }
+
+    void drainWakeup()
+    {
+        char buffer[64];
+
+        while ( ::recv ( _wakeupFd, buffer, sizeof ( buffer ), 0 ) > 0 )
+            ;
+
+        // Cleared after draining, so a wakeup in between still makes this wait return, and can't be lost
+        _woken = false;
+    }
+};
+
+
+// Reactor using select, which is available everywhere, but limited to FD_SETSIZE sockets
+class SelectReactor : public LoopbackWakeupReactor
+{
+public:
+
+    void add ( int fd, uint32_t events, void *data ) override
+    {
+        // FD_SET silently ignores sockets that don't fit, so they would never be ready.
+        // Windows limits the number of sockets including the wakeup socket, and POSIX limits the value of each one.
+#ifdef _WIN32
+        if ( _sockets.size() + 1 >= FD_SETSIZE && _sockets.find ( fd ) == _sockets.end() )
+#else
+        if ( fd >= FD_SETSIZE )
+#endif
+            THROW_EXCEPTION ( "fd=%d; FD_SETSIZE=%d", ERROR_NETWORK_GENERIC, fd, FD_SETSIZE );
+
+        _sockets[fd] = { events, data };
+    }
+
+    void remove ( int fd ) override
+    {
+        _sockets.erase ( fd );
+    }
+
+    size_t wait ( uint64_t timeout, vector<Event>& events ) override
+    {
+        fd_set readFds, writeFds, errorFds;
+        FD_ZERO ( &readFds );
+        FD_ZERO ( &writeFds );
+        FD_ZERO ( &errorFds );
+
+        FD_SET ( _wakeupFd, &readFds );
+        int maxFd = _wakeupFd;
+
+        for ( const auto& kv : _sockets )
+        {
+            if ( kv.second.events & REACTOR_READ )
+                FD_SET ( kv.first, &readFds );
+
+            if ( kv.second.events & REACTOR_WRITE )
+                FD_SET ( kv.first, &writeFds );
+
+            // Failed connects are only reported here on Windows
+            FD_SET ( kv.first, &errorFds );
+
+            maxFd = max ( maxFd, kv.first );
+        }
+
+        timeval tv;
+        tv.tv_sec = timeout / 1000UL;
+        tv.tv_usec = ( timeout * 1000UL ) % 1000000UL;
+
+        // Note: select should be called between timeBeginPeriod / timeEndPeriod to ensure accurate timeouts
+        const int count = ::select ( maxFd + 1, &readFds, &writeFds, &errorFds, timeout == UINT64_MAX ? 0 : &tv );
+
+        if ( count == SOCKET_ERROR )
+        {
+            if ( isInterrupted() )
+                return 0;
+
+            THROW_SOCKET_EXCEPTION ( "select failed" );
+        }
+
+        if ( count == 0 )
+            return 0;
+
+        if ( FD_ISSET ( _wakeupFd, &readFds ) )
+            drainWakeup();
+
+        size_t ready = 0;
+
+        for ( const auto& kv : _sockets )
+        {
+            uint32_t flags = 0;
+
+            if ( FD_ISSET ( kv.first, &readFds ) )
+                flags |= REACTOR_READ;
+
+            if ( FD_ISSET ( kv.first, &writeFds ) )
+                flags |= REACTOR_WRITE;
+
+            if ( FD_ISSET ( kv.first, &errorFds ) )
+                flags |= kv.second.events;
+
+            if ( ! flags )
+                continue;
+
+            events.push_back ( { kv.second.data, flags } );
+            ++ready;
+        }
+
+        return ready;
+    }
+
+    Backend getBackend() const override { return Select; }
+
+private:
+
+    struct Registration
+    {
+        uint32_t events;
+        void *data;
+    };
+
+    unordered_map<int, Registration> _sockets;
+};
+
+
+// Reactor using poll, or WSAPoll on Windows, which isn't limited to FD_SETSIZE sockets.
+//
+// WSAPoll before Windows 10 2004 doesn't report failed connects, so those TCP sockets only fail when their
+// connect timer expires.
+class PollReactor : public LoopbackWakeupReactor
+{
+public:
+
+    PollReactor()
+    {
+        _fds.push_back ( getPollFd ( _wakeupFd, POLLIN ) );
+        _data.push_back ( 0 );
+    }
+
+    void add ( int fd, uint32_t events, void *data ) override
+    {
+        const short pollEvents = ( ( events & REACTOR_READ ) ? POLLIN : 0 )
+                                 | ( ( events & REACTOR_WRITE ) ? POLLOUT : 0 );
+
+        const auto it = _indices.find ( fd );
+
+        if ( it != _indices.end() )
+        {
+            _fds[it->second].events = pollEvents;
+            _data[it->second] = data;
+            return;
+        }
+
+        _indices[fd] = _fds.size();
+        _fds.push_back ( getPollFd ( fd, pollEvents ) );
+        _data.push_back ( data );
+    }
+
+    void remove ( int fd ) override
+    {
+        const auto it = _indices.find ( fd );
+
+        if ( it == _indices.end() )
+            return;
+
+        // Move the last socket into the removed one's place
+        const size_t index = it->second;
+        _indices.erase ( it );
+
+        if ( index + 1 < _fds.size() )
+        {
+            _fds[index] = _fds.back();
+            _data[index] = _data.back();
+            _indices[_fds[index].fd] = index;
+        }
+
+        _fds.pop_back();
+        _data.pop_back();
+    }
+
+    size_t wait ( uint64_t timeout, vector<Event>& events ) override
+    {
+        const int count = pollFds ( &_fds[0], _fds.size(),
+                                   timeout == UINT64_MAX ? -1 : ( int ) min ( timeout, ( uint64_t ) INT_MAX ) );
+
+        if ( count == SOCKET_ERROR )
+        {
+            if ( isInterrupted() )
+                return 0;
+
+            THROW_SOCKET_EXCEPTION ( "poll failed" );
+        }
+
+        if ( count == 0 )
+            return 0;
+
+        if ( _fds[0].revents )
+            drainWakeup();
+
+        size_t ready = 0;
+
+        for ( size_t i = 1; i < _fds.size(); ++i )
+        {
+            const short revents = _fds[i].revents;
+
+            if ( ! revents )
+                continue;
+
+            uint32_t flags = 0;
+
+            if ( revents & POLLIN )
+                flags |= REACTOR_READ;
+
+            if ( revents & POLLOUT )
+                flags |= REACTOR_WRITE;
+
+            if ( revents & ( POLLERR | POLLHUP | POLLNVAL ) )
+            {
+                flags |= ( ( _fds[i].events & POLLIN ) ? REACTOR_READ : 0 )
+                         | ( ( _fds[i].events & POLLOUT ) ? REACTOR_WRITE : 0 );
+            }
+
+            events.push_back ( { _data[i], flags } );
+            ++ready;
+        }
+
+        return ready;
+    }
+
+    Backend getBackend() const override { return Poll; }
+
+private:
+
+    static PollFd getPollFd ( int fd, short events )
+    {
+        PollFd pollFd;
+        pollFd.fd = fd;
+        pollFd.events = events;
+        pollFd.revents = 0;
+        return pollFd;
+    }
+
+    // The first one is the wakeup socket
+    vector<PollFd> _fds;
+
+    // Data of each socket in the same order
+    vector<void *> _data;
+
+    // Index of each socket
+    unordered_map<int, size_t> _indices;
+};
+
+
+#ifdef __linux__
+
+// Reactor using epoll, which only returns the ready sockets without checking every socket
+class EpollReactor : public Reactor
+{
+public:
+
+    EpollReactor()
+    {
+        _epollFd = epoll_create1 ( EPOLL_CLOEXEC );
+
+        if ( _epollFd < 0 )
+            THROW_SOCKET_EXCEPTION ( "epoll_create1 failed" );
+
+        _eventFd = eventfd ( 0, EFD_NONBLOCK | EFD_CLOEXEC );
+
+        if ( _eventFd < 0 )
+        {
+            close ( _epollFd );
+            THROW_SOCKET_EXCEPTION ( "eventfd failed" );
+        }
+
+        // The wakeup event has no registration
+        epoll_event event;
+        event.events = EPOLLIN;
+        event.data.ptr = 0;
+        epoll_ctl ( _epollFd, EPOLL_CTL_ADD, _eventFd, &event );
+    }
+
+    ~EpollReactor()
+    {
+        close ( _eventFd );
+        close ( _epollFd );
+    }
+
+    void add ( int fd, uint32_t events, void *data ) override
+    {
+        const bool exists = ( _sockets.find ( fd ) != _sockets.end() );
+
+        // Pointers to the registrations stay valid until they are removed
+        Registration& registration = _sockets[fd];
+        registration = { fd, events, data };
+
+        epoll_event event;
+        event.events = ( ( events & REACTOR_READ ) ? uint32_t ( EPOLLIN ) : uint32_t ( 0 ) )
+                       | ( ( events & REACTOR_WRITE ) ? uint32_t ( EPOLLOUT ) : uint32_t ( 0 ) );
+        event.data.ptr = &registration;
+
+        if ( epoll_ctl ( _epollFd, exists ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, fd, &event ) < 0 )
+        {
+            _sockets.erase ( fd );
+            THROW_SOCKET_EXCEPTION ( "epoll_ctl failed" );
+        }
+    }
+
+    void remove ( int fd ) override
+    {
+        if ( ! _sockets.erase ( fd ) )
+            return;
+
+        epoll_event event;
+        epoll_ctl ( _epollFd, EPOLL_CTL_DEL, fd, &event );
+    }
+
+    size_t wait ( uint64_t timeout, vector<Event>& events ) override
+    {
+        _ready.resize ( _sockets.size() + 1 );
+
+        const int count = epoll_wait ( _epollFd, &_ready[0], _ready.size(),
+                                       timeout == UINT64_MAX ? -1 : ( int ) min ( timeout, ( uint64_t ) INT_MAX ) );
+
+        if ( count < 0 )
+        {
+            if ( isInterrupted() )
+                return 0;
+
+            THROW_SOCKET_EXCEPTION ( "epoll_wait failed" );
+        }
+
+        size_t ready = 0;
+
+        for ( int i = 0; i < count; ++i )
+        {
+            const Registration *registration = ( const Registration * ) _ready[i].data.ptr;
+
+            // Reset the wakeup counter
+            if ( ! registration )
+            {
+                uint64_t value;
+                const ssize_t bytes = read ( _eventFd, &value, sizeof ( value ) );
+                ( void ) bytes;
+                continue;
+            }
+
+            uint32_t flags = 0;
+
+            if ( _ready[i].events & EPOLLIN )
+                flags |= REACTOR_READ;
+
+            if ( _ready[i].events & EPOLLOUT )
+                flags |= REACTOR_WRITE;
+
+            if ( _ready[i].events & ( EPOLLERR | EPOLLHUP ) )
+                flags |= registration->events;
+
+            events.push_back ( { registration->data, flags } );
+            ++ready;
+        }
+
+        return ready;
+    }
+
+    void wakeup() override
+    {
+        const uint64_t value = 1;
+        const ssize_t bytes = write ( _eventFd, &value, sizeof ( value ) );
+        ( void ) bytes;
+    }
+
+    Backend getBackend() const override { return Epoll; }
+
+private:
+
+    struct Registration
+    {
+        int fd;
+        uint32_t events;
+        void *data;
+    };
+
+    int _epollFd = -1, _eventFd = -1;
+
+    unordered_map<int, Registration> _sockets;
+
+    vector<epoll_event> _ready;
+};
+
+#endif // __linux__
+
+
+Reactor *Reactor::create ( Backend backend )
+{
+    switch ( backend )
+    {
+        case Select:
+            return new SelectReactor();
+
+        case Poll:
+#ifdef _WIN32
+            if ( ! getWSAPoll() )
+                return 0;
+#endif
+            return new PollReactor();
+
+#ifdef __linux__
+        case Epoll:
+            return new EpollReactor();
+#endif
+
+        default:
+            return 0;
+    }
+}
+
+bool Reactor::getBackend ( const string& name, Backend& backend )
+{
+    for ( const Backend b : { Select, Poll, Epoll } )
+    {
+        if ( name != getBackendName ( b ) )
+            continue;
+
+        backend = b;
+        return true;
+    }
+
+    return false;
+}
+
+const char *Reactor::getBackendName ( Backend backend )
+{
+    switch ( backend )
+    {
+        case Select:
+            return "select";
+
+        case Poll:
+            return "poll";
+
+        case Epoll:
+            return "epoll";
+
+        default:
+            return "unknown";
+    }
+}
+
+Reactor::Backend Reactor::getDefaultBackend()
+{
+#if defined ( __linux__ )
+    return Epoll;
+#elif defined ( _WIN32 )
+    return Select;
+#else
+    return Poll;
+#endif
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include <string>
+
+
+// Readiness events a socket can be registered for
+#define REACTOR_READ        ( 0x01 )
+#define REACTOR_WRITE       ( 0x02 )
+
+
+// Waits until registered sockets are ready, a timeout, or a wakeup from another thread.
+//
+// Sockets are registered once with the events they are waiting for, and wait only returns the ready ones, so the
+// caller doesn't have to rebuild anything per wait. The select backend works everywhere but is limited to FD_SETSIZE
+// sockets, the poll backend needs poll(2) or WSAPoll from Vista and later, and the epoll backend is only on Linux,
+// so the same code can be tested on Linux and Windows.
+class Reactor
+{
+public:
+
+    enum Backend : uint8_t { Select = 0, Poll, Epoll };
+
+    // A ready socket, with the data it was registered with
+    struct Event
+    {
+        void *data;
+        uint32_t events;
+    };
+
+    virtual ~Reactor() {}
+
+    // Register a socket, or change the events and data of a registered one
+    virtual void add ( int fd, uint32_t events, void *data ) = 0;
+
+    // Unregister a socket, this must be done before it is closed, unknown sockets are ignored
+    virtual void remove ( int fd ) = 0;
+
+    // Wait up to timeout milliseconds, or forever if UINT64_MAX, until a socket is ready or wakeup is called.
+    // Appends the ready sockets to events, and returns the number of them. Errors are reported as every event the
+    // socket was registered for, so the next read or write on it gets the error.
+    virtual size_t wait ( uint64_t timeout, std::vector<Event>& events ) = 0;
+
+    // Make the current or next wait return, can be called on a different thread
+    virtual void wakeup() = 0;
+
+    // Get the backend
+    virtual Backend getBackend() const = 0;
+
+    // Create a reactor with the given backend, returns null if it isn't supported on this platform
+    static Reactor *create ( Backend backend );
+
+    // Get the best supported backend
+    static Backend getDefaultBackend();
+
+    // Get a backend by name, returns false if the name is unknown
+    static bool getBackend ( const std::string& name, Backend& backend );
+
+    // Get the name of a backend
+    static const char *getBackendName ( Backend backend );
+};
+
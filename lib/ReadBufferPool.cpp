@@ -0,0 +1,64 @@
+#include "ReadBufferPool.hpp"
+#include "Logger.hpp"
+
+using namespace std;
+
+
+char *ReadBufferPool::acquire ( size_t size )
+{
+    ASSERT ( size == READ_SLAB_SIZE || size == READ_OVERSIZED_SIZE );
+
+    const bool oversized = ( size == READ_OVERSIZED_SIZE );
+    vector<char *>& freeSlabs = ( oversized ? _freeOversized : _free );
+
+    if ( freeSlabs.empty() )
+    {
+        if ( oversized )
+            ++_numOversized;
+        else
+            ++_numAllocated;
+
+        // Not zero-filled, since only the bytes that are read are used
+        return new char[size];
+    }
+
+    char *slab = freeSlabs.back();
+    freeSlabs.pop_back();
+    return slab;
+}
+
+void ReadBufferPool::release ( char *slab, size_t size )
+{
+    ASSERT ( size == READ_SLAB_SIZE || size == READ_OVERSIZED_SIZE );
+
+    const bool oversized = ( size == READ_OVERSIZED_SIZE );
+    vector<char *>& freeSlabs = ( oversized ? _freeOversized : _free );
+
+    if ( freeSlabs.size() < ( oversized ? READ_POOL_MAX_OVERSIZED : READ_POOL_MAX_FREE ) )
+    {
+        freeSlabs.push_back ( slab );
+        return;
+    }
+
+    if ( oversized )
+        --_numOversized;
+    else
+        --_numAllocated;
+
+    delete[] slab;
+}
+
+ReadBufferPool::~ReadBufferPool()
+{
+    for ( char *slab : _free )
+        delete[] slab;
+
+    for ( char *slab : _freeOversized )
+        delete[] slab;
+}
+
+ReadBufferPool& ReadBufferPool::get()
+{
+    static ReadBufferPool instance;
+    return instance;
+}
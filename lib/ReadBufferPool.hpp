@@ -0,0 +1,80 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+
+
+// Bytes of each slab, enough for the largest datagram on a 1500 byte Ethernet MTU, which is more than GoBackN sends
+#define READ_SLAB_SIZE          ( 1500 )
+
+// Bytes of each oversized slab, enough for the largest UDP datagram, so datagrams are never truncated
+#define READ_OVERSIZED_SIZE     ( 64 * 1024 )
+
+// Maximum number of free slabs kept for reuse, the rest are freed when released
+#define READ_POOL_MAX_FREE      ( 4 )
+
+// Maximum number of free oversized slabs kept for reuse
+#define READ_POOL_MAX_OVERSIZED ( 1 )
+
+
+// Pool of read buffers shared by all sockets.
+//
+// UDP datagrams only contain whole messages, so UDP sockets don't need to keep any bytes between reads. Instead of
+// a buffer per socket, each read takes a slab from the pool, and returns it once the datagram is decoded. Reads can
+// nest when socket events poll again, so the pool grows to the nesting depth, not the number of sockets.
+//
+// Slabs are sized for the datagrams that are normally received. Larger datagrams are rare, so they are read into
+// separate oversized slabs, which are allocated on demand and mostly freed again.
+//
+// Like SocketManager, this should only be used from the thread that checks the sockets.
+class ReadBufferPool
+{
+public:
+
+    // A slab that is taken from the pool for the lifetime of this object, oversized if len doesn't fit a slab
+    struct Slab
+    {
+        const size_t size;
+        char *const data;
+
+        Slab ( size_t len = 0 )
+            : size ( len > READ_SLAB_SIZE ? READ_OVERSIZED_SIZE : READ_SLAB_SIZE )
+            , data ( ReadBufferPool::get().acquire ( size ) ) {}
+
+        ~Slab() { ReadBufferPool::get().release ( data, size ); }
+    };
+
+    // Take a slab of READ_SLAB_SIZE or READ_OVERSIZED_SIZE bytes, allocates one if none are free
+    char *acquire ( size_t size = READ_SLAB_SIZE );
+
+    // Return a slab of the same size to the pool
+    void release ( char *slab, size_t size = READ_SLAB_SIZE );
+
+    // Get the number of slabs that are allocated, in use or free
+    size_t getNumAllocated() const { return _numAllocated; }
+
+    // Get the number of oversized slabs that are allocated, in use or free
+    size_t getNumOversized() const { return _numOversized; }
+
+    // Get the number of bytes of memory used by the pool
+    size_t getMemoryUsage() const
+    {
+        return _numAllocated * READ_SLAB_SIZE + _numOversized * READ_OVERSIZED_SIZE;
+    }
+
+    // Get the singleton instance
+    static ReadBufferPool& get();
+
+private:
+
+    // Slabs that aren't in use
+    std::vector<char *> _free, _freeOversized;
+
+    size_t _numAllocated = 0, _numOversized = 0;
+
+    // Private constructor, etc. for singleton class
+    ReadBufferPool() {}
+    ~ReadBufferPool();
+    ReadBufferPool ( const ReadBufferPool& );
+    const ReadBufferPool& operator= ( const ReadBufferPool& );
+};
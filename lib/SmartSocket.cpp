@@ -228,6 +228,10 @@ void SmartSocket::socketConnected ( Socket *socket )
 {
     if ( socket == _directSocket.get() || socket == _tunSocket.get() )
     {
+        socket->setHashType ( getHashType() );
+        socket->setSelectiveRepeat ( _selectiveRepeat );
+        socket->setLatency ( _latency );
+
         _sendTimer.reset();
         _connectTimer.reset();
 
@@ -541,6 +545,39 @@ bool SmartSocket::isTunnel() const
     return ( isClient() && _tunSocket && !_tunSocket->getAsUDP().isConnectionLess() && _tunSocket->isConnected() );
 }
 
+void SmartSocket::setHashType ( HashType type )
+{
+    Socket::setHashType ( type );
+
+    if ( _directSocket )
+        _directSocket->setHashType ( type );
+
+    if ( _tunSocket )
+        _tunSocket->setHashType ( type );
+}
+
+void SmartSocket::setSelectiveRepeat ( bool enabled )
+{
+    _selectiveRepeat = enabled;
+
+    if ( _directSocket )
+        _directSocket->setSelectiveRepeat ( enabled );
+
+    if ( _tunSocket )
+        _tunSocket->setSelectiveRepeat ( enabled );
+}
+
+void SmartSocket::setLatency ( const Statistics& latency )
+{
+    _latency = latency;
+
+    if ( _directSocket )
+        _directSocket->setLatency ( latency );
+
+    if ( _tunSocket )
+        _tunSocket->setLatency ( latency );
+}
+
 SocketPtr SmartSocket::accept ( Socket::Owner *owner )
 {
     if ( _isDirectAccept && _directSocket )
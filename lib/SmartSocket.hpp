@@ -43,6 +43,13 @@ public:
     // If this client UDP socket is connected over the UDP tunnel
     bool isTunnel() const;
 
+    // Set the hash type for outgoing messages on the underlying sockets
+    void setHashType ( HashType type ) override;
+
+    // Set selective repeat and the latency on the underlying UDP sockets, including ones connected later
+    void setSelectiveRepeat ( bool enabled ) override;
+    void setLatency ( const Statistics& latency ) override;
+
     // Send raw bytes directly, a return value of false indicates socket is disconnected
     bool send ( const char *buffer, size_t len );
     bool send ( const char *buffer, size_t len, const IpAddrPort& address );
@@ -106,6 +113,10 @@ private:
     // UDP tunnel send timer
     TimerPtr _sendTimer;
 
+    // Applied to the underlying UDP sockets when they connect
+    bool _selectiveRepeat = false;
+    Statistics _latency;
+
     // Unused base socket callback
     void socketRead ( const MsgPtr& msg, const IpAddrPort& address ) override {}
 
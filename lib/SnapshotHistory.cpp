@@ -0,0 +1,227 @@
+#include "SnapshotHistory.hpp"
+#include "Compression.hpp"
+#include "Logger.hpp"
+
+#include <chrono>
+#include <climits>
+
+using namespace std;
+
+
+void SnapshotHistory::start ( size_t recordSize, size_t budget )
+{
+    ASSERT ( recordSize > 0 );
+
+    stop();
+
+    {
+        LOCK ( _mutex );
+
+        _recordSize = recordSize;
+        _budget = budget;
+        _pending.resize ( recordSize );
+        _working.resize ( recordSize );
+        _compressed.resize ( compressBound ( recordSize ) );
+        _hasPending = _isCompressing = _stopping = false;
+        _stats = Stats();
+    }
+
+    _thread.start();
+}
+
+void SnapshotHistory::stop()
+{
+    {
+        LOCK ( _mutex );
+        _stopping = true;
+        _cond.broadcast();
+    }
+
+    _thread.join();
+
+    LOCK ( _mutex );
+
+    _records.clear();
+    _recordsBytes = 0;
+
+    _pending.clear();
+    _pending.shrink_to_fit();
+    _working.clear();
+    _working.shrink_to_fit();
+    _compressed.clear();
+    _compressed.shrink_to_fit();
+
+    _hasPending = false;
+}
+
+char *SnapshotHistory::acquire()
+{
+    LOCK ( _mutex );
+
+    if ( _pending.empty() )
+        return 0;
+
+    if ( _hasPending )
+    {
+        ++_stats.skipped;
+        return 0;
+    }
+
+    return &_pending[0];
+}
+
+void SnapshotHistory::push ( uint64_t key )
+{
+    LOCK ( _mutex );
+
+    ASSERT ( ! _pending.empty() );
+    ASSERT ( ! _hasPending );
+
+    _pendingKey = key;
+    _hasPending = true;
+    _cond.broadcast();
+}
+
+void SnapshotHistory::CompressThread::run()
+{
+    history.compressPending();
+}
+
+void SnapshotHistory::compressPending()
+{
+    LOCK ( _mutex );
+
+    for ( ;; )
+    {
+        while ( ! _hasPending && ! _stopping )
+            _cond.wait ( _mutex );
+
+        if ( _stopping )
+            return;
+
+        // Take the pending record, so the next one can be written while this one is compressed
+        _pending.swap ( _working );
+        _hasPending = false;
+        _isCompressing = true;
+        _discardKey = ULLONG_MAX;
+
+        const uint64_t key = _pendingKey;
+
+        _mutex.unlock();
+
+        const auto start = chrono::steady_clock::now();
+
+        const size_t size = compress ( &_working[0], _recordSize, &_compressed[0], _compressed.size(),
+                                       SNAPSHOT_HISTORY_LEVEL );
+
+        const uint64_t microseconds = chrono::duration_cast<chrono::microseconds> (
+                                          chrono::steady_clock::now() - start ).count();
+
+        _mutex.lock();
+
+        _isCompressing = false;
+        _cond.broadcast();
+
+        // Drop the record if it failed to compress, or was discarded while compressing
+        if ( size == 0 || key > _discardKey )
+            continue;
+
+        ++_stats.compressed;
+        _stats.bytesIn += _recordSize;
+        _stats.bytesOut += size;
+        _stats.microseconds += microseconds;
+
+        // Drop the oldest records to stay within the budget, reusing the memory of the last one dropped
+        vector<char> bytes;
+
+        while ( ! _records.empty() && _recordsBytes + size > _budget )
+        {
+            _recordsBytes -= _records.front().bytes.size();
+            bytes.swap ( _records.front().bytes );
+            _records.pop_front();
+            ++_stats.dropped;
+        }
+
+        if ( size > _budget )
+            continue;
+
+        bytes.assign ( _compressed.begin(), _compressed.begin() + size );
+
+        _records.push_back ( Record { key, vector<char>() } );
+        _records.back().bytes.swap ( bytes );
+        _recordsBytes += size;
+    }
+}
+
+bool SnapshotHistory::load ( uint64_t key, char *record, uint64_t& foundKey ) const
+{
+    LOCK ( _mutex );
+
+    // Keys are mostly increasing, but not strictly, so check all of them
+    const Record *found = 0;
+
+    for ( const Record& r : _records )
+    {
+        if ( r.key <= key && ( ! found || r.key >= found->key ) )
+            found = &r;
+    }
+
+    if ( ! found )
+        return false;
+
+    if ( uncompress ( &found->bytes[0], found->bytes.size(), record, _recordSize ) != _recordSize )
+        return false;
+
+    foundKey = found->key;
+    return true;
+}
+
+void SnapshotHistory::discardAfter ( uint64_t key )
+{
+    LOCK ( _mutex );
+
+    for ( auto it = _records.begin(); it != _records.end(); )
+    {
+        if ( it->key > key )
+        {
+            _recordsBytes -= it->bytes.size();
+            it = _records.erase ( it );
+        }
+        else
+        {
+            ++it;
+        }
+    }
+
+    if ( _hasPending && _pendingKey > key )
+        _hasPending = false;
+
+    if ( _isCompressing && key < _discardKey )
+        _discardKey = key;
+}
+
+void SnapshotHistory::flush()
+{
+    LOCK ( _mutex );
+
+    while ( ( _hasPending || _isCompressing ) && ! _stopping )
+        _cond.wait ( _mutex );
+}
+
+size_t SnapshotHistory::size() const
+{
+    LOCK ( _mutex );
+    return _records.size();
+}
+
+size_t SnapshotHistory::getMemoryUsage() const
+{
+    LOCK ( _mutex );
+    return _recordsBytes + _pending.capacity() + _working.capacity() + _compressed.capacity();
+}
+
+SnapshotHistory::Stats SnapshotHistory::getStats() const
+{
+    LOCK ( _mutex );
+    return _stats;
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+#include "Thread.hpp"
+
+#include <vector>
+#include <deque>
+
+
+// Compression level for the history, the fastest level since it has to keep up with the frame rate
+#define SNAPSHOT_HISTORY_LEVEL ( 1 )
+
+
+// History of fixed size records, compressed in a background thread into a bounded memory budget.
+//
+// Pushing a record never waits for the compression thread. If the thread is still busy with the last record, the
+// new one is skipped, so the spacing of the history adapts to how fast the records can be compressed. When the
+// compressed records exceed the budget, the oldest records are dropped.
+class SnapshotHistory
+{
+public:
+
+    struct Stats
+    {
+        // Number of records compressed, skipped because the thread was busy, and dropped to stay within the budget
+        uint64_t compressed = 0, skipped = 0, dropped = 0;
+
+        // Total input and output bytes of compressed records
+        uint64_t bytesIn = 0, bytesOut = 0;
+
+        // Total time spent compressing in microseconds
+        uint64_t microseconds = 0;
+    };
+
+    ~SnapshotHistory() { stop(); }
+
+    // Start the compression thread, for records of the given size, keeping at most budget bytes compressed
+    void start ( size_t recordSize, size_t budget );
+
+    // Stop the compression thread and free all the records
+    void stop();
+
+    // Let go of the compression thread without joining it, for when threads can't be joined (DLL_PROCESS_DETACH)
+    void release() { _thread.release(); }
+
+    bool isRunning() const { return _thread.isRunning(); }
+
+    // Get the buffer to write the next record to, returns 0 if the compression thread is still busy
+    char *acquire();
+
+    // Queue the acquired buffer for compression, keys should be increasing
+    void push ( uint64_t key );
+
+    // Uncompress the newest record with a key at or before the given key, returns false if none.
+    // The actual key of the record is written to foundKey.
+    bool load ( uint64_t key, char *record, uint64_t& foundKey ) const;
+
+    // Drop all records after the given key, including ones that are still queued
+    void discardAfter ( uint64_t key );
+
+    // Wait until the queued record is compressed
+    void flush();
+
+    // Get the number of compressed records
+    size_t size() const;
+
+    // Get the number of bytes of memory used by the history
+    size_t getMemoryUsage() const;
+
+    Stats getStats() const;
+
+private:
+
+    struct Record
+    {
+        uint64_t key;
+        std::vector<char> bytes;
+    };
+
+    class CompressThread : public Thread
+    {
+    public:
+        CompressThread ( SnapshotHistory& history ) : history ( history ) {}
+        void run() override;
+
+    private:
+        SnapshotHistory& history;
+    };
+
+    CompressThread _thread { *this };
+
+    mutable Mutex _mutex;
+
+    CondVar _cond;
+
+    size_t _recordSize = 0, _budget = 0;
+
+    // Buffer for the next record, and the buffer being compressed by the thread
+    std::vector<char> _pending, _working;
+
+    // Buffer to compress into, large enough for the worst case
+    std::vector<char> _compressed;
+
+    uint64_t _pendingKey = 0;
+
+    bool _hasPending = false, _isCompressing = false, _stopping = false;
+
+    // Smallest key discarded while the working buffer was being compressed
+    uint64_t _discardKey = 0;
+
+    // Compressed records in order of push, and the total bytes used by them
+    std::deque<Record> _records;
+
+    size_t _recordsBytes = 0;
+
+    Stats _stats;
+
+    void compressPending();
+};
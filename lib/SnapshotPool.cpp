@@ -0,0 +1,316 @@
+#include "SnapshotPool.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+
+
+static const char ZeroBlock[SNAPSHOT_BLOCK_SIZE] = { 0 };
+
+
+void SnapshotPool::allocate ( const MemDumpList& list, size_t capacity, size_t keyframeInterval, size_t minSnapshots )
+{
+    ASSERT ( capacity > 0 );
+    ASSERT ( keyframeInterval > 0 );
+    ASSERT ( minSnapshots <= capacity );
+
+    _list = &list;
+    _plan.compile ( list );
+    _keyframeInterval = keyframeInterval;
+
+    // Each keyframe covers keyframeInterval snapshots, plus extra keyframes that are still referenced by older
+    // snapshots when the snapshots are not released in order, or that were saved early instead of a large delta.
+    // When the deltas are too large or the arena is full, every snapshot is a keyframe, so there must also be a
+    // keyframe for each of the minimum number of snapshots. Each snapshot references at most one keyframe, so this
+    // holds no matter how the deltas and keyframes are mixed.
+    const size_t numKeyframes = min ( capacity, max ( capacity / keyframeInterval + 2, minSnapshots ) );
+
+    _keyframeBytes.resize ( numKeyframes * list.totalSize );
+    _keyframeRefs.resize ( numKeyframes );
+    _snapshots.resize ( capacity );
+
+    if ( keyframeInterval > 1 )
+    {
+        _scratch.resize ( list.totalSize );
+
+        // The arena always has room for at least one delta of the maximum size
+        _maxDeltaSize = list.totalSize / 2;
+
+        const size_t maxChunks = ( _maxDeltaSize + SNAPSHOT_DELTA_CHUNK_SIZE - 1 ) / SNAPSHOT_DELTA_CHUNK_SIZE;
+        const size_t numChunks = max ( maxChunks, capacity * list.totalSize / SNAPSHOT_DELTA_ARENA_DIVISOR
+                                       / SNAPSHOT_DELTA_CHUNK_SIZE );
+
+        _deltaArena.resize ( numChunks * SNAPSHOT_DELTA_CHUNK_SIZE );
+
+        for ( Snapshot& snapshot : _snapshots )
+            snapshot.chunks.reserve ( maxChunks );
+    }
+
+    clear();
+}
+
+void SnapshotPool::deallocate()
+{
+    _list = 0;
+    _plan.clear();
+
+    _keyframeBytes.clear();
+    _keyframeBytes.shrink_to_fit();
+    _keyframeRefs.clear();
+    _snapshots.clear();
+    _freeSnapshots.clear();
+    _freeKeyframes.clear();
+    _scratch.clear();
+    _scratch.shrink_to_fit();
+    _deltaArena.clear();
+    _deltaArena.shrink_to_fit();
+    _freeChunks.clear();
+    _maxDeltaSize = 0;
+}
+
+void SnapshotPool::clear()
+{
+    _freeSnapshots.clear();
+    _freeKeyframes.clear();
+
+    // Free ids are popped from the back, so the lowest ids are used first
+    for ( size_t i = _snapshots.size(); i > 0; --i )
+        _freeSnapshots.push_back ( i - 1 );
+
+    for ( size_t i = _keyframeRefs.size(); i > 0; --i )
+    {
+        _keyframeRefs[i - 1] = 0;
+        _freeKeyframes.push_back ( i - 1 );
+    }
+
+    _freeChunks.clear();
+
+    for ( size_t i = _deltaArena.size() / SNAPSHOT_DELTA_CHUNK_SIZE; i > 0; --i )
+        _freeChunks.push_back ( i - 1 );
+
+    for ( Snapshot& snapshot : _snapshots )
+    {
+        snapshot.chunks.clear();
+        snapshot.deltaSize = 0;
+    }
+
+    _currentKeyframe = _keyframeRefs.size();
+    _sinceKeyframe = 0;
+}
+
+size_t SnapshotPool::save()
+{
+    ASSERT ( _list != 0 );
+    ASSERT ( ! full() );
+
+    const size_t id = _freeSnapshots.back();
+    _freeSnapshots.pop_back();
+
+    Snapshot& snapshot = _snapshots[id];
+
+    bool isKeyframe = ( _currentKeyframe == _keyframeRefs.size() || _sinceKeyframe >= _keyframeInterval );
+
+    // Save a keyframe instead if the changes are too large for a delta
+    if ( ! isKeyframe && ! saveDelta ( getKeyframe ( _currentKeyframe ), snapshot ) )
+    {
+        releaseDelta ( snapshot );
+        isKeyframe = true;
+    }
+
+    if ( isKeyframe )
+    {
+        ASSERT ( ! _freeKeyframes.empty() );
+
+        _currentKeyframe = _freeKeyframes.back();
+        _freeKeyframes.pop_back();
+        _sinceKeyframe = 0;
+
+        _plan.saveDump ( getKeyframe ( _currentKeyframe ) );
+    }
+
+    snapshot.isKeyframe = isKeyframe;
+
+    snapshot.keyframe = _currentKeyframe;
+    ++_keyframeRefs[_currentKeyframe];
+    ++_sinceKeyframe;
+    return id;
+}
+
+bool SnapshotPool::saveDelta ( const char *keyframe, Snapshot& snapshot )
+{
+    size_t runStart = 0, runEnd = 0;
+    uint32_t run[2] = { 0, 0 };
+    bool inRun = false, saved = true;
+
+    auto saveChangedBlocks = [&] ( const char *addr, size_t offset, size_t size )
+    {
+        for ( size_t i = 0; saved && i < size; i += SNAPSHOT_BLOCK_SIZE )
+        {
+            const size_t len = min ( size - i, ( size_t ) SNAPSHOT_BLOCK_SIZE );
+            const char *src = ( addr ? addr + i : ZeroBlock );
+
+            if ( memcmp ( src, keyframe + offset + i, len ) == 0 )
+                continue;
+
+            // Extend the current run if the blocks are adjacent, otherwise start a new run
+            if ( ! inRun || runEnd != offset + i )
+            {
+                runStart = snapshot.deltaSize;
+                run[0] = offset + i;
+                run[1] = 0;
+                inRun = true;
+
+                snapshot.deltaSize += sizeof ( run );
+            }
+
+            run[1] += len;
+            runEnd = offset + i + len;
+
+            saved = ( snapshot.deltaSize + len <= _maxDeltaSize
+                      && writeDelta ( snapshot, runStart, run, sizeof ( run ) )
+                      && writeDelta ( snapshot, snapshot.deltaSize, src, len ) );
+
+            snapshot.deltaSize += len;
+        }
+    };
+
+    _plan.forEachDump ( saveChangedBlocks );
+
+    return saved;
+}
+
+bool SnapshotPool::writeDelta ( Snapshot& snapshot, size_t pos, const void *src, size_t len )
+{
+    while ( snapshot.chunks.size() * SNAPSHOT_DELTA_CHUNK_SIZE < pos + len )
+    {
+        if ( _freeChunks.empty() )
+            return false;
+
+        snapshot.chunks.push_back ( _freeChunks.back() );
+        _freeChunks.pop_back();
+    }
+
+    const char *bytes = ( const char * ) src;
+
+    while ( len )
+    {
+        const size_t offset = pos % SNAPSHOT_DELTA_CHUNK_SIZE;
+        const size_t count = min ( len, SNAPSHOT_DELTA_CHUNK_SIZE - offset );
+
+        memcpy ( &_deltaArena[snapshot.chunks[pos / SNAPSHOT_DELTA_CHUNK_SIZE] * SNAPSHOT_DELTA_CHUNK_SIZE + offset],
+                 bytes, count );
+
+        bytes += count;
+        pos += count;
+        len -= count;
+    }
+
+    return true;
+}
+
+void SnapshotPool::readDelta ( const Snapshot& snapshot, size_t pos, void *dst, size_t len ) const
+{
+    ASSERT ( pos + len <= snapshot.deltaSize );
+
+    char *bytes = ( char * ) dst;
+
+    while ( len )
+    {
+        const size_t offset = pos % SNAPSHOT_DELTA_CHUNK_SIZE;
+        const size_t count = min ( len, SNAPSHOT_DELTA_CHUNK_SIZE - offset );
+
+        memcpy ( bytes, &_deltaArena[snapshot.chunks[pos / SNAPSHOT_DELTA_CHUNK_SIZE] * SNAPSHOT_DELTA_CHUNK_SIZE
+                                     + offset], count );
+
+        bytes += count;
+        pos += count;
+        len -= count;
+    }
+}
+
+void SnapshotPool::releaseDelta ( Snapshot& snapshot )
+{
+    _freeChunks.insert ( _freeChunks.end(), snapshot.chunks.begin(), snapshot.chunks.end() );
+
+    snapshot.chunks.clear();
+    snapshot.deltaSize = 0;
+}
+
+void SnapshotPool::load ( size_t id )
+{
+    ASSERT ( _list != 0 );
+    ASSERT ( id < _snapshots.size() );
+
+    const Snapshot& snapshot = _snapshots[id];
+
+    const char *dump = getKeyframe ( snapshot.keyframe );
+
+    if ( snapshot.deltaSize )
+    {
+        copy ( id, &_scratch[0] );
+        dump = &_scratch[0];
+    }
+
+    _plan.loadDump ( dump );
+}
+
+void SnapshotPool::copy ( size_t id, char *dump ) const
+{
+    ASSERT ( _list != 0 );
+    ASSERT ( id < _snapshots.size() );
+
+    const Snapshot& snapshot = _snapshots[id];
+
+    const char *keyframe = getKeyframe ( snapshot.keyframe );
+
+    std::copy ( keyframe, keyframe + _list->totalSize, dump );
+
+    applyDelta ( snapshot, dump );
+}
+
+void SnapshotPool::applyDelta ( const Snapshot& snapshot, char *dump ) const
+{
+    for ( size_t pos = 0; pos < snapshot.deltaSize; )
+    {
+        uint32_t run[2];
+        readDelta ( snapshot, pos, run, sizeof ( run ) );
+        pos += sizeof ( run );
+
+        ASSERT ( run[0] + run[1] <= _list->totalSize );
+
+        readDelta ( snapshot, pos, dump + run[0], run[1] );
+        pos += run[1];
+    }
+}
+
+void SnapshotPool::release ( size_t id )
+{
+    ASSERT ( id < _snapshots.size() );
+
+    const size_t keyframe = _snapshots[id].keyframe;
+
+    releaseDelta ( _snapshots[id] );
+
+    ASSERT ( _keyframeRefs[keyframe] > 0 );
+
+    if ( --_keyframeRefs[keyframe] == 0 )
+    {
+        _freeKeyframes.push_back ( keyframe );
+
+        if ( keyframe == _currentKeyframe )
+            _currentKeyframe = _keyframeRefs.size();
+    }
+
+    _freeSnapshots.push_back ( id );
+}
+
+size_t SnapshotPool::getMemoryUsage() const
+{
+    size_t usage = _keyframeBytes.size() + _scratch.size() + _deltaArena.size();
+
+    for ( const Snapshot& snapshot : _snapshots )
+        usage += snapshot.chunks.capacity() * sizeof ( uint32_t );
+
+    return usage;
+}
@@ -0,0 +1,137 @@
+#pragma once
+
+#include "MemDumpPlan.hpp"
+
+#include <vector>
+
+
+// Size of the blocks compared to find the memory that changed since the last keyframe
+#define SNAPSHOT_BLOCK_SIZE ( 64 )
+
+// Size of the chunks of the preallocated delta arena
+#define SNAPSHOT_DELTA_CHUNK_SIZE ( 4096 )
+
+// The delta arena has 1 / SNAPSHOT_DELTA_ARENA_DIVISOR of the full memory size for each snapshot
+#define SNAPSHOT_DELTA_ARENA_DIVISOR ( 4 )
+
+
+// Pool of snapshots of the memory in a MemDumpList.
+//
+// Every keyframeInterval snapshots, a full copy of the memory is saved as a keyframe. The snapshots in between only
+// store the blocks that changed since their keyframe, so saving doesn't write unchanged memory, and each snapshot
+// can be loaded or released independently of the others.
+//
+// The changed blocks are written to fixed size chunks of an arena allocated up front, so saving never allocates.
+// If the changes would be larger than half the memory, or the arena is out of chunks, a keyframe is saved instead.
+class SnapshotPool
+{
+public:
+
+    // Allocate memory for the given number of snapshots of the memory dump list.
+    // A keyframe interval of 1 saves a full copy of the memory for every snapshot.
+    // At least minSnapshots can always be saved before the pool is full, even if every snapshot is saved as a keyframe.
+    void allocate ( const MemDumpList& list, size_t capacity, size_t keyframeInterval, size_t minSnapshots );
+    void deallocate();
+
+    // Release all snapshots, but keep the allocated memory
+    void clear();
+
+    // Save the current memory to an unused snapshot, returns the id of the snapshot
+    size_t save();
+
+    // Load the current memory from the given snapshot
+    void load ( size_t id );
+
+    // Copy the given snapshot to a full memory dump of _list->totalSize bytes, without loading it
+    void copy ( size_t id, char *dump ) const;
+
+    // Save / load the current memory to / from a full memory dump
+    void saveDump ( char *dump ) const { _plan.saveDump ( dump ); }
+    void loadDump ( const char *dump ) const { _plan.loadDump ( dump ); }
+
+    // Release the given snapshot so it can be reused
+    void release ( size_t id );
+
+    // True if all the snapshots are in use, or all the keyframes are still referenced.
+    // Snapshots must be released until this is false before saving.
+    bool full() const { return _freeSnapshots.empty() || _freeKeyframes.empty(); }
+
+    // True if the given snapshot was saved as a keyframe
+    bool isKeyframe ( size_t id ) const { return _snapshots[id].isKeyframe; }
+
+    // Get the number of bytes changed since the keyframe of the given snapshot
+    size_t getDeltaSize ( size_t id ) const { return _snapshots[id].deltaSize; }
+
+    // Get the number of bytes of memory used by the pool
+    size_t getMemoryUsage() const;
+
+private:
+
+    struct Snapshot
+    {
+        // The keyframe this snapshot is based on
+        size_t keyframe = 0;
+
+        // If this snapshot is the keyframe itself
+        bool isKeyframe = false;
+
+        // Runs of blocks changed since the keyframe, each run is a uint32_t offset and size followed by the bytes.
+        // The bytes are stored in order in the arena chunks, the chunk ids are reserved up front.
+        std::vector<uint32_t> chunks;
+
+        // Number of bytes of runs
+        size_t deltaSize = 0;
+    };
+
+    // The memory being saved
+    const MemDumpList *_list = 0;
+
+    // The list compiled for saving full copies
+    MemDumpPlan _plan;
+
+    size_t _keyframeInterval = 1;
+
+    // Full copies of the memory, each keyframe is _list->totalSize bytes
+    std::vector<char> _keyframeBytes;
+
+    // Number of snapshots using each keyframe
+    std::vector<size_t> _keyframeRefs;
+
+    // The keyframe new snapshots are based on, or _keyframeRefs.size() if none
+    size_t _currentKeyframe = 0;
+
+    // Number of snapshots saved since the current keyframe
+    size_t _sinceKeyframe = 0;
+
+    std::vector<Snapshot> _snapshots;
+
+    // Unused snapshot and keyframe ids
+    std::vector<size_t> _freeSnapshots, _freeKeyframes;
+
+    // Buffer used to reconstruct snapshots before loading them
+    std::vector<char> _scratch;
+
+    // Preallocated chunks of SNAPSHOT_DELTA_CHUNK_SIZE bytes that the deltas are written to, and the unused ids
+    std::vector<char> _deltaArena;
+    std::vector<uint32_t> _freeChunks;
+
+    // Deltas larger than this are saved as keyframes instead
+    size_t _maxDeltaSize = 0;
+
+    char *getKeyframe ( size_t keyframe ) { return &_keyframeBytes[keyframe * _list->totalSize]; }
+
+    const char *getKeyframe ( size_t keyframe ) const { return &_keyframeBytes[keyframe * _list->totalSize]; }
+
+    // Save the blocks changed since the keyframe, returns false if the delta is too large or the arena is full
+    bool saveDelta ( const char *keyframe, Snapshot& snapshot );
+
+    // Write / read the bytes of a delta at the given position, writing returns false if the arena is full
+    bool writeDelta ( Snapshot& snapshot, size_t pos, const void *src, size_t len );
+    void readDelta ( const Snapshot& snapshot, size_t pos, void *dst, size_t len ) const;
+
+    // Return the chunks of a delta to the arena
+    void releaseDelta ( Snapshot& snapshot );
+
+    // Apply the changed blocks of a snapshot to a copy of its keyframe
+    void applyDelta ( const Snapshot& snapshot, char *dump ) const;
+};
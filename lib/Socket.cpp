@@ -3,6 +3,7 @@
 #include "TcpSocket.hpp"
 #include "UdpSocket.hpp"
 #include "SmartSocket.hpp"
+#include "ReadBufferPool.hpp"
 #include "Exceptions.hpp"
 #include "ErrorStrings.hpp"
 
@@ -18,8 +19,18 @@
 using namespace std;
 
 
+// Maximum size of the TCP read buffer, which limits the size of a message
 #define READ_BUFFER_SIZE ( 1024 * 4096 )
 
+// The TCP read buffer grows by this many bytes when there is less room than this to read into
+#define READ_CHUNK_SIZE ( 16 * 1024 )
+
+// Maximum number of datagrams read from a UDP socket per read event, so one socket can't starve the others
+#define MAX_READS_PER_EVENT ( 64 )
+
+// Queued datagrams to the same address are combined up to this size, so they aren't fragmented on any path
+#define MAX_BATCHED_DATAGRAM_SIZE ( MIN_DATAGRAM_SIZE )
+
 #define SET_NON_BLOCKING_MODE(VALUE)                                                                                \
     do {                                                                                                            \
         u_long flag = VALUE;                                                                                        \
@@ -50,6 +61,9 @@ void Socket::disconnect()
 {
     LOG_SOCKET ( this, "disconnected" );
 
+    // Send anything queued before closing, eg UdpControl::Disconnect
+    flushSends();
+
     if ( _fd )
         closesocket ( _fd );
 
@@ -233,12 +247,12 @@ bool Socket::send ( const char *buffer, size_t len )
 
         if ( isTCP() )
         {
-            LOG_SOCKET ( this, "send ( [ %u bytes ] )", len );
+            LOG_SOCKET_TRACE ( this, "send ( [ %u bytes ] )", len );
             sentBytes = ::send ( _fd, buffer, len, 0 );
         }
         else
         {
-            LOG_SOCKET ( this, "sendto ( [ %u bytes ], '%s' )", len, address );
+            LOG_SOCKET_TRACE ( this, "sendto ( [ %u bytes ], '%s' )", len, address );
             sentBytes = ::sendto ( _fd, buffer, len, 0,
                                    address.getAddrInfo()->ai_addr, address.getAddrInfo()->ai_addrlen );
         }
@@ -284,11 +298,23 @@ bool Socket::send ( const char *buffer, size_t len, const IpAddrPort& address )
     ASSERT ( _fd != 0 );
     ASSERT ( address.addr.empty() == false );
 
+    // Raw datagrams aren't combined, since they might not be decoded as protocol messages
+    if ( SocketManager::get().isBatching() && ! _isRaw && len > 0 )
+    {
+        queueSend ( buffer, len, address );
+        return true;
+    }
+
+    return sendTo ( buffer, len, address );
+}
+
+bool Socket::sendTo ( const char *buffer, size_t len, const IpAddrPort& address )
+{
     size_t totalBytes = 0;
 
     while ( totalBytes < len || len == 0 )
     {
-        LOG_SOCKET ( this, "sendto ( [ %u bytes ], '%s' )", len, address );
+        LOG_SOCKET_TRACE ( this, "sendto ( [ %u bytes ], '%s' )", len, address );
         int sentBytes = ::sendto ( _fd, buffer, len, 0,
                                    address.getAddrInfo()->ai_addr, address.getAddrInfo()->ai_addrlen );
 
@@ -307,6 +333,43 @@ bool Socket::send ( const char *buffer, size_t len, const IpAddrPort& address )
     return true;
 }
 
+void Socket::queueSend ( const char *buffer, size_t len, const IpAddrPort& address )
+{
+    if ( _sendQueue.empty() )
+        SocketManager::get().addBatched ( this );
+
+    // Only the last datagram to an address can be appended to, so messages stay in order
+    for ( auto it = _sendQueue.rbegin(); it != _sendQueue.rend(); ++it )
+    {
+        if ( it->address != address )
+            continue;
+
+        if ( it->bytes.size() + len > MAX_BATCHED_DATAGRAM_SIZE )
+            break;
+
+        it->bytes.append ( buffer, len );
+        return;
+    }
+
+    _sendQueue.push_back ( { address, string ( buffer, len ) } );
+}
+
+void Socket::flushSends()
+{
+    if ( _sendQueue.empty() )
+        return;
+
+    LOG_SOCKET_TRACE ( this, "Flushing [ %u datagrams ]", _sendQueue.size() );
+
+    if ( _fd )
+    {
+        for ( const QueuedDatagram& datagram : _sendQueue )
+            sendTo ( &datagram.bytes[0], datagram.bytes.size(), datagram.address );
+    }
+
+    _sendQueue.clear();
+}
+
 int Socket::recv ( char *buffer, size_t& len )
 {
     ASSERT ( isClient() == true );
@@ -345,9 +408,23 @@ int Socket::recvfrom ( char *buffer, size_t& len, IpAddrPort& address )
 
 void Socket::resetBuffer()
 {
-    _readBuffer.reserve ( READ_BUFFER_SIZE );
-    _readBuffer.resize ( READ_BUFFER_SIZE, ( char ) 0 );
-    _readPos = 0;
+    // The buffer is allocated again by the next TCP read
+    freeBuffer();
+}
+
+void Socket::growBuffer()
+{
+    if ( _readBuffer.size() - _readPos >= READ_CHUNK_SIZE )
+        return;
+
+    // A message can't be bigger than the maximum size, so a full buffer will never be decoded
+    if ( _readPos >= READ_BUFFER_SIZE )
+    {
+        LOG ( "Clearing full buffer!" );
+        _readPos = 0;
+    }
+
+    _readBuffer.resize ( min ( _readPos + READ_CHUNK_SIZE, ( size_t ) READ_BUFFER_SIZE ), ( char ) 0 );
 }
 
 void Socket::freeBuffer()
@@ -365,18 +442,56 @@ void Socket::consumeBuffer ( size_t bytes )
     // Erase the consumed bytes (shifting the array)
     ASSERT ( bytes <= _readPos );
     _readBuffer.erase ( 0, bytes );
-    _readBuffer.reserve ( READ_BUFFER_SIZE );
-    _readBuffer.resize ( READ_BUFFER_SIZE, ( char ) 0 );
     _readPos -= bytes;
+
+    // Free the memory once a large message has been consumed
+    if ( _readPos == 0 && _readBuffer.capacity() > 2 * READ_CHUNK_SIZE )
+        freeBuffer();
 }
 
 void Socket::socketRead()
 {
+    // Read every datagram that is queued, since the socket is only ready again once new data arrives
+    const size_t maxReads = ( isUDP() ? MAX_READS_PER_EVENT : 1 );
+
+    for ( size_t i = 0; i < maxReads; ++i )
+    {
+        if ( ! readOnce() )
+            return;
+    }
+}
+
+bool Socket::readOnce()
+{
+    // UDP datagrams only contain whole messages, so they are read into a pooled slab that is only used for this read
+    if ( isUDP() )
+    {
+        // FIONREAD is the size of the next datagram, or of every queued datagram on Windows, so it is never less
+        // than the next datagram. It is only checked again once that many bytes have been read.
+        if ( _pendingBytes == 0 )
+        {
+            u_long pending = 0;
+
+            // Use an oversized slab if the size is unknown
+            if ( ioctlsocket ( _fd, FIONREAD, &pending ) != 0 )
+                pending = READ_OVERSIZED_SIZE;
+
+            _pendingBytes = pending;
+        }
+
+        ReadBufferPool::Slab slab ( _pendingBytes );
+        return readOnce ( slab.data, slab.size );
+    }
+
+    growBuffer();
+
     ASSERT ( _readPos < _readBuffer.size() );
 
-    char *bufferStart = &_readBuffer[_readPos];
-    size_t bufferLen = _readBuffer.size() - _readPos;
+    return readOnce ( &_readBuffer[_readPos], _readBuffer.size() - _readPos );
+}
 
+bool Socket::readOnce ( char *bufferStart, size_t bufferLen )
+{
     IpAddrPort address = getRemoteAddress();
     int error = 0;
 
@@ -385,19 +500,22 @@ void Socket::socketRead()
     else
         error = Socket::recvfrom ( bufferStart, bufferLen, address );
 
+    if ( isUDP() )
+        _pendingBytes = ( ( error || bufferLen >= _pendingBytes ) ? 0 : _pendingBytes - bufferLen );
+
     if ( error )
     {
+        // Skip blocking reads, this is how reading UDP datagrams normally ends
+        if ( error == WSAEWOULDBLOCK )
+            return false;
+
         LOG_SOCKET ( this, "[%d] %s; %s failed",
                      error, WinException::getAsString ( error ), ( isTCP() ? "recv" : "recvfrom" ) );
 
-        // Skip blocking reads
-        if ( error == WSAEWOULDBLOCK )
-            return;
-
         // WSAECONNRESET does not mean the UDP socket is dead, it just means Windows is reporting:
         // http://en.wikipedia.org/wiki/Internet_Control_Message_Protocol#Destination_unreachable
         if ( isUDP() && error == WSAECONNRESET )
-            return;
+            return true;
 
         // Disconnect the socket if an error occurred during read
         LOG_SOCKET ( this, "disconnect due to read error" );
@@ -406,77 +524,129 @@ void Socket::socketRead()
             socketDisconnected();
         else
             disconnect();
-        return;
+        return false;
     }
 
 #ifndef RELEASE
     // Simulated packet loss
     if ( rand() % 100 < _packetLoss )
     {
-        LOG ( "Discarding [ %u bytes ] from '%s'", bufferLen, address );
-        return;
+        LOG_DEBUG ( LOG_MODULE_SOCKET, "Discarding [ %u bytes ] from '%s'", bufferLen, address );
+        return true;
     }
 #endif
 
     // Raw read mode
     if ( _isRaw )
     {
-        LOG ( "Read [ %u bytes ] from '%s'", bufferLen, address );
+        LOG_TRACE ( LOG_MODULE_SOCKET, "Read [ %u bytes ] from '%s'", bufferLen, address );
 
         if ( owner )
             owner->socketRead ( this, bufferStart, bufferLen, address );
-        return;
+
+        return isReadable();
     }
 
+    if ( isUDP() )
+        return decodeDatagram ( bufferStart, bufferLen, address );
+
     // Increment the buffer position
     _readPos += bufferLen;
-    LOG ( "Read [ %u bytes ] from '%s'; %u bytes remaining in buffer", bufferLen, address, _readPos );
-
-    // Handle zero byte packets
-    if ( bufferLen == 0 )
-    {
-        LOG ( "Decoded 'NullMsg' using [ 0 bytes ]" );
-        socketRead ( NullMsg, address );
-        return;
-    }
+    LOG_TRACE ( LOG_MODULE_SOCKET, "Read [ %u bytes ] from '%s'; %u bytes remaining in buffer",
+                bufferLen, address, _readPos );
 
     if ( bufferLen <= 256 )
-        LOG ( "Hex: %s", formatAsHex ( bufferStart, bufferLen ) );
+        LOG_TRACE ( LOG_MODULE_SOCKET, "Hex: %s", formatAsHex ( bufferStart, bufferLen ) );
 
     // Check if the first byte is a valid message type
     if ( _readPos >= sizeof ( MsgType ) && ! ::Protocol::checkMsgType ( * ( MsgType * ) &_readBuffer[0] ) )
     {
         LOG ( "Clearing invalid buffer!" );
         resetBuffer();
-        return;
+        return true;
     }
 
     // Try to decode as many messages from the buffer as possible
     for ( ;; )
     {
         size_t consumedBytes = 0;
-        MsgPtr msg = ::Protocol::decode ( &_readBuffer[0], _readPos, consumedBytes );
+        MsgPtr msg = ::Protocol::decode ( &_readBuffer[0], _readPos, consumedBytes, _msgBuffer );
         consumeBuffer ( consumedBytes );
 
         // Abort if a message could not be decoded
         if ( ! msg.get() )
-            return;
+            return true;
 
-        LOG ( "Decoded '%s' using [ %u bytes ]; %u bytes remaining in buffer", msg, consumedBytes, _readPos );
+        LOG_TRACE ( LOG_MODULE_SOCKET, "Decoded '%s' using [ %u bytes ]; %u bytes remaining in buffer",
+                    msg, consumedBytes, _readPos );
         socketRead ( msg, address );
 
-        // Abort if the socket is de-allocated
-        if ( ! SocketManager::get().isAllocated ( this ) )
-            return;
+        // Abort if the socket is de-allocated or disconnected
+        if ( ! isReadable() )
+            return false;
+    }
+}
 
-        // Abort if socket is disconnected
-        if ( isDisconnected() )
-            return;
+bool Socket::decodeDatagram ( const char *buffer, size_t len, const IpAddrPort& address )
+{
+    LOG_TRACE ( LOG_MODULE_SOCKET, "Read [ %u bytes ] from '%s'", len, address );
+
+    // Handle zero byte packets
+    if ( len == 0 )
+    {
+        LOG_TRACE ( LOG_MODULE_SOCKET, "Decoded 'NullMsg' using [ 0 bytes ]" );
+        socketRead ( NullMsg, address );
+        return isReadable();
+    }
+
+    if ( len <= 256 )
+        LOG_TRACE ( LOG_MODULE_SOCKET, "Hex: %s", formatAsHex ( buffer, len ) );
+
+    // Check if the first byte is a valid message type
+    if ( len >= sizeof ( MsgType ) && ! ::Protocol::checkMsgType ( * ( const MsgType * ) buffer ) )
+    {
+        LOG ( "Discarding [ %u bytes ] with an invalid message type", len );
+        return true;
+    }
+
+    // Every message in the datagram must use the hash type negotiated with the address it is from
+    const HashType hashType = getHashTypeFrom ( address );
+
+    // Decode every message in the datagram
+    for ( size_t pos = 0;; )
+    {
+        size_t consumedBytes = 0;
+        MsgPtr msg = ::Protocol::decode ( buffer + pos, len - pos, consumedBytes, _msgBuffer, hashType );
+        pos += consumedBytes;
+
+        // The remaining bytes of a datagram will never be decoded
+        if ( ! msg.get() )
+        {
+            if ( pos < len )
+                LOG ( "Discarding [ %u bytes ] that could not be decoded", len - pos );
+            return true;
+        }
+
+        LOG_TRACE ( LOG_MODULE_SOCKET, "Decoded '%s' using [ %u bytes ]; %u bytes remaining in datagram",
+                    msg, consumedBytes, len - pos );
+        socketRead ( msg, address );
+
+        // Abort if the socket is de-allocated or disconnected
+        if ( ! isReadable() )
+            return false;
     }
 }
 
+bool Socket::isReadable()
+{
+    // Check if de-allocated first, since this can be called after the socket is deleted by its owner
+    return ( SocketManager::get().isAllocated ( this ) && ! isDisconnected() );
+}
+
 MsgPtr Socket::share ( int processId )
 {
+    flushSends();
+
     shared_ptr<WSAPROTOCOL_INFO> info ( new WSAPROTOCOL_INFO() );
 
     if ( WSADuplicateSocket ( _fd, processId, info.get() ) )
@@ -499,7 +669,9 @@ MsgPtr Socket::share ( int processId )
     LOG ( "Sharing:" );
     LOG ( "address='%s'; protocol=%s; state=%s", address, protocol, _state );
 
-    return MsgPtr ( new SocketShareData ( address, protocol, _readBuffer, _readPos, _state, info ) );
+    // Only the bytes that haven't been decoded yet
+    return MsgPtr ( new SocketShareData ( address, protocol, _readBuffer.substr ( 0, _readPos ), _readPos, _state,
+                                          info ) );
 }
 
 SocketShareData::SocketShareData ( const IpAddrPort& address,
@@ -15,6 +15,10 @@
     LOG ( "%s socket=%08x; fd=%08x; state=%s; address='%s'; isRaw=%u; " FORMAT,                                     \
           SOCKET->protocol, SOCKET, SOCKET->_fd, SOCKET->_state, SOCKET->address, SOCKET->_isRaw, ## __VA_ARGS__ )
 
+#define LOG_SOCKET_TRACE(SOCKET, FORMAT, ...)                                                                       \
+    LOG_TRACE ( LOG_MODULE_SOCKET, "%s socket=%08x; fd=%08x; state=%s; address='%s'; isRaw=%u; " FORMAT,            \
+                SOCKET->protocol, SOCKET, SOCKET->_fd, SOCKET->_state, SOCKET->address, SOCKET->_isRaw, ## __VA_ARGS__ )
+
 
 // Forward declarations
 struct _WSAPROTOCOL_INFOA;
@@ -116,6 +120,22 @@ public:
     // Set the check sum fail percentage for testing purposes
     void setCheckSumFail ( uint8_t percentage );
 
+    // Set the hash type for outgoing messages, this should only be changed once the remote supports it.
+    // Incoming messages are only accepted with the same hash type, see getHashTypeFrom ( address ).
+    virtual void setHashType ( HashType type ) { _msgBuffer.hashType = type; }
+    HashType getHashType() const { return _msgBuffer.hashType; }
+
+    // Get the hash type that incoming messages from an address must use.
+    // UDP server sockets use the hash type of the child socket for that address.
+    virtual HashType getHashTypeFrom ( const IpAddrPort& address ) const { return _msgBuffer.hashType; }
+
+    // Enable selective repeat for sequenced messages, this should only be enabled once the remote supports it.
+    // Only UDP sockets resend messages, so this does nothing on other sockets.
+    virtual void setSelectiveRepeat ( bool enabled ) {}
+
+    // Seed the retransmit timeout of sequenced messages with the latency measured by Pinger
+    virtual void setLatency ( const Statistics& latency ) {}
+
     // Cast this to another socket type
     TcpSocket& getAsTCP();
     const TcpSocket& getAsTCP() const;
@@ -135,17 +155,33 @@ public:
 
 protected:
 
-    // Socket read buffer
+    // TCP read buffer, this is allocated by the first read and grows as needed, UDP sockets read into pooled slabs
     std::string _readBuffer;
 
-    // The position for the next read event.
+    // Reusable buffer for encoding / decoding protocol messages
+    MsgBuffer _msgBuffer;
+
+    // The position for the next read event, only used by TCP sockets.
     // In raw mode, this should be manually updated, otherwise each read will at the same position.
     // In message mode, this is automatically managed, and is only reset when a decode fails.
     size_t _readPos = 0;
 
+    // Bytes of queued UDP datagrams that are known to fit the next reads, only used by UDP sockets
+    size_t _pendingBytes = 0;
+
     // Raw socket type flag
     bool _isRaw = false;
 
+    // UDP datagram queued while SocketManager is batching
+    struct QueuedDatagram
+    {
+        IpAddrPort address;
+        std::string bytes;
+    };
+
+    // UDP datagrams to send when the batch ends, in the order they were sent
+    std::vector<QueuedDatagram> _sendQueue;
+
     // Connection state
     State _state = State::Disconnected;
 
@@ -161,9 +197,12 @@ protected:
     // Hash failure percentage for testing purposes
     uint8_t _hashFailRate = 0;
 
-    // Reset the read buffer to its initial size
+    // Reset the read buffer to empty
     void resetBuffer();
 
+    // Make room in the read buffer for the next TCP read
+    void growBuffer();
+
     // Free the read buffer
     void freeBuffer();
 
@@ -187,6 +226,28 @@ protected:
     // Read raw bytes directly, 0 on success, otherwise returns the socket error code
     int recv ( char *buffer, size_t& len );
     int recvfrom ( char *buffer, size_t& len, IpAddrPort& address );
+
+    // Read once, returns true if this socket should be read again for the same read event
+    bool readOnce();
+    bool readOnce ( char *bufferStart, size_t bufferLen );
+
+    // Decode the messages in a UDP datagram, returns false if this socket can't be read anymore
+    bool decodeDatagram ( const char *buffer, size_t len, const IpAddrPort& address );
+
+    // Check if this socket is still allocated and not disconnected
+    bool isReadable();
+
+    // Send a UDP datagram now
+    bool sendTo ( const char *buffer, size_t len, const IpAddrPort& address );
+
+    // Queue a UDP datagram until the batch ends
+    void queueSend ( const char *buffer, size_t len, const IpAddrPort& address );
+
+    // Send the queued UDP datagrams
+    void flushSends();
+
+    // Send the ACKs that weren't piggybacked during the batch, called before the queued datagrams are sent
+    virtual void sendPendingAcks() {}
 };
 
 
@@ -7,103 +7,157 @@
 #include <winsock2.h>
 #include <windows.h>
 
+#include <algorithm>
+
 using namespace std;
 
 
-void SocketManager::check ( uint64_t timeout )
+bool SocketManager::check ( uint64_t timeout )
 {
     if ( ! _initialized )
-        return;
-
-    if ( _changed )
-    {
-        for ( Socket *socket : _allocatedSockets )
-        {
-            if ( _activeSockets.find ( socket ) != _activeSockets.end() )
-                continue;
-
-            LOG_SOCKET ( socket, "added" );
-            _activeSockets.insert ( socket );
-        }
-
-        for ( auto it = _activeSockets.cbegin(); it != _activeSockets.cend(); )
-        {
-            if ( _allocatedSockets.find ( *it ) != _allocatedSockets.end() )
-            {
-                ++it;
-                continue;
-            }
-
-            LOG ( "socket=%08x removed", *it ); // Don't log any extra data cus already deleted
-            _activeSockets.erase ( it++ );
-        }
-
-        _changed = false;
-    }
-
-    if ( _activeSockets.empty() )
-        return;
-
-    fd_set readFds, writeFds;
-    FD_ZERO ( &readFds );
-    FD_ZERO ( &writeFds );
-
-    for ( Socket *socket : _activeSockets )
-    {
-        if ( socket->isConnecting() && socket->isTCP() )
-            FD_SET ( socket->_fd, &writeFds );
-        else
-            FD_SET ( socket->_fd, &readFds );
-    }
+        return false;
 
     ASSERT ( timeout > 0 );
 
-    timeval tv;
-    tv.tv_sec = timeout / 1000UL;
-    tv.tv_usec = ( timeout * 1000UL ) % 1000000UL;
+    // Not a member, because socket events can poll again
+    vector<Reactor::Event> readyEvents;
 
-    // Note: select should be called between timeBeginPeriod / timeEndPeriod to ensure accurate timeouts
-    int count = select ( 0, &readFds, &writeFds, 0, &tv );
-
-    if ( count == SOCKET_ERROR )
-        THROW_WIN_EXCEPTION ( WSAGetLastError(), "select failed", ERROR_NETWORK_GENERIC );
-
-    if ( count == 0 )
-        return;
+    // Note: this should be called between timeBeginPeriod / timeEndPeriod to ensure accurate timeouts
+    if ( ! _reactor->wait ( timeout, readyEvents ) )
+        return false;
 
     ASSERT ( TimerManager::get().isInitialized() == true );
     TimerManager::get().updateNow();
 
-    for ( Socket *socket : _activeSockets )
+    // Replies to everything read in this check are flushed together
+    Batch batch;
+
+    for ( const Reactor::Event& event : readyEvents )
     {
+        Socket *socket = ( Socket * ) event.data;
+
+        // Sockets can be removed by the events of earlier sockets
         if ( _allocatedSockets.find ( socket ) == _allocatedSockets.end() )
             continue;
 
         if ( socket->isConnecting() && socket->isTCP() )
         {
-            if ( ! FD_ISSET ( socket->_fd, &writeFds ) )
+            if ( ! ( event.events & REACTOR_WRITE ) )
                 continue;
 
-            LOG_SOCKET ( socket, "socketConnected" );
+            LOG_SOCKET_TRACE ( socket, "socketConnected" );
             socket->socketConnected();
+
+            // Wait for reads once connected
+            if ( isAllocated ( socket ) && ! socket->isConnecting() )
+                registerSocket ( socket );
         }
         else
         {
-            if ( ! FD_ISSET ( socket->_fd, &readFds ) )
+            if ( ! ( event.events & REACTOR_READ ) )
                 continue;
 
             if ( socket->isServer() && socket->isTCP() )
             {
-                LOG_SOCKET ( socket, "socketAccepted" );
+                LOG_SOCKET_TRACE ( socket, "socketAccepted" );
                 socket->socketAccepted();
             }
             else
             {
-                LOG_SOCKET ( socket, "socketRead" );
+                LOG_SOCKET_TRACE ( socket, "socketRead" );
                 socket->socketRead();
             }
         }
     }
+
+    return true;
+}
+
+void SocketManager::endBatch()
+{
+    ASSERT ( _batchDepth > 0 );
+
+    if ( _batchDepth > 1 )
+    {
+        --_batchDepth;
+        return;
+    }
+
+    // Still batching, so the ACKs are queued with the other datagrams to the same address
+    for ( Socket *socket : _ackSockets )
+        socket->sendPendingAcks();
+
+    _ackSockets.clear();
+
+    --_batchDepth;
+
+    // Sockets are removed from this list when they are removed, so these are all allocated
+    for ( Socket *socket : _batchedSockets )
+        socket->flushSends();
+
+    _batchedSockets.clear();
+}
+
+void SocketManager::addPendingAck ( Socket *socket )
+{
+    ASSERT ( _batchDepth > 0 );
+
+    if ( find ( _ackSockets.begin(), _ackSockets.end(), socket ) == _ackSockets.end() )
+        _ackSockets.push_back ( socket );
+}
+
+void SocketManager::wakeup()
+{
+    // The reactor can be changed by setBackend while another thread wakes it up
+    shared_ptr<Reactor> reactor = atomic_load ( &_reactor );
+
+    if ( reactor )
+        reactor->wakeup();
+}
+
+bool SocketManager::setBackend ( Reactor::Backend backend )
+{
+    if ( ! _initialized )
+    {
+        // Checked when initialized, since creating a reactor needs WinSock
+        _backend = backend;
+        return true;
+    }
+
+    shared_ptr<Reactor> reactor ( Reactor::create ( backend ) );
+
+    if ( ! reactor )
+    {
+        LOG ( "Unsupported socket backend: %s", Reactor::getBackendName ( backend ) );
+        return false;
+    }
+
+    LOG ( "Changing socket backend: %s -> %s",
+          Reactor::getBackendName ( _backend ), Reactor::getBackendName ( backend ) );
+
+    for ( Socket *socket : _allocatedSockets )
+        _reactor->remove ( socket->_fd );
+
+    atomic_store ( &_reactor, reactor );
+    _backend = backend;
+
+    for ( Socket *socket : _allocatedSockets )
+        registerSocket ( socket );
+
+    // In case another thread woke up the old reactor while it was being changed
+    reactor->wakeup();
+    return true;
+}
+
+void SocketManager::registerSocket ( Socket *socket )
+{
+    if ( ! _reactor )
+        return;
+
+    // Connecting TCP sockets become writable when connected
+    const bool isConnecting = ( socket->isConnecting() && socket->isTCP() );
+
+    _reactor->add ( socket->_fd, isConnecting ? REACTOR_WRITE : REACTOR_READ, socket );
 }
 
 void SocketManager::add ( Socket *socket )
@@ -111,16 +165,29 @@ void SocketManager::add ( Socket *socket )
     LOG_SOCKET ( socket, "Adding socket" );
 
     _allocatedSockets.insert ( socket );
-    _changed = true;
+    registerSocket ( socket );
 }
 
 void SocketManager::remove ( Socket *socket )
 {
+    // The queued datagrams are sent when the socket is disconnected
+    const auto it = find ( _batchedSockets.begin(), _batchedSockets.end(), socket );
+
+    if ( it != _batchedSockets.end() )
+        _batchedSockets.erase ( it );
+
+    const auto jt = find ( _ackSockets.begin(), _ackSockets.end(), socket );
+
+    if ( jt != _ackSockets.end() )
+        _ackSockets.erase ( jt );
+
     if ( _allocatedSockets.erase ( socket ) )
     {
         LOG_SOCKET ( socket, "Removing socket" );
 
-        _changed = true;
+        // This is before the socket is closed
+        if ( _reactor )
+            _reactor->remove ( socket->_fd );
     }
 }
 
@@ -128,12 +195,19 @@ void SocketManager::clear()
 {
     LOG ( "Clearing sockets" );
 
+    // Unregister every socket before they are closed, in case disconnecting doesn't remove it
+    for ( Socket *socket : _allocatedSockets )
+    {
+        if ( _reactor )
+            _reactor->remove ( socket->_fd );
+    }
+
     for ( auto it = _allocatedSockets.begin(); it != _allocatedSockets.end(); )
         ( *it++ )->disconnect();
 
-    _activeSockets.clear();
     _allocatedSockets.clear();
-    _changed = true;
+    _batchedSockets.clear();
+    _ackSockets.clear();
 }
 
 SocketManager::SocketManager() {}
@@ -151,6 +225,18 @@ void SocketManager::initialize()
 
     if ( error != NO_ERROR )
         THROW_WIN_EXCEPTION ( error, "WSAStartup failed", ERROR_NETWORK_INIT );
+
+    _reactor.reset ( Reactor::create ( _backend ) );
+
+    if ( ! _reactor )
+    {
+        LOG ( "Unsupported socket backend: %s", Reactor::getBackendName ( _backend ) );
+
+        _backend = Reactor::getDefaultBackend();
+        _reactor.reset ( Reactor::create ( _backend ) );
+    }
+
+    LOG ( "Socket backend: %s", Reactor::getBackendName ( _backend ) );
 }
 
 void SocketManager::deinitialize()
@@ -162,6 +248,8 @@ void SocketManager::deinitialize()
 
     SocketManager::get().clear();
 
+    atomic_store ( &_reactor, shared_ptr<Reactor>() );
+
     WSACleanup();
 }
 
@@ -1,7 +1,11 @@
 #pragma once
 
+#include "Reactor.hpp"
+
 #include <stdint.h>
 #include <unordered_set>
+#include <vector>
+#include <memory>
 
 
 class Socket;
@@ -11,8 +15,29 @@ class SocketManager
 {
 public:
 
-    // Check for socket events
-    void check ( uint64_t timeout );
+    // Wait up to timeout milliseconds for socket events, or a wakeup, returns true if any sockets were ready
+    bool check ( uint64_t timeout );
+
+    // Make the current or next check return immediately, can be called on a different thread
+    void wakeup();
+
+    // Queue the UDP datagrams sent by non-raw sockets until the batch ends, so the messages sent in one tick are
+    // flushed together, and small ones to the same address share a datagram. Batches can be nested, and the
+    // datagrams are sent when the outermost batch ends. ACKs that weren't piggybacked on other messages during
+    // the batch are sent just before then.
+    void beginBatch() { ++_batchDepth; }
+    void endBatch();
+    bool isBatching() const { return ( _batchDepth > 0 ); }
+
+    // Call sendPendingAcks on the socket when the current batch ends
+    void addPendingAck ( Socket *socket );
+
+    // Batches the sends for the lifetime of this object
+    struct Batch
+    {
+        Batch() { SocketManager::get().beginBatch(); }
+        ~Batch() { SocketManager::get().endBatch(); }
+    };
 
     // Add / remove / clear socket instances
     void add ( Socket *socket );
@@ -24,6 +49,11 @@ public:
     void deinitialize();
     bool isInitialized() const { return _initialized; }
 
+    // Set the backend that waits on sockets, returns false if it isn't supported.
+    // This can be changed while initialized, then the sockets are registered with the new backend.
+    bool setBackend ( Reactor::Backend backend );
+    Reactor::Backend getBackend() const { return _backend; }
+
     // Check if a socket is still allocated
     bool isAllocated ( Socket *socket ) const
     {
@@ -35,11 +65,29 @@ public:
 
 private:
 
-    // Sets of active and allocated socket instances
-    std::unordered_set<Socket *> _activeSockets, _allocatedSockets;
+    // Set of allocated socket instances
+    std::unordered_set<Socket *> _allocatedSockets;
+
+    // Sockets are registered with the reactor when they are added, and unregistered when removed
+    std::shared_ptr<Reactor> _reactor;
+
+    // Backend of the reactor
+    Reactor::Backend _backend = Reactor::getDefaultBackend();
+
+    // Register a socket for the events its state is waiting for
+    void registerSocket ( Socket *socket );
+
+    // Sockets with queued datagrams, and the nesting depth of batches
+    std::vector<Socket *> _batchedSockets;
+    size_t _batchDepth = 0;
+
+    // Called by a socket when it queues its first datagram of a batch
+    void addBatched ( Socket *socket ) { _batchedSockets.push_back ( socket ); }
+
+    // Sockets with ACKs to send when the batch ends
+    std::vector<Socket *> _ackSockets;
 
-    // Flag to indicate the set of allocated sockets has changed
-    bool _changed = false;
+    friend class Socket;
 
     // Flag to indicate if initialized
     bool _initialized = false;
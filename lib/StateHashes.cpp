@@ -0,0 +1,138 @@
+#include "StateHashes.hpp"
+#include "Compression.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+
+
+void StateHashes::compile ( const MemDumpList& list )
+{
+    clear();
+
+    size_t offset = 0;
+
+    for ( const MemDump& mem : list.addrs )
+    {
+        const size_t start = offset;
+
+        offset = compilePtrs ( mem, start, offset + mem.size );
+
+        const size_t numBlocks = ( offset - start + STATE_HASH_BLOCK_SIZE - 1 ) / STATE_HASH_BLOCK_SIZE;
+
+        _regions.push_back ( { mem.addr, start, offset - start, _blockHashes.size() } );
+        _blockHashes.resize ( _blockHashes.size() + numBlocks, 0 );
+    }
+
+    _totalSize = offset;
+    _regionHashes.resize ( _regions.size(), 0 );
+    _scratch.resize ( _totalSize );
+
+    ASSERT ( _totalSize == list.totalSize );
+}
+
+size_t StateHashes::compilePtrs ( const MemDumpBase& mem, size_t parentOffset, size_t offset )
+{
+    // Same pre-order layout as MemDumpBase::saveDump
+    for ( const MemDumpPtr& ptr : mem.ptrs )
+    {
+        _ptrOffsets.push_back ( parentOffset + ptr.srcOffset );
+
+        offset = compilePtrs ( ptr, offset, offset + ptr.size );
+    }
+
+    return offset;
+}
+
+void StateHashes::clear()
+{
+    _regions.clear();
+    _ptrOffsets.clear();
+    _blockHashes.clear();
+    _regionHashes.clear();
+    _scratch.clear();
+    _totalSize = 0;
+    _hash = 0;
+}
+
+void StateHashes::compute ( const char *dump )
+{
+    ASSERT ( dump != 0 );
+
+    if ( _regions.empty() )
+        return;
+
+    memcpy ( _scratch.data(), dump, _totalSize );
+
+    for ( size_t offset : _ptrOffsets )
+        memset ( &_scratch[offset], 0, min ( sizeof ( char * ), _totalSize - offset ) );
+
+    for ( size_t i = 0; i < _regions.size(); ++i )
+    {
+        const Region& region = _regions[i];
+
+        uint64_t *blocks = _blockHashes.data() + region.firstBlock;
+        size_t numBlocks = 0;
+
+        for ( size_t j = 0; j < region.size; j += STATE_HASH_BLOCK_SIZE )
+        {
+            const size_t len = min ( region.size - j, ( size_t ) STATE_HASH_BLOCK_SIZE );
+            blocks[numBlocks++] = getXXH64 ( &_scratch[region.offset + j], len );
+        }
+
+        _regionHashes[i] = getXXH64 ( ( const char * ) blocks, numBlocks * sizeof ( uint64_t ) );
+    }
+
+    _hash = getXXH64 ( ( const char * ) _regionHashes.data(), _regionHashes.size() * sizeof ( uint64_t ) );
+}
+
+vector<uint64_t> StateHashes::getBlockHashes ( uint32_t region ) const
+{
+    ASSERT ( region < _regions.size() );
+
+    const size_t first = _regions[region].firstBlock;
+    const size_t last = ( region + 1 < _regions.size() ? _regions[region + 1].firstBlock : _blockHashes.size() );
+
+    return vector<uint64_t> ( _blockHashes.begin() + first, _blockHashes.begin() + last );
+}
+
+vector<uint32_t> StateHashes::diffRegions ( const vector<uint64_t>& remote ) const
+{
+    vector<uint32_t> regions;
+
+    for ( uint32_t i = 0; i < _regionHashes.size(); ++i )
+    {
+        // Missing remote hashes are treated as different
+        if ( i >= remote.size() || remote[i] != _regionHashes[i] )
+            regions.push_back ( i );
+    }
+
+    return regions;
+}
+
+vector<StateHashes::Range> StateHashes::diffBlocks ( uint32_t region, const vector<uint64_t>& remote ) const
+{
+    ASSERT ( region < _regions.size() );
+
+    const vector<uint64_t> local = getBlockHashes ( region );
+    const Region& r = _regions[region];
+
+    vector<Range> ranges;
+
+    for ( size_t i = 0; i < local.size(); ++i )
+    {
+        if ( i < remote.size() && remote[i] == local[i] )
+            continue;
+
+        const size_t offset = r.offset + i * STATE_HASH_BLOCK_SIZE;
+        const size_t size = min ( r.size - i * STATE_HASH_BLOCK_SIZE, ( size_t ) STATE_HASH_BLOCK_SIZE );
+
+        if ( ! ranges.empty() && ranges.back().offset + ranges.back().size == offset )
+            ranges.back().size += size;
+        else
+            ranges.push_back ( { region, offset, size } );
+    }
+
+    return ranges;
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include "MemDump.hpp"
+
+#include <vector>
+
+
+// Size of the blocks each region is split into for the block hashes
+#define STATE_HASH_BLOCK_SIZE ( 256 )
+
+
+// Hierarchical hashes of the memory in a MemDumpList, for finding exactly where two game states diverged.
+//
+// The flattened memory dump is split into regions, one per top-level MemDump including the memory behind its
+// pointers. Each region is split into fixed size blocks, the hash of a region is the hash of its block hashes, and
+// the hash of the state is the hash of the region hashes. Comparing the region hashes, then only the block hashes
+// of the regions that differ, finds the diverged memory without exchanging the block hashes of the whole state.
+//
+// The pointers themselves are not hashed, since the heap addresses can be different on each machine.
+class StateHashes
+{
+public:
+
+    // A range of memory that differs, the offset is the position in the flattened dump
+    struct Range
+    {
+        uint32_t region;
+        size_t offset, size;
+    };
+
+    // Compile the layout of the given list, the list must not change or be destroyed afterwards
+    void compile ( const MemDumpList& list );
+
+    void clear();
+
+    bool empty() const { return _regions.empty(); }
+
+    // Hash a flattened memory dump of the compiled list
+    void compute ( const char *dump );
+
+    // Get the hash of the whole state
+    uint64_t getHash() const { return _hash; }
+
+    size_t getNumRegions() const { return _regions.size(); }
+
+    const std::vector<uint64_t>& getRegionHashes() const { return _regionHashes; }
+
+    // Get the block hashes of the given region
+    std::vector<uint64_t> getBlockHashes ( uint32_t region ) const;
+
+    // Get the address of the top-level MemDump of the given region
+    char *getRegionAddr ( uint32_t region ) const { return _regions[region].addr; }
+
+    // Get the position of the given region in the flattened dump
+    size_t getRegionOffset ( uint32_t region ) const { return _regions[region].offset; }
+
+    size_t getRegionSize ( uint32_t region ) const { return _regions[region].size; }
+
+    // Compare with remote region hashes, returns the regions that differ
+    std::vector<uint32_t> diffRegions ( const std::vector<uint64_t>& remote ) const;
+
+    // Compare with remote block hashes of the given region, returns the ranges that differ, adjacent blocks merged
+    std::vector<Range> diffBlocks ( uint32_t region, const std::vector<uint64_t>& remote ) const;
+
+private:
+
+    struct Region
+    {
+        char *addr;
+        size_t offset, size;
+
+        // Index of the first block hash of this region
+        size_t firstBlock;
+    };
+
+    std::vector<Region> _regions;
+
+    // Positions of the pointers in the flattened dump, these are zeroed before hashing
+    std::vector<size_t> _ptrOffsets;
+
+    size_t _totalSize = 0;
+
+    std::vector<uint64_t> _blockHashes, _regionHashes;
+
+    uint64_t _hash = 0;
+
+    // Copy of the dump with the pointers zeroed
+    std::vector<char> _scratch;
+
+    size_t compilePtrs ( const MemDumpBase& mem, size_t parentOffset, size_t offset );
+};
@@ -0,0 +1,838 @@
+#include "SyncLogDiff.hpp"
+#include "MappedFile.hpp"
+#include "Thread.hpp"
+#include "StringUtils.hpp"
+
+#include <windows.h>
+
+#include <algorithm>
+#include <functional>
+#include <fstream>
+#include <cstring>
+
+using namespace std;
+
+
+// States that aren't compared, since each client can spend a different number of frames in them
+static const char *SkipStates[] = { "Loading", "Skippable", "RetryMenu" };
+
+
+// One parsed line of a sync log, the pointers are into the mapped file
+struct Line
+{
+    // Start of the whole line
+    const char *text;
+
+    const char *state;
+    size_t stateLength;
+
+    uint32_t index, frame;
+
+    // Data with the tag if any, eg "Inputs: 0x0000 0x0000"
+    const char *data;
+    size_t dataLength;
+
+    uint64_t lineNumber;
+};
+
+// Consecutive lines of a sync log with the same transition index
+struct Run
+{
+    uint32_t index;
+
+    // Byte range of the lines, and the line number of the first line
+    uint64_t begin, end, lineNumber;
+};
+
+// All the runs of a transition index in a sync log
+struct Group
+{
+    uint32_t index;
+
+    vector<Run> runs;
+};
+
+struct Log
+{
+    string file;
+
+    // The short format is made by scripts/sync2replay, and has no RngState lines
+    bool isShort = false;
+
+    // Byte offset and line number of the first line to compare
+    uint64_t begin = 0, lineNumber = 0;
+
+    uint64_t size = 0;
+
+    vector<Group> groups;
+};
+
+// Result of comparing the lines of one transition index
+struct GroupResult
+{
+    uint64_t matched = 0;
+
+    bool mismatch = false;
+
+    uint64_t lineNumbers[2] = { 0, 0 };
+
+    string lines[2];
+
+    uint32_t frame = 0;
+
+    string field;
+
+    string error;
+};
+
+
+// Call func with each task number from 0 to numTasks - 1, spread over the given number of threads.
+// The tasks are started in order.
+static void parallelFor ( size_t numThreads, size_t numTasks, const function<void ( size_t )>& func )
+{
+    class Worker : public Thread
+    {
+    public:
+        Worker ( const function<void()>& work ) : work ( work ) {}
+        void run() override { work(); }
+
+    private:
+        function<void()> work;
+    };
+
+    Mutex mutex;
+    size_t next = 0;
+
+    auto work = [&] ()
+    {
+        for ( ;; )
+        {
+            size_t task;
+
+            {
+                LOCK ( mutex );
+
+                if ( next >= numTasks )
+                    return;
+
+                task = next++;
+            }
+
+            func ( task );
+        }
+    };
+
+    vector<shared_ptr<Worker>> workers;
+
+    for ( size_t i = 1; i < min ( numThreads, numTasks ); ++i )
+    {
+        workers.push_back ( shared_ptr<Worker> ( new Worker ( work ) ) );
+        workers.back()->start();
+    }
+
+    // This thread works too
+    work();
+
+    for ( const auto& worker : workers )
+        worker->join();
+}
+
+
+static bool expect ( const char *& p, const char *end, const char *str )
+{
+    const size_t length = strlen ( str );
+
+    if ( ( size_t ) ( end - p ) < length || memcmp ( p, str, length ) )
+        return false;
+
+    p += length;
+    return true;
+}
+
+static bool parseNumber ( const char *& p, const char *end, uint32_t& value )
+{
+    if ( p == end || ! isdigit ( *p ) )
+        return false;
+
+    for ( value = 0; p != end && isdigit ( *p ); ++p )
+        value = value * 10 + ( *p - '0' );
+
+    return true;
+}
+
+static bool parseWord ( const char *& p, const char *end )
+{
+    if ( p == end || ! isalpha ( *p ) )
+        return false;
+
+    while ( p != end && isalpha ( *p ) )
+        ++p;
+
+    return true;
+}
+
+// Parse a line in the full format, "<GameMode> [<n>] NetplayState::<State> [<index>:<frame>] <data>",
+// or the short format, "<State> [<index>:<frame>] <data>". Same as the regexes in scripts/diff.py, except that the
+// data doesn't need a tag, since the character and timer lines don't have one.
+static bool parseLine ( const char *p, const char *end, bool isShort, Line& line )
+{
+    if ( end != p && end[-1] == '\r' )
+        --end;
+
+    line.text = p;
+
+    if ( ! isShort )
+    {
+        const char *space = ( const char * ) memchr ( p, ' ', end - p );
+
+        if ( ! space || space == p )
+            return false;
+
+        p = space + 1;
+
+        uint32_t gameMode;
+
+        if ( ! expect ( p, end, "[" ) || ! parseNumber ( p, end, gameMode ) || ! expect ( p, end, "] NetplayState::" ) )
+            return false;
+    }
+
+    line.state = p;
+
+    if ( ! parseWord ( p, end ) )
+        return false;
+
+    line.stateLength = p - line.state;
+
+    if ( ! expect ( p, end, " [" ) || ! parseNumber ( p, end, line.index ) || ! expect ( p, end, ":" )
+            || ! parseNumber ( p, end, line.frame ) || ! expect ( p, end, "] " ) )
+    {
+        return false;
+    }
+
+    if ( p == end )
+        return false;
+
+    line.data = p;
+    line.dataLength = end - line.data;
+    return true;
+}
+
+
+// Check the format of the log, and find the first line to compare
+static bool readHeader ( Log& log, string& sessionId, string& error )
+{
+    ifstream fin ( log.file.c_str(), ifstream::binary );
+
+    if ( ! fin.good() )
+    {
+        error = format ( "Couldn't open %s!", log.file );
+        return false;
+    }
+
+    fin.seekg ( 0, ifstream::end );
+    log.size = fin.tellg();
+    fin.seekg ( 0 );
+
+    string line;
+    uint64_t offset = 0, lineNumber = 0;
+
+    auto nextLine = [&] ()
+    {
+        if ( ! getline ( fin, line ) )
+            return false;
+
+        offset += line.size() + 1;
+        ++lineNumber;
+
+        if ( ! line.empty() && line.back() == '\r' )
+            line.pop_back();
+
+        return true;
+    };
+
+    for ( size_t i = 0; i <= SYNC_LOG_HEADER_LENGTH; ++i )
+    {
+        if ( ! nextLine() )
+        {
+            error = format ( "%s is empty!", log.file );
+            return false;
+        }
+    }
+
+    sessionId = line;
+
+    uint64_t begin = offset;
+
+    if ( ! nextLine() )
+    {
+        error = format ( "%s is empty!", log.file );
+        return false;
+    }
+
+    Line parsed;
+
+    if ( parseLine ( &line[0], &line[0] + line.size(), false, parsed ) )
+    {
+        // Start at the first line in chara select
+        while ( line.find ( "CharaSelect" ) == string::npos )
+        {
+            begin = offset;
+
+            if ( ! nextLine() )
+            {
+                error = format ( "%s has no CharaSelect!", log.file );
+                return false;
+            }
+        }
+    }
+    else if ( parseLine ( &line[0], &line[0] + line.size(), true, parsed ) )
+    {
+        log.isShort = true;
+    }
+    else
+    {
+        error = format ( "%s has unknown format!", log.file );
+        return false;
+    }
+
+    log.begin = begin;
+    log.lineNumber = lineNumber;
+    return true;
+}
+
+
+// Runs of the lines starting in one chunk of a log
+struct Chunk
+{
+    uint64_t begin, end;
+
+    vector<Run> runs;
+
+    // Number of lines starting in the chunk, the line numbers of the runs are relative to the chunk
+    uint64_t numLines;
+
+    string error;
+};
+
+static void splitChunk ( const Log& log, Chunk& chunk )
+{
+    // Map from the byte before the chunk, to tell if the chunk starts on a new line
+    const uint64_t viewBegin = ( chunk.begin > log.begin ? chunk.begin - 1 : chunk.begin );
+
+    MappedFile view;
+
+    for ( size_t slack = SYNC_LOG_DIFF_SLACK;; slack *= 2 )
+    {
+        chunk.runs.clear();
+        chunk.numLines = 0;
+
+        if ( ! view.open ( log.file, viewBegin, chunk.end - viewBegin + slack ) )
+        {
+            chunk.error = format ( "Couldn't map %s!", log.file );
+            return;
+        }
+
+        const uint64_t viewEnd = viewBegin + view.size();
+        const bool isEndOfFile = ( viewEnd == log.size );
+
+        // Find the next line ending after pos, or the end of the view
+        auto findEnd = [&] ( uint64_t pos )
+        {
+            const char *p = view.data() + ( pos - viewBegin );
+            const char *newline = ( const char * ) memchr ( p, '\n', viewEnd - pos );
+            return ( newline ? pos + ( newline - p ) : viewEnd );
+        };
+
+        uint64_t pos = chunk.begin;
+
+        // Skip the line that started in the previous chunk
+        if ( viewBegin < chunk.begin )
+            pos = findEnd ( viewBegin ) + 1;
+
+        Run run = { 0, 0, 0, 0 };
+        bool hasRun = false, needsSlack = false;
+
+        // Largest index so far, lines from an older index are skipped
+        uint32_t maxIndex = 0;
+
+        for ( ; pos < chunk.end; ++chunk.numLines )
+        {
+            const uint64_t end = findEnd ( pos );
+
+            if ( end == viewEnd && ! isEndOfFile )
+            {
+                needsSlack = true;
+                break;
+            }
+
+            Line line;
+
+            if ( parseLine ( view.data() + ( pos - viewBegin ), view.data() + ( end - viewBegin ), log.isShort, line )
+                    && line.index >= maxIndex )
+            {
+                maxIndex = line.index;
+
+                if ( hasRun && run.index == line.index )
+                {
+                    run.end = end + 1;
+                }
+                else
+                {
+                    if ( hasRun )
+                        chunk.runs.push_back ( run );
+
+                    run = { line.index, pos, end + 1, chunk.numLines };
+                    hasRun = true;
+                }
+            }
+            else if ( hasRun )
+            {
+                chunk.runs.push_back ( run );
+                hasRun = false;
+            }
+
+            pos = end + 1;
+        }
+
+        if ( needsSlack )
+            continue;
+
+        if ( hasRun )
+            chunk.runs.push_back ( run );
+
+        return;
+    }
+}
+
+// Split the log into groups of lines by transition index
+static bool splitLog ( Log& log, size_t numThreads, string& error )
+{
+    vector<Chunk> chunks;
+
+    for ( uint64_t begin = log.begin; begin < log.size; begin += SYNC_LOG_DIFF_CHUNK )
+    {
+        Chunk chunk;
+        chunk.begin = begin;
+        chunk.end = min ( begin + SYNC_LOG_DIFF_CHUNK, log.size );
+        chunks.push_back ( chunk );
+    }
+
+    parallelFor ( numThreads, chunks.size(), [&] ( size_t i ) { splitChunk ( log, chunks[i] ); } );
+
+    uint64_t lineNumber = log.lineNumber;
+    uint32_t maxIndex = 0;
+
+    for ( const Chunk& chunk : chunks )
+    {
+        if ( ! chunk.error.empty() )
+        {
+            error = chunk.error;
+            return false;
+        }
+
+        for ( Run run : chunk.runs )
+        {
+            // Skip older transition indices, across chunks too
+            if ( run.index < maxIndex )
+                continue;
+
+            maxIndex = run.index;
+            run.lineNumber += lineNumber;
+
+            if ( log.groups.empty() || log.groups.back().index != run.index )
+                log.groups.push_back ( { run.index, {} } );
+
+            log.groups.back().runs.push_back ( run );
+        }
+
+        lineNumber += chunk.numLines;
+    }
+
+    return true;
+}
+
+
+// Reads the lines of a group, mapping one window of the log at a time
+class LineReader
+{
+public:
+
+    LineReader ( const Log& log, const Group& group ) : _log ( log ), _runs ( group.runs )
+    {
+        _pos = _runs[0].begin;
+        _lineNumber = _runs[0].lineNumber;
+    }
+
+    // Read the next line, the line is valid until the next call. Returns false at the end of the group.
+    bool next ( Line& line )
+    {
+        for ( ;; )
+        {
+            if ( _run >= _runs.size() )
+                return false;
+
+            if ( _pos >= _runs[_run].end )
+            {
+                if ( ++_run >= _runs.size() )
+                    return false;
+
+                _pos = _runs[_run].begin;
+                _lineNumber = _runs[_run].lineNumber;
+            }
+
+            const char *begin = 0, *end = 0;
+
+            if ( ! mapLine ( begin, end ) )
+                return false;
+
+            _pos += ( end - begin ) + 1;
+
+            if ( parseLine ( begin, end, _log.isShort, line ) )
+            {
+                line.lineNumber = _lineNumber++;
+                return true;
+            }
+
+            ++_lineNumber;
+        }
+    }
+
+    bool failed() const { return _failed; }
+
+private:
+
+    const Log& _log;
+
+    const vector<Run>& _runs;
+
+    MappedFile _view;
+
+    size_t _run = 0;
+
+    uint64_t _pos = 0, _lineNumber = 0;
+
+    bool _failed = false;
+
+    // Make sure the whole line at _pos is mapped
+    bool mapLine ( const char *& begin, const char *& end )
+    {
+        const uint64_t runEnd = _runs[_run].end;
+
+        for ( size_t size = SYNC_LOG_DIFF_CHUNK;; size *= 2 )
+        {
+            if ( _view.isOpen() && _pos >= _view.getOffset() && _pos < _view.getOffset() + _view.size() )
+            {
+                begin = _view.data() + ( _pos - _view.getOffset() );
+
+                const size_t length = min ( _view.getOffset() + _view.size(), runEnd ) - _pos;
+
+                end = ( const char * ) memchr ( begin, '\n', length );
+
+                if ( end )
+                    return true;
+
+                // The last line of the log might not have a newline
+                if ( _view.getOffset() + _view.size() == _log.size )
+                {
+                    end = begin + length;
+                    return true;
+                }
+            }
+
+            if ( ! _view.open ( _log.file, _pos, min ( ( uint64_t ) size, runEnd - _pos ) ) )
+            {
+                _failed = true;
+                return false;
+            }
+        }
+    }
+};
+
+static bool isSkipState ( const string& state )
+{
+    for ( const char *skip : SkipStates )
+    {
+        if ( state == skip )
+            return true;
+    }
+
+    return false;
+}
+
+// Compare the lines of the same transition index in two logs
+static void compareGroups ( const Log *logs[2], const Group *groups[2], bool align, GroupResult& result )
+{
+    LineReader readers[2] = { { *logs[0], *groups[0] }, { *logs[1], *groups[1] } };
+
+    Line lines[2];
+    bool hasLines[2];
+
+    for ( size_t i = 0; i < 2; ++i )
+        hasLines[i] = readers[i].next ( lines[i] );
+
+    if ( ! hasLines[0] || ! hasLines[1] )
+        return;
+
+    // The NetplayState of each group, a Dummy state is the same as the other log
+    string states[2];
+
+    for ( size_t i = 0; i < 2; ++i )
+        states[i] = string ( lines[i].state, lines[i].stateLength );
+
+    for ( size_t i = 0; i < 2; ++i )
+    {
+        if ( states[i] == "Dummy" )
+            states[i] = states[1 - i];
+    }
+
+    // Ignored NetplayStates
+    if ( isSkipState ( states[0] ) || isSkipState ( states[1] ) )
+        return;
+
+    // Get the state of a line, and whether it's compared
+    auto getState = [&] ( size_t i, const Line& line, string& state )
+    {
+        state.assign ( line.state, line.stateLength );
+
+        if ( state == "Dummy" )
+            state = states[1 - i];
+
+        if ( isSkipState ( state ) )
+            return false;
+
+        // Ignore RngStates if the other log is a dummy sync log
+        if ( logs[1 - i]->isShort && line.dataLength >= 8 && ! memcmp ( line.data, "RngState", 8 ) )
+            return false;
+
+        return true;
+    };
+
+    string lineStates[2];
+
+    auto nextLine = [&] ( size_t i )
+    {
+        while ( ( hasLines[i] = readers[i].next ( lines[i] ) ) && ! getState ( i, lines[i], lineStates[i] ) )
+            ;
+    };
+
+    for ( size_t i = 0; i < 2; ++i )
+    {
+        if ( ! getState ( i, lines[i], lineStates[i] ) )
+            nextLine ( i );
+    }
+
+    while ( hasLines[0] && hasLines[1] )
+    {
+        // Skip initial frames before we match the first line
+        if ( align && result.matched == 0 && lines[0].frame != lines[1].frame )
+        {
+            nextLine ( lines[0].frame < lines[1].frame ? 0 : 1 );
+            continue;
+        }
+
+        const bool sameData = ( lines[0].dataLength == lines[1].dataLength
+                                && ! memcmp ( lines[0].data, lines[1].data, lines[0].dataLength ) );
+
+        if ( lineStates[0] == lineStates[1] && lines[0].frame == lines[1].frame && sameData )
+        {
+            ++result.matched;
+            nextLine ( 0 );
+            nextLine ( 1 );
+            continue;
+        }
+
+        result.mismatch = true;
+        result.frame = lines[0].frame;
+
+        for ( size_t i = 0; i < 2; ++i )
+        {
+            result.lineNumbers[i] = lines[i].lineNumber;
+
+            result.lines[i].assign ( lines[i].text, lines[i].data + lines[i].dataLength );
+        }
+
+        if ( lineStates[0] != lineStates[1] )
+            result.field = "NetplayState";
+        else if ( lines[0].frame != lines[1].frame )
+            result.field = "frame";
+        else
+            result.field = SyncLogDiff::getField ( string ( lines[0].data, lines[0].dataLength ),
+                                                   string ( lines[1].data, lines[1].dataLength ) );
+        break;
+    }
+
+    if ( readers[0].failed() || readers[1].failed() )
+        result.error = "Couldn't map the logs!";
+}
+
+
+size_t SyncLogDiff::getNumThreads() const
+{
+    if ( numThreads )
+        return numThreads;
+
+    SYSTEM_INFO info;
+    GetSystemInfo ( &info );
+    return max ( ( size_t ) info.dwNumberOfProcessors, ( size_t ) 1 );
+}
+
+vector<SyncLogDiff::Result> SyncLogDiff::diff ( const vector<string>& logs ) const
+{
+    vector<Result> results;
+
+    for ( size_t i = 1; i < logs.size(); ++i )
+        results.push_back ( diff ( logs[0], logs[i] ) );
+
+    return results;
+}
+
+SyncLogDiff::Result SyncLogDiff::diff ( const string& first, const string& second ) const
+{
+    Result result;
+
+    Log logs[2];
+    logs[0].file = first;
+    logs[1].file = second;
+
+    string sessionIds[2];
+
+    for ( size_t i = 0; i < 2; ++i )
+    {
+        if ( ! readHeader ( logs[i], sessionIds[i], result.error ) )
+            return result;
+    }
+
+    // Check SessionId
+    if ( sessionIds[0] != sessionIds[1] )
+    {
+        result.mismatch = true;
+
+        for ( size_t i = 0; i < 2; ++i )
+        {
+            result.lineNumbers[i] = SYNC_LOG_HEADER_LENGTH + 1;
+            result.lines[i] = sessionIds[i];
+        }
+
+        result.field = "SessionId";
+        return result;
+    }
+
+    const size_t threads = getNumThreads();
+
+    for ( size_t i = 0; i < 2; ++i )
+    {
+        if ( ! splitLog ( logs[i], threads, result.error ) )
+            return result;
+    }
+
+    // Pair up the transition indices in both logs
+    vector<pair<const Group *, const Group *>> pairs;
+
+    for ( auto a = logs[0].groups.cbegin(), b = logs[1].groups.cbegin();
+            a != logs[0].groups.cend() && b != logs[1].groups.cend(); )
+    {
+        if ( a->index < b->index )
+            ++a;
+        else if ( b->index < a->index )
+            ++b;
+        else
+            pairs.push_back ( { & ( *a++ ), & ( *b++ ) } );
+    }
+
+    vector<GroupResult> groupResults ( pairs.size() );
+
+    // Transition indices after the first mismatch don't need to be compared
+    Mutex mutex;
+    size_t firstMismatch = pairs.size();
+
+    parallelFor ( threads, pairs.size(), [&] ( size_t i )
+    {
+        {
+            LOCK ( mutex );
+
+            if ( i > firstMismatch )
+                return;
+        }
+
+        const Log *logPtrs[2] = { &logs[0], &logs[1] };
+        const Group *groups[2] = { pairs[i].first, pairs[i].second };
+
+        compareGroups ( logPtrs, groups, i == 0, groupResults[i] );
+
+        if ( groupResults[i].mismatch || ! groupResults[i].error.empty() )
+        {
+            LOCK ( mutex );
+            firstMismatch = min ( firstMismatch, i );
+        }
+    } );
+
+    for ( size_t i = 0; i < pairs.size(); ++i )
+    {
+        const GroupResult& groupResult = groupResults[i];
+
+        result.matched += groupResult.matched;
+
+        if ( ! groupResult.error.empty() )
+        {
+            result.error = groupResult.error;
+            break;
+        }
+
+        if ( ! groupResult.mismatch )
+            continue;
+
+        result.mismatch = true;
+        result.lineNumbers[0] = groupResult.lineNumbers[0];
+        result.lineNumbers[1] = groupResult.lineNumbers[1];
+        result.lines[0] = groupResult.lines[0];
+        result.lines[1] = groupResult.lines[1];
+        result.index = pairs[i].first->index;
+        result.frame = groupResult.frame;
+        result.field = groupResult.field;
+        break;
+    }
+
+    return result;
+}
+
+string SyncLogDiff::getField ( const string& first, const string& second )
+{
+    // The data is either "<Tag>: <fields>" or just "<fields>"
+    string tag;
+    size_t start = 0;
+
+    const size_t colon = first.find ( ": " );
+
+    if ( colon != string::npos && colon == first.find_first_of ( " =;:" ) )
+    {
+        tag = first.substr ( 0, colon );
+        start = colon + 2;
+
+        if ( second.compare ( 0, start, first, 0, start ) )
+            return tag;
+    }
+
+    // The fields are separated by ';', and named by the text before '='
+    const vector<string> fields[2] = { split ( first.substr ( start ), ";" ), split ( second.substr ( start ), ";" ) };
+
+    for ( size_t i = 0; i < fields[0].size(); ++i )
+    {
+        if ( i < fields[1].size() && fields[0][i] == fields[1][i] )
+            continue;
+
+        const size_t equals = fields[0][i].find ( '=' );
+
+        if ( equals == string::npos )
+            break;
+
+        const string name = trimmed ( fields[0][i].substr ( 0, equals ) );
+
+        // Fields of another tag, eg "P2: sel" in the chara select line
+        if ( tag.empty() || name.find ( ':' ) != string::npos )
+            return name;
+
+        return tag + ": " + name;
+    }
+
+    return tag;
+}
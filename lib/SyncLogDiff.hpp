@@ -0,0 +1,68 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+
+// Number of lines before the SessionId line of a sync log
+#define SYNC_LOG_HEADER_LENGTH ( 5 )
+
+// Bytes of a sync log split by each task, each task maps its own view of the file
+#define SYNC_LOG_DIFF_CHUNK ( 32 * 1024 * 1024 )
+
+// Bytes mapped past the end of a chunk for the line that crosses it, this grows for longer lines
+#define SYNC_LOG_DIFF_SLACK ( 64 * 1024 )
+
+
+// Finds the first line where sync logs diverge, with the same rules as scripts/diff.py.
+//
+// Each log is memory-mapped one chunk at a time, and the chunks are split into runs of lines with the same
+// transition index on several threads. Then the lines of each transition index found in both logs are compared
+// on several threads, and the divergence in the earliest transition index is reported.
+//
+// As in scripts/diff.py, lines in the Loading, Skippable, and RetryMenu states are ignored, as are lines from an
+// older transition index than the one before them, and the RngState lines when compared with a short format log.
+// Lines that aren't in the sync log format are also ignored.
+class SyncLogDiff
+{
+public:
+
+    struct Result
+    {
+        // Set if the logs couldn't be compared
+        std::string error;
+
+        // Number of lines that matched before the first mismatch
+        uint64_t matched = 0;
+
+        bool mismatch = false;
+
+        // Line numbers from 1, and the text of the first mismatching line in each log
+        uint64_t lineNumbers[2] = { 0, 0 };
+
+        std::string lines[2];
+
+        // Transition index and frame of the first mismatching line of the first log
+        uint32_t index = 0, frame = 0;
+
+        // First field that differs, eg "P1: hp"
+        std::string field;
+    };
+
+    // Number of threads to use, 0 for the number of processors
+    size_t numThreads = 0;
+
+    // Compare the first log against each of the other logs
+    std::vector<Result> diff ( const std::vector<std::string>& logs ) const;
+
+    // Compare two logs
+    Result diff ( const std::string& first, const std::string& second ) const;
+
+    // Get the name of the first field that differs between two lines of sync log data
+    static std::string getField ( const std::string& first, const std::string& second );
+
+private:
+
+    size_t getNumThreads() const;
+};
@@ -128,14 +128,14 @@ bool TcpSocket::send ( SerializableSequence *message, const IpAddrPort& address
 
 bool TcpSocket::send ( const MsgPtr& msg, const IpAddrPort& address )
 {
-    const string buffer = ::Protocol::encode ( msg );
+    ::Protocol::encode ( msg, _msgBuffer );
 
-    LOG ( "Encoded '%s' to [ %u bytes ]", msg, buffer.size() );
+    LOG ( "Encoded '%s' to [ %u bytes ]", msg, _msgBuffer.size() );
 
-    if ( !buffer.empty() && buffer.size() <= 256 )
-        LOG ( "Hex: %s", formatAsHex ( buffer ) );
+    if ( !_msgBuffer.empty() && _msgBuffer.size() <= 256 )
+        LOG ( "Hex: %s", formatAsHex ( _msgBuffer.data(), _msgBuffer.size() ) );
 
-    return Socket::send ( &buffer[0], buffer.size() );
+    return Socket::send ( _msgBuffer.data(), _msgBuffer.size() );
 }
 
 SocketPtr TcpSocket::shared ( Socket::Owner *owner, const SocketShareData& data )
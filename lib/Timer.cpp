@@ -17,9 +17,14 @@ Timer::~Timer()
 void Timer::start ( uint64_t delay )
 {
     _delay = delay;
+
+    if ( delay )
+        TimerManager::get().start ( this );
 }
 
 void Timer::stop()
 {
     _delay = _expiry = 0;
+
+    TimerManager::get().stop ( this );
 }
@@ -2,6 +2,7 @@
 
 #include <iostream>
 #include <memory>
+#include <cstdint>
 
 
 class Timer
@@ -31,6 +32,17 @@ public:
 private:
 
     uint64_t _delay = 0, _expiry = 0;
+
+    // Index in the TimerManager heap, or NOT_RUNNING
+    size_t _heapIndex = NOT_RUNNING;
+
+    // Order of timers with the same expiry
+    uint64_t _sequence = 0;
+
+    // Flag to indicate the timer is waiting to be started by the next check
+    bool _pending = false;
+
+    static const size_t NOT_RUNNING = ( size_t ) -1;
 };
 
 typedef std::shared_ptr<Timer> TimerPtr;
@@ -13,6 +13,14 @@ void TimerManager::updateNow()
     if ( ! _initialized )
         return;
 
+#ifndef RELEASE
+    if ( _manualNow )
+    {
+        _now = _manualNow;
+        return;
+    }
+#endif
+
     if ( _useHiResTimer )
     {
         QueryPerformanceCounter ( ( LARGE_INTEGER * ) &_ticks );
@@ -25,102 +33,217 @@ void TimerManager::updateNow()
     }
 }
 
+uint64_t TimerManager::getMicroseconds()
+{
+    static uint64_t ticksPerSecond = 0;
+    static const bool useHiResTimer = QueryPerformanceFrequency ( ( LARGE_INTEGER * ) &ticksPerSecond );
+
+    if ( ! useHiResTimer )
+        return 1000 * ( uint64_t ) timeGetTime();
+
+    uint64_t ticks;
+    QueryPerformanceCounter ( ( LARGE_INTEGER * ) &ticks );
+
+    // Split the conversion so it doesn't overflow
+    return ( ticks / ticksPerSecond ) * 1000000 + ( ( ticks % ticksPerSecond ) * 1000000 ) / ticksPerSecond;
+}
+
 void TimerManager::check()
 {
     if ( ! _initialized )
         return;
 
-    if ( _changed )
+    if ( _heap.empty() && _pending.empty() )
     {
-        for ( Timer *timer : _allocatedTimers )
-        {
-            if ( _activeTimers.find ( timer ) != _activeTimers.end() )
-                continue;
-
-            LOG ( "Added timer %08x; delay='%llu ms'", timer, timer->_delay );
-            _activeTimers.insert ( timer );
-        }
-
-        for ( auto it = _activeTimers.begin(); it != _activeTimers.end(); )
-        {
-            if ( _allocatedTimers.find ( *it ) != _allocatedTimers.end() )
-            {
-                ++it;
-                continue;
-            }
-
-            LOG ( "Removed timer %08x", *it ); // Don't log any extra data cus already de-allocated
-            _activeTimers.erase ( it++ );
-        }
-
-        _changed = false;
+        _nextExpiry = UINT64_MAX;
+        return;
+    }
+
+    updateNow();
+
+    startPending();
+
+    while ( ! _heap.empty() && _now >= _heap[0]->_expiry )
+    {
+        Timer *timer = _heap[0];
+        erase ( 0 );
+
+        LOG_TRACE ( LOG_MODULE_TIMER, "Expired timer %08x", timer );
+
+        timer->_delay = timer->_expiry = 0;
+
+        // The owner can start, stop, or delete any timer, including this one
+        if ( timer->owner )
+            timer->owner->timerExpired ( timer );
+
+        // Timers started by the owner start from now, so they can't expire in this check
+        startPending();
     }
 
+    _nextExpiry = ( _heap.empty() ? UINT64_MAX : _heap[0]->_expiry );
+}
+
+void TimerManager::add ( Timer *timer )
+{
+    LOG ( "Adding timer %08x", timer );
+}
+
+void TimerManager::remove ( Timer *timer )
+{
+    LOG ( "Removing timer %08x", timer );
+
+    stop ( timer );
+}
+
+void TimerManager::clear()
+{
+    LOG ( "Clearing timers" );
+
+    for ( Timer *timer : _heap )
+        timer->_heapIndex = Timer::NOT_RUNNING;
+
+    for ( Timer *timer : _pending )
+        timer->_pending = false;
+
+    _heap.clear();
+    _pending.clear();
     _nextExpiry = UINT64_MAX;
+}
 
-    if ( _activeTimers.empty() )
+void TimerManager::start ( Timer *timer )
+{
+    if ( timer->_pending )
         return;
 
-    updateNow();
+    timer->_pending = true;
+    _pending.push_back ( timer );
+}
+
+void TimerManager::stop ( Timer *timer )
+{
+    if ( timer->_heapIndex != Timer::NOT_RUNNING )
+        erase ( timer->_heapIndex );
+
+    if ( ! timer->_pending )
+        return;
+
+    timer->_pending = false;
 
-    for ( Timer *timer : _activeTimers )
+    for ( size_t i = 0; i < _pending.size(); ++i )
     {
-        if ( _allocatedTimers.find ( timer ) == _allocatedTimers.end() )
+        if ( _pending[i] != timer )
             continue;
 
-        if ( timer->_expiry > 0 && _now >= timer->_expiry )
-        {
-            LOG ( "Expired timer %08x", timer );
+        _pending[i] = _pending.back();
+        _pending.pop_back();
+        break;
+    }
+}
 
-            timer->_delay = timer->_expiry = 0;
+void TimerManager::startPending()
+{
+    // Timers can't be started while this runs, since no callbacks are called
+    for ( Timer *timer : _pending )
+    {
+        timer->_pending = false;
 
-            if ( timer->owner )
-            {
-                timer->owner->timerExpired ( timer );
+        // Started with a delay of 0 after being started, so only the previous expiry is kept
+        if ( timer->_delay == 0 )
+            continue;
 
-                if ( _allocatedTimers.find ( timer ) == _allocatedTimers.end() )
-                    continue;
-            }
-        }
+        LOG_TRACE ( LOG_MODULE_TIMER, "Started timer %08x; delay='%llu ms'", timer, timer->_delay );
 
-        if ( timer->_delay > 0 )
-        {
-            LOG ( "Started timer %08x; delay='%llu ms'", timer, timer->_delay );
+        if ( timer->_heapIndex != Timer::NOT_RUNNING )
+            erase ( timer->_heapIndex );
 
-            timer->_expiry = _now + timer->_delay;
-            timer->_delay = 0;
-        }
+        timer->_expiry = _now + timer->_delay;
+        timer->_delay = 0;
+        timer->_sequence = _sequence++;
 
-        if ( timer->_expiry > 0 && timer->_expiry < _nextExpiry )
-            _nextExpiry = timer->_expiry;
+        push ( timer );
     }
+
+    _pending.clear();
 }
 
-void TimerManager::add ( Timer *timer )
+bool TimerManager::isBefore ( const Timer *a, const Timer *b ) const
 {
-    LOG ( "Adding timer %08x", timer );
+    if ( a->_expiry != b->_expiry )
+        return ( a->_expiry < b->_expiry );
 
-    _allocatedTimers.insert ( timer );
-    _changed = true;
+    return ( a->_sequence < b->_sequence );
 }
 
-void TimerManager::remove ( Timer *timer )
+void TimerManager::push ( Timer *timer )
+{
+    _heap.push_back ( timer );
+    timer->_heapIndex = _heap.size() - 1;
+    siftUp ( timer->_heapIndex );
+}
+
+void TimerManager::erase ( size_t index )
 {
-    if ( _allocatedTimers.erase ( timer ) )
+    _heap[index]->_heapIndex = Timer::NOT_RUNNING;
+
+    Timer *last = _heap.back();
+    _heap.pop_back();
+
+    if ( index == _heap.size() )
+        return;
+
+    place ( last, index );
+
+    // The last timer can move either way depending on where it was moved to
+    siftUp ( index );
+    siftDown ( last->_heapIndex );
+}
+
+void TimerManager::siftUp ( size_t index )
+{
+    Timer *timer = _heap[index];
+
+    while ( index > 0 )
     {
-        LOG ( "Removing timer %08x", timer );
+        const size_t parent = ( index - 1 ) / 2;
+
+        if ( ! isBefore ( timer, _heap[parent] ) )
+            break;
 
-        _changed = true;
+        place ( _heap[parent], index );
+        index = parent;
     }
+
+    place ( timer, index );
 }
 
-void TimerManager::clear()
+void TimerManager::siftDown ( size_t index )
 {
-    LOG ( "Clearing timers" );
+    Timer *timer = _heap[index];
 
-    _activeTimers.clear();
-    _allocatedTimers.clear();
-    _changed = true;
+    for ( ;; )
+    {
+        size_t child = 2 * index + 1;
+
+        if ( child >= _heap.size() )
+            break;
+
+        if ( child + 1 < _heap.size() && isBefore ( _heap[child + 1], _heap[child] ) )
+            ++child;
+
+        if ( ! isBefore ( _heap[child], timer ) )
+            break;
+
+        place ( _heap[child], index );
+        index = child;
+    }
+
+    place ( timer, index );
+}
+
+void TimerManager::place ( Timer *timer, size_t index )
+{
+    _heap[index] = timer;
+    timer->_heapIndex = index;
 }
 
 TimerManager::TimerManager() : _useHiResTimer ( true ) {}
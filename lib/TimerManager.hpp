@@ -1,7 +1,7 @@
 #pragma once
 
 #include <stdint.h>
-#include <unordered_set>
+#include <vector>
 
 
 class Timer;
@@ -14,7 +14,7 @@ public:
     // Update current time
     void updateNow();
 
-    // Check for timer events
+    // Start the timers that were started since the last check, and expire the timers that are due
     void check();
 
     // Add / remove / clear timer instances
@@ -34,16 +34,36 @@ public:
     uint64_t getNow() const { return _now; }
     uint64_t getNow ( bool update ) { if ( update ) updateNow(); return _now; }
 
+    // Get the current hi-res time in microseconds for measuring short durations.
+    // This doesn't update getNow, so it is safe to call from any thread.
+    static uint64_t getMicroseconds();
+
     // Get the next time when a timer will expire
     uint64_t getNextExpiry() const { return _nextExpiry; }
 
+    // Get the number of running timers
+    size_t getNumRunning() const { return _heap.size(); }
+
+#ifndef RELEASE
+    // Use a manually advanced clock instead of the system timer, 0 to disable, for deterministic tests
+    void setManualNow ( uint64_t now ) { _now = _manualNow = now; }
+#endif
+
     // Get the singleton instance
     static TimerManager& get();
 
+    friend class Timer;
+
 private:
 
-    // Sets of active and allocated timer instances
-    std::unordered_set<Timer *> _activeTimers, _allocatedTimers;
+    // Min-heap of running timers ordered by expiry, each timer knows its index so it can be removed in O(log n)
+    std::vector<Timer *> _heap;
+
+    // Timers that were started since the last check, they are pushed onto the heap with the time of the next check
+    std::vector<Timer *> _pending;
+
+    // Increasing number to order timers with the same expiry by when they were started
+    uint64_t _sequence = 0;
 
     // Indicates if the hi-res timer should be used
     bool _useHiResTimer;
@@ -57,12 +77,29 @@ private:
     // The next time when a timer will expire
     uint64_t _nextExpiry = 0;
 
-    // Flag to indicate the set of allocated timers has changed
-    bool _changed = false;
+#ifndef RELEASE
+    // The manually advanced clock, 0 if using the system timer
+    uint64_t _manualNow = 0;
+#endif
 
     // Flag to indicate if initialized
     bool _initialized = false;
 
+    // Start / stop a timer, called by Timer
+    void start ( Timer *timer );
+    void stop ( Timer *timer );
+
+    // Push the pending timers onto the heap
+    void startPending();
+
+    // Heap operations
+    bool isBefore ( const Timer *a, const Timer *b ) const;
+    void push ( Timer *timer );
+    void erase ( size_t index );
+    void siftUp ( size_t index );
+    void siftDown ( size_t index );
+    void place ( Timer *timer, size_t index );
+
     // Private constructor, etc. for singleton class
     TimerManager();
     TimerManager ( const TimerManager& );
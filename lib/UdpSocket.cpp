@@ -1,6 +1,7 @@
 #include "SocketManager.hpp"
 #include "UdpSocket.hpp"
 #include "Protocol.hpp"
+#include "ReadBufferPool.hpp"
 #include "Exceptions.hpp"
 #include "ErrorStrings.hpp"
 
@@ -114,6 +115,9 @@ UdpSocket::UdpSocket ( ChildSocketEnum, UdpSocket *parentSocket, const IpAddrPor
     , _parentSocket ( parentSocket )
 {
     _state = State::Connecting;
+
+    _gbn.setSelectiveRepeat ( parentSocket->isSelectiveRepeat() );
+    _gbn.setMaxDatagramSize ( parentSocket->getMaxDatagramSize() );
 }
 
 UdpSocket::UdpSocket ( ChildSocketEnum, UdpSocket *parentSocket, const IpAddrPort& address, const GoBackN& state )
@@ -252,6 +256,13 @@ bool UdpSocket::send ( const MsgPtr& msg, const IpAddrPort& address )
 }
 
 bool UdpSocket::sendRaw ( const MsgPtr& msg, const IpAddrPort& address )
+{
+    encodeRaw ( msg );
+
+    return sendBytes ( _msgBuffer.data(), _msgBuffer.size(), address );
+}
+
+void UdpSocket::encodeRaw ( const MsgPtr& msg )
 {
 #ifndef RELEASE
     // Simulate hash fail
@@ -262,6 +273,7 @@ bool UdpSocket::sendRaw ( const MsgPtr& msg, const IpAddrPort& address )
             LOG ( "Munging hash for '%s'", msg );
             for ( char& byte : msg->_hash )
                 byte = ( rand() % 0x100 );
+            msg->_hashType = _msgBuffer.hashType;
             msg->_hashValid = false;
         }
         else
@@ -271,20 +283,23 @@ bool UdpSocket::sendRaw ( const MsgPtr& msg, const IpAddrPort& address )
     }
 #endif // NOT RELEASE
 
-    const string buffer = ::Protocol::encode ( msg );
+    ::Protocol::encode ( msg, _msgBuffer );
 
-    LOG ( "Encoded '%s' to [ %u bytes ]", msg, buffer.size() );
+    LOG_TRACE ( LOG_MODULE_SOCKET, "Encoded '%s' to [ %u bytes ]", msg, _msgBuffer.size() );
 
-    if ( !buffer.empty() && buffer.size() <= 256 )
-        LOG ( "Hex: %s", formatAsHex ( buffer ) );
+    if ( !_msgBuffer.empty() && _msgBuffer.size() <= 256 )
+        LOG_TRACE ( LOG_MODULE_SOCKET, "Hex: %s", formatAsHex ( _msgBuffer.data(), _msgBuffer.size() ) );
+}
 
+bool UdpSocket::sendBytes ( const char *bytes, size_t len, const IpAddrPort& address )
+{
     // Real UDP sockets send directly
     if ( isReal()  )
-        return Socket::send ( &buffer[0], buffer.size(), address.empty() ? this->address : address );
+        return Socket::send ( bytes, len, address.empty() ? this->address : address );
 
     // Child UDP sockets send via parent if not disconnected
     if ( isChild() && _parentSocket )
-        return _parentSocket->Socket::send ( &buffer[0], buffer.size(), address.empty() ? this->address : address );
+        return _parentSocket->Socket::send ( bytes, len, address.empty() ? this->address : address );
 
     LOG_UDP_SOCKET ( this, "Cannot send over disconnected socket" );
     return false;
@@ -298,6 +313,63 @@ void UdpSocket::goBackNSendRaw ( GoBackN *gbn, const MsgPtr& msg )
     sendRaw ( msg, getRemoteAddress() );
 }
 
+size_t UdpSocket::goBackNSendBatch ( GoBackN *gbn, const MsgPtr *msgs, size_t count, size_t maxBytes )
+{
+    ASSERT ( gbn == &_gbn );
+    ASSERT ( getRemoteAddress().empty() == false );
+    ASSERT ( count > 0 );
+
+    _datagram.clear();
+
+    size_t i = 0;
+
+    for ( ; i < count; ++i )
+    {
+        encodeRaw ( msgs[i] );
+
+        // Always send at least one message
+        if ( i > 0 && _datagram.size() + _msgBuffer.size() > maxBytes )
+            break;
+
+        _datagram.append ( _msgBuffer.data(), _msgBuffer.size() );
+    }
+
+    LOG_TRACE ( LOG_MODULE_SOCKET, "Sending [ %u messages ] in [ %u bytes ]", i, _datagram.size() );
+
+    sendBytes ( &_datagram[0], _datagram.size(), getRemoteAddress() );
+    return i;
+}
+
+void UdpSocket::goBackNAckPending ( GoBackN *gbn )
+{
+    ASSERT ( gbn == &_gbn );
+
+    if ( ! SocketManager::get().isBatching() )
+    {
+        gbn->sendPendingAck();
+        return;
+    }
+
+    // Messages sent later in the same batch can carry the ACK, otherwise it is sent when the batch ends.
+    // Child sockets aren't added to SocketManager, so their parent sends the ACK.
+    if ( isChild() )
+        SocketManager::get().addPendingAck ( _parentSocket );
+    else
+        SocketManager::get().addPendingAck ( this );
+}
+
+void UdpSocket::sendPendingAcks()
+{
+    if ( ! isServer() )
+    {
+        _gbn.sendPendingAck();
+        return;
+    }
+
+    for ( auto& kv : _childSockets )
+        kv.second->getAsUDP()._gbn.sendPendingAck();
+}
+
 void UdpSocket::goBackNRecvRaw ( GoBackN *gbn, const MsgPtr& msg )
 {
     ASSERT ( gbn == &_gbn );
@@ -468,6 +540,18 @@ void UdpSocket::socketRead ( const MsgPtr& msg, const IpAddrPort& address )
     }
 }
 
+HashType UdpSocket::getHashTypeFrom ( const IpAddrPort& address ) const
+{
+    if ( isServer() )
+    {
+        const auto it = _childSockets.find ( address );
+        if ( it != _childSockets.end() )
+            return it->second->getHashType();
+    }
+
+    return getHashType();
+}
+
 void UdpSocket::socketReadAddressed ( const MsgPtr& msg, const IpAddrPort& address )
 {
     UdpSocket *socket;
@@ -608,6 +692,31 @@ void UdpSocket::setKeepAlive ( uint64_t timeout )
         _gbn.setKeepAlive ( _keepAlive = timeout );
 }
 
+void UdpSocket::setSelectiveRepeat ( bool enabled )
+{
+    _gbn.setSelectiveRepeat ( enabled );
+
+    if ( isServer() )
+    {
+        for ( auto& kv : _childSockets )
+            kv.second->getAsUDP()._gbn.setSelectiveRepeat ( enabled );
+    }
+}
+
+void UdpSocket::setMaxDatagramSize ( size_t size )
+{
+    // Larger datagrams would need an oversized slab for every read
+    ASSERT ( size <= READ_SLAB_SIZE );
+
+    _gbn.setMaxDatagramSize ( size );
+
+    if ( isServer() )
+    {
+        for ( auto& kv : _childSockets )
+            kv.second->getAsUDP()._gbn.setMaxDatagramSize ( size );
+    }
+}
+
 void UdpSocket::resetGbnState()
 {
     _gbn.reset();
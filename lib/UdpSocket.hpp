@@ -80,6 +80,22 @@ public:
     uint64_t getKeepAlive() const { return _keepAlive; }
     void setKeepAlive ( uint64_t timeout );
 
+    // Get / set if sequenced messages are resent with selective repeat instead of go-back-N.
+    // Both ends must enable this; a server socket applies it to its current and future child sockets.
+    bool isSelectiveRepeat() const { return _gbn.isSelectiveRepeat(); }
+    void setSelectiveRepeat ( bool enabled ) override;
+
+    // Server sockets decode the datagrams of their child sockets, so use the hash type of the addressed child socket
+    HashType getHashTypeFrom ( const IpAddrPort& address ) const override;
+
+    // Seed the selective repeat retransmit timeout with the latency measured by Pinger
+    void setLatency ( const Statistics& latency ) override { _gbn.setLatency ( latency ); }
+
+    // Get / set the maximum datagram size for sending several sequenced messages together, see GoBackN.
+    // A server socket applies this to its current and future child sockets. This can't be more than READ_SLAB_SIZE.
+    size_t getMaxDatagramSize() const { return _gbn.getMaxDatagramSize(); }
+    void setMaxDatagramSize ( size_t size );
+
     // Listen for connections.
     // Can only be used on a connection-less socket, where address.addr is empty.
     // Changes the type to a message-based, UDP server socket.
@@ -114,6 +130,9 @@ private:
     // Child sockets
     std::unordered_map<IpAddrPort, SocketPtr> _childSockets;
 
+    // Buffer for sending several messages in a single datagram
+    std::string _datagram;
+
     // Currently accepted socket
     SocketPtr _acceptedSocket;
 
@@ -122,9 +141,14 @@ private:
 
     // GoBackN callbacks
     void goBackNSendRaw ( GoBackN *gbn, const MsgPtr& msg ) override;
+    size_t goBackNSendBatch ( GoBackN *gbn, const MsgPtr *msgs, size_t count, size_t maxBytes ) override;
     void goBackNRecvRaw ( GoBackN *gbn, const MsgPtr& msg ) override;
     void goBackNRecvMsg ( GoBackN *gbn, const MsgPtr& msg ) override;
     void goBackNTimeout ( GoBackN *gbn ) override;
+    void goBackNAckPending ( GoBackN *gbn ) override;
+
+    // Send the pending ACKs of this socket, or of the child sockets of a server socket
+    void sendPendingAcks() override;
 
     // Callback into the correctly addressed socket
     void socketReadAddressed ( const MsgPtr& msg, const IpAddrPort& address );
@@ -132,6 +156,12 @@ private:
     // Send a protocol message directly, not over GoBackN
     bool sendRaw ( const MsgPtr& msg, const IpAddrPort& address );
 
+    // Encode a message into _msgBuffer
+    void encodeRaw ( const MsgPtr& msg );
+
+    // Send encoded bytes in a single datagram
+    bool sendBytes ( const char *bytes, size_t len, const IpAddrPort& address );
+
     // Construct a server socket
     UdpSocket ( Socket::Owner *owner, uint16_t port, const Type& type, bool isRaw );
 
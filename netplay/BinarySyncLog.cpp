@@ -0,0 +1,403 @@
+#include "BinarySyncLog.hpp"
+#include "LaneHash.hpp"
+#include "Logger.hpp"
+#include "Algorithms.hpp"
+
+#include <cstring>
+#include <algorithm>
+
+using namespace std;
+
+
+// Size of the raw RngState in a full RngState record
+#define RNG_STATE_SIZE ( sizeof ( uint32_t ) * 3 + CC_RNG_STATE3_SIZE )
+
+
+static void getRawRngState ( const RngState& rngState, char *data )
+{
+    memcpy ( &data[0], &rngState.rngState0, sizeof ( uint32_t ) );
+    memcpy ( &data[4], &rngState.rngState1, sizeof ( uint32_t ) );
+    memcpy ( &data[8], &rngState.rngState2, sizeof ( uint32_t ) );
+    copy ( rngState.rngState3.begin(), rngState.rngState3.end(), &data[12] );
+}
+
+uint64_t BinarySyncLog::getDigest ( const RngState& rngState )
+{
+    char data [ RNG_STATE_SIZE ];
+    getRawRngState ( rngState, data );
+    return LaneHash::hash ( data, sizeof ( data ) );
+}
+
+
+#ifdef DISABLE_LOGGING
+
+void BinarySyncLog::initialize ( const string& filePath, uint32_t options ) {}
+void BinarySyncLog::deinitialize() {}
+void BinarySyncLog::release() {}
+void BinarySyncLog::flush() {}
+void BinarySyncLog::log ( const char *srcFile, int srcLine, const char *srcFunc, const char *logMessage ) {}
+void BinarySyncLog::logFrame ( uint32_t gameMode, NetplayState state, IndexedFrame indexedFrame,
+                               const Frame& frame ) {}
+void BinarySyncLog::logRngState ( uint32_t gameMode, NetplayState state, IndexedFrame indexedFrame,
+                                  const RngState& rngState ) {}
+
+#else
+
+void BinarySyncLog::initialize ( const string& filePath, uint32_t options )
+{
+    string path = filePath;
+
+    if ( options & PID_IN_FILENAME )
+    {
+        const size_t i = filePath.find_last_of ( '.' );
+        path = filePath.substr ( 0, i ) + format ( "_%08d", _getpid() ) + filePath.substr ( i );
+    }
+
+    if ( _initialized )
+    {
+        if ( path == _filePath )
+            return;
+
+        // Keep the session and log ID when switching files
+        const string id = sessionId, logId = _logId;
+        deinitialize();
+        sessionId = id;
+        _logId = logId;
+    }
+
+    _fd = fopen ( path.c_str(), "wb" );
+
+    if ( ! _fd )
+    {
+        LOG ( "Failed to open '%s'", path );
+        return;
+    }
+
+    FileHeader header;
+    memcpy ( header.magic, SYNC_LOG_MAGIC, sizeof ( header.magic ) );
+    header.version = SYNC_LOG_VERSION;
+    fwrite ( &header, sizeof ( header ), 1, _fd );
+
+    if ( _logId.empty() )
+        _logId = generateRandomId();
+
+    _filePath = path;
+    _ring.resize ( SYNC_LOG_RING_SIZE );
+    _head = _tail = 0;
+    _stalls = 0;
+    _flushing = _stopping = false;
+    _initialized = true;
+
+    _thread.start();
+}
+
+void BinarySyncLog::deinitialize()
+{
+    if ( ! _initialized )
+        return;
+
+    {
+        LOCK ( _mutex );
+        _stopping = true;
+        _flushCond.signal();
+    }
+
+    // The flush thread writes everything left in the ring buffer before it stops
+    _thread.join();
+
+    fclose ( _fd );
+
+    sessionId.clear();
+    _filePath.clear();
+    _logId.clear();
+    _fd = 0;
+    _initialized = false;
+
+    vector<char>().swap ( _ring );
+}
+
+void BinarySyncLog::release()
+{
+    if ( ! _initialized )
+        return;
+
+    _thread.release();
+    _initialized = false;
+}
+
+void BinarySyncLog::flush()
+{
+    if ( ! _initialized )
+        return;
+
+    const size_t head = _head.load ( memory_order_relaxed );
+
+    LOCK ( _mutex );
+
+    while ( _tail.load ( memory_order_acquire ) != head )
+    {
+        _flushing = true;
+        _flushCond.signal();
+        _flushedCond.wait ( _mutex );
+    }
+}
+
+void BinarySyncLog::log ( const char *srcFile, int srcLine, const char *srcFunc, const char *logMessage )
+{
+    push ( Text, 0, NetplayState(), {{ 0, 0 }}, logMessage, min<size_t> ( strlen ( logMessage ), SYNC_LOG_MAX_TEXT ) );
+}
+
+void BinarySyncLog::logFrame ( uint32_t gameMode, NetplayState state, IndexedFrame indexedFrame, const Frame& frame )
+{
+    push ( FrameState, gameMode, state, indexedFrame, &frame, sizeof ( frame ) );
+}
+
+void BinarySyncLog::logRngState ( uint32_t gameMode, NetplayState state, IndexedFrame indexedFrame,
+                                  const RngState& rngState )
+{
+    char data [ RNG_STATE_SIZE ];
+    getRawRngState ( rngState, data );
+
+    push ( FullRngState, gameMode, state, indexedFrame, data, sizeof ( data ) );
+}
+
+#endif // DISABLE_LOGGING
+
+
+void BinarySyncLog::push ( RecordType type, uint32_t gameMode, NetplayState state, IndexedFrame indexedFrame,
+                           const void *data, size_t size )
+{
+    if ( ! _initialized )
+        return;
+
+    const size_t recordSize = ( sizeof ( RecordHeader ) + size + sizeof ( RecordHeader ) - 1 )
+                              / sizeof ( RecordHeader ) * sizeof ( RecordHeader );
+    const size_t mask = _ring.size() - 1;
+
+    size_t head = _head.load ( memory_order_relaxed );
+    size_t offset = ( head & mask );
+
+    // Records aren't split across the end of the ring buffer, the rest of it is padded instead
+    const size_t contiguous = _ring.size() - offset;
+    const size_t needed = recordSize + ( contiguous < recordSize ? contiguous : 0 );
+
+    if ( _ring.size() - ( head - _tail.load ( memory_order_acquire ) ) < needed )
+    {
+        LOCK ( _mutex );
+
+        ++_stalls;
+
+        while ( _ring.size() - ( head - _tail.load ( memory_order_acquire ) ) < needed )
+        {
+            _flushing = true;
+            _flushCond.signal();
+            _flushedCond.wait ( _mutex );
+        }
+    }
+
+    if ( contiguous < recordSize )
+    {
+        RecordHeader& padding = * ( RecordHeader * ) &_ring[offset];
+        memset ( &padding, 0, sizeof ( padding ) );
+        padding.type = Padding;
+        padding.size = contiguous;
+
+        head += contiguous;
+        offset = 0;
+    }
+
+    RecordHeader& header = * ( RecordHeader * ) &_ring[offset];
+    header.type = type;
+    header.netplayState = state.value;
+    header.size = recordSize;
+    header.gameMode = gameMode;
+    header.index = indexedFrame.parts.index;
+    header.frame = indexedFrame.parts.frame;
+
+    char *payload = &_ring [ offset + sizeof ( RecordHeader ) ];
+    memcpy ( payload, data, size );
+    memset ( payload + size, 0, recordSize - sizeof ( RecordHeader ) - size );
+
+    _head.store ( head + recordSize, memory_order_release );
+}
+
+void BinarySyncLog::drain()
+{
+    const size_t head = _head.load ( memory_order_acquire );
+    size_t tail = _tail.load ( memory_order_relaxed );
+
+    if ( tail == head )
+        return;
+
+    while ( tail != head )
+    {
+        const size_t offset = ( tail & ( _ring.size() - 1 ) );
+        const size_t count = min ( head - tail, _ring.size() - offset );
+
+        fwrite ( &_ring[offset], 1, count, _fd );
+
+        tail += count;
+        _tail.store ( tail, memory_order_release );
+    }
+
+    fflush ( _fd );
+}
+
+void BinarySyncLog::FlushThread::run()
+{
+    log.flushRing();
+}
+
+void BinarySyncLog::flushRing()
+{
+    for ( ;; )
+    {
+        bool stopping;
+
+        {
+            LOCK ( _mutex );
+
+            if ( ! _flushing && ! _stopping )
+                _flushCond.wait ( _mutex, SYNC_LOG_FLUSH_INTERVAL );
+
+            _flushing = false;
+            stopping = _stopping;
+        }
+
+        drain();
+
+        {
+            LOCK ( _mutex );
+            _flushedCond.broadcast();
+        }
+
+        if ( stopping )
+            return;
+    }
+}
+
+
+bool BinarySyncLog::decode ( const string& binaryFile, const string& textFile )
+{
+    FILE *in = fopen ( binaryFile.c_str(), "rb" );
+
+    if ( ! in )
+    {
+        LOG ( "Failed to open '%s'", binaryFile );
+        return false;
+    }
+
+    FileHeader fileHeader;
+
+    if ( fread ( &fileHeader, sizeof ( fileHeader ), 1, in ) != 1
+            || memcmp ( fileHeader.magic, SYNC_LOG_MAGIC, sizeof ( fileHeader.magic ) ) != 0
+            || fileHeader.version != SYNC_LOG_VERSION )
+    {
+        LOG ( "Invalid binary sync log '%s'", binaryFile );
+        fclose ( in );
+        return false;
+    }
+
+    FILE *out = fopen ( textFile.c_str(), "w" );
+
+    if ( ! out )
+    {
+        LOG ( "Failed to open '%s'", textFile );
+        fclose ( in );
+        return false;
+    }
+
+    vector<char> buffer ( 1024 * 1024 );
+    setvbuf ( out, &buffer[0], _IOFBF, buffer.size() );
+
+    RecordHeader header;
+    vector<char> payload;
+
+    // A truncated record at the end of the file is ignored, since the game could have stopped while it was written
+    while ( fread ( &header, sizeof ( header ), 1, in ) == 1 )
+    {
+        if ( header.size < sizeof ( header ) || header.size % sizeof ( header ) != 0 )
+        {
+            LOG ( "Invalid record size %u", header.size );
+            break;
+        }
+
+        payload.resize ( header.size - sizeof ( header ) );
+
+        if ( ! payload.empty() && fread ( &payload[0], payload.size(), 1, in ) != 1 )
+            break;
+
+        if ( header.type == Padding )
+            continue;
+
+        if ( header.type == Text )
+        {
+            fprintf ( out, "%s\n", string ( &payload[0], strnlen ( &payload[0], payload.size() ) ).c_str() );
+            continue;
+        }
+
+        const string prefix = format ( "%s [%u] %s [%u:%u] ", gameModeStr ( header.gameMode ), header.gameMode,
+                                       NetplayState ( ( NetplayState::Enum ) header.netplayState ).str(),
+                                       header.index, header.frame );
+
+        if ( header.type == FullRngState && payload.size() >= RNG_STATE_SIZE )
+        {
+            RngState rngState ( 0 );
+            memcpy ( &rngState.rngState0, &payload[0], sizeof ( uint32_t ) );
+            memcpy ( &rngState.rngState1, &payload[4], sizeof ( uint32_t ) );
+            memcpy ( &rngState.rngState2, &payload[8], sizeof ( uint32_t ) );
+            copy ( &payload[12], &payload[12 + CC_RNG_STATE3_SIZE], rngState.rngState3.begin() );
+
+            fprintf ( out, "%sRngState: %s\n", prefix.c_str(), rngState.dump().c_str() );
+            continue;
+        }
+
+        if ( header.type != FrameState || payload.size() < sizeof ( Frame ) )
+        {
+            LOG ( "Unknown record type %u", header.type );
+            continue;
+        }
+
+        Frame frame;
+        memcpy ( &frame, &payload[0], sizeof ( frame ) );
+
+        if ( frame.flags & SYNC_LOG_RNG_STATE )
+            fprintf ( out, "%sRngState: %016llx\n", prefix.c_str(), ( unsigned long long ) frame.rngState );
+
+        if ( frame.flags & ( SYNC_LOG_INPUTS | SYNC_LOG_REINPUTS ) )
+        {
+            fprintf ( out, "%s%s: 0x%04x 0x%04x\n", prefix.c_str(),
+                      ( frame.flags & SYNC_LOG_REINPUTS ) ? "Reinputs" : "Inputs", frame.inputs[0], frame.inputs[1] );
+        }
+
+        if ( frame.flags & SYNC_LOG_CHARA_SELECT )
+        {
+            fprintf ( out, "%sP1: sel=%u; C=%u; M=%u; c=%u; P2: sel=%u; C=%u; M=%u; c=%u\n", prefix.c_str(),
+                      frame.selectorMode[0], frame.chara[0].chara, frame.chara[0].moon, frame.chara[0].color,
+                      frame.selectorMode[1], frame.chara[1].chara, frame.chara[1].moon, frame.chara[1].color );
+        }
+
+        if ( frame.flags & SYNC_LOG_CHARACTERS )
+        {
+            for ( uint32_t i = 0; i < 2; ++i )
+            {
+                const Character& c = frame.chara[i];
+
+                fprintf ( out, "%sP%u: C=%u; M=%u; c=%u; seq=%u; st=%u; hp=%u; rh=%u; gb=%.1f; gq=%.1f; mt=%u; ht=%u; "
+                          "x=%d; y=%d\n", prefix.c_str(), i + 1, c.chara, c.moon, c.color, c.seq, c.seqState, c.health,
+                          c.redHealth, c.guardBar, c.guardQuality, c.meter, c.heat, c.x, c.y );
+            }
+        }
+
+        if ( frame.flags & SYNC_LOG_ROUND )
+        {
+            fprintf ( out, "%sroundOverTimer=%d; introState=%u; roundTimer=%u; realTimer=%u; hitsparks=%u; "
+                      "camera={ %d, %d }\n", prefix.c_str(), frame.roundOverTimer, frame.introState, frame.roundTimer,
+                      frame.realTimer, frame.hitsparks, frame.cameraX, frame.cameraY );
+        }
+    }
+
+    fclose ( in );
+    fclose ( out );
+    return true;
+}
@@ -0,0 +1,184 @@
+#pragma once
+
+#include "Constants.hpp"
+#include "Messages.hpp"
+#include "NetplayStates.hpp"
+#include "Thread.hpp"
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <cstdio>
+
+
+// Magic bytes at the start of a binary sync log file
+#define SYNC_LOG_MAGIC              "CCSL"
+
+#define SYNC_LOG_VERSION            ( 1 )
+
+// Bytes in the ring buffer between the game thread and the flush thread, must be a power of 2
+#define SYNC_LOG_RING_SIZE          ( 4 * 1024 * 1024 )
+
+// Milliseconds between each flush of the ring buffer to the file
+#define SYNC_LOG_FLUSH_INTERVAL     ( 100 )
+
+// Maximum number of characters of a text record
+#define SYNC_LOG_MAX_TEXT           ( 4096 )
+
+// Parts of the game state logged in a frame record, each is decoded into one line of the text sync log
+#define SYNC_LOG_RNG_STATE          ( 0x01 )    // RngState digest
+#define SYNC_LOG_INPUTS             ( 0x02 )    // Inputs
+#define SYNC_LOG_REINPUTS           ( 0x04 )    // Reinputs, the inputs while re-running after a rollback
+#define SYNC_LOG_CHARA_SELECT       ( 0x08 )    // Selectors of both players
+#define SYNC_LOG_CHARACTERS         ( 0x10 )    // State of each character
+#define SYNC_LOG_ROUND              ( 0x20 )    // Round timers and camera
+
+
+// Sync log that writes fixed size binary records instead of formatting text every frame.
+//
+// Records are copied into a lock-free single producer ring buffer, which is written to the file by a background
+// thread, so logging a frame is just a copy. The text sync log that scripts/sync2replay and scripts/diff.py read
+// is made from a binary sync log with decode.
+//
+// The RngState is only logged as a 64-bit digest every frame, except on the first frame of each transition index,
+// which is where scripts/sync2replay reads the full RngState from.
+//
+// This has the same interface as Logger for text messages, so it can be used with LOG_TO. Only one thread can
+// log at a time.
+class BinarySyncLog
+{
+public:
+
+    struct Character
+    {
+        uint32_t chara, moon, color, seq, seqState, health, redHealth, meter, heat;
+        float guardBar, guardQuality;
+        int32_t x, y;
+    };
+
+    // Frame record, the flags are which parts are logged
+    struct Frame
+    {
+        uint32_t flags = 0;
+
+        uint16_t inputs[2] = { 0, 0 };
+
+        uint64_t rngState = 0;
+
+        uint32_t selectorMode[2] = { 0, 0 };
+
+        Character chara[2] = {};
+
+        int32_t roundOverTimer = 0;
+        uint32_t introState = 0, roundTimer = 0, realTimer = 0, hitsparks = 0;
+        int32_t cameraX = 0, cameraY = 0;
+    };
+
+    // Session ID
+    std::string sessionId;
+
+    ~BinarySyncLog() { deinitialize(); }
+
+    // Initialize / deinitialize logging, only PID_IN_FILENAME is used from the options
+    void initialize ( const std::string& filePath, uint32_t options = 0 );
+    void deinitialize();
+
+    // Let go of the flush thread without joining it, for when threads can't be joined (DLL_PROCESS_DETACH).
+    // Nothing else is logged, and the records still in the ring buffer are lost.
+    void release();
+
+    // Wait until everything logged so far is written to the file
+    void flush();
+
+    // Log the system version
+    void logVersion();
+
+    // Log a text message, the source file, line, and function are ignored like a Logger with no options
+    void log ( const char *srcFile, int srcLine, const char *srcFunc, const char *logMessage );
+
+    // Log the parts of a frame given by the flags
+    void logFrame ( uint32_t gameMode, NetplayState state, IndexedFrame indexedFrame, const Frame& frame );
+
+    // Log the full RngState
+    void logRngState ( uint32_t gameMode, NetplayState state, IndexedFrame indexedFrame, const RngState& rngState );
+
+    // Get the digest of an RngState that is logged in a frame record
+    static uint64_t getDigest ( const RngState& rngState );
+
+    // Number of times logging had to wait for the flush thread because the ring buffer was full
+    size_t getNumStalls() const { return _stalls; }
+
+    // Decode a binary sync log into the text sync log format
+    static bool decode ( const std::string& binaryFile, const std::string& textFile );
+
+private:
+
+    enum RecordType : uint8_t { Padding = 0, Text, FrameState, FullRngState };
+
+    // Header of each record, records are padded to a multiple of 8 bytes
+    struct RecordHeader
+    {
+        uint8_t type, netplayState;
+
+        // Bytes of the record including the header and padding
+        uint16_t size;
+
+        uint32_t gameMode;
+
+        uint32_t index, frame;
+    };
+
+    struct FileHeader
+    {
+        char magic[4];
+        uint32_t version;
+    };
+
+    class FlushThread : public Thread
+    {
+    public:
+        FlushThread ( BinarySyncLog& log ) : log ( log ) {}
+        void run() override;
+
+    private:
+        BinarySyncLog& log;
+    };
+
+    FlushThread _thread { *this };
+
+    Mutex _mutex;
+
+    // Signalled to wake the flush thread, and by the flush thread after writing
+    CondVar _flushCond, _flushedCond;
+
+    bool _flushing = false, _stopping = false;
+
+    // Log file path
+    std::string _filePath;
+
+    // Log identifier, to match up reinitialized logs
+    std::string _logId;
+
+    FILE *_fd = 0;
+
+    bool _initialized = false;
+
+    std::vector<char> _ring;
+
+    // Total bytes ever written to and read from the ring buffer, these only wrap at the size of size_t, which is
+    // a multiple of the ring buffer size. The head is only written by the logging thread, and the tail only by the
+    // flush thread.
+    std::atomic<size_t> _head { 0 }, _tail { 0 };
+
+    size_t _stalls = 0;
+
+    // Copy a record into the ring buffer, waits for the flush thread if the ring buffer is full
+    void push ( RecordType type, uint32_t gameMode, NetplayState state, IndexedFrame indexedFrame,
+                const void *data, size_t size );
+
+    // Write everything in the ring buffer to the file, only called from the flush thread
+    void drain();
+
+    // Drain the ring buffer every interval, or when woken, until stopped
+    void flushRing();
+};
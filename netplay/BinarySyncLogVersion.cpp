@@ -0,0 +1,21 @@
+#include "BinarySyncLog.hpp"
+#include "Logger.hpp"
+
+using namespace std;
+
+
+#ifdef DISABLE_LOGGING
+
+void BinarySyncLog::logVersion() {}
+
+#else
+
+void BinarySyncLog::logVersion()
+{
+    const string version = Logger::formatVersion ( _logId, sessionId );
+
+    // Without the last newline, since each text record is decoded as a line
+    log ( __BASE_FILE__, __LINE__, __PRETTY_FUNCTION__, version.substr ( 0, version.size() - 1 ).c_str() );
+}
+
+#endif
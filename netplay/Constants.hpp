@@ -9,6 +9,9 @@
 // Number of frames of inputs to send per message
 #define NUM_INPUTS                  ( 30 )
 
+// Message hash type to use once both sides support ClientMode::FastHash
+#define FAST_HASH_TYPE              ( HashType::Xxh64 )
+
 // Max allow rollback frames
 #define MAX_ROLLBACK                ( 15 )
 
@@ -19,6 +22,22 @@
 #define NUM_ROLLBACK_STATES         ( 256 )
 #endif
 
+// Number of rollback states between full copies of the game state, the states in between only save the changes
+#define ROLLBACK_KEYFRAME_INTERVAL  ( 8 )
+
+// Memory budget for compressed rollback states older than NUM_ROLLBACK_STATES, 0 to disable
+#ifdef RELEASE
+#define ROLLBACK_HISTORY_BUDGET     ( 0 )
+#else
+#define ROLLBACK_HISTORY_BUDGET     ( 64 * 1024 * 1024 )
+#endif
+
+// Number of frames between rollback states kept in the compressed history
+#define ROLLBACK_HISTORY_INTERVAL   ( 10 )
+
+// Default time budget per frame for hashing the whole game memory, in microseconds
+#define FULL_STATE_HASH_BUDGET      ( 250 )
+
 
 // Game constants and addresses are prefixed CC
 #define CC_VERSION                  "1.4.0"
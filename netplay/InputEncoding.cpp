@@ -0,0 +1,283 @@
+#include "InputEncoding.hpp"
+#include "Messages.hpp"
+
+using namespace std;
+
+
+#define DIRECTION_BITS      ( 4 )
+#define BUTTONS_BITS        ( 12 )
+#define NARROW_BUTTONS_BITS ( 8 )
+#define BUTTON_INDEX_BITS   ( 4 )
+#define RUN_LENGTH_BITS     ( 5 )
+
+#define DIRECTION_MASK      ( ( 1u << DIRECTION_BITS ) - 1 )
+
+
+class BitWriter
+{
+public:
+
+    BitWriter ( string& bytes ) : _bytes ( bytes ) {}
+
+    ~BitWriter()
+    {
+        if ( _count )
+            _bytes.push_back ( ( char ) _bits );
+    }
+
+    void write ( uint32_t value, uint8_t numBits )
+    {
+        _bits |= ( value << _count );
+        _count += numBits;
+
+        while ( _count >= 8 )
+        {
+            _bytes.push_back ( ( char ) ( _bits & 0xFF ) );
+            _bits >>= 8;
+            _count -= 8;
+        }
+    }
+
+private:
+
+    string& _bytes;
+
+    uint32_t _bits = 0;
+
+    uint8_t _count = 0;
+};
+
+
+class BitReader
+{
+public:
+
+    BitReader ( const string& bytes, size_t& pos ) : _bytes ( bytes ), _pos ( pos ) {}
+
+    bool read ( uint32_t& value, uint8_t numBits )
+    {
+        while ( _count < numBits )
+        {
+            if ( _pos >= _bytes.size() )
+                return false;
+
+            _bits |= ( uint32_t ( uint8_t ( _bytes[_pos++] ) ) << _count );
+            _count += 8;
+        }
+
+        value = _bits & ( ( 1u << numBits ) - 1 );
+        _bits >>= numBits;
+        _count -= numBits;
+        return true;
+    }
+
+private:
+
+    const string& _bytes;
+
+    size_t& _pos;
+
+    uint32_t _bits = 0;
+
+    uint8_t _count = 0;
+};
+
+
+void encodeInputs ( const uint16_t *inputs, size_t count, string& bytes )
+{
+    BitWriter writer ( bytes );
+
+    uint16_t previous = 0;
+
+    for ( size_t i = 0; i < count; )
+    {
+        const uint16_t input = inputs[i];
+
+        size_t length = 1;
+        while ( i + length < count && inputs[i + length] == input && length < INPUT_ENCODING_MAX_RUN )
+            ++length;
+
+        writer.write ( length - 1, RUN_LENGTH_BITS );
+
+        const uint16_t direction = ( input & DIRECTION_MASK );
+        const uint16_t buttons = ( ( input ^ previous ) >> DIRECTION_BITS );
+
+        if ( direction != ( previous & DIRECTION_MASK ) )
+        {
+            writer.write ( 1, 1 );
+            writer.write ( direction, DIRECTION_BITS );
+        }
+        else
+        {
+            writer.write ( 0, 1 );
+        }
+
+        if ( buttons && ! ( buttons & ( buttons - 1 ) ) )
+        {
+            // Usually a single button is pressed or released
+            uint32_t index = 0;
+            while ( ! ( buttons & ( 1u << index ) ) )
+                ++index;
+
+            writer.write ( 1, 1 );
+            writer.write ( 1, 1 );
+            writer.write ( index, BUTTON_INDEX_BITS );
+        }
+        else if ( buttons )
+        {
+            const bool wide = ( buttons >> NARROW_BUTTONS_BITS );
+
+            writer.write ( 1, 1 );
+            writer.write ( 0, 1 );
+            writer.write ( wide, 1 );
+            writer.write ( buttons, wide ? BUTTONS_BITS : NARROW_BUTTONS_BITS );
+        }
+        else
+        {
+            writer.write ( 0, 1 );
+        }
+
+        previous = input;
+        i += length;
+    }
+}
+
+bool decodeInputs ( const string& bytes, size_t& pos, uint16_t *inputs, size_t count )
+{
+    BitReader reader ( bytes, pos );
+
+    uint16_t previous = 0;
+    uint32_t length, changed, value;
+
+    for ( size_t i = 0; i < count; )
+    {
+        if ( ! reader.read ( length, RUN_LENGTH_BITS ) )
+            return false;
+
+        ++length;
+
+        if ( i + length > count )
+            return false;
+
+        uint16_t input = previous;
+
+        if ( ! reader.read ( changed, 1 ) )
+            return false;
+
+        if ( changed )
+        {
+            if ( ! reader.read ( value, DIRECTION_BITS ) )
+                return false;
+
+            input = ( input & ~DIRECTION_MASK ) | value;
+        }
+
+        if ( ! reader.read ( changed, 1 ) )
+            return false;
+
+        if ( changed )
+        {
+            uint32_t single, wide;
+
+            if ( ! reader.read ( single, 1 ) )
+                return false;
+
+            if ( single )
+            {
+                if ( ! reader.read ( value, BUTTON_INDEX_BITS ) || value >= BUTTONS_BITS )
+                    return false;
+
+                value = ( 1u << value );
+            }
+            else
+            {
+                if ( ! reader.read ( wide, 1 ) )
+                    return false;
+
+                if ( ! reader.read ( value, wide ? BUTTONS_BITS : NARROW_BUTTONS_BITS ) )
+                    return false;
+            }
+
+            input ^= ( value << DIRECTION_BITS );
+        }
+
+        for ( size_t j = 0; j < length; ++j )
+            inputs[i + j] = input;
+
+        previous = input;
+        i += length;
+    }
+
+    return true;
+}
+
+
+static void saveInputBytes ( cereal::BinaryOutputArchive& ar, const string& bytes )
+{
+    ASSERT ( bytes.size() <= 0xFF );
+
+    ar ( uint8_t ( bytes.size() ), cereal::binary_data ( &bytes[0], bytes.size() ) );
+}
+
+static string loadInputBytes ( cereal::BinaryInputArchive& ar )
+{
+    uint8_t length;
+    ar ( length );
+
+    string bytes ( length, 0 );
+    ar ( cereal::binary_data ( &bytes[0], length ) );
+    return bytes;
+}
+
+
+void CompactPlayerInputs::save ( cereal::BinaryOutputArchive& ar ) const
+{
+    string bytes;
+    encodeInputs ( &playerInputs.inputs[0], playerInputs.size(), bytes );
+
+    ar ( playerInputs.indexedFrame.value );
+    saveInputBytes ( ar, bytes );
+}
+
+void CompactPlayerInputs::load ( cereal::BinaryInputArchive& ar )
+{
+    ar ( playerInputs.indexedFrame.value );
+
+    const string bytes = loadInputBytes ( ar );
+    size_t pos = 0;
+
+    playerInputs.inputs.fill ( 0 );
+
+    // The runs must add up to exactly the frame range of the message, with no bytes left over
+    if ( ! decodeInputs ( bytes, pos, &playerInputs.inputs[0], playerInputs.size() ) || pos != bytes.size() )
+        throw cereal::Exception ( "Invalid input encoding" );
+}
+
+void CompactBothInputs::save ( cereal::BinaryOutputArchive& ar ) const
+{
+    string bytes;
+    encodeInputs ( &bothInputs.inputs[0][0], bothInputs.size(), bytes );
+    encodeInputs ( &bothInputs.inputs[1][0], bothInputs.size(), bytes );
+
+    ar ( bothInputs.indexedFrame.value );
+    saveInputBytes ( ar, bytes );
+}
+
+void CompactBothInputs::load ( cereal::BinaryInputArchive& ar )
+{
+    ar ( bothInputs.indexedFrame.value );
+
+    const string bytes = loadInputBytes ( ar );
+    size_t pos = 0;
+
+    bothInputs.inputs[0].fill ( 0 );
+    bothInputs.inputs[1].fill ( 0 );
+
+    // The runs must add up to exactly the frame range of the message, with no bytes left over
+    if ( ! decodeInputs ( bytes, pos, &bothInputs.inputs[0][0], bothInputs.size() )
+            || ! decodeInputs ( bytes, pos, &bothInputs.inputs[1][0], bothInputs.size() )
+            || pos != bytes.size() )
+    {
+        throw cereal::Exception ( "Invalid input encoding" );
+    }
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+
+
+// Maximum number of frames in a single run of identical inputs
+#define INPUT_ENCODING_MAX_RUN ( 32 )
+
+
+// Compact encoding for a sequence of inputs, see COMBINE_INPUT for the layout of each input.
+//
+// The inputs are split into runs of identical inputs, and each run is delta coded against the previous run,
+// starting from a neutral input. Runs are bit-packed as:
+//
+//   5 bits     run length - 1
+//   1 bit      direction changed, if set followed by the 4-bit direction
+//   1 bit      buttons changed, if set followed by:
+//     1 bit      single button flag, if set followed by the 4-bit index of the only button that changed
+//     otherwise:
+//     1 bit      wide flag
+//     8/12 bits  XOR of the 12-bit buttons with the previous buttons, 8 bits unless the wide flag is set
+//
+// The encoding is padded to a whole number of bytes.
+
+// Append the encoding of count inputs to bytes
+void encodeInputs ( const uint16_t *inputs, size_t count, std::string& bytes );
+
+// Decode count inputs from bytes starting at pos, and advance pos past the encoded inputs.
+// Returns false if the encoding is invalid, or doesn't contain exactly count inputs.
+bool decodeInputs ( const std::string& bytes, size_t& pos, uint16_t *inputs, size_t count );
@@ -7,42 +7,85 @@
 #include <algorithm>
 
 
+// Number of frames of inputs in each page, must be a power of 2.
+// This is small enough that the short indices (CharaSelect, Loading, RetryMenu) don't waste most of a page.
+#define INPUTS_PAGE_SIZE ( 128 )
+
+// Number of pages allocated up front, enough for several minutes of inputs
+#define INPUTS_PREALLOCATED_PAGES ( 128 )
+
+// Default maximum number of bytes of inputs kept, 0 for unlimited
+#define DEFAULT_INPUTS_MEMORY_CAP ( 16 * 1024 * 1024 )
+
+// Maximum number of indices / frames that remote inputs can skip past the known inputs, see isValidRange
+#define INPUTS_MAX_INDEX_GAP ( 16 )
+#define INPUTS_MAX_FRAME_GAP ( 1024 )
+
+
+// Inputs indexed by transition index and frame.
+//
+// The frames of each index are stored in fixed size pages, which are recycled through a free list when older
+// indices are erased, so steady state play doesn't allocate. The indices themselves are stored in a ring buffer,
+// so erasing from the front doesn't move the remaining indices. Each index also tracks the last known input up to
+// and including itself, so the input of an empty index is found without searching the earlier indices.
 template<typename T>
 class InputsContainer
 {
 public:
 
+    InputsContainer()
+    {
+        for ( size_t i = 0; i < INPUTS_PREALLOCATED_PAGES; ++i )
+            releasePage ( newPage() );
+    }
+
     // Get a single input for the given index:frame, returns 0 if none.
     T get ( uint32_t index, uint32_t frame ) const
     {
-        if ( index >= _inputs.size() || _inputs[index].empty() )
+        if ( index >= _count || ! entry ( index ).endFrame )
             return lastInputBefore ( index );
 
-        if ( frame >= _inputs[index].size() )
-            return _inputs[index].back();
+        const Index& e = entry ( index );
+
+        if ( frame >= e.endFrame )
+            return at ( e, e.endFrame - 1 );
 
-        return _inputs[index][frame];
+        return at ( e, frame );
     }
 
     // Get n inputs starting from the given index:frame, ASSERTS if not enough.
     void get ( uint32_t index, uint32_t frame, T *t, size_t n ) const
     {
-        ASSERT ( index < _inputs.size() );
-        ASSERT ( frame + n <= _inputs[index].size() );
+        ASSERT ( index < _count );
+        ASSERT ( frame + n <= entry ( index ).endFrame );
 
-        std::copy ( _inputs[index].begin() + frame,
-                    _inputs[index].begin() + frame + n, t );
+        const Index& e = entry ( index );
+
+        while ( n )
+        {
+            const size_t offset = ( frame & ( INPUTS_PAGE_SIZE - 1 ) );
+            const size_t count = std::min ( n, INPUTS_PAGE_SIZE - offset );
+            const T *page = &_pages[e.pages[frame / INPUTS_PAGE_SIZE]][offset];
+
+            std::copy ( page, page + count, t );
+
+            t += count;
+            frame += count;
+            n -= count;
+        }
     }
 
     // Set a single input for the given index:frame, CANNOT change existing inputs.
     void set ( uint32_t index, uint32_t frame, T t )
     {
-        if ( _inputs.size() > index && _inputs[index].size() > frame )
+        if ( _count > index && entry ( index ).endFrame > frame )
             return;
 
         resize ( index, frame );
 
-        _inputs[index][frame] = t;
+        at ( entry ( index ), frame ) = t;
+
+        updateLast ( index );
     }
 
     // Assign a single input for the given index:frame, CAN change existing inputs
@@ -50,7 +93,9 @@ public:
     {
         resize ( index, frame );
 
-        _inputs[index][frame] = t;
+        at ( entry ( index ), frame ) = t;
+
+        updateLast ( index );
     }
 
     // Fill n inputs with the same given value starting from the given index:frame, CAN change existing inputs.
@@ -58,8 +103,9 @@ public:
     {
         resize ( index, frame, n );
 
-        std::fill ( _inputs[index].begin() + frame,
-                    _inputs[index].begin() + frame + n, t );
+        fill ( entry ( index ), frame, frame + n, t );
+
+        updateLast ( index );
     }
 
     // Set n inputs starting from the given index:frame, CAN change existing inputs.
@@ -67,23 +113,44 @@ public:
     {
         if ( index >= checkStartingFromIndex )
         {
-            IndexedFrame f;
-            size_t i;
+            const size_t i = findChanged ( index, frame, t, n );
 
-            for ( i = 0, f = {{ frame, index }}; i < n; ++i, ++f.parts.frame )
+            // Indicate changed if the input is different from the last known input
+            if ( i < n )
             {
-                if ( get ( f.parts.index, f.parts.frame ) == t[i] )
-                    continue;
-
-                // Indicate changed if the input is different from the last known input
+                const IndexedFrame f = {{ uint32_t ( frame + i ), index }};
                 _lastChangedFrame.value = std::min ( _lastChangedFrame.value, f.value );
-                break;
             }
         }
 
         resize ( index, frame, n );
 
-        std::copy ( t, t + n, &_inputs[index][frame] );
+        Index& e = entry ( index );
+
+        while ( n )
+        {
+            const size_t offset = ( frame & ( INPUTS_PAGE_SIZE - 1 ) );
+            const size_t count = std::min ( n, INPUTS_PAGE_SIZE - offset );
+
+            std::copy ( t, t + count, &_pages[e.pages[frame / INPUTS_PAGE_SIZE]][offset] );
+
+            t += count;
+            frame += count;
+            n -= count;
+        }
+
+        updateLast ( index );
+    }
+
+    // Check if n inputs starting from index:frame are close enough to the known inputs to be set.
+    // Remote inputs are always just after the known inputs, anything further can only be corrupt or malicious,
+    // and would otherwise allocate memory for every index and frame skipped.
+    bool isValidRange ( uint32_t index, uint32_t frame, size_t n ) const
+    {
+        if ( index >= _count + INPUTS_MAX_INDEX_GAP || n > INPUTS_MAX_FRAME_GAP )
+            return false;
+
+        return ( uint64_t ( frame ) <= uint64_t ( getEndFrame ( index ) ) + INPUTS_MAX_FRAME_GAP );
     }
 
     // Resize the container so that it can contain inputs up to index:frame+n.
@@ -91,65 +158,80 @@ public:
     {
         T last = 0;
 
-        if ( index >= _inputs.size() )
-        {
-            last = lastInputBefore ( _inputs.size() );
-            _inputs.resize ( index + 1 );
-        }
-        else if ( ! _inputs[index].empty() )
+        if ( index >= _count )
         {
-            last = _inputs[index].back();
+            last = lastInputBefore ( _count );
+            grow ( index + 1 );
         }
 
-        if ( frame + n > _inputs[index].size() )
-            _inputs[index].resize ( frame + n, last );
+        const Index& e = entry ( index );
+
+        if ( frame + n <= e.endFrame )
+            return;
+
+        if ( e.endFrame )
+            last = at ( e, e.endFrame - 1 );
+
+        extend ( index, frame + n, last );
     }
 
     void clear()
     {
-        _inputs.clear();
+        for ( size_t i = 0; i < _count; ++i )
+            release ( entry ( i ) );
+
+        _head = _count = 0;
     }
 
     bool empty() const
     {
-        return _inputs.empty();
+        return ! _count;
     }
 
     bool empty ( size_t index ) const
     {
-        if ( index >= _inputs.size() )
+        if ( index >= _count )
             return true;
 
-        return _inputs[index].empty();
+        return ! entry ( index ).endFrame;
     }
 
     uint32_t getEndIndex() const
     {
-        return _inputs.size();
+        return _count;
     }
 
     uint32_t getEndFrame() const
     {
-        if ( _inputs.empty() )
+        if ( ! _count )
             return 0;
 
-        return _inputs.back().size();
+        return entry ( _count - 1 ).endFrame;
     }
 
     uint32_t getEndFrame ( size_t index ) const
     {
-        if ( index >= _inputs.size() )
+        if ( index >= _count )
             return 0;
 
-        return _inputs[index].size();
+        return entry ( index ).endFrame;
     }
 
     void eraseIndexOlderThan ( size_t index )
     {
-        if ( index + 1 >= _inputs.size() )
-            _inputs.clear();
-        else
-            _inputs.erase ( _inputs.begin(), _inputs.begin() + index );
+        if ( index + 1 >= _count )
+        {
+            clear();
+            return;
+        }
+
+        for ( size_t i = 0; i < index; ++i )
+            release ( entry ( i ) );
+
+        _head = ( _head + index ) & ( _indices.size() - 1 );
+        _count -= index;
+
+        updateLast ( 0 );
     }
 
     IndexedFrame getLastChangedFrame() const
@@ -162,31 +244,288 @@ public:
         _lastChangedFrame = MaxIndexedFrame;
     }
 
+    // Get / set the maximum number of bytes of inputs kept, 0 for unlimited.
+    // When exceeded, the inputs of the oldest indices are discarded, as if they were never set.
+    // Indices at or after the preserve start index are never discarded, instead the cap is exceeded.
+    size_t getMemoryCap() const
+    {
+        return _memoryCap;
+    }
+
+    void setMemoryCap ( size_t memoryCap )
+    {
+        _memoryCap = memoryCap;
+    }
+
+    // Get / set the first index that must never be discarded, UINT_MAX if only the index being set is needed
+    uint32_t getPreserveStartIndex() const
+    {
+        return _preserveStartIndex;
+    }
+
+    void setPreserveStartIndex ( uint32_t index )
+    {
+        _preserveStartIndex = index;
+    }
+
+    // Get the number of bytes of inputs currently in use
+    size_t getMemoryUsage() const
+    {
+        return ( _pages.size() - _freePages.size() ) * INPUTS_PAGE_SIZE * sizeof ( T );
+    }
+
 private:
 
-    // Mapping: index -> frame -> input
-    std::vector<std::vector<T>> _inputs;
+    struct Index
+    {
+        // Number of frames of inputs for this index
+        uint32_t endFrame = 0;
+
+        // Last input of this index, or of the closest earlier index with inputs if this index is empty
+        T last = 0;
+
+        // Ids of the pages containing the inputs for this index, in order of frames
+        std::vector<uint32_t> pages;
+    };
+
+    // All allocated pages, each containing INPUTS_PAGE_SIZE inputs
+    std::vector<std::vector<T>> _pages;
+
+    // Ids of the pages that are not in use
+    std::vector<uint32_t> _freePages;
+
+    // Ring buffer of indices, index i is stored at ( _head + i ) & ( _indices.size() - 1 ).
+    // The size of the ring buffer is always a power of 2.
+    std::vector<Index> _indices;
+
+    // Position of index 0 in the ring buffer, and the number of indices
+    size_t _head = 0, _count = 0;
+
+    // Maximum number of bytes of inputs kept
+    size_t _memoryCap = DEFAULT_INPUTS_MEMORY_CAP;
+
+    // First index that is never discarded because of the memory cap
+    uint32_t _preserveStartIndex = UINT_MAX;
+
+    // Indicates the memory cap is exceeded because only preserved indices are left, so it is only logged once
+    bool _overMemoryCap = false;
 
     // Last frame of input that changed
     IndexedFrame _lastChangedFrame = MaxIndexedFrame;
 
-    // Get the last known input BEFORE the given index. Defaults to 0 if unknown.
-    T lastInputBefore ( uint32_t index ) const
+    Index& entry ( size_t index )
     {
-        if ( _inputs.empty() || index == 0 )
-            return 0;
+        return _indices[ ( _head + index ) & ( _indices.size() - 1 )];
+    }
+
+    const Index& entry ( size_t index ) const
+    {
+        return _indices[ ( _head + index ) & ( _indices.size() - 1 )];
+    }
 
-        if ( index > _inputs.size() )
-            index = _inputs.size();
+    T& at ( Index& e, uint32_t frame )
+    {
+        return _pages[e.pages[frame / INPUTS_PAGE_SIZE]][frame & ( INPUTS_PAGE_SIZE - 1 )];
+    }
+
+    const T& at ( const Index& e, uint32_t frame ) const
+    {
+        return _pages[e.pages[frame / INPUTS_PAGE_SIZE]][frame & ( INPUTS_PAGE_SIZE - 1 )];
+    }
 
-        do
+    // Fill the frames [start, end) of an index with the same value, the pages must already be allocated
+    void fill ( Index& e, uint32_t start, uint32_t end, T t )
+    {
+        while ( start < end )
         {
-            --index;
-            if ( ! _inputs[index].empty() )
-                return _inputs[index].back();
+            const uint32_t offset = ( start & ( INPUTS_PAGE_SIZE - 1 ) );
+            const uint32_t count = std::min ( end - start, INPUTS_PAGE_SIZE - offset );
+            T *page = &_pages[e.pages[start / INPUTS_PAGE_SIZE]][offset];
+
+            std::fill ( page, page + count, t );
+
+            start += count;
         }
-        while ( index > 0 );
+    }
+
+    // Get the offset of the first of n inputs starting from index:frame that differs from the known inputs,
+    // returns n if none are different.
+    size_t findChanged ( uint32_t index, uint32_t frame, const T *t, size_t n ) const
+    {
+        size_t i = 0;
+
+        if ( index < _count )
+        {
+            const Index& e = entry ( index );
+
+            while ( i < n && frame + i < e.endFrame )
+            {
+                const uint32_t f = frame + i;
+                const size_t offset = ( f & ( INPUTS_PAGE_SIZE - 1 ) );
+                const size_t count = std::min ( std::min ( n - i, INPUTS_PAGE_SIZE - offset ),
+                                                size_t ( e.endFrame - f ) );
+                const T *page = &_pages[e.pages[f / INPUTS_PAGE_SIZE]][offset];
+                const size_t same = std::mismatch ( page, page + count, t + i ).first - page;
+
+                i += same;
+
+                if ( same < count )
+                    return i;
+            }
+        }
+
+        if ( i == n )
+            return n;
+
+        // The remaining inputs are compared against the last known input
+        const T last = get ( index, frame + i );
+
+        while ( i < n && t[i] == last )
+            ++i;
+
+        return i;
+    }
+
+    // Grow the number of indices, the new indices are empty
+    void grow ( size_t count )
+    {
+        if ( count > _indices.size() )
+        {
+            // Linearize the ring buffer into a larger one
+            size_t size = std::max<size_t> ( 8, 2 * _indices.size() );
+            while ( size < count )
+                size *= 2;
+
+            std::vector<Index> indices ( size );
+
+            for ( size_t i = 0; i < _count; ++i )
+                indices[i] = std::move ( entry ( i ) );
+
+            _indices.swap ( indices );
+            _head = 0;
+        }
+
+        const size_t oldCount = _count;
+
+        _count = count;
+
+        updateLast ( oldCount );
+    }
+
+    // Extend the frames of an index up to endFrame, filling the new frames with the given value
+    void extend ( uint32_t index, uint32_t endFrame, T t )
+    {
+        const size_t numPages = ( endFrame + INPUTS_PAGE_SIZE - 1 ) / INPUTS_PAGE_SIZE;
+
+        while ( entry ( index ).pages.size() < numPages )
+        {
+            const uint32_t id = allocatePage ( index );
+            entry ( index ).pages.push_back ( id );
+        }
+
+        Index& e = entry ( index );
+
+        fill ( e, e.endFrame, endFrame, t );
+
+        e.endFrame = endFrame;
+
+        updateLast ( index );
+    }
+
+    uint32_t newPage()
+    {
+        _pages.emplace_back ( INPUTS_PAGE_SIZE );
+        return _pages.size() - 1;
+    }
+
+    void releasePage ( uint32_t id )
+    {
+        _freePages.push_back ( id );
+    }
+
+    // Release the pages of an index, making it empty
+    void release ( Index& e )
+    {
+        for ( uint32_t id : e.pages )
+            releasePage ( id );
+
+        e.pages.clear();
+        e.endFrame = 0;
+    }
+
+    // Get an unused page for the given index, discarding the oldest indices before it if over the memory cap.
+    // The preserved indices are never discarded, so the cap is exceeded instead.
+    uint32_t allocatePage ( uint32_t index )
+    {
+        const size_t pageBytes = INPUTS_PAGE_SIZE * sizeof ( T );
+        const size_t end = std::min<size_t> ( index, _preserveStartIndex );
+
+        for ( size_t i = 0; i < end && isOverMemoryCap ( pageBytes ); ++i )
+        {
+            if ( ! entry ( i ).endFrame )
+                continue;
+
+            LOG ( "Discarding inputs for index %u: memoryUsage=%u; memoryCap=%u", i, getMemoryUsage(), _memoryCap );
+
+            release ( entry ( i ) );
+            updateLast ( i );
+        }
+
+        if ( ! isOverMemoryCap ( pageBytes ) )
+        {
+            _overMemoryCap = false;
+        }
+        else if ( ! _overMemoryCap )
+        {
+            LOG ( "Exceeding memory cap for preserved inputs: index=%u; preserveStartIndex=%u; "
+                  "memoryUsage=%u; memoryCap=%u", index, _preserveStartIndex, getMemoryUsage(), _memoryCap );
+
+            _overMemoryCap = true;
+        }
+
+        if ( _freePages.empty() )
+            return newPage();
+
+        const uint32_t id = _freePages.back();
+        _freePages.pop_back();
+        return id;
+    }
+
+    bool isOverMemoryCap ( size_t extraBytes ) const
+    {
+        return ( _memoryCap && getMemoryUsage() + extraBytes > _memoryCap );
+    }
+
+    // Update the last known input of an index, and of the empty indices after it that carry the same input
+    void updateLast ( size_t index )
+    {
+        T last = ( index ? entry ( index - 1 ).last : 0 );
+
+        for ( size_t i = index; i < _count; ++i )
+        {
+            Index& e = entry ( i );
+
+            if ( e.endFrame )
+            {
+                if ( i > index )
+                    break;
+
+                last = at ( e, e.endFrame - 1 );
+            }
+
+            e.last = last;
+        }
+    }
+
+    // Get the last known input BEFORE the given index. Defaults to 0 if unknown.
+    T lastInputBefore ( uint32_t index ) const
+    {
+        if ( ! _count || index == 0 )
+            return 0;
+
+        if ( index > _count )
+            index = _count;
 
-        return 0;
+        return entry ( index - 1 ).last;
     }
 };
@@ -33,7 +33,8 @@ struct ClientMode : public SerializableSequence
 {
     ENUM_BOILERPLATE ( ClientMode, Host, Client, SpectateNetplay, SpectateBroadcast, Broadcast, Offline )
 
-    enum { Training = 0x01, GameStarted = 0x02, UdpTunnel = 0x04, IsWine = 0x08, VersusCPU = 0x10, Replay = 0x20 };
+    enum { Training = 0x01, GameStarted = 0x02, UdpTunnel = 0x04, IsWine = 0x08, VersusCPU = 0x10, Replay = 0x20,
+           FastHash = 0x40, CompactInputs = 0x80 };
 
     uint8_t flags = 0;
 
@@ -62,6 +63,8 @@ struct ClientMode : public SerializableSequence
     bool isGameStarted() const { return ( flags & GameStarted ); }
     bool isUdpTunnel() const { return ( flags & UdpTunnel ); }
     bool isWine() const { return ( flags & IsWine ); }
+    bool isFastHash() const { return ( flags & FastHash ); }
+    bool isCompactInputs() const { return ( flags & CompactInputs ); }
     bool isSinglePlayer() const { return ( isNetplay() || isVersusCPU() ); }
 
     std::string flagString() const
@@ -86,6 +89,12 @@ struct ClientMode : public SerializableSequence
         if ( flags & VersusCPU )
             str += std::string ( str.empty() ? "" : ", " ) + "VersusCPU";
 
+        if ( flags & FastHash )
+            str += std::string ( str.empty() ? "" : ", " ) + "FastHash";
+
+        if ( flags & CompactInputs )
+            str += std::string ( str.empty() ? "" : ", " ) + "CompactInputs";
+
         return str;
     }
 
@@ -121,13 +130,44 @@ struct VersionConfig : public SerializableSequence
     ClientMode mode;
     Version version;
 
+    // Always advertise FastHash and CompactInputs support, older versions ignore these flags
     VersionConfig ( const ClientMode& mode, uint8_t flags = 0 )
-        : mode ( mode.value, mode.flags | flags ), version ( LocalVersion ) {}
+        : mode ( mode.value, mode.flags | flags | ClientMode::FastHash | ClientMode::CompactInputs )
+        , version ( LocalVersion ) {}
 
     PROTOCOL_MESSAGE_BOILERPLATE ( VersionConfig, mode, version )
 };
 
 
+// Features that don't fit in ClientMode::flags, exchanged after VersionConfig.
+// Older versions can't decode this, so it is only sent once the remote has advertised ClientMode::FastHash,
+// since every version that advertises FastHash also understands this message.
+struct FeatureConfig : public SerializableSequence
+{
+    enum { SelectiveRepeat = 0x01 };
+
+    uint32_t flags = 0;
+
+    FeatureConfig ( uint32_t flags ) : flags ( flags ) {}
+
+    bool isSelectiveRepeat() const { return ( flags & SelectiveRepeat ); }
+
+    std::string flagString() const
+    {
+        std::string str;
+
+        if ( flags & SelectiveRepeat )
+            str += "SelectiveRepeat";
+
+        return str;
+    }
+
+    void clear() { flags = 0; }
+
+    PROTOCOL_MESSAGE_BOILERPLATE ( FeatureConfig, flags )
+};
+
+
 struct InitialConfig : public SerializableSequence
 {
     ClientMode mode;
@@ -403,6 +443,43 @@ struct SyncHash : public SerializableSequence
 };
 
 
+// DesyncHashes::region for the hashes of all the regions
+#define DESYNC_ALL_REGIONS ( 0xFFFFFFFF )
+
+// Hierarchical hashes of the game memory at a frame, see StateHashes.
+// Either the hash of each region, or the block hashes of a single region.
+struct DesyncHashes : public SerializableSequence
+{
+    IndexedFrame indexedFrame = {{ 0, 0 }};
+
+    uint32_t region = DESYNC_ALL_REGIONS;
+
+    std::vector<uint64_t> hashes;
+
+    DesyncHashes ( IndexedFrame indexedFrame, uint32_t region, const std::vector<uint64_t>& hashes )
+        : indexedFrame ( indexedFrame ), region ( region ), hashes ( hashes ) {}
+
+    std::string str() const override { return format ( "DesyncHashes[%s,%u]", indexedFrame, region ); }
+
+    PROTOCOL_MESSAGE_BOILERPLATE ( DesyncHashes, indexedFrame.value, region, hashes )
+};
+
+
+// Fast hash of the whole game memory at a frame, see LaneHash
+struct FullStateHash : public SerializableSequence
+{
+    IndexedFrame indexedFrame = {{ 0, 0 }};
+
+    uint64_t hash = 0;
+
+    FullStateHash ( IndexedFrame indexedFrame, uint64_t hash ) : indexedFrame ( indexedFrame ), hash ( hash ) {}
+
+    std::string str() const override { return format ( "FullStateHash[%s]", indexedFrame ); }
+
+    PROTOCOL_MESSAGE_BOILERPLATE ( FullStateHash, indexedFrame.value, hash )
+};
+
+
 struct MenuIndex : public SerializableSequence
 {
     uint32_t index = 0;
@@ -493,3 +570,29 @@ struct BothInputs : public SerializableSequence, public BaseInputs
 
     PROTOCOL_MESSAGE_BOILERPLATE ( BothInputs, indexedFrame.value, inputs )
 };
+
+
+// PlayerInputs using the encoding in InputEncoding.hpp, only sent if both sides support ClientMode::CompactInputs
+struct CompactPlayerInputs : public SerializableMessage
+{
+    PlayerInputs playerInputs;
+
+    CompactPlayerInputs ( const PlayerInputs& playerInputs ) : playerInputs ( playerInputs ) {}
+
+    std::string str() const override { return format ( "CompactPlayerInputs[%s]", playerInputs.indexedFrame ); }
+
+    DECLARE_MESSAGE_BOILERPLATE ( CompactPlayerInputs )
+};
+
+
+// BothInputs using the encoding in InputEncoding.hpp, only sent if the spectator supports ClientMode::CompactInputs
+struct CompactBothInputs : public SerializableSequence
+{
+    BothInputs bothInputs;
+
+    CompactBothInputs ( const BothInputs& bothInputs ) : bothInputs ( bothInputs ) {}
+
+    std::string str() const override { return format ( "CompactBothInputs[%s]", bothInputs.indexedFrame ); }
+
+    DECLARE_MESSAGE_BOILERPLATE ( CompactBothInputs )
+};
@@ -32,6 +32,11 @@ ENUM ( Options,
        PidLog,
        SyncTest,
        Replay,
+       FullStateHash,
+       LogLevels,
+       SocketBackend,
+       RollbackHistory,
+       AsyncLog,
        // Special options
        NoFork,
        AppDir,
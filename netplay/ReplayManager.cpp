@@ -2,14 +2,325 @@
 #include "Exceptions.hpp"
 #include "Logger.hpp"
 #include "Messages.hpp"
+#include "NetplayStates.hpp"
 
 #include <iostream>
 #include <fstream>
+#include <algorithm>
+#include <climits>
 
 using namespace std;
 
 
-bool ReplayManager::load ( const string& replayFile, bool real )
+// Size of the raw RngState in a binary replay
+#define RNG_STATE_SIZE ( sizeof ( uint32_t ) * 3 + CC_RNG_STATE3_SIZE )
+
+
+static uint32_t getNetplayStateValue ( const string& str )
+{
+    for ( uint32_t i = 1; i < 256; ++i )
+    {
+        if ( NetplayState ( ( NetplayState::Enum ) i ).str() == str )
+            return i;
+    }
+
+    return 0;
+}
+
+
+// Parse a RngState hex dump, returns 0 if the dump has an unknown size
+static RngState *parseRngState ( stringstream& ss )
+{
+    RngState *rngState = 0;
+
+    if ( ss.str().size() == 707 ) // Old RngState hex dump size
+    {
+        rngState = new RngState ( 0 );
+
+        char data [ sizeof ( uint32_t ) * 3 + 4 + CC_RNG_STATE3_SIZE ];
+
+        for ( char& c : data )
+        {
+            uint32_t v;
+            ss >> hex >> v;
+            c = v;
+        }
+
+        memcpy ( &rngState->rngState0, &data[0], sizeof ( uint32_t ) );
+        memcpy ( &rngState->rngState1, &data[4], sizeof ( uint32_t ) );
+        memcpy ( &rngState->rngState2, &data[8], sizeof ( uint32_t ) );
+        copy ( &data[16], &data[16 + CC_RNG_STATE3_SIZE], rngState->rngState3.begin() );
+    }
+    else if ( ss.str().size() == 695 ) // New RngState hex dump size
+    {
+        rngState = new RngState ( 0 );
+
+        char data [ sizeof ( uint32_t ) * 3 + CC_RNG_STATE3_SIZE ];
+
+        for ( char& c : data )
+        {
+            uint32_t v;
+            ss >> hex >> v;
+            c = v;
+        }
+
+        memcpy ( &rngState->rngState0, &data[0], sizeof ( uint32_t ) );
+        memcpy ( &rngState->rngState1, &data[4], sizeof ( uint32_t ) );
+        memcpy ( &rngState->rngState2, &data[8], sizeof ( uint32_t ) );
+        copy ( &data[12], &data[12 + CC_RNG_STATE3_SIZE], rngState->rngState3.begin() );
+    }
+
+    return rngState;
+}
+
+
+ReplayManager::~ReplayManager()
+{
+    {
+        LOCK ( _mutex );
+        _stopping = true;
+        _cond.broadcast();
+    }
+
+    _thread.join();
+}
+
+bool ReplayManager::load ( const string& replayFile, bool real, bool stream )
+{
+    char magic[4] = { 0 };
+
+    ifstream fin ( replayFile.c_str(), ifstream::binary );
+    fin.read ( magic, sizeof ( magic ) );
+    fin.close();
+
+    if ( ! memcmp ( magic, REPLAY_MAGIC, sizeof ( magic ) ) )
+        return loadBinary ( replayFile, real );
+
+    if ( stream )
+        return loadStream ( replayFile, real );
+
+    return loadText ( replayFile, real );
+}
+
+bool ReplayManager::loadBinary ( const string& replayFile, bool real )
+{
+    if ( ! _file.open ( replayFile ) )
+        return false;
+
+    _real = real;
+
+    if ( _file.size() < sizeof ( FileHeader ) )
+    {
+        LOG ( "Replay file is too small" );
+        _file.close();
+        return false;
+    }
+
+    const FileHeader& header = getHeader();
+
+    if ( header.version != REPLAY_VERSION )
+    {
+        LOG ( "Unknown replay version: %u", header.version );
+        _file.close();
+        return false;
+    }
+
+    if ( ! getArray<IndexEntry> ( header.indicesOffset, header.numIndices )
+            || ! getArray<InitialStateEntry> ( header.initialStatesOffset, header.numInitialStates ) )
+    {
+        LOG ( "Invalid replay file offsets" );
+        _file.close();
+        return false;
+    }
+
+    LOG ( "Mapped up to [%u:%u]", getLastIndex(), getLastFrame() );
+    return true;
+}
+
+bool ReplayManager::convert ( const string& textFile, const string& binaryFile )
+{
+    // The real inputs are parsed separately, since they include the reinputs after each rollback
+    ReplayManager replay, real;
+
+    if ( ! replay.loadText ( textFile, false ) || ! real.loadText ( textFile, true ) )
+        return false;
+
+    const size_t numIndices = max ( { replay._modes.size(), replay._states.size(), replay._inputs.size(),
+                                      real._inputs.size(), replay._rngStates.size(), replay._rollbacks.size() } );
+
+    string bytes ( sizeof ( FileHeader ), 0 );
+
+    // Append 4 byte aligned data, returns its offset
+    auto append = [&] ( const void *data, size_t size ) -> uint32_t
+    {
+        bytes.resize ( ( bytes.size() + 3 ) & ~3 );
+
+        const uint32_t offset = bytes.size();
+
+        if ( size > 0 )
+            bytes.append ( ( const char * ) data, size );
+
+        return offset;
+    };
+
+    auto appendInputs = [&] ( const vector<Inputs>& inputs, uint32_t& count, uint32_t& offset )
+    {
+        vector<PackedInputs> packed;
+
+        for ( const Inputs& i : inputs )
+            packed.push_back ( { i.p1, i.p2 } );
+
+        count = packed.size();
+        offset = append ( packed.data(), packed.size() * sizeof ( PackedInputs ) );
+    };
+
+    vector<IndexEntry> entries ( numIndices );
+
+    for ( size_t i = 0; i < numIndices; ++i )
+    {
+        IndexEntry& entry = entries[i];
+
+        entry.gameMode = ( i < replay._modes.size() ? replay._modes[i] : 0 );
+        entry.netplayState = ( i < replay._states.size() ? getNetplayStateValue ( replay._states[i] ) : 0 );
+
+        if ( i < replay._inputs.size() )
+            appendInputs ( replay._inputs[i], entry.numInputs, entry.inputsOffset );
+
+        if ( i < real._inputs.size() )
+            appendInputs ( real._inputs[i], entry.numRealInputs, entry.realInputsOffset );
+
+        if ( i < replay._rngStates.size() && replay._rngStates[i] )
+        {
+            const RngState& rngState = replay._rngStates[i]->getAs<RngState>();
+
+            char data [ RNG_STATE_SIZE ];
+
+            memcpy ( &data[0], &rngState.rngState0, sizeof ( uint32_t ) );
+            memcpy ( &data[4], &rngState.rngState1, sizeof ( uint32_t ) );
+            memcpy ( &data[8], &rngState.rngState2, sizeof ( uint32_t ) );
+            copy ( rngState.rngState3.begin(), rngState.rngState3.end(), &data[12] );
+
+            entry.rngStateOffset = append ( data, sizeof ( data ) );
+        }
+
+        if ( i >= replay._rollbacks.size() )
+            continue;
+
+        vector<RollbackEntry> rollbacks;
+
+        for ( size_t j = 0; j < replay._rollbacks[i].size(); ++j )
+        {
+            const IndexedFrame target = replay._rollbacks[i][j];
+
+            vector<PackedReinputs> reinputs;
+
+            if ( i < replay._reinputs.size() && j < replay._reinputs[i].size() )
+            {
+                for ( const Inputs& r : replay._reinputs[i][j] )
+                    reinputs.push_back ( { r.indexedFrame.parts.index, r.indexedFrame.parts.frame, r.p1, r.p2 } );
+            }
+
+            const uint32_t offset = append ( reinputs.data(), reinputs.size() * sizeof ( PackedReinputs ) );
+
+            rollbacks.push_back ( { target.parts.index, target.parts.frame, ( uint32_t ) reinputs.size(), offset } );
+        }
+
+        entry.numRollbacks = rollbacks.size();
+        entry.rollbacksOffset = append ( rollbacks.data(), rollbacks.size() * sizeof ( RollbackEntry ) );
+    }
+
+    vector<InitialStateEntry> initialStates;
+
+    for ( const MsgPtr& msg : replay._initialStates )
+    {
+        const InitialGameState& initial = msg->getAs<InitialGameState>();
+
+        InitialStateEntry entry;
+        memset ( &entry, 0, sizeof ( entry ) );
+
+        entry.index = initial.indexedFrame.parts.index;
+
+        for ( size_t i = 0; i < 2; ++i )
+        {
+            entry.chara[i] = initial.chara[i];
+            entry.moon[i] = initial.moon[i];
+            entry.color[i] = initial.color[i];
+        }
+
+        initialStates.push_back ( entry );
+    }
+
+    FileHeader header;
+    memcpy ( header.magic, REPLAY_MAGIC, sizeof ( header.magic ) );
+    header.version = REPLAY_VERSION;
+    header.numIndices = entries.size();
+    header.indicesOffset = append ( entries.data(), entries.size() * sizeof ( IndexEntry ) );
+    header.numInitialStates = initialStates.size();
+    header.initialStatesOffset = append ( initialStates.data(), initialStates.size() * sizeof ( InitialStateEntry ) );
+    header.lastIndex = replay.getLastIndex();
+    header.lastFrame = replay.getLastFrame();
+    header.lastRealIndex = real.getLastIndex();
+    header.lastRealFrame = real.getLastFrame();
+
+    memcpy ( &bytes[0], &header, sizeof ( header ) );
+
+    ofstream fout ( binaryFile.c_str(), ofstream::binary );
+    fout.write ( &bytes[0], bytes.size() );
+    fout.close();
+
+    if ( ! fout.good() )
+        return false;
+
+    LOG ( "Converted '%s' to '%s': %u bytes", textFile, binaryFile, bytes.size() );
+    return true;
+}
+
+void ReplayManager::addTransition ( uint32_t gameMode, const string& netplayState, uint32_t index )
+{
+    if ( index >= _modes.size() )
+    {
+        _modes.resize ( index + 1 );
+        _modes[index] = 0;
+    }
+
+    if ( ! _modes[index] )
+        _modes[index] = gameMode;
+
+    ASSERT ( _modes[index] == gameMode );
+
+    if ( index >= _states.size() )
+        _states.resize ( index + 1 );
+
+    if ( _states[index].empty() )
+        _states[index] = "NetplayState::" + netplayState;
+
+    if ( gameMode == CC_GAME_MODE_LOADING )
+    {
+        if ( _initialStates.empty() )
+            _initialStates.push_back ( MsgPtr ( new InitialGameState ( { 0, index } ) ) );
+
+        ASSERT ( _initialStates.back().get() != 0 );
+
+        if ( _initialStates.back()->getAs<InitialGameState>().indexedFrame.parts.index != index )
+            _initialStates.push_back ( MsgPtr ( new InitialGameState ( { 0, index } ) ) );
+    }
+
+    ASSERT ( _states[index] == "NetplayState::" + netplayState );
+}
+
+void ReplayManager::setInitialPlayer ( size_t player, stringstream& ss )
+{
+    ASSERT ( _initialStates.back().get() != 0 );
+
+    uint32_t chara, moon, color;
+    ss >> chara >> moon >> color;
+
+    _initialStates.back()->getAs<InitialGameState>().chara[player] = chara;
+    _initialStates.back()->getAs<InitialGameState>().moon[player] = moon;
+    _initialStates.back()->getAs<InitialGameState>().color[player] = color;
+}
+
+bool ReplayManager::loadText ( const string& replayFile, bool real )
 {
     ifstream fin ( replayFile.c_str() );
     bool good = fin.good();
@@ -29,35 +340,7 @@ bool ReplayManager::load ( const string& replayFile, bool real )
             getline ( fin, str );
             ss << trimmed ( str );
 
-            if ( index >= _modes.size() )
-            {
-                _modes.resize ( index + 1 );
-                _modes[index] = 0;
-            }
-
-            if ( ! _modes[index] )
-                _modes[index] = gameMode;
-
-            ASSERT ( _modes[index] == gameMode );
-
-            if ( index >= _states.size() )
-                _states.resize ( index + 1 );
-
-            if ( _states[index].empty() )
-                _states[index] = "NetplayState::" + netplayState;
-
-            if ( gameMode == CC_GAME_MODE_LOADING )
-            {
-                if ( _initialStates.empty() )
-                    _initialStates.push_back ( MsgPtr ( new InitialGameState ( { 0, index } ) ) );
-
-                ASSERT ( _initialStates.back().get() != 0 );
-
-                if ( _initialStates.back()->getAs<InitialGameState>().indexedFrame.parts.index != index )
-                    _initialStates.push_back ( MsgPtr ( new InitialGameState ( { 0, index } ) ) );
-            }
-
-            ASSERT ( _states[index] == "NetplayState::" + netplayState );
+            addTransition ( gameMode, netplayState, index );
 
             if ( tag == "Inputs" || ( real && tag == "Reinputs" ) )
             {
@@ -83,48 +366,10 @@ bool ReplayManager::load ( const string& replayFile, bool real )
 
                 ASSERT ( _rngStates[index].get() == 0 );
 
-                RngState *rngState = 0;
-
-                if ( ss.str().size() == 707 ) // Old RngState hex dump size
-                {
-                    rngState = new RngState ( 0 );
-
-                    char data [ sizeof ( uint32_t ) * 3 + 4 + CC_RNG_STATE3_SIZE ];
-
-                    for ( char& c : data )
-                    {
-                        uint32_t v;
-                        ss >> hex >> v;
-                        c = v;
-                    }
-
-                    memcpy ( &rngState->rngState0, &data[0], sizeof ( uint32_t ) );
-                    memcpy ( &rngState->rngState1, &data[4], sizeof ( uint32_t ) );
-                    memcpy ( &rngState->rngState2, &data[8], sizeof ( uint32_t ) );
-                    copy ( &data[16], &data[16 + CC_RNG_STATE3_SIZE], rngState->rngState3.begin() );
-                }
-                else if ( ss.str().size() == 695 ) // New RngState hex dump size
-                {
-                    rngState = new RngState ( 0 );
-
-                    char data [ sizeof ( uint32_t ) * 3 + CC_RNG_STATE3_SIZE ];
-
-                    for ( char& c : data )
-                    {
-                        uint32_t v;
-                        ss >> hex >> v;
-                        c = v;
-                    }
-
-                    memcpy ( &rngState->rngState0, &data[0], sizeof ( uint32_t ) );
-                    memcpy ( &rngState->rngState1, &data[4], sizeof ( uint32_t ) );
-                    memcpy ( &rngState->rngState2, &data[8], sizeof ( uint32_t ) );
-                    copy ( &data[12], &data[12 + CC_RNG_STATE3_SIZE], rngState->rngState3.begin() );
-                }
-                else
-                {
+                RngState *rngState = parseRngState ( ss );
+
+                if ( ! rngState )
                     THROW_EXCEPTION ( "Unknown RngState size: %u", "Invalid replay file!", ss.str().size() );
-                }
 
                 _rngStates[index].reset ( rngState );
             }
@@ -170,31 +415,13 @@ bool ReplayManager::load ( const string& replayFile, bool real )
             }
             else if ( tag == "P1" )
             {
-                if ( gameMode != CC_GAME_MODE_IN_GAME )
-                    continue;
-
-                ASSERT ( _initialStates.back().get() != 0 );
-
-                uint32_t chara, moon, color;
-                ss >> chara >> moon >> color;
-
-                _initialStates.back()->getAs<InitialGameState>().chara[0] = chara;
-                _initialStates.back()->getAs<InitialGameState>().moon[0] = moon;
-                _initialStates.back()->getAs<InitialGameState>().color[0] = color;
+                if ( gameMode == CC_GAME_MODE_IN_GAME )
+                    setInitialPlayer ( 0, ss );
             }
             else if ( tag == "P2" )
             {
-                if ( gameMode != CC_GAME_MODE_IN_GAME )
-                    continue;
-
-                ASSERT ( _initialStates.back().get() != 0 );
-
-                uint32_t chara, moon, color;
-                ss >> chara >> moon >> color;
-
-                _initialStates.back()->getAs<InitialGameState>().chara[1] = chara;
-                _initialStates.back()->getAs<InitialGameState>().moon[1] = moon;
-                _initialStates.back()->getAs<InitialGameState>().color[1] = color;
+                if ( gameMode == CC_GAME_MODE_IN_GAME )
+                    setInitialPlayer ( 1, ss );
             }
             else
             {
@@ -209,8 +436,327 @@ bool ReplayManager::load ( const string& replayFile, bool real )
     return good;
 }
 
+bool ReplayManager::loadStream ( const string& replayFile, bool real )
+{
+    // Binary mode so the byte offset of each line is just the sum of the line lengths
+    ifstream fin ( replayFile.c_str(), ifstream::binary );
+
+    if ( ! fin.good() )
+        return false;
+
+    _real = real;
+    _replayFile = replayFile;
+
+    uint64_t offset = 0;
+    bool hasInputs = false;
+    string line;
+
+    while ( getline ( fin, line ) )
+    {
+        const uint64_t begin = offset;
+        offset += line.size() + 1;
+
+        uint32_t gameMode;
+        string netplayState;
+        uint32_t index, frame;
+        string tag;
+
+        stringstream ls ( line );
+
+        if ( ! ( ls >> gameMode >> netplayState >> index >> frame >> tag ) )
+        {
+            if ( trimmed ( line ).empty() )
+                continue;
+
+            break;
+        }
+
+        string str;
+        stringstream ss;
+
+        getline ( ls, str );
+        ss << trimmed ( str );
+
+        addTransition ( gameMode, netplayState, index );
+
+        // Reinputs after a rollback are parsed with the rollback, so they aren't part of the range of their index
+        if ( real || tag != "Reinputs" )
+        {
+            if ( index >= _ranges.size() )
+                _ranges.resize ( index + 1 );
+
+            if ( _ranges[index].begin == _ranges[index].end )
+                _ranges[index].begin = begin;
+
+            _ranges[index].end = offset;
+        }
+
+        if ( tag == "Inputs" || ( real && tag == "Reinputs" ) )
+        {
+            if ( ! hasInputs || index > _lastIndex )
+            {
+                _lastIndex = index;
+                _lastFrame = frame;
+                hasInputs = true;
+            }
+            else if ( index == _lastIndex )
+            {
+                _lastFrame = max ( _lastFrame, frame );
+            }
+        }
+        else if ( tag == "RngState" )
+        {
+            // Check the RngState now, so parsing the lines later can't fail
+            if ( ss.str().size() != 707 && ss.str().size() != 695 )
+                THROW_EXCEPTION ( "Unknown RngState size: %u", "Invalid replay file!", ss.str().size() );
+        }
+        else if ( tag == "P1" || tag == "P2" )
+        {
+            if ( gameMode == CC_GAME_MODE_IN_GAME )
+                setInitialPlayer ( tag == "P1" ? 0 : 1, ss );
+        }
+        else if ( tag != "Rollback" && tag != "Reinputs" )
+        {
+            THROW_EXCEPTION ( "Unhandled tag: '%s'", "Invalid replay file!", tag );
+        }
+    }
+
+    fin.close();
+
+    LOG ( "Indexed up to [%u:%u]", _lastIndex, _lastFrame );
+
+    _streaming = true;
+    _stopping = false;
+    _thread.start();
+    return true;
+}
+
+ReplayManager::ChunkPtr ReplayManager::parseChunk ( uint32_t index ) const
+{
+    ASSERT ( index < _ranges.size() );
+
+    const ChunkRange& range = _ranges[index];
+
+    ifstream fin ( _replayFile.c_str(), ifstream::binary );
+    fin.seekg ( range.begin );
+
+    shared_ptr<Chunk> chunk ( new Chunk() );
+
+    uint64_t offset = range.begin;
+
+    // Frame of the last rollback in this index, while parsing the reinputs after it
+    uint32_t rollbackFrame = UINT_MAX;
+
+    string line;
+
+    while ( getline ( fin, line ) )
+    {
+        const uint64_t begin = offset;
+        offset += line.size() + 1;
+
+        uint32_t gameMode;
+        string netplayState;
+        uint32_t lineIndex, frame;
+        string tag;
+
+        stringstream ls ( line );
+
+        if ( ! ( ls >> gameMode >> netplayState >> lineIndex >> frame >> tag ) )
+        {
+            if ( trimmed ( line ).empty() )
+                continue;
+
+            break;
+        }
+
+        const bool isReinputs = ( ! _real && tag == "Reinputs" );
+
+        // The reinputs after the last rollback can go past the end of the range
+        if ( begin >= range.end && ! ( isReinputs && rollbackFrame != UINT_MAX ) )
+            break;
+
+        string str;
+        stringstream ss;
+
+        getline ( ls, str );
+        ss << trimmed ( str );
+
+        if ( isReinputs )
+        {
+            if ( rollbackFrame == UINT_MAX )
+                continue;
+
+            Inputs i;
+            i.indexedFrame.parts.index = lineIndex;
+            i.indexedFrame.parts.frame = frame;
+            ss >> hex >> i.p1 >> i.p2;
+
+            chunk->reinputs[rollbackFrame].push_back ( i );
+            continue;
+        }
+
+        rollbackFrame = UINT_MAX;
+
+        if ( lineIndex != index )
+            continue;
+
+        if ( tag == "Inputs" || ( _real && tag == "Reinputs" ) )
+        {
+            if ( frame >= chunk->inputs.size() )
+                chunk->inputs.resize ( frame + 1 );
+
+            Inputs i;
+            i.indexedFrame.parts.index = index;
+            i.indexedFrame.parts.frame = frame;
+            ss >> hex >> i.p1 >> i.p2;
+
+            chunk->inputs[frame] = i;
+        }
+        else if ( tag == "RngState" )
+        {
+            chunk->rngState.reset ( parseRngState ( ss ) );
+        }
+        else if ( tag == "Rollback" && ! _real )
+        {
+            if ( frame >= chunk->rollbacks.size() )
+            {
+                chunk->rollbacks.resize ( frame + 1, MaxIndexedFrame );
+                chunk->reinputs.resize ( frame + 1 );
+            }
+
+            IndexedFrame i;
+            ss >> i.parts.index >> i.parts.frame;
+
+            chunk->rollbacks[frame] = i;
+            rollbackFrame = frame;
+        }
+    }
+
+    return chunk;
+}
+
+ReplayManager::ChunkPtr ReplayManager::getChunk ( uint32_t index )
+{
+    LOCK ( _mutex );
+
+    if ( index != _cursor )
+    {
+        _cursor = index;
+        evictChunks();
+        _cond.broadcast();
+    }
+
+    auto it = _chunks.find ( index );
+
+    if ( it != _chunks.end() )
+        return it->second;
+
+    if ( index >= _ranges.size() || _ranges[index].begin == _ranges[index].end )
+        return 0;
+
+    // The index hasn't been prefetched yet, eg right after a seek, so parse it now
+    _mutex.unlock();
+
+    ChunkPtr chunk = parseChunk ( index );
+
+    _mutex.lock();
+
+    _chunks[index] = chunk;
+    return chunk;
+}
+
+void ReplayManager::evictChunks()
+{
+    for ( auto it = _chunks.begin(); it != _chunks.end(); )
+    {
+        if ( it->first + REPLAY_STREAM_BEHIND < _cursor || it->first > _cursor + REPLAY_STREAM_AHEAD )
+            it = _chunks.erase ( it );
+        else
+            ++it;
+    }
+}
+
+bool ReplayManager::findMissingChunk ( uint32_t& index ) const
+{
+    for ( uint32_t i = _cursor + 1; i <= _cursor + REPLAY_STREAM_AHEAD && i < _ranges.size(); ++i )
+    {
+        if ( _ranges[i].begin != _ranges[i].end && _chunks.find ( i ) == _chunks.end() )
+        {
+            index = i;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void ReplayManager::PrefetchThread::run()
+{
+    replay.prefetchChunks();
+}
+
+void ReplayManager::prefetchChunks()
+{
+    LOCK ( _mutex );
+
+    for ( ;; )
+    {
+        uint32_t index = 0;
+
+        while ( ! _stopping && ! findMissingChunk ( index ) )
+            _cond.wait ( _mutex );
+
+        if ( _stopping )
+            return;
+
+        _mutex.unlock();
+
+        ChunkPtr chunk = parseChunk ( index );
+
+        _mutex.lock();
+
+        // Drop the chunk if the cursor moved away while it was being parsed
+        if ( index + REPLAY_STREAM_BEHIND >= _cursor && index <= _cursor + REPLAY_STREAM_AHEAD )
+            _chunks.insert ( { index, chunk } );
+    }
+}
+
+MsgPtr ReplayManager::seek ( IndexedFrame indexedFrame )
+{
+    MsgPtr initial = getInitialStateBefore ( indexedFrame.parts.index );
+
+    if ( ! initial )
+        return 0;
+
+    // Start streaming from the start of the match
+    if ( _streaming )
+        getChunk ( initial->getAs<InitialGameState>().indexedFrame.parts.index );
+
+    return initial;
+}
+
+size_t ReplayManager::getNumStreamedIndices() const
+{
+    LOCK ( _mutex );
+    return _chunks.size();
+}
+
+const ReplayManager::IndexEntry *ReplayManager::getIndexEntry ( uint32_t index ) const
+{
+    if ( ! _file.isOpen() || index >= getHeader().numIndices )
+        return 0;
+
+    return getArray<IndexEntry> ( getHeader().indicesOffset, getHeader().numIndices ) + index;
+}
+
 uint32_t ReplayManager::getGameMode ( IndexedFrame indexedFrame )
 {
+    if ( _file.isOpen() )
+    {
+        const IndexEntry *entry = getIndexEntry ( indexedFrame.parts.index );
+        return ( entry ? entry->gameMode : 0 );
+    }
+
     if ( indexedFrame.parts.index >= _modes.size() )
         return 0;
 
@@ -219,27 +765,49 @@ uint32_t ReplayManager::getGameMode ( IndexedFrame indexedFrame )
 
 const string& ReplayManager::getStateStr ( IndexedFrame indexedFrame )
 {
-    if ( indexedFrame.parts.index >= _states.size() )
+    static const string empty;
+
+    if ( _file.isOpen() )
     {
-        static const string empty;
-        return empty;
+        // String of each NetplayState value
+        static vector<string> states;
+
+        if ( states.empty() )
+        {
+            for ( uint32_t i = 0; i < 256; ++i )
+                states.push_back ( NetplayState ( ( NetplayState::Enum ) i ).str() );
+        }
+
+        const IndexEntry *entry = getIndexEntry ( indexedFrame.parts.index );
+
+        if ( ! entry || ! entry->netplayState || entry->netplayState >= states.size() )
+            return empty;
+
+        return states[entry->netplayState];
     }
 
+    if ( indexedFrame.parts.index >= _states.size() )
+        return empty;
+
     return _states[indexedFrame.parts.index];
 }
 
-const ReplayManager::Inputs& ReplayManager::getInputs ( IndexedFrame indexedFrame )
+ReplayManager::Inputs ReplayManager::getInputs ( IndexedFrame indexedFrame )
 {
     static const Inputs confirm = { MaxIndexedFrame, CC_BUTTON_CONFIRM << 4, CC_BUTTON_CONFIRM << 4 };
     static const Inputs down = { MaxIndexedFrame, 2, 2 };
     static const Inputs empty = { MaxIndexedFrame, 0, 0 };
 
-    if ( _modes[indexedFrame.parts.index] == CC_GAME_MODE_LOADING )
+    const uint32_t gameMode = getGameMode ( indexedFrame );
+
+    if ( gameMode == CC_GAME_MODE_LOADING )
         return ( ( indexedFrame.parts.frame % 2 ) ? empty : confirm );
 
-    if ( _modes[indexedFrame.parts.index] == CC_GAME_MODE_RETRY )
+    if ( gameMode == CC_GAME_MODE_RETRY )
     {
-        if ( _modes[indexedFrame.parts.index + 1] == CC_GAME_MODE_LOADING )
+        const IndexedFrame next = {{ 0, indexedFrame.parts.index + 1 }};
+
+        if ( getGameMode ( next ) == CC_GAME_MODE_LOADING )
             return ( ( indexedFrame.parts.frame % 2 ) ? empty : confirm );
 
         if ( indexedFrame.parts.frame == 30 )
@@ -254,6 +822,33 @@ const ReplayManager::Inputs& ReplayManager::getInputs ( IndexedFrame indexedFram
         return empty;
     }
 
+    if ( _file.isOpen() )
+    {
+        const IndexEntry *entry = getIndexEntry ( indexedFrame.parts.index );
+
+        if ( ! entry )
+            return empty;
+
+        const uint32_t count = ( _real ? entry->numRealInputs : entry->numInputs );
+        const uint32_t offset = ( _real ? entry->realInputsOffset : entry->inputsOffset );
+        const PackedInputs *inputs = getArray<PackedInputs> ( offset, count );
+
+        if ( ! inputs || indexedFrame.parts.frame >= count )
+            return empty;
+
+        return { indexedFrame, inputs[indexedFrame.parts.frame].p1, inputs[indexedFrame.parts.frame].p2 };
+    }
+
+    if ( _streaming )
+    {
+        const ChunkPtr chunk = getChunk ( indexedFrame.parts.index );
+
+        if ( ! chunk || indexedFrame.parts.frame >= chunk->inputs.size() )
+            return empty;
+
+        return chunk->inputs[indexedFrame.parts.frame];
+    }
+
     if ( indexedFrame.parts.index >= _inputs.size()
             || indexedFrame.parts.frame >= _inputs[indexedFrame.parts.index].size() )
     {
@@ -263,8 +858,45 @@ const ReplayManager::Inputs& ReplayManager::getInputs ( IndexedFrame indexedFram
     return _inputs[indexedFrame.parts.index][indexedFrame.parts.frame];
 }
 
+const ReplayManager::RollbackEntry *ReplayManager::getRollbackEntry ( IndexedFrame indexedFrame ) const
+{
+    // Rollbacks are ignored when replaying the real inputs
+    const IndexEntry *entry = ( _real ? 0 : getIndexEntry ( indexedFrame.parts.index ) );
+
+    if ( ! entry || indexedFrame.parts.frame >= entry->numRollbacks )
+        return 0;
+
+    const RollbackEntry *rollbacks = getArray<RollbackEntry> ( entry->rollbacksOffset, entry->numRollbacks );
+
+    if ( ! rollbacks )
+        return 0;
+
+    return &rollbacks[indexedFrame.parts.frame];
+}
+
 IndexedFrame ReplayManager::getRollbackTarget ( IndexedFrame indexedFrame )
 {
+    if ( _file.isOpen() )
+    {
+        const RollbackEntry *rollback = getRollbackEntry ( indexedFrame );
+
+        if ( ! rollback )
+            return MaxIndexedFrame;
+
+        const IndexedFrame target = {{ rollback->targetFrame, rollback->targetIndex }};
+        return target;
+    }
+
+    if ( _streaming )
+    {
+        const ChunkPtr chunk = getChunk ( indexedFrame.parts.index );
+
+        if ( ! chunk || indexedFrame.parts.frame >= chunk->rollbacks.size() )
+            return MaxIndexedFrame;
+
+        return chunk->rollbacks[indexedFrame.parts.frame];
+    }
+
     if ( indexedFrame.parts.index >= _rollbacks.size()
             || indexedFrame.parts.frame >= _rollbacks[indexedFrame.parts.index].size() )
     {
@@ -274,13 +906,45 @@ IndexedFrame ReplayManager::getRollbackTarget ( IndexedFrame indexedFrame )
     return _rollbacks[indexedFrame.parts.index][indexedFrame.parts.frame];
 }
 
-const vector<ReplayManager::Inputs>& ReplayManager::getReinputs ( IndexedFrame indexedFrame )
+vector<ReplayManager::Inputs> ReplayManager::getReinputs ( IndexedFrame indexedFrame )
 {
+    if ( _file.isOpen() )
+    {
+        const RollbackEntry *rollback = getRollbackEntry ( indexedFrame );
+
+        if ( ! rollback )
+            return {};
+
+        const PackedReinputs *packed = getArray<PackedReinputs> ( rollback->reinputsOffset, rollback->numReinputs );
+
+        if ( ! packed )
+            return {};
+
+        vector<Inputs> reinputs;
+
+        for ( uint32_t i = 0; i < rollback->numReinputs; ++i )
+        {
+            const IndexedFrame reinputFrame = {{ packed[i].frame, packed[i].index }};
+            reinputs.push_back ( { reinputFrame, packed[i].p1, packed[i].p2 } );
+        }
+
+        return reinputs;
+    }
+
+    if ( _streaming )
+    {
+        const ChunkPtr chunk = getChunk ( indexedFrame.parts.index );
+
+        if ( ! chunk || indexedFrame.parts.frame >= chunk->reinputs.size() )
+            return {};
+
+        return chunk->reinputs[indexedFrame.parts.frame];
+    }
+
     if ( indexedFrame.parts.index >= _reinputs.size()
             || indexedFrame.parts.frame >= _reinputs[indexedFrame.parts.index].size() )
     {
-        static const vector<ReplayManager::Inputs> empty;
-        return empty;
+        return {};
     }
 
     return _reinputs[indexedFrame.parts.index][indexedFrame.parts.frame];
@@ -288,6 +952,38 @@ const vector<ReplayManager::Inputs>& ReplayManager::getReinputs ( IndexedFrame i
 
 MsgPtr ReplayManager::getRngState ( IndexedFrame indexedFrame )
 {
+    if ( _file.isOpen() )
+    {
+        const IndexEntry *entry = getIndexEntry ( indexedFrame.parts.index );
+
+        if ( ! entry || ! entry->rngStateOffset )
+            return 0;
+
+        const char *data = getArray<char> ( entry->rngStateOffset, RNG_STATE_SIZE );
+
+        if ( ! data )
+            return 0;
+
+        RngState *rngState = new RngState ( 0 );
+
+        memcpy ( &rngState->rngState0, &data[0], sizeof ( uint32_t ) );
+        memcpy ( &rngState->rngState1, &data[4], sizeof ( uint32_t ) );
+        memcpy ( &rngState->rngState2, &data[8], sizeof ( uint32_t ) );
+        copy ( &data[12], &data[12 + CC_RNG_STATE3_SIZE], rngState->rngState3.begin() );
+
+        return MsgPtr ( rngState );
+    }
+
+    if ( _streaming )
+    {
+        const ChunkPtr chunk = getChunk ( indexedFrame.parts.index );
+
+        if ( ! chunk )
+            return 0;
+
+        return chunk->rngState;
+    }
+
     if ( indexedFrame.parts.index >= _rngStates.size() )
         return 0;
 
@@ -296,6 +992,12 @@ MsgPtr ReplayManager::getRngState ( IndexedFrame indexedFrame )
 
 uint32_t ReplayManager::getLastIndex() const
 {
+    if ( _file.isOpen() )
+        return ( _real ? getHeader().lastRealIndex : getHeader().lastIndex );
+
+    if ( _streaming )
+        return _lastIndex;
+
     if ( _inputs.empty() )
         return 0;
 
@@ -304,6 +1006,12 @@ uint32_t ReplayManager::getLastIndex() const
 
 uint32_t ReplayManager::getLastFrame() const
 {
+    if ( _file.isOpen() )
+        return ( _real ? getHeader().lastRealFrame : getHeader().lastFrame );
+
+    if ( _streaming )
+        return _lastFrame;
+
     if ( _inputs.empty() )
         return 0;
 
@@ -315,6 +1023,32 @@ uint32_t ReplayManager::getLastFrame() const
 
 MsgPtr ReplayManager::getInitialStateBefore ( uint32_t index ) const
 {
+    if ( _file.isOpen() )
+    {
+        const FileHeader& header = getHeader();
+        const InitialStateEntry *initialStates = getArray<InitialStateEntry> ( header.initialStatesOffset,
+                                                                               header.numInitialStates );
+
+        for ( int i = header.numInitialStates - 1; i >= 0; --i )
+        {
+            if ( initialStates[i].index >= index )
+                continue;
+
+            InitialGameState *initial = new InitialGameState ( { 0, initialStates[i].index } );
+
+            for ( size_t j = 0; j < 2; ++j )
+            {
+                initial->chara[j] = initialStates[i].chara[j];
+                initial->moon[j] = initialStates[i].moon[j];
+                initial->color[j] = initialStates[i].color[j];
+            }
+
+            return MsgPtr ( initial );
+        }
+
+        return 0;
+    }
+
     for ( int i = _initialStates.size() - 1; i >= 0; --i )
     {
         ASSERT ( _initialStates[i].get() != 0 );
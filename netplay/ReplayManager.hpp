@@ -2,11 +2,35 @@
 
 #include "Constants.hpp"
 #include "Protocol.hpp"
+#include "MappedFile.hpp"
+#include "Thread.hpp"
 
 #include <string>
+#include <sstream>
 #include <vector>
+#include <map>
 
 
+// Magic bytes at the start of a binary replay file
+#define REPLAY_MAGIC                "CCRP"
+
+#define REPLAY_VERSION              ( 1 )
+
+// Number of transition indices kept parsed behind and ahead of the playback cursor when streaming a text replay
+#define REPLAY_STREAM_BEHIND        ( 2 )
+
+#define REPLAY_STREAM_AHEAD         ( 4 )
+
+
+// Replays either a text replay made from a sync log with scripts/sync2replay, or a binary replay.
+//
+// A binary replay has a table with an entry for each transition index, pointing to fixed width inputs for each
+// frame, the raw RngState, and the rollbacks with their reinputs. It is read through a memory-mapped view, so
+// nothing is parsed up front, and each lookup is O(1).
+//
+// A streamed text replay is only scanned up front, for the byte range of the lines of each transition index. The
+// lines of an index are parsed when the playback cursor reaches it, and the indices ahead of the cursor are parsed
+// on a background thread, so the memory used doesn't grow with the length of the replay.
 class ReplayManager
 {
 public:
@@ -17,17 +41,30 @@ public:
         uint16_t p1, p2;
     };
 
-    bool load ( const std::string& replayFile, bool real );
+    ~ReplayManager();
+
+    // Load a text or binary replay file, a text replay can be streamed instead of being parsed all at once
+    bool load ( const std::string& replayFile, bool real, bool stream = false );
+
+    // Move the playback cursor to the given frame, returns the initial state of the match to start replaying from.
+    // Returns null if there is no match before the given frame.
+    MsgPtr seek ( IndexedFrame indexedFrame );
+
+    // Get the number of transition indices currently parsed into memory when streaming
+    size_t getNumStreamedIndices() const;
+
+    // Convert a text replay file into a binary replay file
+    static bool convert ( const std::string& textFile, const std::string& binaryFile );
 
     uint32_t getGameMode ( IndexedFrame indexedFrame );
 
     const std::string& getStateStr ( IndexedFrame indexedFrame );
 
-    const Inputs& getInputs ( IndexedFrame indexedFrame );
+    Inputs getInputs ( IndexedFrame indexedFrame );
 
     IndexedFrame getRollbackTarget ( IndexedFrame indexedFrame );
 
-    const std::vector<Inputs>& getReinputs ( IndexedFrame indexedFrame );
+    std::vector<Inputs> getReinputs ( IndexedFrame indexedFrame );
 
     MsgPtr getRngState ( IndexedFrame indexedFrame );
 
@@ -39,6 +76,63 @@ public:
 
 private:
 
+    // Binary replay file layout, all offsets are from the start of the file and 4 byte aligned
+    struct FileHeader
+    {
+        char magic[4];
+        uint32_t version;
+        uint32_t numIndices, indicesOffset;
+        uint32_t numInitialStates, initialStatesOffset;
+
+        // Last index and frame of the inputs, and of the real inputs
+        uint32_t lastIndex, lastFrame, lastRealIndex, lastRealFrame;
+    };
+
+    struct IndexEntry
+    {
+        uint32_t gameMode;
+
+        // NetplayState value, 0 if unknown
+        uint32_t netplayState;
+
+        // PackedInputs for each frame, the real inputs include the reinputs after a rollback
+        uint32_t numInputs, inputsOffset;
+        uint32_t numRealInputs, realInputsOffset;
+
+        // Raw RngState, 0 if none
+        uint32_t rngStateOffset;
+
+        // RollbackEntry for each frame
+        uint32_t numRollbacks, rollbacksOffset;
+    };
+
+    struct PackedInputs
+    {
+        uint16_t p1, p2;
+    };
+
+    struct RollbackEntry
+    {
+        // MaxIndexedFrame if there is no rollback on this frame
+        uint32_t targetIndex, targetFrame;
+
+        // PackedReinputs for this rollback
+        uint32_t numReinputs, reinputsOffset;
+    };
+
+    struct PackedReinputs
+    {
+        uint32_t index, frame;
+        uint16_t p1, p2;
+    };
+
+    struct InitialStateEntry
+    {
+        uint32_t index;
+        uint8_t chara[2], moon[2], color[2];
+        uint8_t padding[2];
+    };
+
     std::vector<uint32_t> _modes;
 
     std::vector<std::string> _states;
@@ -52,4 +146,101 @@ private:
     std::vector<std::vector<std::vector<Inputs>>> _reinputs;
 
     std::vector<MsgPtr> _initialStates;
+
+    // Parsed lines of one transition index of a streamed text replay
+    struct Chunk
+    {
+        std::vector<Inputs> inputs;
+
+        MsgPtr rngState;
+
+        std::vector<IndexedFrame> rollbacks;
+
+        std::vector<std::vector<Inputs>> reinputs;
+    };
+
+    typedef std::shared_ptr<const Chunk> ChunkPtr;
+
+    // Byte range of the lines of one transition index, the ranges of neighbouring indices can overlap
+    struct ChunkRange
+    {
+        uint64_t begin = 0, end = 0;
+    };
+
+    class PrefetchThread : public Thread
+    {
+    public:
+        PrefetchThread ( ReplayManager& replay ) : replay ( replay ) {}
+        void run() override;
+
+    private:
+        ReplayManager& replay;
+    };
+
+    PrefetchThread _thread { *this };
+
+    mutable Mutex _mutex;
+
+    CondVar _cond;
+
+    std::string _replayFile;
+
+    bool _streaming = false, _stopping = false;
+
+    // Sparse index of the streamed text replay
+    std::vector<ChunkRange> _ranges;
+
+    uint32_t _lastIndex = 0, _lastFrame = 0;
+
+    // Parsed transition indices around the cursor
+    std::map<uint32_t, ChunkPtr> _chunks;
+
+    uint32_t _cursor = 0;
+
+    // Memory-mapped binary replay file, not open if the replay was loaded from a text file
+    MappedFile _file;
+
+    bool _real = false;
+
+    bool loadText ( const std::string& replayFile, bool real );
+
+    bool loadBinary ( const std::string& replayFile, bool real );
+
+    bool loadStream ( const std::string& replayFile, bool real );
+
+    // Record the game mode and state of a transition index, and the start of each match
+    void addTransition ( uint32_t gameMode, const std::string& netplayState, uint32_t index );
+
+    // Parse the character, moon, and color of a player for the initial state of the current match
+    void setInitialPlayer ( size_t player, std::stringstream& ss );
+
+    // Parse the lines of one transition index of the streamed text replay
+    ChunkPtr parseChunk ( uint32_t index ) const;
+
+    // Get the parsed lines of a transition index, and move the cursor to it
+    ChunkPtr getChunk ( uint32_t index );
+
+    // Drop the parsed indices outside the window around the cursor, must be called with the mutex locked
+    void evictChunks();
+
+    // Find an index ahead of the cursor that isn't parsed yet, must be called with the mutex locked
+    bool findMissingChunk ( uint32_t& index ) const;
+
+    void prefetchChunks();
+
+    const FileHeader& getHeader() const { return * ( const FileHeader * ) _file.data(); }
+
+    // Get count elements of type T at the given offset of the binary file, returns 0 if out of bounds
+    template<typename T>
+    const T *getArray ( uint32_t offset, uint32_t count ) const
+    {
+        if ( offset > _file.size() || count > ( _file.size() - offset ) / sizeof ( T ) )
+            return 0;
+
+        return ( const T * ) ( _file.data() + offset );
+    }
+
+    const IndexEntry *getIndexEntry ( uint32_t index ) const;
+
+    const RollbackEntry *getRollbackEntry ( IndexedFrame indexedFrame ) const;
 };
@@ -0,0 +1,190 @@
+#pragma once
+
+#include "Constants.hpp"
+#include "Logger.hpp"
+
+#include <vector>
+
+
+// Counters for the rollback states
+struct RollbackStats
+{
+    // Number of states saved, and how many of those reused the slot of an evicted state
+    uint64_t statesSaved = 0, statesReused = 0;
+
+    // Number of rollbacks, and the total number of states discarded by them
+    uint64_t rollbacks = 0, rollbackStates = 0;
+
+    // Total time spent loading states
+    uint64_t loadMicroseconds = 0;
+
+    double getAverageRollbackDepth() const { return ( rollbacks ? double ( rollbackStates ) / rollbacks : 0 ); }
+
+    double getAverageLoadMicroseconds() const { return ( rollbacks ? double ( loadMicroseconds ) / rollbacks : 0 ); }
+};
+
+
+// Fixed capacity ring of rollback states in chronological order, ie ordered by IndexedFrame.
+// T must have an IndexedFrame indexedFrame member.
+//
+// All the memory is allocated up front, so saving, evicting, and rolling back never allocate. States are saved
+// every frame, so looking up a frame is usually a single subtraction from the newest state.
+template<typename T>
+class RollbackRing
+{
+public:
+
+    // Allocate slots for the given number of states, and clear the ring
+    void allocate ( size_t capacity )
+    {
+        ASSERT ( capacity > 0 );
+
+        _states.resize ( capacity );
+        _stats = RollbackStats();
+        clear();
+    }
+
+    void deallocate()
+    {
+        _states.clear();
+        _states.shrink_to_fit();
+        clear();
+    }
+
+    // Remove all states, but keep the allocated memory and the counters
+    void clear()
+    {
+        _head = _count = 0;
+    }
+
+    bool empty() const { return _count == 0; }
+
+    bool full() const { return _count == _states.size(); }
+
+    size_t size() const { return _count; }
+
+    size_t capacity() const { return _states.size(); }
+
+    // Get the i-th oldest state
+    T& operator[] ( size_t i ) { return _states[slot ( i )]; }
+    const T& operator[] ( size_t i ) const { return _states[slot ( i )]; }
+
+    T& front() { return ( *this ) [0]; }
+    const T& front() const { return ( *this ) [0]; }
+
+    T& back() { return ( *this ) [_count - 1]; }
+    const T& back() const { return ( *this ) [_count - 1]; }
+
+    // Remove a state to make room for a new one, returns the removed state.
+    // The oldest state is kept if it is at or before the remote frame, since it may be needed to roll back that far,
+    // so the next oldest state is removed instead.
+    T evict ( uint32_t remoteFrame )
+    {
+        ASSERT ( _count > 0 );
+
+        T evicted;
+
+        if ( _count > 1 && front().indexedFrame.parts.frame <= remoteFrame )
+        {
+            evicted = ( *this ) [1];
+            ( *this ) [1] = front();
+        }
+        else
+        {
+            evicted = front();
+        }
+
+        _head = slot ( 1 );
+        --_count;
+
+        ++_stats.statesReused;
+        return evicted;
+    }
+
+    // Add a new state after all the others, there must be room for it
+    void push ( const T& state )
+    {
+        ASSERT ( _count < _states.size() );
+        ASSERT ( _count == 0 || back().indexedFrame.value < state.indexedFrame.value );
+
+        _states[slot ( _count )] = state;
+        ++_count;
+
+        ++_stats.statesSaved;
+    }
+
+    // Remove the newest state
+    void popBack()
+    {
+        ASSERT ( _count > 0 );
+        --_count;
+    }
+
+    // Find the newest state at or before the given IndexedFrame, returns size() if none
+    size_t find ( IndexedFrame indexedFrame ) const
+    {
+        if ( _count == 0 )
+            return _count;
+
+        const IndexedFrame& last = back().indexedFrame;
+
+        if ( last.value <= indexedFrame.value )
+            return _count - 1;
+
+        // Consecutive frames are in consecutive slots, so try the slot at the distance from the newest state
+        if ( last.parts.index == indexedFrame.parts.index && last.parts.frame - indexedFrame.parts.frame < _count )
+        {
+            const size_t i = _count - 1 - ( last.parts.frame - indexedFrame.parts.frame );
+
+            if ( ( *this ) [i].indexedFrame.value == indexedFrame.value )
+                return i;
+        }
+
+        // Otherwise binary search for the first state after the given IndexedFrame
+        size_t lo = 0, hi = _count;
+
+        while ( lo < hi )
+        {
+            const size_t mid = ( lo + hi ) / 2;
+
+            if ( ( *this ) [mid].indexedFrame.value <= indexedFrame.value )
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+
+        return ( lo == 0 ? _count : lo - 1 );
+    }
+
+    // Roll back to the i-th oldest state, by removing all the states after it.
+    // The removed states should be released before calling this.
+    void rollback ( size_t i )
+    {
+        ASSERT ( i < _count );
+
+        ++_stats.rollbacks;
+        _stats.rollbackStates += _count - 1 - i;
+
+        _count = i + 1;
+    }
+
+    // Add the time taken to load a state
+    void addLoadTime ( uint64_t microseconds ) { _stats.loadMicroseconds += microseconds; }
+
+    const RollbackStats& getStats() const { return _stats; }
+
+private:
+
+    std::vector<T> _states;
+
+    // Slot of the oldest state, and the number of states
+    size_t _head = 0, _count = 0;
+
+    RollbackStats _stats;
+
+    size_t slot ( size_t i ) const
+    {
+        i += _head;
+        return ( i >= _states.size() ? i - _states.size() : i );
+    }
+};
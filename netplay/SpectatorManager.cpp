@@ -38,6 +38,7 @@ SocketPtr SpectatorManager::popPendingSocket ( Socket *socketPtr )
     _pendingTimerToSocket.erase ( timerPtr );
     _pendingSocketTimers.erase ( socketPtr );
     _pendingSockets.erase ( socketPtr );
+    _pendingCompactInputs.erase ( socketPtr );
 
     return socket;
 }
@@ -58,5 +59,17 @@ void SpectatorManager::timerExpired ( Timer *timerPtr )
 
     _pendingSocketTimers.erase ( it->second );
     _pendingSockets.erase ( it->second );
+    _pendingCompactInputs.erase ( it->second );
     _pendingTimerToSocket.erase ( timerPtr );
 }
+
+void SpectatorManager::setCompactInputs ( Socket *socket, bool compactInputs )
+{
+    if ( ! isPendingSocket ( socket ) )
+        return;
+
+    if ( compactInputs )
+        _pendingCompactInputs.insert ( socket );
+    else
+        _pendingCompactInputs.erase ( socket );
+}
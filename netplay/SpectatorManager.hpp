@@ -5,6 +5,7 @@
 #include "Constants.hpp"
 
 #include <unordered_map>
+#include <unordered_set>
 #include <list>
 
 
@@ -26,6 +27,9 @@ struct Spectator
 
     bool sentRngState = false, sentRetryMenuIndex = false;
 
+    // Send inputs with the compact encoding
+    bool compactInputs = false;
+
     IpAddrPort serverAddr;
 
     std::list<Socket *>::iterator it;
@@ -54,6 +58,9 @@ public:
 
     void timerExpired ( Timer *timer );
 
+    // Set if a pending socket supports the compact input encoding, this is applied when it becomes a spectator
+    void setCompactInputs ( Socket *socket, bool compactInputs );
+
 
     size_t numSpectators() const { return _spectatorMap.size(); }
 
@@ -76,6 +83,8 @@ private:
 
     std::unordered_map<Timer *, Socket *> _pendingTimerToSocket;
 
+    std::unordered_set<Socket *> _pendingCompactInputs;
+
     std::unordered_map<Socket *, Spectator> _spectatorMap;
 
     std::list<Socket *> _spectatorList;
@@ -6,6 +6,7 @@
 #include "ChangeMonitor.hpp"
 #include "SmartSocket.hpp"
 #include "UdpSocket.hpp"
+#include "CompressionPolicy.hpp"
 #include "Exceptions.hpp"
 #include "Enum.hpp"
 #include "ErrorStringsExt.hpp"
@@ -16,10 +17,12 @@
 #include "DllFrameRate.hpp"
 #include "ReplayManager.hpp"
 #include "DllRollbackManager.hpp"
+#include "BinarySyncLog.hpp"
 
 #include <windows.h>
 
 #include <vector>
+#include <deque>
 #include <memory>
 #include <algorithm>
 
@@ -29,7 +32,10 @@ using namespace std;
 // The main log file path
 #define LOG_FILE                    FOLDER "dll.log"
 
-// The number of milliseconds to poll for events each frame
+// The binary sync log file path, this is decoded into the text sync log with tools/sync_decoder.exe
+#define BINARY_SYNC_LOG_FILE        FOLDER "sync.bin"
+
+// The maximum number of milliseconds to poll for events each frame, polling returns early once sockets are handled
 #define POLL_TIMEOUT                ( 3 )
 
 // The extra number of frames to delay checking round over state during rollback
@@ -41,6 +47,15 @@ using namespace std;
 // The number of milliseconds to wait to perform a delayed stop so that ErrorMessages are received before sockets die
 #define DELAYED_STOP                ( 100 )
 
+// Number of local state hashes to keep for comparing with the remote
+#define MAX_LOCAL_STATE_HASHES      ( 4 )
+
+// Maximum number of regions to exchange block hashes for after a memory desync
+#define MAX_DESYNC_REGIONS          ( 16 )
+
+// Number of local full-state hashes to keep for comparing with the remote
+#define MAX_LOCAL_FULL_STATE_HASHES ( 16 )
+
 // The number of milliseconds before resending inputs while waiting for more inputs
 #define RESEND_INPUTS_INTERVAL      ( 100 )
 
@@ -72,6 +87,14 @@ using namespace std;
                *CC_P ## N ## _GUARD_QUALITY_ADDR,  *CC_P ## N ## _METER_ADDR, *CC_P ## N ## _HEAT_ADDR,             \
                *CC_P ## N ## _X_POSITION_ADDR, *CC_P ## N ## _Y_POSITION_ADDR )
 
+#define SYNC_LOG_CHARACTER(N)                                                                                       \
+    BinarySyncLog::Character {                                                                                      \
+        *CC_P ## N ## _CHARACTER_ADDR, *CC_P ## N ## _MOON_SELECTOR_ADDR, *CC_P ## N ## _COLOR_SELECTOR_ADDR,      \
+        *CC_P ## N ## _SEQUENCE_ADDR, *CC_P ## N ## _SEQ_STATE_ADDR, *CC_P ## N ## _HEALTH_ADDR,                    \
+        *CC_P ## N ## _RED_HEALTH_ADDR, *CC_P ## N ## _METER_ADDR, *CC_P ## N ## _HEAT_ADDR,                        \
+        *CC_P ## N ## _GUARD_BAR_ADDR, *CC_P ## N ## _GUARD_QUALITY_ADDR,                                           \
+        *CC_P ## N ## _X_POSITION_ADDR, *CC_P ## N ## _Y_POSITION_ADDR }
+
 
 // Main application state
 static ENUM ( AppState, Uninitialized, Polling, Stopping, Deinitialized ) appState = AppState::Uninitialized;
@@ -105,6 +128,9 @@ struct DllMain
     // DllRollbackManager instance
     DllRollbackManager rollMan;
 
+    // Sync log of the game state every frame
+    BinarySyncLog syncLog;
+
     // If remote has loaded up to character select
     bool remoteCharaSelectLoaded = false;
 
@@ -145,6 +171,12 @@ struct DllMain
     // Client serverCtrlSocket address
     IpAddrPort clientServerAddr;
 
+    // Latency measured by the Pinger before starting netplay
+    Statistics latency;
+
+    // Features negotiated with the remote that don't fit in ClientMode
+    FeatureConfig featureConfig;
+
     // Sockets that have been redirected to another client
     unordered_set<Socket *> redirectedSockets;
 
@@ -164,6 +196,29 @@ struct DllMain
     // Local and remote SyncHashes
     list<MsgPtr> localSync, remoteSync;
 
+    // Hierarchical hashes of the game memory, the layout is compiled once and the hashes are saved at each SyncHash
+    StateHashes stateHashes;
+    deque<pair<IndexedFrame, StateHashes>> localStateHashes;
+
+    // Remote DesyncHashes
+    list<MsgPtr> remoteStateHashes;
+
+    // Fast hash of the whole game memory, spread over several frames if it takes longer than the budget.
+    // The budget is in microseconds per frame, 0 if disabled.
+    LaneHash fullStateHash;
+    uint64_t fullStateHashBudget = 0;
+
+    // Frame the current full-state hash was started on, and the number of frames it has taken so far
+    IndexedFrame fullStateHashFrame = {{ 0, 0 }};
+    uint32_t fullStateHashFrames = 0;
+
+    // Full-state hashes are only started on frames that are a multiple of this
+    uint32_t fullStateHashSpacing = 1;
+
+    // Local full-state hashes, and remote FullStateHashes
+    deque<pair<IndexedFrame, uint64_t>> localFullStateHashes;
+    list<MsgPtr> remoteFullStateHashes;
+
     // Debug testing flags
     bool randomInputs = false;
     bool randomDelay = false;
@@ -374,7 +429,7 @@ struct DllMain
                             LOG_TO ( syncLog, "%s Rollback: target=[%s]; actual=[%s]",
                                      before, target, netMan.getIndexedFrame() );
 
-                            LOG_SYNC ( "Reinputs: 0x%04x 0x%04x", netMan.getRawInput ( 1 ), netMan.getRawInput ( 2 ) );
+                            logSyncFrame ( SYNC_LOG_REINPUTS );
                             return;
                         }
 
@@ -578,7 +633,7 @@ struct DllMain
                 LOG_TO ( syncLog, "%s Rollback: target=[%s]; actual=[%s]",
                          before, netMan.getLastChangedFrame(), netMan.getIndexedFrame() );
 
-                LOG_SYNC ( "Reinputs: 0x%04x 0x%04x", netMan.getRawInput ( 1 ), netMan.getRawInput ( 2 ) );
+                logSyncFrame ( SYNC_LOG_REINPUTS );
 
                 netMan.clearLastChangedFrame();
                 --rollbackTimer;
@@ -681,7 +736,7 @@ struct DllMain
                         LOG_TO ( syncLog, "%s Rollback: target=[%s]; actual=[%s]",
                                  before, netMan.getLastChangedFrame(), netMan.getIndexedFrame() );
 
-                        LOG_SYNC ( "Reinputs: 0x%04x 0x%04x", netMan.getRawInput ( 1 ), netMan.getRawInput ( 2 ) );
+                        logSyncFrame ( SYNC_LOG_REINPUTS );
                         return;
                     }
                 }
@@ -728,7 +783,7 @@ struct DllMain
                     LOG_TO ( syncLog, "%s Rollback: target=[%s]; actual=[%s]",
                              before, target, netMan.getIndexedFrame() );
 
-                    LOG_SYNC ( "Reinputs: 0x%04x 0x%04x", netMan.getRawInput ( 1 ), netMan.getRawInput ( 2 ) );
+                    logSyncFrame ( SYNC_LOG_REINPUTS );
 
                     --rollbackTimer;
                     return;
@@ -751,9 +806,24 @@ struct DllMain
                 MsgPtr msgSyncHash ( new SyncHash ( netMan.getIndexedFrame() ) );
                 dataSocket->send ( msgSyncHash );
                 localSync.push_back ( msgSyncHash );
+
+                // Also send the region hashes of the whole game memory, so the remote can find where a desync is
+                sendStateHashes();
             }
         }
 
+        checkStateHashes();
+
+        // Hash the whole game memory every frame, only when not in rollback, since the hashed frame must be final
+        if ( fullStateHashBudget && dataSocket && dataSocket->isConnected() && netMan.isInGame()
+                && !netMan.isInRollback() )
+        {
+            updateFullStateHash();
+        }
+
+        if ( !checkFullStateHashes() )
+            return;
+
         // Compare current lists of sync hashes
         while ( !localSync.empty() && !remoteSync.empty() )
         {
@@ -813,7 +883,8 @@ struct DllMain
 
             if ( dump.find ( replayCheckRngHexStr ) != 0 )
             {
-                LOG_SYNC ( "RngState: %s", msgRngState->getAs<RngState>().dump() );
+                syncLog.logRngState ( *CC_GAME_MODE_ADDR, netMan.getState(), netMan.getIndexedFrame(),
+                                      msgRngState->getAs<RngState>() );
                 LOG_TO ( syncLog, "Desync!" );
                 syncLog.deinitialize();
 
@@ -856,31 +927,64 @@ struct DllMain
         MsgPtr msgRngState = procMan.getRngState ( 0 );
         ASSERT ( msgRngState.get() != 0 );
 
-        // Log state every frame
-        LOG_SYNC ( "RngState: %s", msgRngState->getAs<RngState>().dump() );
-        LOG_SYNC ( "Inputs: 0x%04x 0x%04x", netMan.getRawInput ( 1 ), netMan.getRawInput ( 2 ) );
+        // Log state every frame, with the full RngState on the first frame of each transition index
+        uint32_t flags = SYNC_LOG_INPUTS;
 
-        // Log extra state during chara select
+        if ( netMan.getFrame() == 0 )
+        {
+            syncLog.logRngState ( *CC_GAME_MODE_ADDR, netMan.getState(), netMan.getIndexedFrame(),
+                                  msgRngState->getAs<RngState>() );
+        }
+        else
+        {
+            flags |= SYNC_LOG_RNG_STATE;
+        }
+
+        // Log extra state during chara select, and while in-game
         if ( netMan.getState() == NetplayState::CharaSelect )
+            flags |= SYNC_LOG_CHARA_SELECT;
+        else if ( netMan.isInGame() )
+            flags |= SYNC_LOG_CHARACTERS | SYNC_LOG_ROUND;
+
+        logSyncFrame ( flags, ( flags & SYNC_LOG_RNG_STATE )
+                       ? BinarySyncLog::getDigest ( msgRngState->getAs<RngState>() ) : 0 );
+#endif // NOT DISABLE_LOGGING
+    }
+
+    // Log the given parts of the current frame to the sync log
+    void logSyncFrame ( uint32_t flags, uint64_t rngState = 0 )
+    {
+#ifndef DISABLE_LOGGING
+        BinarySyncLog::Frame frame;
+        frame.flags = flags;
+        frame.inputs[0] = netMan.getRawInput ( 1 );
+        frame.inputs[1] = netMan.getRawInput ( 2 );
+        frame.rngState = rngState;
+
+        if ( flags & SYNC_LOG_CHARA_SELECT )
         {
-            LOG_SYNC ( "P1: sel=%u; C=%u; M=%u; c=%u; P2: sel=%u; C=%u; M=%u; c=%u",
-                       *CC_P1_SELECTOR_MODE_ADDR, *CC_P1_CHARACTER_ADDR,
-                       *CC_P1_MOON_SELECTOR_ADDR, *CC_P1_COLOR_SELECTOR_ADDR,
-                       *CC_P2_SELECTOR_MODE_ADDR, *CC_P2_CHARACTER_ADDR,
-                       *CC_P2_MOON_SELECTOR_ADDR, *CC_P2_COLOR_SELECTOR_ADDR );
-            return;
+            frame.selectorMode[0] = *CC_P1_SELECTOR_MODE_ADDR;
+            frame.selectorMode[1] = *CC_P2_SELECTOR_MODE_ADDR;
         }
 
-        // Log extra state while in-game
-        if ( netMan.isInGame() )
+        if ( flags & ( SYNC_LOG_CHARA_SELECT | SYNC_LOG_CHARACTERS ) )
         {
-            LOG_SYNC_CHARACTER ( 1 );
-            LOG_SYNC_CHARACTER ( 2 );
-            LOG_SYNC ( "roundOverTimer=%d; introState=%u; roundTimer=%u; realTimer=%u; hitsparks=%u; camera={ %d, %d }",
-                       roundOverTimer, *CC_INTRO_STATE_ADDR, *CC_ROUND_TIMER_ADDR, *CC_REAL_TIMER_ADDR,
-                       *CC_HIT_SPARKS_ADDR, *CC_CAMERA_X_ADDR, *CC_CAMERA_Y_ADDR );
-            return;
+            frame.chara[0] = SYNC_LOG_CHARACTER ( 1 );
+            frame.chara[1] = SYNC_LOG_CHARACTER ( 2 );
         }
+
+        if ( flags & SYNC_LOG_ROUND )
+        {
+            frame.roundOverTimer = roundOverTimer;
+            frame.introState = *CC_INTRO_STATE_ADDR;
+            frame.roundTimer = *CC_ROUND_TIMER_ADDR;
+            frame.realTimer = *CC_REAL_TIMER_ADDR;
+            frame.hitsparks = *CC_HIT_SPARKS_ADDR;
+            frame.cameraX = *CC_CAMERA_X_ADDR;
+            frame.cameraY = *CC_CAMERA_Y_ADDR;
+        }
+
+        syncLog.logFrame ( *CC_GAME_MODE_ADDR, netMan.getState(), netMan.getIndexedFrame(), frame );
 #endif // NOT DISABLE_LOGGING
     }
 
@@ -908,10 +1012,7 @@ struct DllMain
             *CC_SKIP_FRAMES_ADDR = 1;
         }
 
-        LOG_SYNC ( "Reinputs: 0x%04x 0x%04x", netMan.getRawInput ( 1 ), netMan.getRawInput ( 2 ) );
-        LOG_SYNC ( "roundOverTimer=%d; introState=%u; roundTimer=%u; realTimer=%u; hitsparks=%u; camera={ %d, %d }",
-                   roundOverTimer, *CC_INTRO_STATE_ADDR, *CC_ROUND_TIMER_ADDR, *CC_REAL_TIMER_ADDR,
-                   *CC_HIT_SPARKS_ADDR, *CC_CAMERA_X_ADDR, *CC_CAMERA_Y_ADDR );
+        logSyncFrame ( SYNC_LOG_REINPUTS | SYNC_LOG_ROUND );
 
         // LOG_SYNC ( "ReSFX 0x%X: CC_SFX_ARRAY=%u; sfxFilterArray=%u; sfxMuteArray=%u", SFX_NUM,
         //            CC_SFX_ARRAY_ADDR[SFX_NUM], AsmHacks::sfxFilterArray[SFX_NUM], AsmHacks::sfxMuteArray[SFX_NUM] );
@@ -1124,6 +1225,145 @@ struct DllMain
         THROW_EXCEPTION ( "gameModeChanged(%u, %u)", ERROR_INVALID_GAME_MODE, previous, current );
     }
 
+#ifndef RELEASE
+    void sendStateHashes()
+    {
+        if ( ! rollMan.hashState ( stateHashes ) )
+            return;
+
+        localStateHashes.push_back ( { netMan.getIndexedFrame(), stateHashes } );
+
+        while ( localStateHashes.size() > MAX_LOCAL_STATE_HASHES )
+            localStateHashes.pop_front();
+
+        dataSocket->send ( new DesyncHashes ( netMan.getIndexedFrame(), DESYNC_ALL_REGIONS,
+                                              stateHashes.getRegionHashes() ) );
+    }
+
+    // Compare the remote DesyncHashes with the local hashes of the same frame.
+    // Both sides do the same, so when the region hashes differ, each side sends the block hashes of those regions,
+    // and the other side logs exactly which blocks of memory differ.
+    void checkStateHashes()
+    {
+        while ( !remoteStateHashes.empty() )
+        {
+            const DesyncHashes& remote = remoteStateHashes.front()->getAs<DesyncHashes>();
+
+            auto it = find_if ( localStateHashes.begin(), localStateHashes.end(),
+                                [&] ( const pair<IndexedFrame, StateHashes>& local )
+            {
+                return local.first.value == remote.indexedFrame.value;
+            } );
+
+            if ( it == localStateHashes.end() )
+            {
+                // Wait if the local hashes for this frame haven't been saved yet
+                if ( remote.indexedFrame.value > netMan.getIndexedFrame().value )
+                    break;
+
+                remoteStateHashes.pop_front();
+                continue;
+            }
+
+            const StateHashes& local = it->second;
+
+            if ( remote.region == DESYNC_ALL_REGIONS )
+            {
+                const vector<uint32_t> regions = local.diffRegions ( remote.hashes );
+
+                if ( !regions.empty() )
+                    LOG ( "[%s] Memory desync in %u regions", remote.indexedFrame, regions.size() );
+
+                for ( size_t i = 0; dataSocket && i < regions.size() && i < MAX_DESYNC_REGIONS; ++i )
+                {
+                    dataSocket->send ( new DesyncHashes ( remote.indexedFrame, regions[i],
+                                                          local.getBlockHashes ( regions[i] ) ) );
+                }
+            }
+            else if ( remote.region < local.getNumRegions() )
+            {
+                for ( const StateHashes::Range& range : local.diffBlocks ( remote.region, remote.hashes ) )
+                {
+                    LOG ( "[%s] Memory desync: region=%u; addr=%p+%u; size=%u", remote.indexedFrame, range.region,
+                          local.getRegionAddr ( range.region ), range.offset - local.getRegionOffset ( range.region ),
+                          range.size );
+                }
+            }
+
+            remoteStateHashes.pop_front();
+        }
+    }
+
+    void updateFullStateHash()
+    {
+        if ( !fullStateHash.isHashing() )
+        {
+            // Both sides start on the same frames, as long as they take a similar number of frames per hash
+            if ( netMan.getFrame() % fullStateHashSpacing )
+                return;
+
+            fullStateHashFrame = netMan.getIndexedFrame();
+            fullStateHashFrames = 0;
+        }
+
+        ++fullStateHashFrames;
+
+        if ( !rollMan.hashState ( fullStateHash, fullStateHashBudget ) )
+            return;
+
+        // Round up to a power of two, so the start frames still line up when one side is slower
+        fullStateHashSpacing = 1;
+
+        while ( fullStateHashSpacing < fullStateHashFrames )
+            fullStateHashSpacing *= 2;
+
+        localFullStateHashes.push_back ( { fullStateHashFrame, fullStateHash.getHash() } );
+
+        while ( localFullStateHashes.size() > MAX_LOCAL_FULL_STATE_HASHES )
+            localFullStateHashes.pop_front();
+
+        dataSocket->send ( new FullStateHash ( fullStateHashFrame, fullStateHash.getHash() ) );
+    }
+
+    // Compare the remote FullStateHashes with the local hashes of the same frame, returns false on a desync
+    bool checkFullStateHashes()
+    {
+        while ( !remoteFullStateHashes.empty() )
+        {
+            const FullStateHash& remote = remoteFullStateHashes.front()->getAs<FullStateHash>();
+
+            // Wait until the local hashes have caught up to this frame
+            if ( localFullStateHashes.empty()
+                    || localFullStateHashes.back().first.value < remote.indexedFrame.value )
+                break;
+
+            auto it = find_if ( localFullStateHashes.begin(), localFullStateHashes.end(),
+                                [&] ( const pair<IndexedFrame, uint64_t>& local )
+            {
+                return local.first.value == remote.indexedFrame.value;
+            } );
+
+            if ( it != localFullStateHashes.end() && it->second != remote.hash )
+            {
+                LOG_TO ( syncLog, "Full state desync:" );
+                LOG_TO ( syncLog, "< [%s] %016llx", it->first, it->second );
+                LOG_TO ( syncLog, "> [%s] %016llx", remote.indexedFrame, remote.hash );
+
+                syncLog.deinitialize();
+                delayedStop ( "Desync!" );
+
+                randomInputs = false;
+                localInputs [ clientMode.isLocal() ? 1 : 0 ] = 0;
+                return false;
+            }
+
+            remoteFullStateHashes.pop_front();
+        }
+
+        return true;
+    }
+#endif // NOT RELEASE
+
     void delayedStop ( const string& error )
     {
         if ( ! error.empty() )
@@ -1207,6 +1447,18 @@ struct DllMain
         }
     }
 
+    // Apply the options negotiated with the remote to a new dataSocket
+    void initDataSocket()
+    {
+        if ( clientMode.isFastHash() )
+            dataSocket->setHashType ( FAST_HASH_TYPE );
+
+        if ( featureConfig.isSelectiveRepeat() )
+            dataSocket->setSelectiveRepeat ( true );
+
+        dataSocket->setLatency ( latency );
+    }
+
     // Socket callbacks
     void socketAccepted ( Socket *serverSocket ) override
     {
@@ -1251,6 +1503,8 @@ struct DllMain
             ASSERT ( dataSocket != 0 );
             ASSERT ( dataSocket->isConnected() == true );
 
+            initDataSocket();
+
             netplayStateChanged ( NetplayState::Initial );
 
             initialTimer.reset();
@@ -1287,6 +1541,8 @@ struct DllMain
             {
                 dataSocket = SmartSocket::connectUDP ( this, address );
                 LOG ( "dataSocket=%08x", dataSocket.get() );
+
+                initDataSocket();
                 return;
             }
 
@@ -1341,6 +1597,13 @@ struct DllMain
                     return;
                 }
 
+                // Use the faster message hash if the spectator supports it
+                if ( msg->getAs<VersionConfig>().mode.isFastHash() )
+                    socket->setHashType ( FAST_HASH_TYPE );
+
+                // Send inputs with the compact encoding if the spectator supports it
+                setCompactInputs ( socket, msg->getAs<VersionConfig>().mode.isCompactInputs() );
+
                 socket->send ( new SpectateConfig ( netMan.config, netMan.getState().value ) );
                 return;
             }
@@ -1364,6 +1627,15 @@ struct DllMain
             case MsgType::SyncHash:
                 remoteSync.push_back ( msg );
                 return;
+
+            case MsgType::DesyncHashes:
+                remoteStateHashes.push_back ( msg );
+                return;
+
+            case MsgType::FullStateHash:
+                if ( fullStateHashBudget )
+                    remoteFullStateHashes.push_back ( msg );
+                return;
 #endif // NOT RELEASE
 
             default:
@@ -1384,10 +1656,21 @@ struct DllMain
             case ClientMode::Client:
                 switch ( msg->getMsgType() )
                 {
+                    // Only the negotiated input encoding is accepted
                     case MsgType::PlayerInputs:
+                        if ( netMan.config.mode.isCompactInputs() )
+                            break;
+
                         netMan.setInputs ( remotePlayer, msg->getAs<PlayerInputs>() );
                         return;
 
+                    case MsgType::CompactPlayerInputs:
+                        if ( ! netMan.config.mode.isCompactInputs() )
+                            break;
+
+                        netMan.setInputs ( remotePlayer, msg->getAs<CompactPlayerInputs>().playerInputs );
+                        return;
+
                     case MsgType::MenuIndex:
                         netMan.setRemoteRetryMenuIndex ( msg->getAs<MenuIndex>().menuIndex );
                         return;
@@ -1449,10 +1732,21 @@ struct DllMain
                         netplayStateChanged ( NetplayState::Initial );
                         return;
 
+                    // Only the negotiated input encoding is accepted
                     case MsgType::BothInputs:
+                        if ( netMan.config.mode.isCompactInputs() )
+                            break;
+
                         netMan.setBothInputs ( msg->getAs<BothInputs>() );
                         return;
 
+                    case MsgType::CompactBothInputs:
+                        if ( ! netMan.config.mode.isCompactInputs() )
+                            break;
+
+                        netMan.setBothInputs ( msg->getAs<CompactBothInputs>().bothInputs );
+                        return;
+
                     case MsgType::MenuIndex:
                         netMan.setRetryMenuIndex ( msg->getAs<MenuIndex>().index, msg->getAs<MenuIndex>().menuIndex );
                         return;
@@ -1503,18 +1797,31 @@ struct DllMain
                 
                 netMan.replayRollbackOn = options[Options::ReplayRollbackOn];
 
+                if ( options[Options::LogLevels] )
+                    Logger::setLevels ( options.arg ( Options::LogLevels ) );
+
+                if ( options[Options::SocketBackend] )
+                {
+                    Reactor::Backend backend;
+
+                    if ( Reactor::getBackend ( options.arg ( Options::SocketBackend ), backend ) )
+                        SocketManager::get().setBackend ( backend );
+                }
+
                 // This will log in the previous appDir folder it not the same
                 LOG ( "appDir='%s'", ProcessManager::appDir );
 
+                // The frame thread logs every frame, so this keeps the file writes off it
                 Logger::get().sessionId = options.arg ( Options::SessionId );
-                Logger::get().initialize ( ProcessManager::appDir + LOG_FILE );
+                Logger::get().initialize ( ProcessManager::appDir + LOG_FILE,
+                                           LOG_DEFAULT_OPTIONS | ( options[Options::AsyncLog] ? LOG_ASYNC : 0 ) );
                 Logger::get().logVersion();
 
                 LOG ( "gameDir='%s'", ProcessManager::gameDir );
                 LOG ( "appDir='%s'", ProcessManager::appDir );
 
                 syncLog.sessionId = options.arg ( Options::SessionId );
-                syncLog.initialize ( ProcessManager::appDir + SYNC_LOG_FILE, 0 );
+                syncLog.initialize ( ProcessManager::appDir + BINARY_SYNC_LOG_FILE, 0 );
                 syncLog.logVersion();
 
                 // Manually hit Alt+Enter to enable fullscreen
@@ -1558,6 +1865,7 @@ struct DllMain
 
                     const string replayFile = ProcessManager::appDir + args[0];
                     const bool real = find ( args.begin(), args.end(), "real" ) != args.end();
+                    const bool stream = find ( args.begin(), args.end(), "stream" ) != args.end();
 
                     // Parse replay speed
                     auto it = find ( args.begin(), args.end(), "speed" );
@@ -1588,7 +1896,7 @@ struct DllMain
                     }
 
                     // Parse replay file
-                    const bool good = repMan.load ( replayFile, real );
+                    const bool good = repMan.load ( replayFile, real, stream );
                     ASSERT ( good == true );
 
                     // Parse start index
@@ -1597,7 +1905,9 @@ struct DllMain
                         ++it;
                     if ( it != args.end() )
                     {
-                        MsgPtr msgInitialState = repMan.getInitialStateBefore ( lexical_cast<int> ( *it ) );
+                        const IndexedFrame start = {{ 0, lexical_cast<uint32_t> ( *it ) }};
+
+                        MsgPtr msgInitialState = repMan.seek ( start );
 
                         ASSERT ( msgInitialState.get() != 0 );
 
@@ -1612,6 +1922,18 @@ struct DllMain
                 {
                     randomInputs = options[Options::SyncTest];
                 }
+
+                if ( options[Options::FullStateHash] )
+                {
+                    fullStateHashBudget = FULL_STATE_HASH_BUDGET;
+
+                    if ( ! options.arg ( Options::FullStateHash ).empty() )
+                        fullStateHashBudget = lexical_cast<uint64_t> ( options.arg ( Options::FullStateHash ) );
+
+                    LOG ( "fullStateHashBudget=%llu us", fullStateHashBudget );
+                }
+
+                rollMan.setHistoryEnabled ( options[Options::RollbackHistory] );
 #endif // NOT RELEASE
                 break;
 
@@ -1641,6 +1963,16 @@ struct DllMain
                 LOG ( "%s: flags={ %s }", clientMode, clientMode.flagString() );
                 break;
 
+            case MsgType::PingStats:
+                latency = msg->getAs<PingStats>().latency;
+                LOG ( "latency=%.2f ms; stddev=%.2f ms", latency.getMean(), latency.getStdDev() );
+                break;
+
+            case MsgType::FeatureConfig:
+                featureConfig = msg->getAs<FeatureConfig>();
+                LOG ( "FeatureConfig: flags={ %s }", featureConfig.flagString() );
+                break;
+
             case MsgType::IpAddrPort:
                 if ( ! address.empty() )
                     break;
@@ -1753,6 +2085,8 @@ struct DllMain
 
                         dataSocket = SmartSocket::connectUDP ( this, address, clientMode.isUdpTunnel() );
                         LOG ( "dataSocket=%08x", dataSocket.get() );
+
+                        initDataSocket();
                     }
 
                     initialTimer.reset ( new Timer ( this ) );
@@ -1920,12 +2254,8 @@ struct DllMain
     // Destructor
     ~DllMain()
     {
-        rollMan.deallocateStates();
-
         KeyboardManager::get().unhook();
 
-        syncLog.deinitialize();
-
         procMan.disconnectPipe();
 
         ControllerManager::get().owner = 0;
@@ -1967,6 +2297,18 @@ static void initializeDllMain()
     mainApp.reset ( new DllMain() );
 }
 
+// Let go of the background threads without joining them, since threads can't be joined during DLL_PROCESS_DETACH
+static void releaseThreads()
+{
+    Logger::get().release();
+
+    if ( ! mainApp )
+        return;
+
+    mainApp->rollMan.releaseHistory();
+    mainApp->syncLog.release();
+}
+
 static void deinitialize()
 {
     LOCK ( deinitMutex );
@@ -1974,8 +2316,17 @@ static void deinitialize()
     if ( appState == AppState::Deinitialized )
         return;
 
+    // Stop the background threads here, since ~DllMain can also run during DLL_PROCESS_DETACH
+    if ( mainApp )
+    {
+        mainApp->rollMan.deallocateStates();
+        mainApp->syncLog.deinitialize();
+    }
+
     mainApp.reset();
 
+    CompressionPolicy::get().logStats();
+
     EventManager::get().release();
     TimerManager::get().deinitialize();
     SocketManager::get().deinitialize();
@@ -2049,6 +2400,7 @@ extern "C" BOOL APIENTRY DllMain ( HMODULE, DWORD reason, LPVOID )
 
             appState = AppState::Stopping;
             EventManager::get().release();
+            releaseThreads();
             exit ( 0 );
             break;
     }
@@ -517,6 +517,17 @@ uint32_t NetplayManager::getBufferedPreserveStartIndex() const
     return ( preserveStartIndex - PRESERVE_START_INDEX_BUFFER );
 }
 
+void NetplayManager::preserveSpectatorInputs()
+{
+    // Spectators can read from the buffered preserveStartIndex, and new spectators from the spectate start index,
+    // so the inputs memory cap must never discard those indices.
+    const uint32_t preserveIndex = min ( getBufferedPreserveStartIndex(), _spectateStartIndex );
+    const uint32_t offset = ( preserveIndex > _startIndex ? preserveIndex - _startIndex : 0 );
+
+    _inputs[0].setPreserveStartIndex ( offset );
+    _inputs[1].setPreserveStartIndex ( offset );
+}
+
 void NetplayManager::setState ( NetplayState state )
 {
     if ( ! isValidNext ( state ) )
@@ -661,6 +672,8 @@ void NetplayManager::setInput ( uint8_t player, uint16_t input )
     ASSERT ( player == 1 || player == 2 );
     ASSERT ( getIndex() >= _startIndex );
 
+    preserveSpectatorInputs();
+
     if ( isInRollback() ) {
         _inputs[player - 1].set ( getIndex() - _startIndex, getFrame() + config.rollbackDelay, input );
     } else if ( _state == NetplayState::RetryMenu ) {
@@ -684,6 +697,8 @@ void NetplayManager::assignInput ( uint8_t player, uint16_t input, IndexedFrame
     ASSERT ( player == 1 || player == 2 );
     ASSERT ( _indexedFrame.parts.index >= _startIndex );
 
+    preserveSpectatorInputs();
+
     _inputs[player - 1].assign ( _indexedFrame.parts.index - _startIndex, _indexedFrame.parts.frame, input );
 }
 
@@ -693,14 +708,30 @@ MsgPtr NetplayManager::getInputs ( uint8_t player ) const
     ASSERT ( getIndex() >= _startIndex );
     ASSERT ( _inputs[player - 1].getEndFrame ( getIndex() - _startIndex ) >= 1 );
 
-    PlayerInputs *playerInputs = new PlayerInputs ( { _inputs[player - 1].getEndFrame() - 1, getIndex() } );
+    const PlayerInputs inputs ( { _inputs[player - 1].getEndFrame() - 1, getIndex() } );
+
+    MsgPtr msg;
+    PlayerInputs *playerInputs;
+
+    // Only the negotiated encoding is sent, the compact encoding if both sides support it
+    if ( config.mode.isCompactInputs() )
+    {
+        CompactPlayerInputs *compactInputs = new CompactPlayerInputs ( inputs );
+        msg.reset ( compactInputs );
+        playerInputs = &compactInputs->playerInputs;
+    }
+    else
+    {
+        playerInputs = new PlayerInputs ( inputs );
+        msg.reset ( playerInputs );
+    }
 
     ASSERT ( playerInputs->getIndex() >= _startIndex );
 
     _inputs[player - 1].get ( playerInputs->getIndex() - _startIndex, playerInputs->getStartFrame(),
                               &playerInputs->inputs[0], playerInputs->size() );
 
-    return MsgPtr ( playerInputs );
+    return msg;
 }
 
 void NetplayManager::setInputs ( uint8_t player, const PlayerInputs& playerInputs )
@@ -713,8 +744,17 @@ void NetplayManager::setInputs ( uint8_t player, const PlayerInputs& playerInput
     ASSERT ( getIndex() >= _startIndex );
     ASSERT ( playerInputs.getIndex() >= _startIndex );
 
+    if ( ! _inputs[player - 1].isValidRange ( playerInputs.getIndex() - _startIndex, playerInputs.getStartFrame(),
+                                              playerInputs.size() ) )
+    {
+        LOG ( "Ignoring inputs out of range: [%s]; startIndex=%u", playerInputs.indexedFrame, _startIndex );
+        return;
+    }
+
     const uint32_t checkStartingFromIndex = ( isInRollback() ? getIndex() - _startIndex : UINT_MAX );
 
+    preserveSpectatorInputs();
+
     _inputs[player - 1].set ( playerInputs.getIndex() - _startIndex, playerInputs.getStartFrame(),
                               &playerInputs.inputs[0], playerInputs.size(), checkStartingFromIndex );
 }
@@ -797,6 +837,18 @@ void NetplayManager::setBothInputs ( const BothInputs& bothInputs )
 
     ASSERT ( bothInputs.getIndex() >= _startIndex );
 
+    for ( uint8_t i = 0; i < 2; ++i )
+    {
+        if ( ! _inputs[i].isValidRange ( bothInputs.getIndex() - _startIndex, bothInputs.getStartFrame(),
+                                         bothInputs.size() ) )
+        {
+            LOG ( "Ignoring inputs out of range: [%s]; startIndex=%u", bothInputs.indexedFrame, _startIndex );
+            return;
+        }
+    }
+
+    preserveSpectatorInputs();
+
     _inputs[0].set ( bothInputs.getIndex() - _startIndex, bothInputs.getStartFrame(),
                      &bothInputs.inputs[0][0], bothInputs.size() );
 
@@ -814,7 +866,7 @@ bool NetplayManager::isRemoteInputReady() const
 
     if ( _inputs[_remotePlayer - 1].empty() )
     {
-        LOG ( "[%s] No remote inputs (index)", _indexedFrame );
+        LOG_TRACE ( LOG_MODULE_NETPLAY, "[%s] No remote inputs (index)", _indexedFrame );
         return false;
     }
 
@@ -822,8 +874,8 @@ bool NetplayManager::isRemoteInputReady() const
 
     if ( _startIndex + _inputs[_remotePlayer - 1].getEndIndex() - 1 < getIndex() )
     {
-        LOG ( "[%s] remoteIndex=%u < localIndex=%u",
-              _indexedFrame, _startIndex + _inputs[_remotePlayer - 1].getEndIndex() - 1, getIndex() );
+        LOG_TRACE ( LOG_MODULE_NETPLAY, "[%s] remoteIndex=%u < localIndex=%u",
+                    _indexedFrame, _startIndex + _inputs[_remotePlayer - 1].getEndIndex() - 1, getIndex() );
         return false;
     }
 
@@ -833,7 +885,7 @@ bool NetplayManager::isRemoteInputReady() const
 
     if ( _inputs[_remotePlayer - 1].getEndFrame() == 0 )
     {
-        LOG ( "[%s] No remote inputs (frame)", _indexedFrame );
+        LOG_TRACE ( LOG_MODULE_NETPLAY, "[%s] No remote inputs (frame)", _indexedFrame );
         return false;
     }
 
@@ -843,9 +895,10 @@ bool NetplayManager::isRemoteInputReady() const
 
     if ( ( _inputs[_remotePlayer - 1].getEndFrame() - 1 + maxFramesAhead ) < getFrame() )
     {
-        LOG ( "[%s] remoteFrame = %u < localFrame=%u; delay=%u; rollback=%u; rollbackDelay=%u",
-              _indexedFrame, _inputs[_remotePlayer - 1].getEndFrame() - 1, getFrame(),
-              config.delay, config.rollback, config.rollbackDelay );
+        LOG_TRACE ( LOG_MODULE_NETPLAY,
+                    "[%s] remoteFrame = %u < localFrame=%u; delay=%u; rollback=%u; rollbackDelay=%u",
+                    _indexedFrame, _inputs[_remotePlayer - 1].getEndFrame() - 1, getFrame(),
+                    config.delay, config.rollback, config.rollbackDelay );
 
         return false;
     }
@@ -894,13 +947,14 @@ bool NetplayManager::isRngStateReady ( bool shouldSyncRngState ) const
 
     if ( _rngStates.empty() )
     {
-        LOG ( "[%s] No remote RngStates", _indexedFrame );
+        LOG_TRACE ( LOG_MODULE_NETPLAY, "[%s] No remote RngStates", _indexedFrame );
         return false;
     }
 
     if ( ( _startIndex + _rngStates.size() - 1 ) < getIndex() )
     {
-        LOG ( "[%s] remoteIndex=%u < localIndex=%u", _indexedFrame, _startIndex + _rngStates.size() - 1, getIndex() );
+        LOG_TRACE ( LOG_MODULE_NETPLAY, "[%s] remoteIndex=%u < localIndex=%u",
+                    _indexedFrame, _startIndex + _rngStates.size() - 1, getIndex() );
         return false;
     }
 
@@ -966,6 +1020,8 @@ void NetplayManager::setRemoteIndex ( uint32_t remoteIndex )
 
     LOG ( "remoteIndex=%u", remoteIndex );
 
+    preserveSpectatorInputs();
+
     _inputs[_remotePlayer - 1].resize ( remoteIndex - _startIndex, 0, 0 );
 }
 
@@ -215,6 +215,9 @@ private:
 
     // Get the buffered preserveStartIndex
     uint32_t getBufferedPreserveStartIndex() const;
+
+    // Update the inputs that are never discarded because of the memory cap, before setting any inputs
+    void preserveSpectatorInputs();
     
     std::string sanitizePlayerName( std::string name );
     void findAndReplaceAll( std::string& data, std::string toSearch, std::string replaceStr );
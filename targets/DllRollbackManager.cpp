@@ -5,6 +5,7 @@
 
 #include <utility>
 #include <algorithm>
+#include <chrono>
 
 using namespace std;
 
@@ -16,37 +17,8 @@ extern const unsigned char binary_res_rollback_bin_end;
 // Deserialized rollback memory data
 static MemDumpList allAddrs;
 
-template<typename T>
-static inline void deleteArray ( T *ptr ) { delete[] ptr; }
 
-
-void DllRollbackManager::GameState::save()
-{
-    ASSERT ( rawBytes != 0 );
-
-    char *dump = rawBytes;
-
-    for ( const MemDump& mem : allAddrs.addrs )
-        mem.saveDump ( dump );
-
-    ASSERT ( dump == rawBytes + allAddrs.totalSize );
-}
-
-void DllRollbackManager::GameState::load()
-{
-    fesetenv(&fp_env);
-
-    ASSERT ( rawBytes != 0 );
-
-    const char *dump = rawBytes;
-
-    for ( const MemDump& mem : allAddrs.addrs )
-        mem.loadDump ( dump );
-
-    ASSERT ( dump == rawBytes + allAddrs.totalSize );
-}
-
-void DllRollbackManager::allocateStates()
+static void loadAllAddrs()
 {
     if ( allAddrs.empty() )
     {
@@ -56,14 +28,23 @@ void DllRollbackManager::allocateStates()
 
     if ( allAddrs.empty() )
         THROW_EXCEPTION ( "Failed to load rollback data!", ERROR_BAD_ROLLBACK_DATA );
+}
 
-    if ( ! _memoryPool )
-        _memoryPool.reset ( new char[NUM_ROLLBACK_STATES * allAddrs.totalSize], deleteArray<char> );
+void DllRollbackManager::allocateStates()
+{
+    loadAllAddrs();
 
-    for ( size_t i = 0; i < NUM_ROLLBACK_STATES; ++i )
-        _freeStack.push ( i * allAddrs.totalSize );
+    // Rolling back MAX_ROLLBACK frames needs that many states before the current one, plus the oldest state that is
+    // kept while it is at or before the remote frame, see RollbackRing::evict.
+    _snapshots.allocate ( allAddrs, NUM_ROLLBACK_STATES, ROLLBACK_KEYFRAME_INTERVAL, MAX_ROLLBACK + 2 );
 
-    _statesList.clear();
+    _statesRing.allocate ( NUM_ROLLBACK_STATES );
+
+    if ( _historyEnabled && ROLLBACK_HISTORY_BUDGET > 0 )
+    {
+        _historyRecord.resize ( sizeof ( HistoryHeader ) + allAddrs.totalSize );
+        _history.start ( _historyRecord.size(), ROLLBACK_HISTORY_BUDGET );
+    }
 
     for ( auto& sfxArray : _sfxHistory )
         memset ( &sfxArray[0], 0, CC_SFX_ARRAY_LEN );
@@ -71,32 +52,53 @@ void DllRollbackManager::allocateStates()
 
 void DllRollbackManager::deallocateStates()
 {
-    _memoryPool.reset();
+    const RollbackStats& stats = _statesRing.getStats();
+
+    LOG ( "statesSaved=%llu; statesReused=%llu; rollbacks=%llu; averageRollbackDepth=%.2f; averageLoadTime=%.2f us",
+          stats.statesSaved, stats.statesReused, stats.rollbacks,
+          stats.getAverageRollbackDepth(), stats.getAverageLoadMicroseconds() );
+
+    if ( _history.isRunning() )
+    {
+        const SnapshotHistory::Stats historyStats = _history.getStats();
+
+        LOG ( "history: size=%u; compressed=%llu; skipped=%llu; dropped=%llu; bytesIn=%llu; bytesOut=%llu",
+              _history.size(), historyStats.compressed, historyStats.skipped, historyStats.dropped,
+              historyStats.bytesIn, historyStats.bytesOut );
+    }
+
+    _history.stop();
+
+    _historyRecord.clear();
+    _historyRecord.shrink_to_fit();
 
-    while ( ! _freeStack.empty() )
-        _freeStack.pop();
+    _hashDump.clear();
+    _hashDump.shrink_to_fit();
 
-    _statesList.clear();
+    _snapshots.deallocate();
+
+    _statesRing.deallocate();
 }
 
 void DllRollbackManager::saveState ( const NetplayManager& netMan )
 {
-    if ( _freeStack.empty() )
+    // Replace any states that aren't before the current frame, so the states stay in chronological order
+    while ( ! _statesRing.empty() && _statesRing.back().indexedFrame.value >= netMan._indexedFrame.value )
     {
-        ASSERT ( _statesList.empty() == false );
+        _snapshots.release ( _statesRing.back().snapshot );
+        _statesRing.popBack();
+    }
 
-        if ( _statesList.front().indexedFrame.parts.frame <= netMan.getRemoteFrame() )
-        {
-            auto it = _statesList.begin();
-            ++it;
-            _freeStack.push ( it->rawBytes - _memoryPool.get() );
-            _statesList.erase ( it );
-        }
-        else
-        {
-            _freeStack.push ( _statesList.front().rawBytes - _memoryPool.get() );
-            _statesList.pop_front();
-        }
+    // Evict until a snapshot can be saved, a keyframe is only freed once all the states using it are evicted
+    while ( _statesRing.full() || _snapshots.full() )
+    {
+        ASSERT ( _statesRing.empty() == false );
+
+        const GameState evicted = _statesRing.evict ( netMan.getRemoteFrame() );
+
+        saveHistory ( evicted );
+
+        _snapshots.release ( evicted.snapshot );
     }
 
     std::fenv_t fp_env;
@@ -109,111 +111,221 @@ void DllRollbackManager::saveState ( const NetplayManager& netMan )
         netMan._startWorldTime,
         netMan._indexedFrame,
         fp_env,
-        _memoryPool.get() + _freeStack.top()
+        _snapshots.save()
     };
 
-    _freeStack.pop();
-    state.save();
-    _statesList.push_back ( state );
+    _statesRing.push ( state );
 
     uint8_t *currentSfxArray = &_sfxHistory [ netMan.getFrame() % NUM_ROLLBACK_STATES ][0];
     memcpy ( currentSfxArray, AsmHacks::sfxFilterArray, CC_SFX_ARRAY_LEN );
 }
 
+void DllRollbackManager::saveHistory ( const GameState& state )
+{
+    if ( ! _history.isRunning() || state.indexedFrame.parts.frame % ROLLBACK_HISTORY_INTERVAL != 0 )
+        return;
+
+    // Skip this state if the last one is still being compressed
+    char *record = _history.acquire();
+
+    if ( ! record )
+        return;
+
+    const HistoryHeader header = { state.netplayState.value, state.startWorldTime, state.indexedFrame, state.fp_env };
+
+    memcpy ( record, &header, sizeof ( header ) );
+    _snapshots.copy ( state.snapshot, record + sizeof ( header ) );
+
+    _history.push ( state.indexedFrame.value );
+}
+
+bool DllRollbackManager::loadHistory ( IndexedFrame indexedFrame, NetplayManager& netMan )
+{
+    uint64_t foundKey;
+
+    if ( _historyRecord.empty() || ! _history.load ( indexedFrame.value, &_historyRecord[0], foundKey ) )
+        return false;
+
+    HistoryHeader header;
+    memcpy ( &header, &_historyRecord[0], sizeof ( header ) );
+
+    LOG ( "Loaded state from history: indexedFrame=%s", header.indexedFrame );
+
+    // Overwrite the current game state
+    netMan._state = ( NetplayState::Enum ) header.netplayState;
+    netMan._startWorldTime = header.startWorldTime;
+    netMan._indexedFrame = header.indexedFrame;
+    fesetenv ( &header.fp_env );
+    _snapshots.loadDump ( &_historyRecord[sizeof ( header )] );
+
+    // All the saved states are after the loaded one
+    for ( size_t i = 0; i < _statesRing.size(); ++i )
+        _snapshots.release ( _statesRing[i].snapshot );
+
+    _statesRing.clear();
+    return true;
+}
+
 bool DllRollbackManager::loadState ( IndexedFrame indexedFrame, NetplayManager& netMan )
 {
-    if ( _statesList.empty() )
+    if ( _statesRing.empty() )
     {
         LOG ( "Failed to load state: indexedFrame=%s", indexedFrame );
         return false;
     }
 
-    LOG ( "Trying to load state: indexedFrame=%s; _statesList={ %s ... %s }",
-          indexedFrame, _statesList.front().indexedFrame, _statesList.back().indexedFrame );
+    LOG ( "Trying to load state: indexedFrame=%s; _statesRing={ %s ... %s }",
+          indexedFrame, _statesRing.front().indexedFrame, _statesRing.back().indexedFrame );
+
+    const auto start = chrono::steady_clock::now();
 
     const uint32_t origFrame = netMan.getFrame();
 
-    for ( auto it = _statesList.rbegin(); it != _statesList.rend(); ++it )
+    const IndexedFrame lastFrame = _statesRing.back().indexedFrame;
+
+    size_t pos = _statesRing.find ( indexedFrame );
+
+    // If there are no states old enough, try the compressed history if enabled
+    bool fromHistory = false;
+
+    if ( pos == _statesRing.size() && _historyEnabled )
+    {
+        LOG ( "No state old enough, falling back to the history: indexedFrame=%s", indexedFrame );
+
+        fromHistory = loadHistory ( indexedFrame, netMan );
+    }
+
+    if ( pos == _statesRing.size() && ! fromHistory )
     {
 #ifdef RELEASE
-        if ( ( it->indexedFrame.value <= indexedFrame.value ) || ( & ( *it ) == &_statesList.front() ) )
+        // Load the oldest state if there are none old enough
+        pos = 0;
 #else
-        if ( it->indexedFrame.value <= indexedFrame.value )
+        LOG ( "Failed to load state: indexedFrame=%s", indexedFrame );
+        return false;
 #endif
-        {
-            LOG ( "Loaded state: indexedFrame=%s", it->indexedFrame );
-
-            // Overwrite the current game state
-            netMan._state = it->netplayState;
-            netMan._startWorldTime = it->startWorldTime;
-            netMan._indexedFrame = it->indexedFrame;
-            it->load();
-            
-            
-            int rbFrames;
-            if (netMan.replayRollbackOn) {
-                // Count the number of frames rolled back
-                rbFrames = _statesList.back().indexedFrame.value - it->indexedFrame.value;
-                //LOG("Rolled back %i frames", rbFrames);
-            }
+    }
 
-            // Erase all other states after the current one.
-            // Note: it.base() returns 1 after the position of it, but moving forward.
-            for ( auto jt = it.base(); jt != _statesList.end(); ++jt )
-            {
-                _freeStack.push ( jt->rawBytes - _memoryPool.get() );
-            }
-            
-            if (!netMan.config.mode.isTraining() && netMan.replayRollbackOn) {
-                // Erase one frame of inputs from the game's replay structs for each frame rolled back.
-                for (; rbFrames > 0; rbFrames--) {
-                    if (!*(RepRound**)CC_REPROUND_TBL_ENDPTR_ADDR) break;
-                    RepRound* curRound = (*(RepRound**)CC_REPROUND_TBL_ENDPTR_ADDR - 1);
-                    if (!curRound->inputs) break;
-                    // Assumes there are always containers for 4 players in input container table; may not be true
-                    for (int i=0; i<4; i++) {
-                        RepInputContainer* inputs = &(curRound->inputs[i]);
-                        if (!inputs->states) continue;
-                        RepInputState* state = &(inputs->states[inputs->activeIndex]);
-                        if (!state->frameCount) continue;
-                        if (state->frameCount == 1) {
-                            memset(state, 0, sizeof(RepInputState));
-                            inputs->statesEnd -= sizeof(RepInputState);
-                            //LOG("Replay state %i for p%i has frame count 1; decrementing index", inputs->activeIndex, i+1);
-                            inputs->activeIndex--;
-                        } else {
-                            //LOG("Replay state %i for p%i has frame count %i; decrementing count", inputs->activeIndex, i+1, state->frameCount);
-                            state->frameCount--;
-                        }
-                    }
+    if ( ! fromHistory )
+    {
+        const GameState& saved = _statesRing[pos];
+
+        LOG ( "Loaded state: indexedFrame=%s", saved.indexedFrame );
+
+        // Overwrite the current game state
+        netMan._state = saved.netplayState;
+        netMan._startWorldTime = saved.startWorldTime;
+        netMan._indexedFrame = saved.indexedFrame;
+        fesetenv ( &saved.fp_env );
+        _snapshots.load ( saved.snapshot );
+
+        // Erase all other states after the current one
+        for ( size_t j = pos + 1; j < _statesRing.size(); ++j )
+            _snapshots.release ( _statesRing[j].snapshot );
+
+        _statesRing.rollback ( pos );
+    }
+
+    // The compressed states after the loaded one are from the discarded timeline
+    _history.discardAfter ( netMan._indexedFrame.value );
+
+    _statesRing.addLoadTime ( chrono::duration_cast<chrono::microseconds> (
+                                  chrono::steady_clock::now() - start ).count() );
+
+    int rbFrames;
+    if (netMan.replayRollbackOn) {
+        // Count the number of frames rolled back
+        rbFrames = lastFrame.value - netMan._indexedFrame.value;
+        //LOG("Rolled back %i frames", rbFrames);
+    }
+
+    if (!netMan.config.mode.isTraining() && netMan.replayRollbackOn) {
+        // Erase one frame of inputs from the game's replay structs for each frame rolled back.
+        for (; rbFrames > 0; rbFrames--) {
+            if (!*(RepRound**)CC_REPROUND_TBL_ENDPTR_ADDR) break;
+            RepRound* curRound = (*(RepRound**)CC_REPROUND_TBL_ENDPTR_ADDR - 1);
+            if (!curRound->inputs) break;
+            // Assumes there are always containers for 4 players in input container table; may not be true
+            for (int i=0; i<4; i++) {
+                RepInputContainer* inputs = &(curRound->inputs[i]);
+                if (!inputs->states) continue;
+                RepInputState* state = &(inputs->states[inputs->activeIndex]);
+                if (!state->frameCount) continue;
+                if (state->frameCount == 1) {
+                    memset(state, 0, sizeof(RepInputState));
+                    inputs->statesEnd -= sizeof(RepInputState);
+                    //LOG("Replay state %i for p%i has frame count 1; decrementing index", inputs->activeIndex, i+1);
+                    inputs->activeIndex--;
+                } else {
+                    //LOG("Replay state %i for p%i has frame count %i; decrementing count", inputs->activeIndex, i+1, state->frameCount);
+                    state->frameCount--;
                 }
             }
+        }
+    }
 
-            _statesList.erase ( it.base(), _statesList.end() );
+    // Initialize the SFX filter by flagging all played SFX flags in the range (R,S),
+    // where R is the actual reset frame, and S is the original starting frame.
+    // Note: we can skip frame S, because the current SFX filter array is already initialized by frame S.
+    for ( uint32_t i = netMan.getFrame() + 1; i < origFrame; ++i )
+    {
+        for ( uint32_t j = 0; j < CC_SFX_ARRAY_LEN; ++j )
+            AsmHacks::sfxFilterArray[j] |= _sfxHistory [ i % NUM_ROLLBACK_STATES ][j];
+    }
 
-            // Initialize the SFX filter by flagging all played SFX flags in the range (R,S),
-            // where R is the actual reset frame, and S is the original starting frame.
-            // Note: we can skip frame S, because the current SFX filter array is already initialized by frame S.
-            for ( uint32_t i = netMan.getFrame() + 1; i < origFrame; ++i )
-            {
-                for ( uint32_t j = 0; j < CC_SFX_ARRAY_LEN; ++j )
-                    AsmHacks::sfxFilterArray[j] |= _sfxHistory [ i % NUM_ROLLBACK_STATES ][j];
-            }
+    // We set the SFX filter flag to 0x80. Since played (but filtered) SFX are incremented,
+    // unplayed sound effects in the filter will stay as 0 or 0x80.
+    for ( uint32_t j = 0; j < CC_SFX_ARRAY_LEN; ++j )
+    {
+        if ( AsmHacks::sfxFilterArray[j] )
+            AsmHacks::sfxFilterArray[j] = 0x80;
+    }
 
-            // We set the SFX filter flag to 0x80. Since played (but filtered) SFX are incremented,
-            // unplayed sound effects in the filter will stay as 0 or 0x80.
-            for ( uint32_t j = 0; j < CC_SFX_ARRAY_LEN; ++j )
-            {
-                if ( AsmHacks::sfxFilterArray[j] )
-                    AsmHacks::sfxFilterArray[j] = 0x80;
-            }
+    return true;
+}
 
-            return true;
-        }
+bool DllRollbackManager::hashState ( StateHashes& hashes )
+{
+    if ( _statesRing.capacity() == 0 )
+        return false;
+
+    if ( hashes.empty() )
+        hashes.compile ( allAddrs );
+
+    _hashDump.resize ( allAddrs.totalSize );
+    _snapshots.saveDump ( &_hashDump[0] );
+
+    hashes.compute ( &_hashDump[0] );
+    return true;
+}
+
+bool DllRollbackManager::hashState ( LaneHash& hash, uint64_t budget )
+{
+    if ( hash.empty() )
+    {
+        loadAllAddrs();
+
+        hash.compile ( allAddrs );
+
+        if ( _hashPlan.empty() )
+            _hashPlan.compile ( allAddrs );
+    }
+
+    if ( ! hash.isHashing() )
+    {
+        const auto start = chrono::steady_clock::now();
+
+        _hashPlan.saveDump ( hash.getDump() );
+        hash.start();
+
+        // Flattening the memory counts towards the budget
+        const uint64_t microseconds = chrono::duration_cast<chrono::microseconds> (
+                                          chrono::steady_clock::now() - start ).count();
+
+        budget = ( microseconds < budget ? budget - microseconds : 0 );
     }
 
-    LOG ( "Failed to load state: indexedFrame=%s", indexedFrame );
-    return false;
+    return hash.update ( budget );
 }
 
 void DllRollbackManager::saveRerunSounds ( uint32_t frame )
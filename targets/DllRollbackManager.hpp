@@ -1,12 +1,16 @@
 #pragma once
 
 #include "DllNetplayManager.hpp"
+#include "SnapshotPool.hpp"
+#include "RollbackRing.hpp"
+#include "SnapshotHistory.hpp"
+#include "StateHashes.hpp"
+#include "LaneHash.hpp"
+#include "MemDumpPlan.hpp"
 #include "Constants.hpp"
 
-#include <memory>
-#include <stack>
-#include <list>
 #include <array>
+#include <vector>
 #include <cfenv>
 
 struct __attribute__((packed)) RepInputState
@@ -44,6 +48,13 @@ public:
     void allocateStates();
     void deallocateStates();
 
+    // Enable keeping a compressed history of evicted states, and loading it when there are no states old enough.
+    // This is off by default, so loading a state that is too old fails instead.
+    void setHistoryEnabled ( bool enabled ) { _historyEnabled = enabled; }
+
+    // Let go of the history thread without joining it, since threads can't be joined during DLL_PROCESS_DETACH
+    void releaseHistory() { _history.release(); }
+
     // Save / load current game state
     void saveState ( const NetplayManager& netMan );
     bool loadState ( IndexedFrame indexedFrame, NetplayManager& netMan );
@@ -54,6 +65,16 @@ public:
     // Finalize rollback sound effects
     void finishedRerunSounds();
 
+    // Hash the current game memory, returns false if the states aren't allocated
+    bool hashState ( StateHashes& hashes );
+
+    // Continue hashing the game memory for up to the budget in microseconds, starting a new hash of the current
+    // game memory if none is in progress. This doesn't need the states to be allocated. Returns true when done.
+    bool hashState ( LaneHash& hash, uint64_t budget );
+
+    // Get the counters for the saved and loaded states
+    const RollbackStats& getStats() const { return _statesRing.getStats(); }
+
 private:
 
     struct GameState
@@ -67,22 +88,44 @@ private:
         // Floating-point environment state
         std::fenv_t fp_env;
 
-        // The pointer to the raw bytes in the state pool
-        char *rawBytes;
+        // The id of the snapshot of the game's memory
+        size_t snapshot;
+    };
+
+    // Snapshots of the game's memory for each game state
+    SnapshotPool _snapshots;
+
+    // Saved game states in chronological order
+    RollbackRing<GameState> _statesRing;
 
-        // Save / load the game state
-        void save();
-        void load();
+    // The game state saved in front of each compressed memory dump in the history
+    struct HistoryHeader
+    {
+        uint8_t netplayState;
+        uint32_t startWorldTime;
+        IndexedFrame indexedFrame;
+        std::fenv_t fp_env;
     };
 
-    // Memory pool to allocate game states
-    std::shared_ptr<char> _memoryPool;
+    // Compressed game states that were evicted from _statesRing
+    SnapshotHistory _history;
+
+    bool _historyEnabled = false;
+
+    // Buffer to uncompress a history record into
+    std::vector<char> _historyRecord;
+
+    // Buffer to flatten the game memory into for hashing
+    std::vector<char> _hashDump;
+
+    // Compiled game memory layout for flattening the memory for a LaneHash
+    MemDumpPlan _hashPlan;
 
-    // Unused indices in the memory pool, each game state has the same size
-    std::stack<size_t> _freeStack;
+    // Compress an evicted game state into the history, if the history isn't busy
+    void saveHistory ( const GameState& state );
 
-    // List of saved game states in chronological order
-    std::list<GameState> _statesList;
+    // Load the newest state in the history at or before the given frame, this erases all the saved states
+    bool loadHistory ( IndexedFrame indexedFrame, NetplayManager& netMan );
 
     // History of sound effect playbacks
     std::array<std::array<uint8_t, CC_SFX_ARRAY_LEN>, NUM_ROLLBACK_STATES> _sfxHistory;
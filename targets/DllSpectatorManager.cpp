@@ -20,6 +20,8 @@ void SpectatorManager::pushSpectator ( Socket *socketPtr, const IpAddrPort& serv
 {
     LOG ( "socket=%08x; serverAddr='%s'", socketPtr, serverAddr );
 
+    const bool compactInputs = ( _pendingCompactInputs.find ( socketPtr ) != _pendingCompactInputs.end() );
+
     SocketPtr newSocket = popPendingSocket ( socketPtr );
 
     if ( ! newSocket )
@@ -53,6 +55,7 @@ void SpectatorManager::pushSpectator ( Socket *socketPtr, const IpAddrPort& serv
     Spectator spectator;
     spectator.socket = newSocket;
     spectator.serverAddr = serverAddr;
+    spectator.compactInputs = compactInputs;
     spectator.it = it;
     spectator.pos.parts.frame = NUM_INPUTS - 1;
     spectator.pos.parts.index = _netManPtr->getSpectateStartIndex();
@@ -170,7 +173,9 @@ void SpectatorManager::frameStepSpectators()
         MsgPtr msgBothInputs = _netManPtr->getBothInputs ( spectator.pos );
 
         // Send inputs if available
-        if ( msgBothInputs )
+        if ( msgBothInputs && spectator.compactInputs )
+            socket->send ( new CompactBothInputs ( msgBothInputs->getAs<BothInputs>() ) );
+        else if ( msgBothInputs )
             socket->send ( msgBothInputs );
 
         // Clear sent flags whenever the index changes
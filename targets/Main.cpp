@@ -283,11 +283,43 @@ int main ( int argc, char *argv[] )
             "  --replay, -R args    Replay the given file with options.\n"
             "                         TODO list possible arguments.\n"
         },
+
+        {
+            Options::FullStateHash, 0, "", "full-state-hash", Arg::OptionalNumeric,
+            "  --full-state-hash B  Hash the whole game memory every frame to detect desyncs.\n"
+            "                         B is the time budget per frame in microseconds.\n"
+        },
+
+        {
+            Options::LogLevels, 0, "", "log-levels", Arg::Required,
+            "  --log-levels L       Set the log level of each module, eg socket=trace,gobackn=debug.\n"
+            "                         Levels are trace, debug, info, warn. Modules are general,\n"
+            "                         socket, gobackn, timer, netplay, all. Defaults to all=info.\n"
+        },
+
+        {
+            Options::SocketBackend, 0, "", "socket-backend", Arg::Required,
+            "  --socket-backend B   Wait on sockets with select, poll, or epoll.\n"
+            "                         Defaults to select, poll needs Vista or later.\n"
+        },
+
+        {
+            Options::RollbackHistory, 0, "", "rollback-history", Arg::None,
+            "  --rollback-history   Keep a compressed history of older rollback states, and load\n"
+            "                         it when rolling back further than the saved states.\n"
+        },
+
+        {
+            Options::AsyncLog, 0, "", "async-log", Arg::None,
+            "  --async-log          Write the logs on a background thread, so logging doesn't block\n"
+            "                         the game or the netcode on file writes.\n"
+        },
 #else
         { Options::Tunnel, 0, "", "tunnel", Arg::None, 0 },
         { Options::Dummy, 0, "", "dummy", Arg::None, 0 },
         { Options::PidLog, 0, "", "pidlog", Arg::None, 0 },
         { Options::StrictVersion, 0, "S", "", Arg::None, 0 },
+        { Options::AsyncLog, 0, "", "async-log", Arg::None, 0 },
 #endif
 
         { Options::NoFork, 0, "", "no-fork", Arg::None, 0 }, // Don't fork when inside Wine, ie when under wineconsole
@@ -382,12 +414,28 @@ int main ( int argc, char *argv[] )
     }
 
     // Initialize logging
+    if ( opt[Options::LogLevels] && ! Logger::setLevels ( opt[Options::LogLevels].arg ) )
+        PRINT ( "Invalid log levels: '%s'", opt[Options::LogLevels].arg );
+
+    // Initialize sockets with the backend
+    if ( opt[Options::SocketBackend] )
+    {
+        Reactor::Backend backend;
+
+        if ( Reactor::getBackend ( opt[Options::SocketBackend].arg, backend ) )
+            SocketManager::get().setBackend ( backend );
+        else
+            PRINT ( "Invalid socket backend: '%s'", opt[Options::SocketBackend].arg );
+    }
+
+    const uint32_t logOptions = LOG_DEFAULT_OPTIONS | ( opt[Options::AsyncLog] ? LOG_ASYNC : 0 );
+
     if ( opt[Options::Stdout] )
-        Logger::get().initialize();
+        Logger::get().initialize ( "", logOptions );
     else if ( opt[Options::PidLog] )
-        Logger::get().initialize ( ProcessManager::appDir + LOG_FILE, LOG_DEFAULT_OPTIONS | PID_IN_FILENAME );
+        Logger::get().initialize ( ProcessManager::appDir + LOG_FILE, logOptions | PID_IN_FILENAME );
     else
-        Logger::get().initialize ( ProcessManager::appDir + LOG_FILE );
+        Logger::get().initialize ( ProcessManager::appDir + LOG_FILE, logOptions );
     Logger::get().logVersion();
 
     LOG ( "Running from: %s", ProcessManager::appDir );
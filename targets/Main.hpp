@@ -39,8 +39,6 @@ struct Main
 
     TimerPtr stopTimer;
 
-    Logger syncLog;
-
 
     Main() : procMan ( this ) {}
 
@@ -20,6 +20,9 @@ using namespace std;
 
 #define NUM_PINGS ( 10 )
 
+// Features this version supports that are negotiated with FeatureConfig
+#define LOCAL_FEATURES ( FeatureConfig::SelectiveRepeat )
+
 
 extern vector<option::Option> opt;
 
@@ -89,12 +92,20 @@ struct MainApp
 
     SpectateConfig spectateConfig;
 
+    // Indicates if the host we are spectating sends compact inputs
+    bool isHostCompactInputs = false;
+
+    // Features supported by both sides, only set once the remote sends its FeatureConfig
+    FeatureConfig featureConfig;
+
     NetplayConfig netplayConfig;
 
     Pinger pinger;
 
     PingStats pingStats;
 
+    Logger syncLog;
+
     bool isBroadcastPortReady = false;
 
     bool isFinalConfigReady = false;
@@ -304,6 +315,10 @@ struct MainApp
             return;
         }
 
+        // Use the faster message hash on this socket if the remote supports it
+        if ( versionConfig.mode.isFastHash() )
+            socket->setHashType ( FAST_HASH_TYPE );
+
         // Switch to spectate mode if the game is already started
         if ( clientMode.isClient() && versionConfig.mode.isGameStarted() )
             clientMode.value = ClientMode::SpectateNetplay;
@@ -317,6 +332,9 @@ struct MainApp
             if ( ! versionConfig.mode.isGameStarted() )
                 stop ( "Not in a game yet, cannot spectate!" );
 
+            // The host sends compact inputs to spectators whenever it supports them
+            isHostCompactInputs = versionConfig.mode.isCompactInputs();
+
             // Wait for SpectateConfig
             return;
         }
@@ -346,6 +364,19 @@ struct MainApp
             LOG ( "serverDataSocket=%08x", serverDataSocket.get() );
         }
 
+        // The flags are merged when exchanging InitialConfig, so these are only used if both sides support them
+        for ( uint8_t flag : { ClientMode::FastHash, ClientMode::CompactInputs } )
+        {
+            if ( versionConfig.mode.flags & flag )
+                initialConfig.mode.flags |= flag;
+            else
+                initialConfig.mode.flags &= ~flag;
+        }
+
+        // Only send the features that don't fit in ClientMode to a remote that can decode them
+        if ( versionConfig.mode.isFastHash() )
+            ctrlSocket->send ( new FeatureConfig ( LOCAL_FEATURES ) );
+
         initialConfig.invalidate();
         ctrlSocket->send ( initialConfig );
     }
@@ -385,6 +416,9 @@ struct MainApp
                                                    ctrlSocket->getAsSmart().isTunnel() );
             LOG ( "dataSocket=%08x", dataSocket.get() );
 
+            if ( this->initialConfig.mode.isFastHash() )
+                dataSocket->setHashType ( FAST_HASH_TYPE );
+
             ui.display (
                 "Connecting to " + this->initialConfig.remoteName
                 + "\n\n" + ( this->initialConfig.mode.isTraining() ? "Training" : "Versus" ) + " mode"
@@ -450,6 +484,12 @@ struct MainApp
 
         this->spectateConfig = spectateConfig;
 
+        // The flags of the host's netplay session don't indicate which inputs the host sends to us
+        if ( isHostCompactInputs )
+            this->spectateConfig.mode.flags |= ClientMode::CompactInputs;
+        else
+            this->spectateConfig.mode.flags &= ~ClientMode::CompactInputs;
+
         ui.spectate ( spectateConfig );
 
         getUserConfirmation();
@@ -673,10 +713,15 @@ struct MainApp
             case MsgType::RngState:
                 return;
 
+            case MsgType::CompactPlayerInputs:
             case MsgType::PlayerInputs:
             {
+                const PlayerInputs& remote = ( msg->getMsgType() == MsgType::PlayerInputs
+                                               ? msg->getAs<PlayerInputs>()
+                                               : msg->getAs<CompactPlayerInputs>().playerInputs );
+
                 // TODO log dummy inputs to check sync
-                PlayerInputs inputs ( msg->getAs<PlayerInputs>().indexedFrame );
+                PlayerInputs inputs ( remote.indexedFrame );
                 inputs.indexedFrame.parts.frame += netplayConfig.delay * 2;
 
                 for ( uint32_t i = 0; i < inputs.size(); ++i )
@@ -685,7 +730,10 @@ struct MainApp
                     inputs.inputs[i] = ( ( frame % 5 ) ? 0 : COMBINE_INPUT ( 0, CC_BUTTON_A | CC_BUTTON_CONFIRM ) );
                 }
 
-                dataSocket->send ( inputs );
+                if ( initialConfig.mode.isCompactInputs() )
+                    dataSocket->send ( new CompactPlayerInputs ( inputs ) );
+                else
+                    dataSocket->send ( inputs );
                 return;
             }
 
@@ -696,11 +744,14 @@ struct MainApp
                     dataSocket->send ( new MenuIndex ( msg->getAs<MenuIndex>().index, 0 ) );
                 return;
 
+            case MsgType::CompactBothInputs:
             case MsgType::BothInputs:
             {
                 static IndexedFrame last = {{ 0, 0 }};
 
-                const BothInputs& both = msg->getAs<BothInputs>();
+                const BothInputs& both = ( msg->getMsgType() == MsgType::BothInputs
+                                           ? msg->getAs<BothInputs>()
+                                           : msg->getAs<CompactBothInputs>().bothInputs );
 
                 if ( both.getIndex() > last.parts.index )
                 {
@@ -877,6 +928,9 @@ struct MainApp
             ASSERT ( dataSocket != 0 );
             ASSERT ( dataSocket->isConnected() == true );
 
+            if ( initialConfig.mode.isFastHash() )
+                dataSocket->setHashType ( FAST_HASH_TYPE );
+
             pinger.start();
         }
         else
@@ -1004,6 +1058,11 @@ struct MainApp
                     gotSpectateConfig ( msg->getAs<SpectateConfig>() );
                     return;
 
+                case MsgType::FeatureConfig:
+                    featureConfig.flags = ( LOCAL_FEATURES & msg->getAs<FeatureConfig>().flags );
+                    LOG ( "FeatureConfig: flags={ %s }", featureConfig.flagString() );
+                    return;
+
                 case MsgType::InitialConfig:
                     gotInitialConfig ( msg->getAs<InitialConfig>() );
                     return;
@@ -1071,6 +1130,16 @@ struct MainApp
 
         ASSERT ( netplayConfig.delay != 0xFF );
 
+        // Seeds the retransmit timeout of the netplay dataSocket, and enables the features both sides support
+        if ( clientMode.isNetplay() )
+        {
+            pingStats.invalidate();
+            procMan.ipcSend ( pingStats );
+
+            featureConfig.invalidate();
+            procMan.ipcSend ( featureConfig );
+        }
+
         netplayConfig.invalidate();
 
         procMan.ipcSend ( netplayConfig );
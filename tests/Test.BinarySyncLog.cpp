@@ -0,0 +1,291 @@
+#ifndef RELEASE
+
+#include "BinarySyncLog.hpp"
+#include "NetplayStates.hpp"
+#include "Logger.hpp"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <fstream>
+#include <random>
+#include <cstdio>
+
+using namespace std;
+
+
+// Number of in-game frames in the benchmark
+#define BENCHMARK_FRAMES ( 60 * 60 * 10 )
+
+#define BINARY_SYNC_LOG_FILE "test_sync.bin"
+
+#define TEXT_SYNC_LOG_FILE "test_sync.log"
+
+
+// Log a frame to the binary sync log, and add the lines that LOG_SYNC in DllMain would log for it
+static void logFrame ( BinarySyncLog& syncLog, vector<string>& lines, uint32_t gameMode, NetplayState state,
+                       IndexedFrame indexedFrame, const BinarySyncLog::Frame& frame, const RngState& rngState )
+{
+    const string prefix = format ( "%s [%u] %s [%s] ", gameModeStr ( gameMode ), gameMode, state, indexedFrame );
+
+    if ( indexedFrame.parts.frame == 0 )
+    {
+        syncLog.logRngState ( gameMode, state, indexedFrame, rngState );
+        lines.push_back ( prefix + "RngState: " + rngState.dump() );
+    }
+
+    syncLog.logFrame ( gameMode, state, indexedFrame, frame );
+
+    if ( frame.flags & SYNC_LOG_RNG_STATE )
+        lines.push_back ( prefix + format ( "RngState: %016llx", frame.rngState ) );
+
+    if ( frame.flags & ( SYNC_LOG_INPUTS | SYNC_LOG_REINPUTS ) )
+    {
+        lines.push_back ( prefix + format ( "%s: 0x%04x 0x%04x", ( frame.flags & SYNC_LOG_REINPUTS )
+                                            ? "Reinputs" : "Inputs", frame.inputs[0], frame.inputs[1] ) );
+    }
+
+    if ( frame.flags & SYNC_LOG_CHARA_SELECT )
+    {
+        lines.push_back ( prefix + format ( "P1: sel=%u; C=%u; M=%u; c=%u; P2: sel=%u; C=%u; M=%u; c=%u",
+                                            frame.selectorMode[0], frame.chara[0].chara, frame.chara[0].moon,
+                                            frame.chara[0].color, frame.selectorMode[1], frame.chara[1].chara,
+                                            frame.chara[1].moon, frame.chara[1].color ) );
+    }
+
+    if ( frame.flags & SYNC_LOG_CHARACTERS )
+    {
+        for ( uint32_t i = 0; i < 2; ++i )
+        {
+            const BinarySyncLog::Character& c = frame.chara[i];
+
+            lines.push_back ( prefix + format ( "P%u: C=%u; M=%u; c=%u; seq=%u; st=%u; hp=%u; rh=%u; gb=%.1f; gq=%.1f; "
+                                                "mt=%u; ht=%u; x=%d; y=%d", i + 1, c.chara, c.moon, c.color, c.seq,
+                                                c.seqState, c.health, c.redHealth, c.guardBar, c.guardQuality,
+                                                c.meter, c.heat, c.x, c.y ) );
+        }
+    }
+
+    if ( frame.flags & SYNC_LOG_ROUND )
+    {
+        lines.push_back ( prefix + format ( "roundOverTimer=%d; introState=%u; roundTimer=%u; realTimer=%u; "
+                                            "hitsparks=%u; camera={ %d, %d }", frame.roundOverTimer,
+                                            frame.introState, frame.roundTimer, frame.realTimer, frame.hitsparks,
+                                            frame.cameraX, frame.cameraY ) );
+    }
+}
+
+static BinarySyncLog::Frame randomFrame ( mt19937& rng, uint32_t flags )
+{
+    BinarySyncLog::Frame frame;
+    frame.flags = flags;
+    frame.inputs[0] = rng() % 0x1000;
+    frame.inputs[1] = rng() % 0x1000;
+    frame.rngState = ( uint64_t ( rng() ) << 32 ) | rng();
+    frame.selectorMode[0] = rng() % 3;
+    frame.selectorMode[1] = rng() % 3;
+
+    for ( BinarySyncLog::Character& c : frame.chara )
+    {
+        c.chara = rng() % 32;
+        c.moon = rng() % 3;
+        c.color = rng() % 36;
+        c.seq = rng() % 600;
+        c.seqState = rng() % 40;
+        c.health = rng() % 11401;
+        c.redHealth = rng() % 11401;
+        c.meter = rng() % 30001;
+        c.heat = rng() % 600;
+        c.guardBar = ( rng() % 80000 ) / 10.0f;
+        c.guardQuality = ( rng() % 30 ) / 10.0f;
+        c.x = int32_t ( rng() % 131072 ) - 65536;
+        c.y = rng() % 10000;
+    }
+
+    frame.roundOverTimer = int32_t ( rng() % 100 ) - 1;
+    frame.introState = rng() % 3;
+    frame.roundTimer = rng() % 4752;
+    frame.realTimer = rng() % 10000;
+    frame.hitsparks = rng() % 10;
+    frame.cameraX = int32_t ( rng() % 2000 ) - 1000;
+    frame.cameraY = rng() % 1000;
+    return frame;
+}
+
+static RngState randomRngState ( mt19937& rng )
+{
+    RngState rngState ( 0 );
+    rngState.rngState0 = rng();
+    rngState.rngState1 = rng();
+    rngState.rngState2 = rng();
+
+    for ( char& c : rngState.rngState3 )
+        c = rng() % 256;
+
+    return rngState;
+}
+
+
+TEST ( BinarySyncLog, Decode )
+{
+    mt19937 rng ( 1234 );
+
+    vector<string> lines;
+
+    BinarySyncLog syncLog;
+    syncLog.initialize ( BINARY_SYNC_LOG_FILE );
+
+    syncLog.log ( __BASE_FILE__, __LINE__, __PRETTY_FUNCTION__, "SessionId 'test'" );
+    lines.push_back ( "SessionId 'test'" );
+
+    // More than the ring buffer holds, so it wraps around several times
+    uint32_t index = 0;
+
+    for ( uint32_t i = 0; i < 20; ++i )
+    {
+        for ( uint32_t frame = 0; frame < 300; ++frame )
+        {
+            logFrame ( syncLog, lines, CC_GAME_MODE_CHARA_SELECT, NetplayState::CharaSelect, {{ frame, index }},
+                       randomFrame ( rng, SYNC_LOG_INPUTS | SYNC_LOG_CHARA_SELECT | ( frame ? SYNC_LOG_RNG_STATE : 0 ) ),
+                       randomRngState ( rng ) );
+        }
+
+        ++index;
+
+        for ( uint32_t frame = 0; frame < 3000; ++frame )
+        {
+            logFrame ( syncLog, lines, CC_GAME_MODE_IN_GAME, NetplayState::InGame, {{ frame, index }},
+                       randomFrame ( rng, SYNC_LOG_INPUTS | SYNC_LOG_CHARACTERS | SYNC_LOG_ROUND
+                                     | ( frame ? SYNC_LOG_RNG_STATE : 0 ) ),
+                       randomRngState ( rng ) );
+
+            if ( frame > 10 && rng() % 50 == 0 )
+            {
+                const string line = format ( "In-game [%u] NetplayState::InGame [%u:%u] Rollback: target=[%u:%u]; "
+                                             "actual=[%u:%u]", CC_GAME_MODE_IN_GAME, index, frame, index, frame - 5,
+                                             index, frame - 5 );
+
+                syncLog.log ( __BASE_FILE__, __LINE__, __PRETTY_FUNCTION__, line.c_str() );
+                lines.push_back ( line );
+
+                for ( uint32_t rerun = frame - 5; rerun < frame; ++rerun )
+                {
+                    logFrame ( syncLog, lines, CC_GAME_MODE_IN_GAME, NetplayState::InGame, {{ rerun, index }},
+                               randomFrame ( rng, SYNC_LOG_REINPUTS | SYNC_LOG_ROUND ), randomRngState ( rng ) );
+                }
+            }
+        }
+
+        ++index;
+    }
+
+    syncLog.flush();
+
+    ifstream binaryFile ( BINARY_SYNC_LOG_FILE, ifstream::binary | ifstream::ate );
+    EXPECT_GT ( ( uint64_t ) binaryFile.tellg(), ( uint64_t ) SYNC_LOG_RING_SIZE * 2 );
+    binaryFile.close();
+
+    syncLog.deinitialize();
+
+    ASSERT_TRUE ( BinarySyncLog::decode ( BINARY_SYNC_LOG_FILE, TEXT_SYNC_LOG_FILE ) );
+
+    ifstream textFile ( TEXT_SYNC_LOG_FILE );
+
+    string line;
+    size_t i = 0;
+
+    for ( ; getline ( textFile, line ); ++i )
+    {
+        ASSERT_LT ( i, lines.size() );
+        ASSERT_EQ ( lines[i], line );
+    }
+
+    EXPECT_EQ ( lines.size(), i );
+
+    textFile.close();
+
+    remove ( BINARY_SYNC_LOG_FILE );
+    remove ( TEXT_SYNC_LOG_FILE );
+}
+
+TEST ( BinarySyncLog, Benchmark )
+{
+    mt19937 rng ( 1234 );
+
+    const BinarySyncLog::Frame frame = randomFrame ( rng, SYNC_LOG_INPUTS | SYNC_LOG_CHARACTERS | SYNC_LOG_ROUND );
+    const RngState rngState = randomRngState ( rng );
+
+    // Text sync log, formatted the same way as LOG_SYNC in DllMain
+    Logger textLog;
+    textLog.initialize ( TEXT_SYNC_LOG_FILE, 0 );
+
+    auto start = chrono::steady_clock::now();
+
+    for ( uint32_t i = 0; i < BENCHMARK_FRAMES; ++i )
+    {
+        const IndexedFrame indexedFrame = {{ i, 1 }};
+
+#define LOG_TEXT(FORMAT, ...)                                                                                       \
+        LOG_TO ( textLog, "%s [%u] %s [%s] " FORMAT, gameModeStr ( CC_GAME_MODE_IN_GAME ), CC_GAME_MODE_IN_GAME,    \
+                 NetplayState ( NetplayState::InGame ), indexedFrame, ## __VA_ARGS__ )
+
+        LOG_TEXT ( "RngState: %s", rngState.dump() );
+        LOG_TEXT ( "Inputs: 0x%04x 0x%04x", frame.inputs[0], frame.inputs[1] );
+
+        for ( uint32_t j = 0; j < 2; ++j )
+        {
+            const BinarySyncLog::Character& c = frame.chara[j];
+
+            LOG_TEXT ( "P%u: C=%u; M=%u; c=%u; seq=%u; st=%u; hp=%u; rh=%u; gb=%.1f; gq=%.1f; mt=%u; ht=%u; x=%d; y=%d",
+                       j + 1, c.chara, c.moon, c.color, c.seq, c.seqState, c.health, c.redHealth, c.guardBar,
+                       c.guardQuality, c.meter, c.heat, c.x, c.y );
+        }
+
+        LOG_TEXT ( "roundOverTimer=%d; introState=%u; roundTimer=%u; realTimer=%u; hitsparks=%u; camera={ %d, %d }",
+                   frame.roundOverTimer, frame.introState, frame.roundTimer, frame.realTimer, frame.hitsparks,
+                   frame.cameraX, frame.cameraY );
+
+#undef LOG_TEXT
+    }
+
+    const uint64_t textMicroseconds = chrono::duration_cast<chrono::microseconds> (
+                                          chrono::steady_clock::now() - start ).count();
+
+    textLog.deinitialize();
+
+    BinarySyncLog binaryLog;
+    binaryLog.initialize ( BINARY_SYNC_LOG_FILE );
+
+    start = chrono::steady_clock::now();
+
+    for ( uint32_t i = 0; i < BENCHMARK_FRAMES; ++i )
+    {
+        BinarySyncLog::Frame copy = frame;
+        copy.flags |= SYNC_LOG_RNG_STATE;
+        copy.rngState = BinarySyncLog::getDigest ( rngState );
+
+        binaryLog.logFrame ( CC_GAME_MODE_IN_GAME, NetplayState::InGame, {{ i, 1 }}, copy );
+    }
+
+    const uint64_t binaryMicroseconds = chrono::duration_cast<chrono::microseconds> (
+                                            chrono::steady_clock::now() - start ).count();
+
+    const size_t stalls = binaryLog.getNumStalls();
+
+    binaryLog.deinitialize();
+
+    ifstream textFile ( TEXT_SYNC_LOG_FILE, ifstream::binary | ifstream::ate );
+    ifstream binaryFile ( BINARY_SYNC_LOG_FILE, ifstream::binary | ifstream::ate );
+
+    LOG ( "frames=%u; text: %.3f us/frame, size=%u; binary: %.3f us/frame, size=%u, stalls=%u",
+          BENCHMARK_FRAMES, double ( textMicroseconds ) / BENCHMARK_FRAMES, ( size_t ) textFile.tellg(),
+          double ( binaryMicroseconds ) / BENCHMARK_FRAMES, ( size_t ) binaryFile.tellg(), stalls );
+
+    textFile.close();
+    binaryFile.close();
+
+    remove ( BINARY_SYNC_LOG_FILE );
+    remove ( TEXT_SYNC_LOG_FILE );
+}
+
+#endif // NOT RELEASE
@@ -0,0 +1,211 @@
+#ifndef RELEASE
+
+#include "Test.Socket.hpp"
+#include "CompressionPolicy.hpp"
+#include "Protocol.hpp"
+#include "Thread.hpp"
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <random>
+#include <vector>
+#include <memory>
+
+using namespace std;
+
+
+static string randomString ( mt19937& rng, size_t length, uint8_t alphabet )
+{
+    string str ( length, 0 );
+    for ( char& c : str )
+        c = ( char ) ( 'a' + rng() % alphabet );
+    return str;
+}
+
+static size_t encodeTestMessage ( const string& str, MsgBuffer& buffer )
+{
+    MsgPtr msg ( new TestMessage ( str ) );
+    msg->compressionLevel = 9;
+    return Protocol::encode ( msg, buffer );
+}
+
+
+TEST ( CompressionPolicy, SkipSmallMessages )
+{
+    CompressionPolicy& policy = CompressionPolicy::get();
+    policy.clear();
+
+    MsgBuffer buffer;
+
+    // Highly compressible, but below the size threshold
+    const string str ( 200, 'a' );
+
+    policy.setMinSize ( MsgType::TestMessage, 1000 );
+
+    encodeTestMessage ( str, buffer );
+
+    EXPECT_EQ ( 1, policy.getStats ( MsgType::TestMessage ).skipped );
+    EXPECT_EQ ( 0, policy.getStats ( MsgType::TestMessage ).compressed );
+
+    // Header + sequence + string length + string + hash
+    EXPECT_EQ ( 2 + 4 + 4 + str.size() + 16, buffer.size() );
+
+    // Lowering the threshold should compress the same message
+    policy.setMinSize ( MsgType::TestMessage, DEFAULT_COMPRESSION_MIN_SIZE );
+
+    encodeTestMessage ( str, buffer );
+
+    EXPECT_EQ ( 1, policy.getStats ( MsgType::TestMessage ).compressed );
+    EXPECT_GT ( policy.getStats ( MsgType::TestMessage ).bytesSaved(), 0 );
+    EXPECT_LT ( buffer.size(), 2 + 4 + 4 + str.size() + 16 );
+
+    policy.clear();
+}
+
+TEST ( CompressionPolicy, AdaptiveLevel )
+{
+    CompressionPolicy& policy = CompressionPolicy::get();
+    policy.clear();
+
+    mt19937 rng ( 1234 );
+    MsgBuffer buffer;
+
+    // Random bytes don't compress, so compression should eventually be disabled
+    for ( size_t i = 0; i < 4 * COMPRESSION_ADAPT_INTERVAL; ++i )
+        encodeTestMessage ( randomString ( rng, 1000, 255 ), buffer );
+
+    EXPECT_GT ( policy.getStats ( MsgType::TestMessage ).skipped, 0 );
+    EXPECT_EQ ( 0, policy.getLevel ( MsgType::TestMessage, 9, 1000 ) );
+
+    const uint64_t compressed = policy.getStats ( MsgType::TestMessage ).compressed;
+
+    // Compressible messages are only probed occasionally
+    for ( size_t i = 0; i < COMPRESSION_PROBE_INTERVAL / 2; ++i )
+        encodeTestMessage ( randomString ( rng, 1000, 2 ), buffer );
+
+    EXPECT_EQ ( compressed, policy.getStats ( MsgType::TestMessage ).compressed );
+
+    // After which compression is re-enabled
+    for ( size_t i = 0; i < COMPRESSION_PROBE_INTERVAL; ++i )
+        encodeTestMessage ( randomString ( rng, 1000, 2 ), buffer );
+
+    EXPECT_GT ( policy.getStats ( MsgType::TestMessage ).compressed, compressed + 1 );
+    EXPECT_GT ( policy.getLevel ( MsgType::TestMessage, 9, 1000 ), 0 );
+
+    // The level never exceeds the requested level
+    EXPECT_EQ ( 0, policy.getLevel ( MsgType::TestMessage, 0, 1000 ) );
+
+    policy.clear();
+}
+
+TEST ( CompressionPolicy, Dictionary )
+{
+    CompressionPolicy& policy = CompressionPolicy::get();
+    policy.clear();
+    policy.setMinSize ( MsgType::TestMessage, 0 );
+
+    mt19937 rng ( 1234 );
+    MsgBuffer buffer;
+
+    const string dictionary = randomString ( rng, 1000, 255 );
+
+    for ( size_t length : { 0, 10, 100, 1000 } )
+    {
+        // Messages that mostly repeat the dictionary
+        const string str = dictionary.substr ( 0, length ) + "Hello!";
+
+        const size_t size = encodeTestMessage ( str, buffer );
+
+        policy.setDictionary ( MsgType::TestMessage, dictionary );
+
+        const size_t dictSize = encodeTestMessage ( str, buffer );
+
+        if ( length >= 100 )
+            EXPECT_LT ( dictSize, size );
+
+        if ( length >= 1000 )
+            EXPECT_LT ( dictSize, size / 4 );
+
+        size_t consumed;
+        MsgPtr msg = Protocol::decode ( buffer.data(), buffer.size(), consumed );
+
+        ASSERT_TRUE ( msg.get() );
+        EXPECT_EQ ( buffer.size(), consumed );
+        EXPECT_EQ ( str, msg->getAs<TestMessage>().str );
+
+        // Messages compressed with a dictionary can't be decoded without it
+        const string bytes = buffer.str();
+
+        policy.setDictionary ( MsgType::TestMessage, "" );
+
+        if ( dictSize < size )
+            EXPECT_FALSE ( Protocol::decode ( &bytes[0], bytes.size(), consumed ).get() );
+    }
+
+    policy.clear();
+}
+
+// Number of messages encoded by each thread
+#define NUM_THREAD_MESSAGES ( 2000 )
+
+struct EncodingThread : public Thread
+{
+    mt19937 rng;
+
+    EncodingThread ( uint32_t seed ) : rng ( seed ) {}
+
+    void run() override
+    {
+        MsgBuffer buffer;
+
+        for ( size_t i = 0; i < NUM_THREAD_MESSAGES; ++i )
+        {
+            const string str = randomString ( rng, 100 + rng() % 1000, 1 + rng() % 255 );
+
+            encodeTestMessage ( str, buffer );
+
+            size_t consumed;
+            MsgPtr msg = Protocol::decode ( buffer.data(), buffer.size(), consumed, buffer );
+
+            if ( ! msg || msg->getAs<TestMessage>().str != str )
+                ++failed;
+        }
+    }
+
+    size_t failed = 0;
+};
+
+TEST ( CompressionPolicy, Threads )
+{
+    CompressionPolicy& policy = CompressionPolicy::get();
+    policy.clear();
+
+    // Every thread reads the dictionary without locking
+    mt19937 rng ( 1234 );
+    policy.setDictionary ( MsgType::TestMessage, randomString ( rng, 1000, 255 ) );
+
+    // The policy is shared by sockets on the main and network threads
+    vector<shared_ptr<EncodingThread>> threads;
+
+    for ( uint32_t i = 0; i < 4; ++i )
+        threads.push_back ( make_shared<EncodingThread> ( i ) );
+
+    for ( auto& thread : threads )
+        thread->start();
+
+    for ( auto& thread : threads )
+    {
+        thread->join();
+        EXPECT_EQ ( 0, thread->failed );
+    }
+
+    // Every message was either compressed or skipped
+    const CompressionPolicy::Stats stats = policy.getStats ( MsgType::TestMessage );
+
+    EXPECT_EQ ( threads.size() * NUM_THREAD_MESSAGES, stats.compressed + stats.skipped );
+
+    policy.clear();
+}
+
+#endif // NOT RELEASE
@@ -3,10 +3,16 @@
 #include "Test.Socket.hpp"
 #include "UdpSocket.hpp"
 #include "GoBackN.hpp"
+#include "TimerManager.hpp"
 
 #include <gtest/gtest.h>
 
 #include <vector>
+#include <map>
+#include <random>
+#include <algorithm>
+#include <functional>
+#include <memory>
 
 using namespace std;
 
@@ -15,6 +21,14 @@ using namespace std;
 #define CHECK_SUM_FAIL  50
 #define LONG_TIMEOUT    ( 120 * 1000 )
 
+// Simulated link parameters: one message per frame, one-way latency and jitter in milliseconds, and packet loss
+#define LINK_NUM_MESSAGES   ( 600 )
+#define LINK_SEND_INTERVAL  ( 16 )
+#define LINK_LATENCY        ( 40 )
+#define LINK_JITTER         ( 20 )
+#define LINK_PACKET_LOSS    ( 10 )
+#define LINK_TIMEOUT        ( 10 * 60 * 1000 )
+
 
 struct TestClass : public GoBackN::Owner, public Socket::Owner, public Timer::Owner
 {
@@ -411,4 +425,386 @@ TEST ( GoBackN, Timeout )
     TimerManager::get().deinitialize();
 }
 
+// Simulated link between two GoBackN instances, with a manually advanced clock so the results are deterministic
+struct LossyLink : public GoBackN::Owner
+{
+    mt19937 rng;
+
+    GoBackN sender, receiver;
+
+    // Send several messages per datagram
+    bool batched;
+
+    // Datagrams in flight, ordered by their delivery time
+    multimap<uint64_t, pair<GoBackN *, string>> datagrams;
+
+    uint64_t now = 1;
+
+    vector<uint64_t> sentAt, latencies;
+
+    vector<string> received;
+
+    void sendDatagram ( GoBackN *gbn, const string& bytes )
+    {
+        if ( rng() % 100 < LINK_PACKET_LOSS )
+            return;
+
+        const uint64_t deliverAt = now + LINK_LATENCY + rng() % LINK_JITTER;
+
+        datagrams.insert ( make_pair ( deliverAt, make_pair ( gbn == &sender ? &receiver : &sender, bytes ) ) );
+    }
+
+    void goBackNSendRaw ( GoBackN *gbn, const MsgPtr& msg ) override
+    {
+        if ( msg )
+            sendDatagram ( gbn, Protocol::encode ( msg ) );
+    }
+
+    size_t goBackNSendBatch ( GoBackN *gbn, const MsgPtr *msgs, size_t count, size_t maxBytes ) override
+    {
+        if ( ! batched )
+            return GoBackN::Owner::goBackNSendBatch ( gbn, msgs, count, maxBytes );
+
+        string bytes;
+        size_t i = 0;
+
+        for ( ; i < count; ++i )
+        {
+            const string msg = Protocol::encode ( msgs[i] );
+
+            if ( i > 0 && bytes.size() + msg.size() > maxBytes )
+                break;
+
+            bytes += msg;
+        }
+
+        sendDatagram ( gbn, bytes );
+        return i;
+    }
+
+    void goBackNRecvRaw ( GoBackN *gbn, const MsgPtr& msg ) override {}
+    void goBackNTimeout ( GoBackN *gbn ) override {}
+
+    void goBackNRecvMsg ( GoBackN *gbn, const MsgPtr& msg ) override
+    {
+        received.push_back ( msg->getAs<TestMessage>().str );
+        latencies.push_back ( now - sentAt[received.size() - 1] );
+    }
+
+    LossyLink ( bool selectiveRepeat, bool batched = true )
+        : rng ( 1234 ), sender ( this ), receiver ( this ), batched ( batched )
+    {
+        sender.setSelectiveRepeat ( selectiveRepeat );
+        receiver.setSelectiveRepeat ( selectiveRepeat );
+
+        // Seed the round trip time like Pinger would
+        Statistics latency;
+        for ( uint32_t i = 0; i < 10; ++i )
+            latency.addSample ( LINK_LATENCY + rng() % LINK_JITTER );
+        sender.setLatency ( latency );
+
+        TimerManager::get().setManualNow ( now );
+    }
+
+    // Advance the clock by 1 millisecond, delivering datagrams and checking timers
+    void step()
+    {
+        TimerManager::get().setManualNow ( ++now );
+
+        while ( ! datagrams.empty() && datagrams.begin()->first <= now )
+        {
+            GoBackN *gbn = datagrams.begin()->second.first;
+            const string bytes = datagrams.begin()->second.second;
+            datagrams.erase ( datagrams.begin() );
+
+            for ( size_t pos = 0, consumed; pos < bytes.size(); pos += consumed )
+                gbn->recvFromSocket ( Protocol::decode ( &bytes[pos], bytes.size() - pos, consumed ) );
+        }
+
+        TimerManager::get().check();
+    }
+
+    // Send one message per frame, and measure the latency of each one
+    void sendFrames()
+    {
+        while ( now < LINK_TIMEOUT && received.size() < LINK_NUM_MESSAGES )
+        {
+            if ( now % LINK_SEND_INTERVAL == 0 && sentAt.size() < LINK_NUM_MESSAGES )
+            {
+                sender.sendViaGoBackN ( new TestMessage ( format ( "%u", sentAt.size() ) ) );
+                sentAt.push_back ( now );
+            }
+
+            step();
+        }
+
+        sort ( latencies.begin(), latencies.end() );
+    }
+
+    // Send a single message of random bytes, and return the time until it was received
+    uint64_t transfer ( size_t size )
+    {
+        string str ( size, 0 );
+        for ( char& c : str )
+            c = ( char ) rng();
+
+        MsgPtr msg ( new TestMessage ( str ) );
+        msg->compressionLevel = 0;
+
+        sentAt.push_back ( now );
+        sender.sendViaGoBackN ( msg );
+
+        while ( now < LINK_TIMEOUT && received.empty() )
+            step();
+
+        EXPECT_EQ ( 1, received.size() );
+
+        if ( received.empty() )
+            return LINK_TIMEOUT;
+
+        EXPECT_EQ ( str, received[0] );
+        return latencies[0];
+    }
+
+    uint64_t getPercentile ( uint32_t percent ) const
+    {
+        return latencies[ ( latencies.size() - 1 ) * percent / 100];
+    }
+};
+
+TEST ( GoBackN, SelectiveRepeatLatency )
+{
+    TimerManager::get().initialize();
+
+    // One message per datagram, so only the resend strategies are compared
+    LossyLink goBackN ( false, false ), selectiveRepeat ( true, false );
+
+    goBackN.sendFrames();
+    selectiveRepeat.sendFrames();
+
+    TimerManager::get().setManualNow ( 0 );
+    TimerManager::get().deinitialize();
+
+    for ( const LossyLink *link : { &goBackN, &selectiveRepeat } )
+    {
+        ASSERT_EQ ( LINK_NUM_MESSAGES, link->received.size() );
+
+        // All messages are delivered once in order
+        for ( uint32_t i = 0; i < link->received.size(); ++i )
+            EXPECT_EQ ( format ( "%u", i ), link->received[i] );
+    }
+
+    LOG ( "GoBackN: p50=%llu; p90=%llu; p99=%llu",
+          goBackN.getPercentile ( 50 ), goBackN.getPercentile ( 90 ), goBackN.getPercentile ( 99 ) );
+    LOG ( "SelectiveRepeat: p50=%llu; p90=%llu; p99=%llu; retransmitTimeout=%llu",
+          selectiveRepeat.getPercentile ( 50 ), selectiveRepeat.getPercentile ( 90 ),
+          selectiveRepeat.getPercentile ( 99 ), selectiveRepeat.sender.getRetransmitTimeout() );
+
+    EXPECT_LE ( selectiveRepeat.getPercentile ( 50 ), goBackN.getPercentile ( 50 ) );
+    EXPECT_LT ( selectiveRepeat.getPercentile ( 90 ), goBackN.getPercentile ( 90 ) );
+    EXPECT_LT ( selectiveRepeat.getPercentile ( 99 ), goBackN.getPercentile ( 99 ) );
+}
+
+// Receives selective repeat messages directly, and lets each test act on the delivered messages
+struct DeliveryTest : public GoBackN::Owner
+{
+    unique_ptr<GoBackN> gbn;
+
+    vector<string> received;
+
+    function<void ( const string& )> delivered;
+
+    DeliveryTest() : gbn ( new GoBackN ( this ) )
+    {
+        gbn->setSelectiveRepeat ( true );
+    }
+
+    void goBackNSendRaw ( GoBackN *gbn, const MsgPtr& msg ) override {}
+    void goBackNRecvRaw ( GoBackN *gbn, const MsgPtr& msg ) override {}
+    void goBackNTimeout ( GoBackN *gbn ) override {}
+
+    void goBackNRecvMsg ( GoBackN *gbn, const MsgPtr& msg ) override
+    {
+        received.push_back ( msg->getAs<TestMessage>().str );
+
+        if ( delivered )
+            delivered ( received.back() );
+    }
+
+    void recv ( uint32_t sequence )
+    {
+        MsgPtr msg ( new TestMessage ( format ( "%u", sequence ) ) );
+        msg->getAs<SerializableSequence>().setSequence ( sequence );
+
+        gbn->recvFromSocket ( msg );
+    }
+};
+
+TEST ( GoBackN, SelectiveRepeatReentrantDelivery )
+{
+    TimerManager::get().initialize();
+
+    {
+        DeliveryTest test;
+
+        // Messages received while handling a delivered message are delivered after the buffered ones
+        test.delivered = [&] ( const string& str )
+        {
+            if ( str == "1" )
+                test.recv ( 4 );
+        };
+
+        test.recv ( 3 );
+        test.recv ( 2 );
+        test.recv ( 1 );
+
+        EXPECT_EQ ( vector<string> ( { "1", "2", "3", "4" } ), test.received );
+        EXPECT_EQ ( 4, test.gbn->getRecvCount() );
+    }
+
+    {
+        DeliveryTest test;
+
+        // Resetting while handling a delivered message drops the rest of the buffered messages
+        test.delivered = [&] ( const string& str )
+        {
+            if ( str == "2" )
+                test.gbn->reset();
+        };
+
+        test.recv ( 3 );
+        test.recv ( 2 );
+        test.recv ( 1 );
+
+        EXPECT_EQ ( vector<string> ( { "1", "2" } ), test.received );
+        EXPECT_EQ ( 0, test.gbn->getRecvCount() );
+
+        // Delivery starts over after the reset
+        test.delivered = nullptr;
+        test.recv ( 1 );
+
+        EXPECT_EQ ( vector<string> ( { "1", "2", "1" } ), test.received );
+        EXPECT_EQ ( 1, test.gbn->getRecvCount() );
+    }
+
+    {
+        DeliveryTest test;
+
+        // Destroying while handling a delivered message stops the delivery
+        test.delivered = [&] ( const string& str )
+        {
+            if ( str == "1" )
+                test.gbn.reset();
+        };
+
+        test.recv ( 2 );
+        test.recv ( 1 );
+
+        EXPECT_EQ ( vector<string> ( { "1" } ), test.received );
+        EXPECT_FALSE ( test.gbn );
+    }
+
+    TimerManager::get().deinitialize();
+}
+
+TEST ( GoBackN, AckWithoutDelay )
+{
+    struct TestSocket : public GoBackN::Owner
+    {
+        GoBackN gbn;
+
+        bool deferred = false;
+
+        vector<uint32_t> acks;
+
+        TestSocket() : gbn ( this ) {}
+
+        void goBackNSendRaw ( GoBackN *gbn, const MsgPtr& msg ) override
+        {
+            ASSERT_EQ ( MsgType::AckSequence, msg->getMsgType() );
+            acks.push_back ( msg->getAs<AckSequence>().getSequence() );
+        }
+
+        void goBackNRecvRaw ( GoBackN *gbn, const MsgPtr& msg ) override {}
+        void goBackNRecvMsg ( GoBackN *gbn, const MsgPtr& msg ) override {}
+        void goBackNTimeout ( GoBackN *gbn ) override {}
+
+        void goBackNAckPending ( GoBackN *gbn ) override
+        {
+            if ( ! deferred )
+                gbn->sendPendingAck();
+        }
+
+        void recv ( uint32_t sequence )
+        {
+            MsgPtr msg ( new TestMessage ( format ( "%u", sequence ) ) );
+            msg->getAs<SerializableSequence>().setSequence ( sequence );
+
+            gbn.recvFromSocket ( msg );
+        }
+    };
+
+    TimerManager::get().initialize();
+
+    TestSocket test;
+
+    // Without a batch, each message is ACKed as soon as it is received, without waiting for a timer
+    test.recv ( 1 );
+    test.recv ( 2 );
+
+    EXPECT_EQ ( vector<uint32_t> ( { 1, 2 } ), test.acks );
+
+    // While deferred, the messages are covered by a single ACK once the pending ACK is sent
+    test.deferred = true;
+    test.recv ( 3 );
+    test.recv ( 4 );
+    test.recv ( 5 );
+
+    EXPECT_EQ ( 2, test.acks.size() );
+
+    test.gbn.sendPendingAck();
+    test.gbn.sendPendingAck();
+
+    EXPECT_EQ ( vector<uint32_t> ( { 1, 2, 5 } ), test.acks );
+
+    TimerManager::get().deinitialize();
+}
+
+TEST ( GoBackN, TransferBenchmark )
+{
+    TimerManager::get().initialize();
+
+    for ( size_t size : { 1024, 16 * 1024, 256 * 1024 } )
+    {
+        uint64_t unbatched, batched, selectiveRepeat;
+
+        {
+            LossyLink link ( false, false );
+            unbatched = link.transfer ( size );
+        }
+        {
+            LossyLink link ( false, true );
+            batched = link.transfer ( size );
+        }
+        {
+            LossyLink link ( true, true );
+            selectiveRepeat = link.transfer ( size );
+        }
+
+        LOG ( "size=%u; unbatched=%llu ms; batched=%llu ms; selectiveRepeat=%llu ms",
+              size, unbatched, batched, selectiveRepeat );
+
+        EXPECT_LE ( batched, unbatched );
+        EXPECT_LE ( selectiveRepeat, batched );
+
+        if ( size > DEFAULT_DATAGRAM_SIZE )
+        {
+            EXPECT_LT ( batched, unbatched );
+        }
+    }
+
+    TimerManager::get().setManualNow ( 0 );
+    TimerManager::get().deinitialize();
+}
+
 #endif // NOT RELEASE
@@ -0,0 +1,259 @@
+#ifndef RELEASE
+
+#include "InputEncoding.hpp"
+#include "ProcessManager.hpp"
+#include "Messages.hpp"
+
+#include <gtest/gtest.h>
+
+#include <vector>
+#include <random>
+#include <algorithm>
+
+using namespace std;
+
+
+// Recorded-style runs of { direction, buttons, frames }: neutral, walking, jumping, combos and held buttons.
+// Directions are in numpad format, except neutral is 0.
+static const uint16_t RecordedRuns[][3] =
+{
+    { 0, 0, 74 }, { 6, 0, 12 }, { 0, 0, 3 }, { 2, 0, 9 }, { 3, 0, 2 }, { 6, 0, 2 },
+    { 6, CC_BUTTON_A, 3 }, { 0, 0, 5 }, { 0, CC_BUTTON_B, 4 }, { 0, 0, 11 }, { 2, 0, 6 },
+    { 2, CC_BUTTON_C, 3 }, { 2, 0, 14 }, { 1, 0, 27 }, { 4, 0, 41 }, { 0, 0, 7 }, { 8, 0, 4 },
+    { 9, 0, 11 }, { 9, CC_BUTTON_A, 2 }, { 9, 0, 9 }, { 9, CC_BUTTON_B, 2 }, { 0, 0, 6 },
+    { 2, CC_BUTTON_C, 3 }, { 0, 0, 16 }, { 2, 0, 4 }, { 3, 0, 3 }, { 6, 0, 2 }, { 6, CC_BUTTON_C, 3 },
+    { 0, 0, 20 }, { 0, CC_BUTTON_D, 38 }, { 0, 0, 10 }, { 4, 0, 9 }, { 4, CC_BUTTON_AB, 2 },
+    { 0, 0, 60 }, { 0, CC_BUTTON_START, 5 }, { 0, 0, 15 }, { 2, CC_BUTTON_CONFIRM, 2 }, { 0, 0, 30 },
+};
+
+static vector<uint16_t> getRecordedInputs()
+{
+    vector<uint16_t> inputs;
+
+    for ( const auto& run : RecordedRuns )
+        inputs.insert ( inputs.end(), run[2], COMBINE_INPUT ( run[0], run[1] ) );
+
+    return inputs;
+}
+
+static vector<uint16_t> getRandomInputs ( mt19937& rng, size_t count )
+{
+    vector<uint16_t> inputs;
+
+    while ( inputs.size() < count )
+    {
+        // Mix short and long runs, with random changes in either or both fields
+        const size_t length = 1 + ( rng() % 2 ? rng() % 4 : rng() % 64 );
+        const uint16_t direction = rng() % 16;
+        const uint16_t buttons = ( rng() % 2 ? rng() % 0x100 : rng() % 0x1000 );
+
+        uint16_t input = COMBINE_INPUT ( direction, buttons );
+
+        if ( ! inputs.empty() && rng() % 3 == 0 )
+            input = ( inputs.back() & 0xFFF0u ) | direction;
+
+        inputs.insert ( inputs.end(), min ( length, count - inputs.size() ), input );
+    }
+
+    return inputs;
+}
+
+static void checkRoundTrip ( const uint16_t *inputs, size_t count )
+{
+    string bytes;
+    encodeInputs ( inputs, count, bytes );
+
+    vector<uint16_t> decoded ( count );
+    size_t pos = 0;
+
+    ASSERT_TRUE ( decodeInputs ( bytes, pos, &decoded[0], count ) );
+    EXPECT_EQ ( bytes.size(), pos );
+    EXPECT_EQ ( vector<uint16_t> ( inputs, inputs + count ), decoded );
+}
+
+
+TEST ( InputEncoding, RandomRoundTrip )
+{
+    mt19937 rng ( 1234 );
+
+    for ( size_t i = 0; i < 1000; ++i )
+    {
+        const size_t count = 1 + rng() % ( 4 * NUM_INPUTS );
+        const vector<uint16_t> inputs = getRandomInputs ( rng, count );
+
+        checkRoundTrip ( &inputs[0], inputs.size() );
+    }
+}
+
+TEST ( InputEncoding, RecordedRoundTrip )
+{
+    const vector<uint16_t> inputs = getRecordedInputs();
+
+    size_t totalSize = 0, numWindows = 0;
+
+    // Every window of inputs that could be sent in a single message
+    for ( size_t i = 0; i + NUM_INPUTS <= inputs.size(); ++i )
+    {
+        checkRoundTrip ( &inputs[i], NUM_INPUTS );
+
+        string bytes;
+        encodeInputs ( &inputs[i], NUM_INPUTS, bytes );
+
+        totalSize += bytes.size();
+        ++numWindows;
+    }
+
+    checkRoundTrip ( &inputs[0], inputs.size() );
+
+    // Held inputs should be an order of magnitude smaller than the raw inputs
+    EXPECT_LE ( 10 * totalSize, numWindows * sizeof ( uint16_t ) * NUM_INPUTS );
+}
+
+TEST ( InputEncoding, InvalidEncoding )
+{
+    const vector<uint16_t> inputs = getRecordedInputs();
+
+    string bytes;
+    encodeInputs ( &inputs[0], NUM_INPUTS, bytes );
+
+    vector<uint16_t> decoded ( 2 * NUM_INPUTS );
+    size_t pos;
+
+    // Truncated
+    for ( size_t i = 0; i < bytes.size(); ++i )
+    {
+        pos = 0;
+        EXPECT_FALSE ( decodeInputs ( bytes.substr ( 0, i ), pos, &decoded[0], NUM_INPUTS ) );
+    }
+
+    // Fewer inputs than encoded
+    pos = 0;
+    EXPECT_FALSE ( decodeInputs ( bytes, pos, &decoded[0], NUM_INPUTS - 1 ) );
+
+    // More inputs than encoded
+    pos = 0;
+    EXPECT_FALSE ( decodeInputs ( bytes, pos, &decoded[0], NUM_INPUTS + 1 ) );
+}
+
+TEST ( InputEncoding, CompactMessages )
+{
+    mt19937 rng ( 1234 );
+
+    for ( size_t i = 0; i < 100; ++i )
+    {
+        // Include the first frames, where only part of the inputs are used
+        const IndexedFrame indexedFrame = {{ ( uint32_t ) ( rng() % ( 2 * NUM_INPUTS ) ), ( uint32_t ) ( rng() % 8 ) }};
+
+        PlayerInputs playerInputs ( indexedFrame );
+        BothInputs bothInputs ( indexedFrame );
+
+        playerInputs.inputs.fill ( 0 );
+        bothInputs.inputs[0].fill ( 0 );
+        bothInputs.inputs[1].fill ( 0 );
+
+        vector<uint16_t> inputs = getRandomInputs ( rng, playerInputs.size() );
+        copy ( inputs.begin(), inputs.end(), playerInputs.inputs.begin() );
+        copy ( inputs.begin(), inputs.end(), bothInputs.inputs[0].begin() );
+
+        inputs = getRandomInputs ( rng, playerInputs.size() );
+        copy ( inputs.begin(), inputs.end(), bothInputs.inputs[1].begin() );
+
+        size_t consumed;
+
+        const string player = Protocol::encode ( MsgPtr ( new CompactPlayerInputs ( playerInputs ) ) );
+        MsgPtr msg = Protocol::decode ( &player[0], player.size(), consumed );
+
+        ASSERT_TRUE ( msg.get() );
+        ASSERT_EQ ( MsgType::CompactPlayerInputs, msg->getMsgType() );
+        EXPECT_EQ ( player.size(), consumed );
+        EXPECT_EQ ( playerInputs.indexedFrame.value, msg->getAs<CompactPlayerInputs>().playerInputs.indexedFrame.value );
+        EXPECT_EQ ( playerInputs.inputs, msg->getAs<CompactPlayerInputs>().playerInputs.inputs );
+
+        const string both = Protocol::encode ( MsgPtr ( new CompactBothInputs ( bothInputs ) ) );
+        msg = Protocol::decode ( &both[0], both.size(), consumed );
+
+        ASSERT_TRUE ( msg.get() );
+        ASSERT_EQ ( MsgType::CompactBothInputs, msg->getMsgType() );
+        EXPECT_EQ ( both.size(), consumed );
+        EXPECT_EQ ( bothInputs.indexedFrame.value, msg->getAs<CompactBothInputs>().bothInputs.indexedFrame.value );
+        EXPECT_EQ ( bothInputs.inputs, msg->getAs<CompactBothInputs>().bothInputs.inputs );
+    }
+}
+
+// Build a message with the given type and raw message data, using a valid hash so only the data is malformed
+static string encodeRawMessage ( MsgType type, const string& data )
+{
+    char hash[MAX_HASH_SIZE];
+    getHash ( HashType::Md5, &data[0], data.size(), hash );
+
+    string bytes;
+    bytes += ( char ) type;
+    bytes += ( char ) 0;
+    bytes += data;
+    bytes.append ( hash, getHashSize ( HashType::Md5 ) );
+    return bytes;
+}
+
+// Message data for a CompactPlayerInputs: indexedFrame, then the length prefixed input encoding
+static string getCompactData ( IndexedFrame indexedFrame, const string& encoding, uint8_t length )
+{
+    string data ( ( const char * ) &indexedFrame.value, sizeof ( indexedFrame.value ) );
+    data += ( char ) length;
+    data += encoding;
+    return data;
+}
+
+TEST ( InputEncoding, MalformedPayloads )
+{
+    const vector<uint16_t> inputs = getRecordedInputs();
+
+    const IndexedFrame indexedFrame = {{ NUM_INPUTS - 1, 3 }};
+
+    string encoding;
+    encodeInputs ( &inputs[0], NUM_INPUTS, encoding );
+
+    size_t consumed;
+
+    // Sanity check the raw message is valid
+    string bytes = encodeRawMessage ( MsgType::CompactPlayerInputs,
+                                      getCompactData ( indexedFrame, encoding, encoding.size() ) );
+    MsgPtr msg = Protocol::decode ( &bytes[0], bytes.size(), consumed );
+
+    ASSERT_TRUE ( msg.get() );
+    EXPECT_EQ ( bytes.size(), consumed );
+    EXPECT_TRUE ( equal ( inputs.begin(), inputs.begin() + NUM_INPUTS,
+                          msg->getAs<CompactPlayerInputs>().playerInputs.inputs.begin() ) );
+
+    // Runs that go past the frame range of the message
+    const IndexedFrame shortFrame = {{ 4, 3 }};
+
+    bytes = encodeRawMessage ( MsgType::CompactPlayerInputs, getCompactData ( shortFrame, encoding, encoding.size() ) );
+    EXPECT_FALSE ( Protocol::decode ( &bytes[0], bytes.size(), consumed ).get() );
+
+    // A single run of the maximum length is longer than any frame range
+    bytes = encodeRawMessage ( MsgType::CompactPlayerInputs, getCompactData ( indexedFrame, string ( 1, '\x1F' ), 1 ) );
+    EXPECT_FALSE ( Protocol::decode ( &bytes[0], bytes.size(), consumed ).get() );
+
+    // Bytes left over after the runs
+    bytes = encodeRawMessage ( MsgType::CompactPlayerInputs,
+                               getCompactData ( indexedFrame, encoding + '\0', encoding.size() + 1 ) );
+    EXPECT_FALSE ( Protocol::decode ( &bytes[0], bytes.size(), consumed ).get() );
+
+    // Length prefix longer than the encoding
+    bytes = encodeRawMessage ( MsgType::CompactPlayerInputs,
+                               getCompactData ( indexedFrame, encoding, encoding.size() + 1 ) );
+    EXPECT_FALSE ( Protocol::decode ( &bytes[0], bytes.size(), consumed ).get() );
+
+    // Encoding for one player only
+    bytes = encodeRawMessage ( MsgType::CompactBothInputs,
+                               string ( 4, '\0' ) + getCompactData ( indexedFrame, encoding, encoding.size() ) );
+    EXPECT_FALSE ( Protocol::decode ( &bytes[0], bytes.size(), consumed ).get() );
+
+    // Encoding for both players
+    bytes = encodeRawMessage ( MsgType::CompactBothInputs,
+                               string ( 4, '\0' ) + getCompactData ( indexedFrame, encoding + encoding,
+                                                                     2 * encoding.size() ) );
+    EXPECT_TRUE ( Protocol::decode ( &bytes[0], bytes.size(), consumed ).get() );
+}
+
+#endif // NOT RELEASE
@@ -0,0 +1,464 @@
+#ifndef RELEASE
+
+#include "InputsContainer.hpp"
+#include "TimerManager.hpp"
+
+#include <gtest/gtest.h>
+
+#include <vector>
+#include <random>
+
+using namespace std;
+
+
+// Reference implementation using a vector of vectors
+template<typename T>
+class VectorInputsContainer
+{
+public:
+
+    T get ( uint32_t index, uint32_t frame ) const
+    {
+        if ( index >= _inputs.size() || _inputs[index].empty() )
+            return lastInputBefore ( index );
+
+        if ( frame >= _inputs[index].size() )
+            return _inputs[index].back();
+
+        return _inputs[index][frame];
+    }
+
+    void get ( uint32_t index, uint32_t frame, T *t, size_t n ) const
+    {
+        copy ( _inputs[index].begin() + frame, _inputs[index].begin() + frame + n, t );
+    }
+
+    void set ( uint32_t index, uint32_t frame, T t )
+    {
+        if ( _inputs.size() > index && _inputs[index].size() > frame )
+            return;
+
+        resize ( index, frame );
+        _inputs[index][frame] = t;
+    }
+
+    void assign ( uint32_t index, uint32_t frame, T t )
+    {
+        resize ( index, frame );
+        _inputs[index][frame] = t;
+    }
+
+    void set ( uint32_t index, uint32_t frame, T t, size_t n )
+    {
+        resize ( index, frame, n );
+        fill ( _inputs[index].begin() + frame, _inputs[index].begin() + frame + n, t );
+    }
+
+    void set ( uint32_t index, uint32_t frame, const T *t, size_t n, uint32_t checkStartingFromIndex = UINT_MAX )
+    {
+        if ( index >= checkStartingFromIndex )
+        {
+            IndexedFrame f;
+            size_t i;
+
+            for ( i = 0, f = {{ frame, index }}; i < n; ++i, ++f.parts.frame )
+            {
+                if ( get ( f.parts.index, f.parts.frame ) == t[i] )
+                    continue;
+
+                _lastChangedFrame.value = min ( _lastChangedFrame.value, f.value );
+                break;
+            }
+        }
+
+        resize ( index, frame, n );
+        copy ( t, t + n, &_inputs[index][frame] );
+    }
+
+    void resize ( uint32_t index, uint32_t frame, size_t n = 1 )
+    {
+        T last = 0;
+
+        if ( index >= _inputs.size() )
+        {
+            last = lastInputBefore ( _inputs.size() );
+            _inputs.resize ( index + 1 );
+        }
+        else if ( ! _inputs[index].empty() )
+        {
+            last = _inputs[index].back();
+        }
+
+        if ( frame + n > _inputs[index].size() )
+            _inputs[index].resize ( frame + n, last );
+    }
+
+    bool empty() const { return _inputs.empty(); }
+
+    bool empty ( size_t index ) const { return index >= _inputs.size() || _inputs[index].empty(); }
+
+    uint32_t getEndIndex() const { return _inputs.size(); }
+
+    uint32_t getEndFrame() const { return _inputs.empty() ? 0 : _inputs.back().size(); }
+
+    uint32_t getEndFrame ( size_t index ) const { return index >= _inputs.size() ? 0 : _inputs[index].size(); }
+
+    void eraseIndexOlderThan ( size_t index )
+    {
+        if ( index + 1 >= _inputs.size() )
+            _inputs.clear();
+        else
+            _inputs.erase ( _inputs.begin(), _inputs.begin() + index );
+    }
+
+    IndexedFrame getLastChangedFrame() const { return _lastChangedFrame; }
+
+    void clearLastChangedFrame() { _lastChangedFrame = MaxIndexedFrame; }
+
+private:
+
+    vector<vector<T>> _inputs;
+
+    IndexedFrame _lastChangedFrame = MaxIndexedFrame;
+
+    T lastInputBefore ( uint32_t index ) const
+    {
+        if ( _inputs.empty() || index == 0 )
+            return 0;
+
+        if ( index > _inputs.size() )
+            index = _inputs.size();
+
+        do
+        {
+            --index;
+            if ( ! _inputs[index].empty() )
+                return _inputs[index].back();
+        }
+        while ( index > 0 );
+
+        return 0;
+    }
+};
+
+
+// Number of frames spent in each netplay state of a single match: character select, loading, skippable,
+// in-game, and the retry menu.
+static const uint32_t MatchStateFrames[] = { 900, 240, 300, 5400, 300 };
+
+// Replay a session of the given number of frames, with the same calls NetplayManager makes each frame.
+// Returns a checksum of all the inputs read back.
+template<typename C>
+static uint64_t replaySession ( C inputs[2], uint32_t numFrames, bool eraseOldIndices )
+{
+    mt19937 rng ( 1234 );
+
+    uint64_t checksum = 0;
+    uint32_t index = 0, frame = 0, state = 0;
+    uint16_t localInput = 0;
+
+    array<uint16_t, NUM_INPUTS> remoteInputs;
+    remoteInputs.fill ( 0 );
+
+    for ( uint32_t i = 0; i < numFrames; ++i )
+    {
+        if ( frame >= MatchStateFrames[state] )
+        {
+            frame = 0;
+            ++index;
+            state = ( state + 1 ) % ( sizeof ( MatchStateFrames ) / sizeof ( MatchStateFrames[0] ) );
+
+            // Loading erases all but the current index, unless spectators need older inputs
+            if ( eraseOldIndices && state == 1 )
+            {
+                inputs[0].eraseIndexOlderThan ( index );
+                inputs[1].eraseIndexOlderThan ( index );
+                index = 0;
+            }
+        }
+
+        // Held inputs, changing every few frames
+        if ( rng() % 8 == 0 )
+            localInput = rng() % 0x10000;
+
+        inputs[0].set ( index, frame + 2, localInput );
+
+        // Remote inputs arrive a few frames late, and overlap the previously received inputs
+        if ( rng() % 8 == 0 )
+            remoteInputs[NUM_INPUTS - 1] = rng() % 0x10000;
+
+        rotate ( remoteInputs.begin(), remoteInputs.begin() + 1, remoteInputs.end() );
+        remoteInputs[NUM_INPUTS - 1] = remoteInputs[NUM_INPUTS - 2];
+
+        if ( frame >= NUM_INPUTS )
+            inputs[1].set ( index, frame - NUM_INPUTS, &remoteInputs[0], NUM_INPUTS, index );
+        else
+            inputs[1].set ( index, frame, remoteInputs[0] );
+
+        checksum = 31 * checksum + inputs[0].get ( index, frame );
+        checksum = 31 * checksum + inputs[1].get ( index, frame );
+
+        // Spectators get both inputs for the frames both players have confirmed
+        const uint32_t endFrame = min ( inputs[0].getEndFrame ( index ), inputs[1].getEndFrame ( index ) );
+
+        if ( endFrame >= NUM_INPUTS )
+        {
+            array<uint16_t, NUM_INPUTS> both[2];
+
+            inputs[0].get ( index, endFrame - NUM_INPUTS, &both[0][0], NUM_INPUTS );
+            inputs[1].get ( index, endFrame - NUM_INPUTS, &both[1][0], NUM_INPUTS );
+
+            checksum = 31 * checksum + both[0][i % NUM_INPUTS] + both[1][( i + 1 ) % NUM_INPUTS];
+        }
+
+        ++frame;
+    }
+
+    return checksum;
+}
+
+
+TEST ( InputsContainer, RandomOperations )
+{
+    mt19937 rng ( 1234 );
+
+    InputsContainer<uint16_t> actual;
+    VectorInputsContainer<uint16_t> expected;
+
+    vector<uint16_t> buffer ( 3 * INPUTS_PAGE_SIZE );
+
+    for ( size_t i = 0; i < 100000; ++i )
+    {
+        const uint32_t index = rng() % 8;
+        const uint32_t frame = rng() % ( 2 * INPUTS_PAGE_SIZE );
+        const size_t n = ( rng() % 4 ? 1 + rng() % NUM_INPUTS : rng() % ( 2 * INPUTS_PAGE_SIZE ) );
+        const uint16_t input = rng() % 16;
+
+        for ( size_t j = 0; j < n; ++j )
+            buffer[j] = rng() % 16;
+
+        switch ( rng() % 16 )
+        {
+            case 0:
+            case 1:
+            case 2:
+                actual.set ( index, frame, input );
+                expected.set ( index, frame, input );
+                break;
+
+            case 3:
+                actual.assign ( index, frame, input );
+                expected.assign ( index, frame, input );
+                break;
+
+            case 4:
+                actual.set ( index, frame, input, n );
+                expected.set ( index, frame, input, n );
+                break;
+
+            case 5:
+            case 6:
+            case 7:
+                actual.set ( index, frame, &buffer[0], n, index / 2 );
+                expected.set ( index, frame, &buffer[0], n, index / 2 );
+                break;
+
+            case 8:
+                actual.resize ( index, frame, n % 2 );
+                expected.resize ( index, frame, n % 2 );
+                break;
+
+            case 9:
+                if ( rng() % 64 == 0 )
+                {
+                    const size_t erase = rng() % 4;
+                    actual.eraseIndexOlderThan ( erase );
+                    expected.eraseIndexOlderThan ( erase );
+                }
+                break;
+
+            case 10:
+                actual.clearLastChangedFrame();
+                expected.clearLastChangedFrame();
+                break;
+
+            default:
+                if ( ! expected.empty ( index ) )
+                {
+                    const uint32_t start = rng() % expected.getEndFrame ( index );
+                    const size_t count = rng() % ( expected.getEndFrame ( index ) - start + 1 );
+
+                    vector<uint16_t> a ( count ), b ( count );
+
+                    if ( count )
+                    {
+                        actual.get ( index, start, &a[0], count );
+                        expected.get ( index, start, &b[0], count );
+                    }
+
+                    ASSERT_EQ ( b, a );
+                }
+                break;
+        }
+
+        ASSERT_EQ ( expected.empty(), actual.empty() );
+        ASSERT_EQ ( expected.getEndIndex(), actual.getEndIndex() );
+        ASSERT_EQ ( expected.getEndFrame(), actual.getEndFrame() );
+        ASSERT_EQ ( expected.getLastChangedFrame().value, actual.getLastChangedFrame().value );
+
+        for ( uint32_t j = 0; j < 9; ++j )
+        {
+            ASSERT_EQ ( expected.empty ( j ), actual.empty ( j ) );
+            ASSERT_EQ ( expected.getEndFrame ( j ), actual.getEndFrame ( j ) );
+            ASSERT_EQ ( expected.get ( j, frame ), actual.get ( j, frame ) );
+        }
+    }
+}
+
+TEST ( InputsContainer, MemoryCap )
+{
+    InputsContainer<uint16_t> inputs;
+
+    const size_t pageBytes = INPUTS_PAGE_SIZE * sizeof ( uint16_t );
+
+    inputs.setMemoryCap ( 4 * pageBytes );
+
+    for ( uint32_t i = 0; i < 8; ++i )
+        inputs.set ( i, 0, ( uint16_t ) ( i + 1 ), 2 * INPUTS_PAGE_SIZE );
+
+    EXPECT_LE ( inputs.getMemoryUsage(), inputs.getMemoryCap() );
+    EXPECT_EQ ( 8, inputs.getEndIndex() );
+
+    // The oldest indices are discarded, but the indices don't shift
+    EXPECT_TRUE ( inputs.empty ( 0 ) );
+    EXPECT_FALSE ( inputs.empty ( 7 ) );
+    EXPECT_EQ ( 2 * INPUTS_PAGE_SIZE, inputs.getEndFrame ( 7 ) );
+    EXPECT_EQ ( 8, inputs.get ( 7, 0 ) );
+
+    // A single index can exceed the cap, since its inputs are always needed
+    inputs.set ( 8, 0, 9, 8 * INPUTS_PAGE_SIZE );
+
+    EXPECT_EQ ( 8 * INPUTS_PAGE_SIZE, inputs.getEndFrame ( 8 ) );
+    EXPECT_EQ ( 8 * pageBytes, inputs.getMemoryUsage() );
+
+    // Without a cap nothing is discarded
+    inputs.setMemoryCap ( 0 );
+    inputs.eraseIndexOlderThan ( 7 );
+    inputs.set ( 2, 0, 10, 8 * INPUTS_PAGE_SIZE );
+
+    EXPECT_EQ ( 3, inputs.getEndIndex() );
+    EXPECT_EQ ( 16 * pageBytes, inputs.getMemoryUsage() );
+    EXPECT_EQ ( 9, inputs.get ( 1, 0 ) );
+    EXPECT_EQ ( 10, inputs.get ( 2, 0 ) );
+
+    inputs.clear();
+
+    EXPECT_EQ ( 0, inputs.getMemoryUsage() );
+}
+
+TEST ( InputsContainer, PreserveStartIndex )
+{
+    InputsContainer<uint16_t> inputs;
+
+    const size_t pageBytes = INPUTS_PAGE_SIZE * sizeof ( uint16_t );
+
+    inputs.setMemoryCap ( 4 * pageBytes );
+    inputs.setPreserveStartIndex ( 2 );
+
+    for ( uint32_t i = 0; i < 8; ++i )
+        inputs.set ( i, 0, ( uint16_t ) ( i + 1 ), 2 * INPUTS_PAGE_SIZE );
+
+    // Only the indices before the preserve start index are discarded, so the cap is exceeded instead
+    EXPECT_TRUE ( inputs.empty ( 0 ) );
+    EXPECT_TRUE ( inputs.empty ( 1 ) );
+    EXPECT_EQ ( 12 * pageBytes, inputs.getMemoryUsage() );
+
+    for ( uint32_t i = 2; i < 8; ++i )
+    {
+        EXPECT_EQ ( 2 * INPUTS_PAGE_SIZE, inputs.getEndFrame ( i ) );
+        EXPECT_EQ ( i + 1, inputs.get ( i, 0 ) );
+    }
+
+    // Empty indices read the last input of the closest earlier index
+    EXPECT_EQ ( 0, inputs.get ( 1, 0 ) );
+    inputs.set ( 10, 0, 11 );
+    EXPECT_EQ ( 8, inputs.get ( 9, 0 ) );
+    inputs.set ( 7, 2 * INPUTS_PAGE_SIZE - 1, 12, 1 );
+    EXPECT_EQ ( 12, inputs.get ( 9, 0 ) );
+    EXPECT_EQ ( 11, inputs.get ( 20, 0 ) );
+
+    // Once the preserve start index moves forward, the older indices can be discarded again
+    inputs.setPreserveStartIndex ( UINT_MAX );
+    inputs.set ( 11, 0, 13, INPUTS_PAGE_SIZE );
+
+    EXPECT_LE ( inputs.getMemoryUsage(), inputs.getMemoryCap() );
+    EXPECT_TRUE ( inputs.empty ( 2 ) );
+    EXPECT_EQ ( 13, inputs.get ( 11, 0 ) );
+}
+
+TEST ( InputsContainer, ValidRange )
+{
+    InputsContainer<uint16_t> inputs;
+
+    inputs.set ( 0, 0, 1, 100 );
+    inputs.set ( 1, 0, 2, 10 );
+
+    // Inputs just after the known inputs, or overlapping them
+    EXPECT_TRUE ( inputs.isValidRange ( 0, 0, NUM_INPUTS ) );
+    EXPECT_TRUE ( inputs.isValidRange ( 1, 10, NUM_INPUTS ) );
+    EXPECT_TRUE ( inputs.isValidRange ( 1, 10 + INPUTS_MAX_FRAME_GAP, NUM_INPUTS ) );
+    EXPECT_TRUE ( inputs.isValidRange ( 2, 0, NUM_INPUTS ) );
+    EXPECT_TRUE ( inputs.isValidRange ( 1 + INPUTS_MAX_INDEX_GAP, 0, NUM_INPUTS ) );
+
+    // Skipping too far past the known frames or indices
+    EXPECT_FALSE ( inputs.isValidRange ( 1, 11 + INPUTS_MAX_FRAME_GAP, NUM_INPUTS ) );
+    EXPECT_FALSE ( inputs.isValidRange ( 2, 1 + INPUTS_MAX_FRAME_GAP, NUM_INPUTS ) );
+    EXPECT_FALSE ( inputs.isValidRange ( 2 + INPUTS_MAX_INDEX_GAP, 0, NUM_INPUTS ) );
+    EXPECT_FALSE ( inputs.isValidRange ( UINT_MAX, 0, NUM_INPUTS ) );
+    EXPECT_FALSE ( inputs.isValidRange ( 0, UINT_MAX, NUM_INPUTS ) );
+    EXPECT_FALSE ( inputs.isValidRange ( 0, 0, INPUTS_MAX_FRAME_GAP + 1 ) );
+}
+
+TEST ( InputsContainer, SessionBenchmark )
+{
+    // Two hours at 60 FPS
+    const uint32_t numFrames = 2 * 60 * 60 * 60;
+
+    TimerManager::get().initialize();
+
+    for ( bool eraseOldIndices : { true, false } )
+    {
+        uint64_t start, vectorTime, pagedTime, vectorChecksum, pagedChecksum;
+
+        {
+            VectorInputsContainer<uint16_t> inputs[2];
+
+            start = TimerManager::get().getNow ( true );
+            vectorChecksum = replaySession ( inputs, numFrames, eraseOldIndices );
+            vectorTime = TimerManager::get().getNow ( true ) - start;
+        }
+
+        InputsContainer<uint16_t> inputs[2];
+
+        start = TimerManager::get().getNow ( true );
+        pagedChecksum = replaySession ( inputs, numFrames, eraseOldIndices );
+        pagedTime = TimerManager::get().getNow ( true ) - start;
+
+        LOG ( "eraseOldIndices=%u; vector=%llu ms; paged=%llu ms; memoryUsage=%u",
+              eraseOldIndices, vectorTime, pagedTime, inputs[0].getMemoryUsage() + inputs[1].getMemoryUsage() );
+
+        EXPECT_EQ ( vectorChecksum, pagedChecksum );
+
+        // When old indices are erased, the pages of a single match are recycled for the whole session
+        if ( eraseOldIndices )
+        {
+            const size_t preallocatedBytes = INPUTS_PREALLOCATED_PAGES * INPUTS_PAGE_SIZE * sizeof ( uint16_t );
+
+            EXPECT_LE ( inputs[0].getMemoryUsage(), preallocatedBytes );
+        }
+    }
+
+    TimerManager::get().deinitialize();
+}
+
+#endif // NOT RELEASE
@@ -0,0 +1,183 @@
+#ifndef RELEASE
+
+#include "Test.MemDump.hpp"
+#include "LaneHash.hpp"
+#include "Compression.hpp"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+
+using namespace std;
+
+
+// Number of hashes in the benchmark
+#define BENCHMARK_HASHES ( 100 )
+
+// Size of the dump if res/rollback.bin can't be loaded
+#define DEFAULT_DUMP_SIZE ( 1200 * 1024 )
+
+// Time budget per frame in the benchmark, in microseconds
+#define BENCHMARK_BUDGET ( 50 )
+
+
+// Hash the dump of two copies of the same memory, with the pointers pointing to different addresses
+static void hashBoth ( RandomMemory& a, RandomMemory& b, uint64_t budget, uint64_t& hashA, uint64_t& hashB )
+{
+    LaneHash laneHashA, laneHashB;
+    laneHashA.compile ( a.list );
+    laneHashB.compile ( b.list );
+
+    const string dumpA = a.dump(), dumpB = b.dump();
+
+    ASSERT_NE ( dumpA, dumpB );
+
+    memcpy ( laneHashA.getDump(), &dumpA[0], dumpA.size() );
+    memcpy ( laneHashB.getDump(), &dumpB[0], dumpB.size() );
+
+    laneHashA.start();
+    laneHashB.start();
+
+    while ( ! laneHashA.update ( budget ) )
+        ASSERT_TRUE ( laneHashA.isHashing() );
+
+    while ( ! laneHashB.update ( budget ) )
+        ASSERT_TRUE ( laneHashB.isHashing() );
+
+    EXPECT_EQ ( dumpA.size(), laneHashA.getPosition() );
+    EXPECT_FALSE ( laneHashA.isHashing() );
+
+    hashA = laneHashA.getHash();
+    hashB = laneHashB.getHash();
+}
+
+
+TEST ( LaneHash, Lengths )
+{
+    mt19937 rng ( 1234 );
+    string bytes ( 4 * 1024 + 100, 0 );
+
+    for ( char& c : bytes )
+        c = rng() % 256;
+
+    // Every length hashes differently, including lengths that only differ by trailing zeroes
+    vector<uint64_t> hashes;
+
+    for ( size_t len = 0; len <= bytes.size(); ++len )
+        hashes.push_back ( LaneHash::hash ( &bytes[0], len ) );
+
+    string zeroes ( 256, 0 );
+
+    for ( size_t len = 1; len <= zeroes.size(); ++len )
+        hashes.push_back ( LaneHash::hash ( &zeroes[0], len ) );
+
+    sort ( hashes.begin(), hashes.end() );
+
+    EXPECT_TRUE ( adjacent_find ( hashes.begin(), hashes.end() ) == hashes.end() );
+
+    // Flipping any single bit changes the hash
+    const uint64_t hash = LaneHash::hash ( &bytes[0], bytes.size() );
+
+    for ( size_t i = 0; i < bytes.size() * 8; i += 7 )
+    {
+        bytes[i / 8] ^= ( 1 << ( i % 8 ) );
+        EXPECT_NE ( hash, LaneHash::hash ( &bytes[0], bytes.size() ) ) << "bit=" << i;
+        bytes[i / 8] ^= ( 1 << ( i % 8 ) );
+    }
+}
+
+TEST ( LaneHash, Incremental )
+{
+    for ( uint32_t seed = 0; seed < 10; ++seed )
+    {
+        RandomMemory a ( seed, 500 ), b ( seed, 500 );
+        a.step();
+        b.step();
+
+        // Zero budget hashes one chunk per update, and the result is the same as hashing all at once
+        uint64_t incrementalA = 0, incrementalB = 0, onceA = 0, onceB = 0;
+
+        hashBoth ( a, b, 0, incrementalA, incrementalB );
+        hashBoth ( a, b, ULLONG_MAX, onceA, onceB );
+
+        EXPECT_EQ ( incrementalA, onceA ) << "seed=" << seed;
+
+        // Pointers aren't hashed
+        EXPECT_EQ ( incrementalA, incrementalB ) << "seed=" << seed;
+        EXPECT_EQ ( onceA, onceB ) << "seed=" << seed;
+
+        // Any other change is
+        b.step();
+
+        hashBoth ( a, b, 0, incrementalA, incrementalB );
+
+        EXPECT_NE ( incrementalA, incrementalB ) << "seed=" << seed;
+    }
+}
+
+TEST ( LaneHash, Benchmark )
+{
+    RollbackLayout layout;
+    const size_t dumpSize = ( layout.load ( "res/rollback.bin" ) ? layout.list.totalSize : DEFAULT_DUMP_SIZE );
+
+    mt19937 rng ( 1234 );
+    string dump ( dumpSize, 0 );
+
+    for ( char& c : dump )
+        c = rng() % 256;
+
+    // Compare with the hashes already used for detecting desyncs
+    uint64_t laneMicroseconds = 0, xxh64Microseconds = 0, md5Microseconds = 0, sum = 0;
+
+    for ( uint32_t i = 0; i < BENCHMARK_HASHES; ++i )
+    {
+        dump[i] = i;
+
+        auto start = chrono::steady_clock::now();
+        sum += LaneHash::hash ( &dump[0], dumpSize );
+        laneMicroseconds += chrono::duration_cast<chrono::microseconds> ( chrono::steady_clock::now() - start ).count();
+
+        start = chrono::steady_clock::now();
+        sum += getXXH64 ( &dump[0], dumpSize );
+        xxh64Microseconds += chrono::duration_cast<chrono::microseconds> ( chrono::steady_clock::now() - start ).count();
+
+        char md5[16];
+        start = chrono::steady_clock::now();
+        getMD5 ( &dump[0], dumpSize, md5 );
+        md5Microseconds += chrono::duration_cast<chrono::microseconds> ( chrono::steady_clock::now() - start ).count();
+
+        sum += md5[0];
+    }
+
+    const double bytes = double ( dumpSize ) * BENCHMARK_HASHES;
+
+    // Bytes per microsecond is MB/s
+    LOG ( "dumpSize=%u; lane=%.1f MB/s; xxh64=%.1f MB/s; md5=%.1f MB/s; lane=%llu us/hash; sum=%llu",
+          dumpSize, bytes / max ( laneMicroseconds, ( uint64_t ) 1 ), bytes / max ( xxh64Microseconds, ( uint64_t ) 1 ),
+          bytes / max ( md5Microseconds, ( uint64_t ) 1 ), laneMicroseconds / BENCHMARK_HASHES, sum );
+
+    // Number of frames each hash takes within the budget
+    LaneHash laneHash;
+    laneHash.compile ( layout.list );
+
+    if ( laneHash.empty() )
+        return;
+
+    uint32_t frames = 0;
+
+    for ( uint32_t i = 0; i < BENCHMARK_HASHES; ++i )
+    {
+        memcpy ( laneHash.getDump(), &dump[0], dumpSize );
+        laneHash.start();
+
+        do
+        {
+            ++frames;
+        }
+        while ( ! laneHash.update ( BENCHMARK_BUDGET ) );
+    }
+
+    LOG ( "budget=%u us; %.2f frames/hash", BENCHMARK_BUDGET, double ( frames ) / BENCHMARK_HASHES );
+}
+
+#endif // NOT RELEASE
@@ -0,0 +1,291 @@
+#ifndef RELEASE
+
+#include "Logger.hpp"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <fstream>
+#include <algorithm>
+#include <cstdio>
+
+using namespace std;
+
+
+// Number of messages logged by each thread
+#define NUM_MESSAGES ( 20000 )
+
+#define NUM_THREADS ( 4 )
+
+// Number of messages in the benchmark
+#define BENCHMARK_MESSAGES ( 100000 )
+
+// Number of frames in the frame time benchmark
+#define BENCHMARK_FRAMES ( 10000 )
+
+// Number of netcode messages logged each frame in the frame time benchmark
+#define FRAME_MESSAGES ( 32 )
+
+#define LOG_FILE "test_logger.log"
+
+
+struct LoggingThread : public Thread
+{
+    Logger& logger;
+
+    uint32_t id = 0;
+
+    LoggingThread ( Logger& logger, uint32_t id ) : logger ( logger ), id ( id ) {}
+
+    void run() override
+    {
+        for ( uint32_t i = 0; i < NUM_MESSAGES; ++i )
+        {
+            LOG_TO ( logger, "thread=%u; i=%u", id, i );
+
+            // Too long for the ring buffer, so this is written synchronously
+            if ( i == NUM_MESSAGES / 2 )
+                LOG_TO ( logger, "thread=%u; long=%s", id, string ( LOG_ASYNC_RING_SIZE / 2, 'x' ) );
+        }
+    }
+};
+
+
+TEST ( Logger, Async )
+{
+    Logger logger;
+    logger.initialize ( LOG_FILE, LOG_ASYNC );
+
+    LOG_TO ( logger, "first" );
+
+    vector<shared_ptr<LoggingThread>> threads;
+
+    for ( uint32_t id = 0; id < NUM_THREADS; ++id )
+        threads.push_back ( make_shared<LoggingThread> ( logger, id ) );
+
+    for ( auto& thread : threads )
+        thread->start();
+
+    for ( auto& thread : threads )
+        thread->join();
+
+    LOG_TO ( logger, "last" );
+
+    const size_t stalls = logger.getNumStalls();
+
+    logger.deinitialize();
+
+    ifstream fin ( LOG_FILE );
+
+    vector<uint32_t> next ( NUM_THREADS, 0 );
+    vector<bool> longs ( NUM_THREADS, false );
+
+    string line;
+    size_t numLines = 0;
+
+    for ( ; getline ( fin, line ); ++numLines )
+    {
+        if ( numLines == 0 )
+        {
+            EXPECT_EQ ( "first", line );
+            continue;
+        }
+
+        uint32_t id, i;
+
+        if ( sscanf ( line.c_str(), "thread=%u; i=%u", &id, &i ) == 2 )
+        {
+            ASSERT_LT ( id, NUM_THREADS );
+
+            // The messages from each thread are in order
+            ASSERT_EQ ( next[id], i ) << line;
+            ++next[id];
+            continue;
+        }
+
+        if ( sscanf ( line.c_str(), "thread=%u; long=", &id ) == 1 )
+        {
+            ASSERT_LT ( id, NUM_THREADS );
+            EXPECT_EQ ( NUM_MESSAGES / 2 + 1, next[id] );
+            longs[id] = true;
+            continue;
+        }
+
+        EXPECT_EQ ( "last", line );
+    }
+
+    fin.close();
+
+    for ( uint32_t id = 0; id < NUM_THREADS; ++id )
+    {
+        EXPECT_EQ ( NUM_MESSAGES, next[id] );
+        EXPECT_TRUE ( longs[id] );
+    }
+
+    EXPECT_EQ ( 2 + NUM_THREADS * ( NUM_MESSAGES + 1 ), numLines );
+
+    LOG ( "stalls=%u", stalls );
+
+    remove ( LOG_FILE );
+}
+
+TEST ( Logger, Benchmark )
+{
+    for ( uint32_t options : { LOG_DEFAULT_OPTIONS, LOG_DEFAULT_OPTIONS | LOG_ASYNC } )
+    {
+        Logger logger;
+        logger.initialize ( LOG_FILE, options );
+
+        vector<uint64_t> latencies ( BENCHMARK_MESSAGES );
+
+        for ( uint32_t i = 0; i < BENCHMARK_MESSAGES; ++i )
+        {
+            const auto start = chrono::steady_clock::now();
+
+            LOG_TO ( logger, "i=%u; frame=%u; inputs=[ 0x%04x, 0x%04x ]", i, i % 60, i * 7 % 0x1000, i * 13 % 0x1000 );
+
+            latencies[i] = chrono::duration_cast<chrono::nanoseconds> ( chrono::steady_clock::now() - start ).count();
+        }
+
+        const size_t stalls = logger.getNumStalls();
+
+        logger.deinitialize();
+
+        uint64_t total = 0;
+
+        for ( uint64_t latency : latencies )
+            total += latency;
+
+        sort ( latencies.begin(), latencies.end() );
+
+        // Latency of each call on the logging thread
+        LOG ( "%s: mean=%.3f us; p99=%.3f us; max=%.3f us; stalls=%u", ( options & LOG_ASYNC ) ? "async" : "sync",
+              total / 1000.0 / BENCHMARK_MESSAGES, latencies [ BENCHMARK_MESSAGES * 99 / 100 ] / 1000.0,
+              latencies.back() / 1000.0, stalls );
+    }
+
+    remove ( LOG_FILE );
+}
+
+TEST ( Logger, Levels )
+{
+    Logger logger;
+    logger.initialize ( LOG_FILE, 0 );
+
+    // Trace and debug are off by default
+    EXPECT_FALSE ( Logger::isEnabled ( LOG_LEVEL_TRACE, LOG_MODULE_SOCKET ) );
+    EXPECT_FALSE ( Logger::isEnabled ( LOG_LEVEL_DEBUG, LOG_MODULE_GO_BACK_N ) );
+    EXPECT_TRUE ( Logger::isEnabled ( LOG_LEVEL_INFO, LOG_MODULE_NETPLAY ) );
+
+    EXPECT_TRUE ( Logger::setLevels ( "socket=trace, GoBackN=debug" ) );
+
+    EXPECT_TRUE ( Logger::isEnabled ( LOG_LEVEL_TRACE, LOG_MODULE_SOCKET ) );
+    EXPECT_FALSE ( Logger::isEnabled ( LOG_LEVEL_TRACE, LOG_MODULE_GO_BACK_N ) );
+    EXPECT_TRUE ( Logger::isEnabled ( LOG_LEVEL_DEBUG, LOG_MODULE_GO_BACK_N ) );
+    EXPECT_FALSE ( Logger::isEnabled ( LOG_LEVEL_DEBUG, LOG_MODULE_TIMER ) );
+
+    // Invalid entries are skipped
+    EXPECT_FALSE ( Logger::setLevels ( "timer=warn,socket=loud,nothing=trace,netplay" ) );
+
+    EXPECT_FALSE ( Logger::isEnabled ( LOG_LEVEL_INFO, LOG_MODULE_TIMER ) );
+    EXPECT_TRUE ( Logger::isEnabled ( LOG_LEVEL_WARN, LOG_MODULE_TIMER ) );
+    EXPECT_TRUE ( Logger::isEnabled ( LOG_LEVEL_TRACE, LOG_MODULE_SOCKET ) );
+
+    // The arguments are only evaluated and formatted if the message is logged
+    uint32_t evaluated = 0;
+
+    LOG_TO_AT ( logger, LOG_LEVEL_TRACE, LOG_MODULE_TIMER, "timer=%u", ++evaluated );
+    LOG_TO_AT ( logger, LOG_LEVEL_WARN, LOG_MODULE_TIMER, "timer=%u", ++evaluated );
+    LOG_TO_AT ( logger, LOG_LEVEL_TRACE, LOG_MODULE_SOCKET, "socket=%u", ++evaluated );
+    LOG_TO_AT ( logger, LOG_LEVEL_DEBUG, LOG_MODULE_NETPLAY, "netplay=%u", ++evaluated );
+
+    EXPECT_EQ ( 2, evaluated );
+
+    Logger::setLevel ( LOG_MODULE_ALL, LOG_DEFAULT_LEVEL );
+
+    EXPECT_FALSE ( Logger::isEnabled ( LOG_LEVEL_TRACE, LOG_MODULE_SOCKET ) );
+    EXPECT_TRUE ( Logger::isEnabled ( LOG_LEVEL_INFO, LOG_MODULE_TIMER ) );
+
+    logger.deinitialize();
+
+    ifstream fin ( LOG_FILE );
+
+    vector<string> lines;
+    string line;
+
+    while ( getline ( fin, line ) )
+        lines.push_back ( line );
+
+    fin.close();
+
+    EXPECT_EQ ( ( vector<string> { "timer=1", "socket=2" } ), lines );
+
+    remove ( LOG_FILE );
+}
+
+TEST ( Logger, FrameTime )
+{
+    // Each frame logs the messages of the netcode paths, like the inputs check, socket reads, and timers
+    auto frame = [] ( Logger& logger, uint32_t i, bool leveled )
+    {
+        for ( uint32_t j = 0; j < FRAME_MESSAGES; ++j )
+        {
+            if ( leveled )
+                LOG_TO_AT ( logger, LOG_LEVEL_TRACE, LOG_MODULE_NETPLAY, "[%u:%u] remoteFrame=%u < localFrame=%u",
+                            i / 1000, i % 1000, i - 1, i );
+            else
+                LOG_TO ( logger, "[%u:%u] remoteFrame=%u < localFrame=%u", i / 1000, i % 1000, i - 1, i );
+        }
+    };
+
+    // Unleveled is how these were logged before, disabled is the default for trace messages
+    const vector<pair<const char *, int>> modes =
+    {
+        { "none", -1 },
+        { "disabled", LOG_LEVEL_INFO },
+        { "enabled", LOG_LEVEL_TRACE },
+        { "unleveled", -1 },
+    };
+
+    for ( const auto& mode : modes )
+    {
+        Logger logger;
+        logger.initialize ( LOG_FILE );
+
+        if ( mode.second >= 0 )
+            Logger::setLevel ( LOG_MODULE_NETPLAY, mode.second );
+
+        const bool none = ( string ( mode.first ) == "none" );
+
+        vector<uint64_t> frameTimes ( BENCHMARK_FRAMES );
+
+        for ( uint32_t i = 0; i < BENCHMARK_FRAMES; ++i )
+        {
+            const auto start = chrono::steady_clock::now();
+
+            if ( ! none )
+                frame ( logger, i, mode.second >= 0 );
+
+            frameTimes[i] = chrono::duration_cast<chrono::nanoseconds> ( chrono::steady_clock::now() - start ).count();
+        }
+
+        logger.deinitialize();
+
+        Logger::setLevel ( LOG_MODULE_ALL, LOG_DEFAULT_LEVEL );
+
+        uint64_t total = 0;
+
+        for ( uint64_t frameTime : frameTimes )
+            total += frameTime;
+
+        sort ( frameTimes.begin(), frameTimes.end() );
+
+        // Time spent logging per frame, out of the 16.7 ms frame budget
+        LOG ( "%s: mean=%.3f us; p99=%.3f us; max=%.3f us", mode.first, total / 1000.0 / BENCHMARK_FRAMES,
+              frameTimes [ BENCHMARK_FRAMES * 99 / 100 ] / 1000.0, frameTimes.back() / 1000.0 );
+    }
+
+    remove ( LOG_FILE );
+}
+
+#endif // NOT RELEASE
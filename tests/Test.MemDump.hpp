@@ -0,0 +1,282 @@
+#pragma once
+
+#ifndef RELEASE
+
+#include "MemDump.hpp"
+
+#include <vector>
+#include <string>
+#include <random>
+#include <fstream>
+#include <cstring>
+#include <climits>
+
+
+// Synthetic memory with randomized regions and pointer graphs, for comparing different ways of saving a MemDumpList
+class RandomMemory
+{
+public:
+
+    MemDumpList list;
+
+    RandomMemory ( uint32_t seed, size_t numRegions ) : _rng ( seed )
+    {
+        // Reserve up front so the addresses don't move
+        _fixed.reserve ( 16 * 1024 * 1024 );
+        _heap.reserve ( 16 * 1024 * 1024 );
+
+        for ( size_t i = 0; i < numRegions; ++i )
+        {
+            // Gaps between regions, sometimes none so regions get merged
+            _fixed.resize ( _fixed.size() + ( _rng() % 2 ? 0 : 1 + _rng() % 64 ) );
+
+            const size_t numPtrs = ( _rng() % 4 == 0 ? 1 + _rng() % 4 : 0 );
+            const size_t size = std::max ( numPtrs * sizeof ( char * ), randomSize() );
+
+            char *addr = allocate ( _fixed, size );
+
+            list.append ( { addr, size, randomPtrs ( { addr }, numPtrs, 0 ) } );
+        }
+
+        list.update();
+    }
+
+    // Mutate the memory, including where the pointers point
+    void step()
+    {
+        for ( size_t i = 0; i < 256; ++i )
+        {
+            std::vector<char>& mem = ( _rng() % 2 ? _fixed : _heap );
+
+            if ( ! mem.empty() )
+                mem[_rng() % mem.size()] = _rng() % 256;
+        }
+
+        // The writes may have overwritten pointers, so point them somewhere valid again
+        for ( const auto& ptr : _ptrs )
+        {
+            const std::vector<char *>& targets = _targets[ptr.second];
+            * ( char ** ) ptr.first = ( _rng() % 8 == 0 ? 0 : targets[_rng() % targets.size()] );
+        }
+    }
+
+    // Flatten the memory with MemDumpBase::saveDump
+    std::string dump() const
+    {
+        std::string bytes ( list.totalSize, 0 );
+        char *dump = &bytes[0];
+
+        for ( const MemDump& mem : list.addrs )
+            mem.saveDump ( dump );
+
+        return bytes;
+    }
+
+private:
+
+    std::mt19937 _rng;
+
+    std::vector<char> _fixed, _heap;
+
+    // Location of each pointer, and the index of its possible targets
+    std::vector<std::pair<char *, size_t>> _ptrs;
+
+    // Possible targets for each pointer, all with the same layout
+    std::vector<std::vector<char *>> _targets;
+
+    size_t randomSize()
+    {
+        switch ( _rng() % 8 )
+        {
+            case 0:
+                return 1 + _rng() % ( 64 * 1024 );
+
+            case 1:
+                return 1 + _rng() % 256;
+
+            default:
+                return ( 1 << ( _rng() % 4 ) );
+        }
+    }
+
+    char *allocate ( std::vector<char>& mem, size_t size )
+    {
+        const size_t offset = mem.size();
+
+        ASSERT ( offset + size <= mem.capacity() );
+
+        mem.resize ( offset + size );
+
+        for ( size_t i = offset; i < mem.size(); ++i )
+            mem[i] = _rng() % 256;
+
+        return &mem[offset];
+    }
+
+    // Pointers stored at the start of each of the parents, pointing to one of a few heap objects with the same layout
+    std::vector<MemDumpPtr> randomPtrs ( const std::vector<char *>& parents, size_t numPtrs, size_t depth )
+    {
+        std::vector<MemDumpPtr> ptrs;
+
+        for ( size_t i = 0; i < numPtrs; ++i )
+        {
+            const size_t srcOffset = i * sizeof ( char * );
+            const size_t numChildren = ( depth < 3 && _rng() % 2 ? 1 + _rng() % 3 : 0 );
+            const size_t dstOffset = _rng() % 64;
+            const size_t size = std::max ( numChildren * sizeof ( char * ), randomSize() % 4096 + 1 );
+
+            std::vector<char *> targets, childParents;
+
+            for ( size_t j = 0; j < 4; ++j )
+            {
+                targets.push_back ( allocate ( _heap, dstOffset + size ) );
+                childParents.push_back ( targets.back() + dstOffset );
+            }
+
+            const std::vector<MemDumpPtr> children = randomPtrs ( childParents, numChildren, depth + 1 );
+
+            _targets.push_back ( targets );
+
+            for ( char *parent : parents )
+            {
+                _ptrs.push_back ( { parent + srcOffset, _targets.size() - 1 } );
+                * ( char ** ) ( parent + srcOffset ) = targets[_rng() % targets.size()];
+            }
+
+            if ( children.empty() )
+                ptrs.push_back ( MemDumpPtr ( srcOffset, dstOffset, size ) );
+            else
+                ptrs.push_back ( MemDumpPtr ( srcOffset, dstOffset, size, children ) );
+        }
+
+        return ptrs;
+    }
+};
+
+
+// The layout of res/rollback.bin, rebased into a synthetic address space.
+// The pointers are only populated when the pointer size matches the game's 4 bytes.
+class RollbackLayout
+{
+public:
+
+    MemDumpList list;
+
+    // Load the layout, returns false if the file can't be read
+    bool load ( const std::string& filename )
+    {
+        std::ifstream fin ( filename.c_str(), std::ifstream::binary );
+
+        if ( ! fin.good() )
+            return false;
+
+        _data.assign ( std::istreambuf_iterator<char> ( fin ), std::istreambuf_iterator<char>() );
+        _pos = 0;
+
+        // Trailing MD5
+        if ( _data.size() <= 16 )
+            return false;
+
+        _data.resize ( _data.size() - 16 );
+
+        const uint32_t totalSize = read();
+        const uint32_t count = read();
+
+        std::vector<std::pair<uint32_t, uint32_t>> addrs;
+        std::vector<std::vector<MemDumpPtr>> ptrs;
+
+        for ( uint32_t i = 0; i < count; ++i )
+        {
+            const uint32_t addr = read();
+            const uint32_t size = read();
+            addrs.push_back ( { addr, size } );
+            ptrs.push_back ( readPtrs ( read() ) );
+        }
+
+        if ( _pos > _data.size() || addrs.empty() )
+            return false;
+
+        uint32_t start = UINT_MAX, end = 0;
+
+        for ( const auto& addr : addrs )
+        {
+            start = std::min ( start, addr.first );
+            end = std::max ( end, addr.first + addr.second );
+        }
+
+        _fixed.assign ( end - start, 0 );
+        _heap.reserve ( _heapSize );
+
+        for ( size_t i = 0; i < addrs.size(); ++i )
+            list.append ( { &_fixed[addrs[i].first - start], addrs[i].second, ptrs[i] } );
+
+        list.update();
+
+        if ( sizeof ( char * ) == 4 )
+        {
+            for ( const MemDump& mem : list.addrs )
+                populate ( mem );
+        }
+
+        return ( list.totalSize == totalSize );
+    }
+
+private:
+
+    std::string _data;
+
+    size_t _pos = 0;
+
+    std::vector<char> _fixed, _heap;
+
+    size_t _heapSize = 0;
+
+    uint32_t read()
+    {
+        uint32_t value = 0;
+
+        if ( _pos + 4 <= _data.size() )
+            memcpy ( &value, &_data[_pos], 4 );
+
+        _pos += 4;
+        return value;
+    }
+
+    std::vector<MemDumpPtr> readPtrs ( uint32_t count )
+    {
+        std::vector<MemDumpPtr> ptrs;
+
+        for ( uint32_t i = 0; i < count && _pos <= _data.size(); ++i )
+        {
+            const uint32_t srcOffset = read();
+            const uint32_t dstOffset = read();
+            const uint32_t size = read();
+            const uint32_t numChildren = read();
+
+            _heapSize += dstOffset + size;
+
+            if ( numChildren )
+                ptrs.push_back ( MemDumpPtr ( srcOffset, dstOffset, size, readPtrs ( numChildren ) ) );
+            else
+                ptrs.push_back ( MemDumpPtr ( srcOffset, dstOffset, size ) );
+        }
+
+        return ptrs;
+    }
+
+    // Point each pointer to its own heap object
+    void populate ( const MemDumpBase& mem )
+    {
+        for ( const MemDumpPtr& ptr : mem.ptrs )
+        {
+            const size_t offset = _heap.size();
+            _heap.resize ( offset + ptr.dstOffset + ptr.size, 1 );
+
+            * ( char ** ) ( mem.getAddr() + ptr.srcOffset ) = &_heap[offset];
+
+            populate ( ptr );
+        }
+    }
+};
+
+#endif // NOT RELEASE
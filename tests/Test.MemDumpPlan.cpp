@@ -0,0 +1,131 @@
+#ifndef RELEASE
+
+#include "Test.MemDump.hpp"
+#include "MemDumpPlan.hpp"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+
+using namespace std;
+
+
+// Number of frames to save in the benchmark
+#define BENCHMARK_FRAMES ( 1000 )
+
+// Number of states to rotate through, same as the release BENCHMARK_STATES
+#define BENCHMARK_STATES ( 60 )
+
+
+TEST ( MemDumpPlan, SameAsMemDumpList )
+{
+    for ( uint32_t seed = 0; seed < 10; ++seed )
+    {
+        RandomMemory memory ( seed, 500 );
+
+        MemDumpPlan plan;
+        plan.compile ( memory.list );
+
+        ASSERT_EQ ( memory.list.totalSize, plan.getTotalSize() );
+
+        for ( size_t i = 0; i < 10; ++i )
+        {
+            memory.step();
+
+            const string expected = memory.dump();
+
+            string actual ( plan.getTotalSize(), 0 );
+            plan.saveDump ( &actual[0] );
+
+            ASSERT_EQ ( expected, actual ) << "seed=" << seed << "; i=" << i;
+
+            // Loading restores the same memory, including the pointers
+            memory.step();
+            plan.loadDump ( &actual[0] );
+
+            ASSERT_EQ ( expected, memory.dump() ) << "seed=" << seed << "; i=" << i;
+        }
+    }
+}
+
+TEST ( MemDumpPlan, PointerBenchmark )
+{
+    // Large pointer graphs, so fewer frames
+    RandomMemory memory ( 1234, 2000 );
+    const size_t numFrames = BENCHMARK_FRAMES / 10;
+
+    MemDumpPlan plan;
+    plan.compile ( memory.list );
+
+    vector<char> dump ( plan.getTotalSize() );
+    uint64_t listTime = 0, planTime = 0;
+
+    for ( size_t i = 0; i < numFrames; ++i )
+    {
+        auto start = chrono::steady_clock::now();
+
+        char *ptr = &dump[0];
+        for ( const MemDump& mem : memory.list.addrs )
+            mem.saveDump ( ptr );
+
+        listTime += chrono::duration_cast<chrono::nanoseconds> ( chrono::steady_clock::now() - start ).count();
+
+        start = chrono::steady_clock::now();
+
+        plan.saveDump ( &dump[0] );
+
+        planTime += chrono::duration_cast<chrono::nanoseconds> ( chrono::steady_clock::now() - start ).count();
+    }
+
+    LOG ( "totalSize=%u; list: %llu us/frame; plan: %llu us/frame",
+          plan.getTotalSize(), listTime / numFrames / 1000, planTime / numFrames / 1000 );
+}
+
+TEST ( MemDumpPlan, Benchmark )
+{
+    RollbackLayout layout;
+
+    if ( ! layout.load ( "res/rollback.bin" ) )
+    {
+        LOG ( "Skipping, failed to load res/rollback.bin" );
+        return;
+    }
+
+    MemDumpPlan plan;
+    plan.compile ( layout.list );
+
+    // Rotate through as many states as rollback does, which don't fit in the cache
+    vector<char> states ( BENCHMARK_STATES * plan.getTotalSize() );
+    uint64_t listTime = 0, planTime = 0;
+
+    for ( size_t i = 0; i < BENCHMARK_FRAMES; ++i )
+    {
+        char *dump = &states[ ( i % BENCHMARK_STATES ) * plan.getTotalSize()];
+
+        auto start = chrono::steady_clock::now();
+
+        char *ptr = dump;
+        for ( const MemDump& mem : layout.list.addrs )
+            mem.saveDump ( ptr );
+
+        listTime += chrono::duration_cast<chrono::nanoseconds> ( chrono::steady_clock::now() - start ).count();
+
+        dump = &states[ ( ( i + BENCHMARK_STATES / 2 ) % BENCHMARK_STATES ) * plan.getTotalSize()];
+
+        start = chrono::steady_clock::now();
+
+        plan.saveDump ( dump );
+
+        planTime += chrono::duration_cast<chrono::nanoseconds> ( chrono::steady_clock::now() - start ).count();
+    }
+
+    // Bytes per nanosecond is GB/s
+    const double bytes = double ( plan.getTotalSize() ) * BENCHMARK_FRAMES;
+
+    LOG ( "totalSize=%u; list: %.2f GB/s, %llu us/frame; plan: %.2f GB/s, %llu us/frame",
+          plan.getTotalSize(),
+          bytes / listTime, listTime / BENCHMARK_FRAMES / 1000,
+          bytes / planTime, planTime / BENCHMARK_FRAMES / 1000 );
+}
+
+#endif // NOT RELEASE
@@ -0,0 +1,363 @@
+#ifndef RELEASE
+
+#include "Test.Socket.hpp"
+#include "Protocol.hpp"
+#include "Compression.hpp"
+#include "TimerManager.hpp"
+#include "Logger.hpp"
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <random>
+
+using namespace std;
+
+
+#define NUM_ITERATIONS ( 10000 )
+
+
+// Bytes produced by the original ostringstream based encoder for the 32-bit target, the buffered encoder must stay
+// wire compatible with older versions
+struct GoldenMessage
+{
+    size_t length;
+    uint8_t compressionLevel;
+    size_t size;
+    const char *bytes;
+};
+
+static const GoldenMessage goldenMessages[] =
+{
+    { 0, 0, 26,
+      "\x1c\x00\x00\x00\x00\x00\x00\x00\x00\x00\x7d\xea\x36\x2b\x3f\xac\x8e\x00\x95\x6a\x49\x52\xa3\xd4"
+      "\xf4\x74"
+    },
+    { 5, 0, 31,
+      "\x1c\x00\x00\x00\x00\x00\x05\x00\x00\x00\x61\x68\x62\x69\x63\x1b\xcb\xb0\x97\x53\xaf\xe3\x5b\x73"
+      "\x9c\x20\xcd\xfe\xf2\x67\x57"
+    },
+    { 50, 0, 76,
+      "\x1c\x00\x00\x00\x00\x00\x32\x00\x00\x00\x61\x68\x62\x69\x63\x6a\x64\x6b\x65\x6c\x66\x6d\x67\x61"
+      "\x68\x62\x69\x63\x6a\x64\x6b\x65\x6c\x66\x6d\x67\x61\x68\x62\x69\x63\x6a\x64\x6b\x65\x6c\x66\x6d"
+      "\x67\x61\x68\x62\x69\x63\x6a\x64\x6b\x65\x6c\x66\x08\x50\x0f\x4d\x07\x76\xc2\x60\x3b\x8f\x47\x43"
+      "\x11\xf2\xa4\x4e"
+    },
+    { 300, 9, 77,
+      "\x1c\x09\x44\x01\x00\x00\x43\x00\x00\x00\x78\x01\xed\xc7\x3b\x11\x80\x20\x00\x06\xe0\xdf\xb3\x8e"
+      "\x9b\x77\x76\x30\x80\xba\xe8\x20\xef\xe7\x4a\x39\x06\x22\xb0\xc3\x42\x14\x1a\x90\x80\xf1\x03\x80"
+      "\x6d\x01\x7e\x45\x34\x35\xcc\x72\x27\xbc\x9c\x18\xe2\xac\xeb\xfe\xbd\xed\x29\x39\xa4\xfb\x8a\x47"
+      "\x07\xf5\xd4\x80\xa0"
+    },
+    { 5000, 9, 92,
+      "\x1c\x09\xa0\x13\x00\x00\x52\x00\x00\x00\x78\x01\xed\xc7\xab\x0d\x80\x30\x00\x45\xd1\xb7\x03\x61"
+      "\x06\x1c\x93\xb0\x04\xff\xbf\x42\x23\x70\x84\x2d\xd8\xa0\xba\xbe\x8b\x74\x85\xea\x26\x9d\xa2\xee"
+      "\xca\x23\x49\x6f\x21\xb5\x4b\xb7\xf6\xdb\xb0\x8f\xc7\x74\xce\x00\x00\x00\x00\x00\x00\x00\x00\x00"
+      "\x00\x00\x80\x2c\x50\x75\x99\x26\x3c\x65\xbc\x6b\xf7\x7f\xd6\x27\x87\x9b\xe5\x08"
+    }
+};
+
+
+static string getTestString ( size_t length )
+{
+    string str;
+    for ( size_t i = 0; i < length; ++i )
+        str += ( char ) ( 'a' + ( i * 7 ) % 13 );
+    return str;
+}
+
+TEST ( Protocol, EncodeDecodeInPlace )
+{
+    MsgBuffer buffer;
+
+    for ( const GoldenMessage& golden : goldenMessages )
+    {
+        const string str = getTestString ( golden.length );
+        const string expected ( golden.bytes, golden.size );
+
+        MsgPtr msg ( new TestMessage ( str ) );
+        msg->compressionLevel = golden.compressionLevel;
+
+        EXPECT_EQ ( expected.size(), Protocol::encode ( msg, buffer ) );
+        EXPECT_EQ ( formatAsHex ( expected ), formatAsHex ( buffer.str() ) );
+
+        // The convenience encoder should produce the same bytes
+        msg->invalidate();
+        msg->compressionLevel = golden.compressionLevel;
+
+        EXPECT_EQ ( expected, Protocol::encode ( msg ) );
+
+        // Decode two back to back messages in place
+        const string bytes = expected + expected;
+
+        size_t consumed = 0;
+        MsgPtr decoded = Protocol::decode ( &bytes[0], bytes.size(), consumed, buffer );
+
+        EXPECT_TRUE ( decoded.get() );
+        EXPECT_EQ ( expected.size(), consumed );
+
+        if ( decoded.get() )
+        {
+            EXPECT_EQ ( MsgType::TestMessage, decoded->getMsgType() );
+            EXPECT_EQ ( str, decoded->getAs<TestMessage>().str );
+        }
+
+        decoded = Protocol::decode ( &bytes[consumed], bytes.size() - consumed, consumed, buffer );
+
+        EXPECT_TRUE ( decoded.get() );
+        EXPECT_EQ ( expected.size(), consumed );
+    }
+}
+
+TEST ( Protocol, EncodeDecodeThroughput )
+{
+    TimerManager::get().initialize();
+
+    MsgBuffer buffer;
+
+    for ( uint8_t i = ( uint8_t ) MsgType::FirstType + 1; i < ( uint8_t ) MsgType::LastType; ++i )
+    {
+        const MsgType type = ( MsgType ) i;
+
+        // SocketShareData can't be serialized without a real socket
+        if ( type == MsgType::SocketShareData )
+            continue;
+
+        MsgPtr msg = Protocol::create ( type );
+
+        ASSERT_TRUE ( msg.get() );
+
+        // Warm up the buffer once, after which it should never need to grow
+        msg->invalidate();
+        Protocol::encode ( msg, buffer );
+
+        size_t consumed;
+        Protocol::decode ( buffer.data(), buffer.size(), consumed, buffer );
+
+        // The buffer is reused without global allocation hooks, so check that it never grows or moves instead
+        const size_t capacity = buffer.capacity();
+        const char *data = buffer.data();
+
+        size_t encodeGrowths = 0, decodeGrowths = 0;
+
+        uint64_t start = TimerManager::get().getNow ( true );
+
+        for ( size_t j = 0; j < NUM_ITERATIONS; ++j )
+        {
+            msg->invalidate();
+            Protocol::encode ( msg, buffer );
+
+            if ( buffer.capacity() != capacity || buffer.data() != data )
+                ++encodeGrowths;
+        }
+
+        const uint64_t encodeTime = TimerManager::get().getNow ( true ) - start;
+
+        start = TimerManager::get().getNow ( true );
+
+        for ( size_t j = 0; j < NUM_ITERATIONS; ++j )
+        {
+            EXPECT_TRUE ( Protocol::decode ( buffer.data(), buffer.size(), consumed, buffer ).get() );
+
+            if ( buffer.capacity() != capacity || buffer.data() != data )
+                ++decodeGrowths;
+        }
+
+        const uint64_t decodeTime = TimerManager::get().getNow ( true ) - start;
+
+        // Encoding and decoding with a warmed up buffer must not reallocate it
+        EXPECT_EQ ( 0, encodeGrowths ) << type;
+        EXPECT_EQ ( 0, decodeGrowths ) << type;
+
+        LOG ( "%s: [ %u bytes ]; encode=%.0f msgs/s; decode=%.0f msgs/s", type, buffer.size(),
+              1000.0 * NUM_ITERATIONS / max ( encodeTime, ( uint64_t ) 1 ),
+              1000.0 * NUM_ITERATIONS / max ( decodeTime, ( uint64_t ) 1 ) );
+    }
+
+    TimerManager::get().deinitialize();
+}
+
+TEST ( Protocol, HashTypes )
+{
+    MsgBuffer buffer;
+
+    for ( uint8_t i = 0; i < ( uint8_t ) HashType::LastType; ++i )
+    {
+        buffer.hashType = ( HashType ) i;
+
+        MsgPtr msg ( new TestMessage ( "Hello hash!" ) );
+        msg->compressionLevel = 0;
+
+        const size_t size = Protocol::encode ( msg, buffer );
+
+        // Uncompressed size is the header + sequence + string length + string + hash
+        EXPECT_EQ ( 2 + 4 + 4 + 11 + getHashSize ( buffer.hashType ), size );
+
+        size_t consumed;
+        MsgPtr decoded = Protocol::decode ( buffer.data(), buffer.size(), consumed, buffer );
+
+        ASSERT_TRUE ( decoded.get() );
+        EXPECT_EQ ( size, consumed );
+        EXPECT_EQ ( "Hello hash!", decoded->getAs<TestMessage>().str );
+
+        // Decoding only accepts the negotiated hash type
+        for ( uint8_t j = 0; j < ( uint8_t ) HashType::LastType; ++j )
+        {
+            MsgBuffer other;
+            other.hashType = ( HashType ) j;
+
+            EXPECT_EQ ( i == j, ( bool ) Protocol::decode ( buffer.data(), buffer.size(), consumed, other ) );
+        }
+
+        // Re-encoding with the same hash type should produce identical bytes using the cached hash
+        const string bytes = buffer.str();
+
+        MsgBuffer other;
+        other.hashType = buffer.hashType;
+        decoded->compressionLevel = 0;
+        Protocol::encode ( decoded, other );
+
+        EXPECT_EQ ( bytes, other.str() );
+    }
+}
+
+TEST ( Protocol, CorruptedMessages )
+{
+    mt19937 rng ( 1234 );
+
+    MsgBuffer buffer;
+
+    for ( uint8_t i = 0; i < ( uint8_t ) HashType::LastType; ++i )
+    {
+        buffer.hashType = ( HashType ) i;
+
+        for ( uint8_t compressionLevel : { 0, 9 } )
+        {
+            string str;
+            for ( size_t j = 0; j < 200; ++j )
+                str += ( char ) ( 'a' + rng() % 4 );
+
+            MsgPtr msg ( new TestMessage ( str ) );
+            msg->compressionLevel = compressionLevel;
+
+            Protocol::encode ( msg, buffer );
+
+            const string original = buffer.str();
+
+            for ( size_t j = 0; j < 500; ++j )
+            {
+                string bytes = original;
+
+                // The message type byte is not covered by the hash, so start corrupting after it
+                const size_t numFlips = 1 + rng() % 3;
+                for ( size_t k = 0; k < numFlips; ++k )
+                    bytes[1 + rng() % ( bytes.size() - 1 )] ^= ( char ) ( 1 << ( rng() % 8 ) );
+
+                // Also randomly truncate
+                if ( rng() % 4 == 0 )
+                    bytes.resize ( rng() % bytes.size() );
+
+                size_t consumed;
+                MsgPtr decoded = Protocol::decode ( &bytes[0], bytes.size(), consumed, buffer );
+
+                // Only accept if the corruption didn't change the actual message
+                if ( decoded.get() )
+                {
+                    ASSERT_EQ ( MsgType::TestMessage, decoded->getMsgType() );
+                    ASSERT_EQ ( str, decoded->getAs<TestMessage>().str );
+                }
+            }
+
+            // Any change to the hash type bits must be rejected
+            for ( uint8_t j = 1; j < 4; ++j )
+            {
+                string bytes = original;
+                bytes[1] ^= ( char ) ( j << 6 );
+
+                size_t consumed;
+                EXPECT_FALSE ( Protocol::decode ( &bytes[0], bytes.size(), consumed, buffer ).get() );
+                EXPECT_EQ ( 0, consumed );
+            }
+        }
+    }
+}
+
+TEST ( Protocol, TrailingBytes )
+{
+    MsgBuffer buffer;
+
+    for ( uint8_t i = 0; i < ( uint8_t ) HashType::LastType; ++i )
+    {
+        buffer.hashType = ( HashType ) i;
+
+        MsgPtr msg ( new TestMessage ( string ( 200, 'x' ) ) );
+        msg->compressionLevel = 0;
+
+        Protocol::encode ( msg, buffer );
+
+        // Compress the message data by hand, with and without extra bytes after the hash
+        for ( const string& trailing : { string(), string ( 8, 'x' ) } )
+        {
+            const string data = buffer.str().substr ( 2 ) + trailing;
+
+            string compressed ( compressBound ( data.size() ), 0 );
+            compressed.resize ( compress ( &data[0], data.size(), &compressed[0], compressed.size() ) );
+
+            ASSERT_FALSE ( compressed.empty() );
+
+            const uint32_t uncompressedSize = data.size();
+            const uint32_t compressedSize = compressed.size();
+
+            string bytes;
+            bytes += ( char ) MsgType::TestMessage;
+            bytes += ( char ) ( 9 | ( i << 6 ) );
+            bytes.append ( ( const char * ) &uncompressedSize, sizeof ( uncompressedSize ) );
+            bytes.append ( ( const char * ) &compressedSize, sizeof ( compressedSize ) );
+            bytes += compressed;
+
+            size_t consumed;
+            MsgPtr decoded = Protocol::decode ( &bytes[0], bytes.size(), consumed, buffer );
+
+            EXPECT_EQ ( trailing.empty(), ( bool ) decoded );
+            EXPECT_EQ ( trailing.empty() ? bytes.size() : 0, consumed );
+        }
+    }
+}
+
+TEST ( Protocol, HashThroughput )
+{
+    TimerManager::get().initialize();
+
+    for ( size_t size : { 16, 64, 256, 1024, 4096, 65536 } )
+    {
+        string bytes ( size, 0 );
+        for ( size_t i = 0; i < size; ++i )
+            bytes[i] = ( char ) ( i * 31 );
+
+        const size_t iterations = max ( ( size_t ) 16 * 1024 * 1024 / size, ( size_t ) 1000 );
+
+        string result = format ( "[ %u bytes ]", size );
+
+        for ( uint8_t i = 0; i < ( uint8_t ) HashType::LastType; ++i )
+        {
+            const HashType type = ( HashType ) i;
+
+            char hash[MAX_HASH_SIZE];
+
+            const uint64_t start = TimerManager::get().getNow ( true );
+
+            for ( size_t j = 0; j < iterations; ++j )
+                getHash ( type, &bytes[0], bytes.size(), hash );
+
+            const uint64_t elapsed = max ( TimerManager::get().getNow ( true ) - start, ( uint64_t ) 1 );
+
+            result += format ( "; hashType=%u: %.1f ns/msg", i, 1000000.0 * elapsed / iterations );
+        }
+
+        LOG ( "%s", result );
+    }
+
+    TimerManager::get().deinitialize();
+}
+
+#endif // NOT RELEASE
@@ -0,0 +1,360 @@
+#ifndef RELEASE
+
+#include "Reactor.hpp"
+#include "Thread.hpp"
+#include "Logger.hpp"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <memory>
+#include <algorithm>
+#include <cstring>
+
+#ifdef _WIN32
+#include "SocketManager.hpp"
+#include <winsock2.h>
+#include <windows.h>
+#else
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#define closesocket close
+#define Sleep(MILLISECONDS) usleep ( ( MILLISECONDS ) * 1000 )
+#endif
+
+using namespace std;
+
+
+// Number of inputs in the latency benchmark
+#define BENCHMARK_INPUTS ( 200 )
+
+// Milliseconds that the old EventManager::poll kept polling for each frame, see POLL_TIMEOUT in DllMain
+#define BENCHMARK_POLL_TIMEOUT ( 3 )
+
+// Number of sockets in the stress test, more than the default FD_SETSIZE of 64 on Windows
+#define STRESS_SOCKETS ( 500 )
+
+// Number of rounds in the stress test, each sends to 1 to 4 of the sockets
+#define STRESS_ROUNDS ( 2000 )
+
+
+static uint64_t nanoseconds()
+{
+    return chrono::duration_cast<chrono::nanoseconds> ( chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+// UDP socket bound to a loopback port, for testing the reactor without the Socket classes
+struct LoopbackSocket
+{
+    int fd = 0;
+
+    uint16_t port = 0;
+
+    LoopbackSocket()
+    {
+        fd = ::socket ( AF_INET, SOCK_DGRAM, IPPROTO_UDP );
+
+        sockaddr_in addr = getAddress ( 0 );
+        ::bind ( fd, ( sockaddr * ) &addr, sizeof ( addr ) );
+
+#ifdef _WIN32
+        int len = sizeof ( addr );
+#else
+        socklen_t len = sizeof ( addr );
+#endif
+        ::getsockname ( fd, ( sockaddr * ) &addr, &len );
+        port = ntohs ( addr.sin_port );
+    }
+
+    ~LoopbackSocket()
+    {
+        closesocket ( fd );
+    }
+
+    void sendTo ( const LoopbackSocket& other, uint64_t value )
+    {
+        sockaddr_in addr = getAddress ( other.port );
+        ::sendto ( fd, ( const char * ) &value, sizeof ( value ), 0, ( sockaddr * ) &addr, sizeof ( addr ) );
+    }
+
+    uint64_t recv()
+    {
+        uint64_t value = 0;
+        ::recv ( fd, ( char * ) &value, sizeof ( value ), 0 );
+        return value;
+    }
+
+    static sockaddr_in getAddress ( uint16_t port )
+    {
+        sockaddr_in addr;
+        memset ( &addr, 0, sizeof ( addr ) );
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl ( INADDR_LOOPBACK );
+        addr.sin_port = htons ( port );
+        return addr;
+    }
+};
+
+static vector<shared_ptr<Reactor>> createReactors()
+{
+    vector<shared_ptr<Reactor>> reactors;
+
+    for ( Reactor::Backend backend : { Reactor::Select, Reactor::Poll, Reactor::Epoll } )
+    {
+        shared_ptr<Reactor> reactor ( Reactor::create ( backend ) );
+
+        if ( reactor )
+            reactors.push_back ( reactor );
+    }
+
+    return reactors;
+}
+
+
+TEST ( Reactor, Wait )
+{
+#ifdef _WIN32
+    SocketManager::get().initialize();
+#endif
+
+    for ( const shared_ptr<Reactor>& reactor : createReactors() )
+    {
+        LoopbackSocket sender, receiver;
+        reactor->add ( receiver.fd, REACTOR_READ, &receiver );
+
+        vector<Reactor::Event> events;
+
+        // Times out without any events
+        uint64_t start = nanoseconds();
+        EXPECT_EQ ( 0, reactor->wait ( 20, events ) );
+        EXPECT_GE ( nanoseconds() - start, 15 * 1000000ULL );
+
+        // Returns the ready socket
+        sender.sendTo ( receiver, 1234 );
+        ASSERT_EQ ( 1, reactor->wait ( 1000, events ) );
+        EXPECT_EQ ( &receiver, events[0].data );
+        EXPECT_EQ ( REACTOR_READ, events[0].events );
+        EXPECT_EQ ( 1234, receiver.recv() );
+
+        // Only the ready sockets are returned
+        LoopbackSocket other;
+        reactor->add ( other.fd, REACTOR_READ, &other );
+
+        events.clear();
+        sender.sendTo ( other, 5678 );
+        ASSERT_EQ ( 1, reactor->wait ( 1000, events ) );
+        EXPECT_EQ ( &other, events[0].data );
+        EXPECT_EQ ( 5678, other.recv() );
+
+        // Woken up from another thread
+        struct WakeupThread : public Thread
+        {
+            Reactor& reactor;
+
+            WakeupThread ( Reactor& reactor ) : reactor ( reactor ) {}
+
+            void run() override
+            {
+                Sleep ( 20 );
+                reactor.wakeup();
+            }
+        };
+
+        WakeupThread thread ( *reactor );
+        thread.start();
+
+        events.clear();
+        start = nanoseconds();
+        EXPECT_EQ ( 0, reactor->wait ( UINT64_MAX, events ) );
+        EXPECT_LT ( nanoseconds() - start, 1000 * 1000000ULL );
+
+        thread.join();
+
+        // A wakeup before waiting makes the next wait return
+        reactor->wakeup();
+        reactor->wakeup();
+        start = nanoseconds();
+        EXPECT_EQ ( 0, reactor->wait ( 1000, events ) );
+        EXPECT_LT ( nanoseconds() - start, 500 * 1000000ULL );
+
+        // Removed sockets aren't returned
+        reactor->remove ( receiver.fd );
+        reactor->remove ( other.fd );
+        sender.sendTo ( receiver, 1 );
+        EXPECT_EQ ( 0, reactor->wait ( 20, events ) );
+        EXPECT_TRUE ( events.empty() );
+    }
+
+#ifdef _WIN32
+    SocketManager::get().deinitialize();
+#endif
+}
+
+TEST ( Reactor, Stress )
+{
+#ifdef _WIN32
+    SocketManager::get().initialize();
+#endif
+
+    // Like a host with hundreds of spectators, where only a few sockets are ready each wait
+    for ( const shared_ptr<Reactor>& reactor : createReactors() )
+    {
+        LoopbackSocket sender;
+        vector<shared_ptr<LoopbackSocket>> sockets;
+
+        for ( uint32_t i = 0; i < STRESS_SOCKETS; ++i )
+        {
+            sockets.push_back ( make_shared<LoopbackSocket>() );
+            reactor->add ( sockets.back()->fd, REACTOR_READ, sockets.back().get() );
+        }
+
+        vector<Reactor::Event> events;
+        uint64_t waits = 0, ready = 0, total = 0;
+
+        for ( uint32_t round = 0; round < STRESS_ROUNDS; ++round )
+        {
+            vector<LoopbackSocket *> targets;
+
+            for ( uint32_t j = 0; j <= round % 4; ++j )
+            {
+                targets.push_back ( sockets [ ( round * 37 + j * 101 ) % STRESS_SOCKETS ].get() );
+                sender.sendTo ( *targets.back(), round );
+            }
+
+            size_t received = 0;
+
+            while ( received < targets.size() )
+            {
+                events.clear();
+
+                const uint64_t start = nanoseconds();
+                const size_t count = reactor->wait ( 1000, events );
+                total += nanoseconds() - start;
+
+                ++waits;
+                ready += count;
+
+                ASSERT_GT ( count, 0 );
+
+                // Only the sockets that were sent to are returned
+                for ( const Reactor::Event& event : events )
+                {
+                    LoopbackSocket *socket = ( LoopbackSocket * ) event.data;
+
+                    ASSERT_NE ( targets.end(), find ( targets.begin(), targets.end(), socket ) );
+                    EXPECT_EQ ( round, socket->recv() );
+                    ++received;
+                }
+            }
+
+            EXPECT_EQ ( targets.size(), received );
+        }
+
+        for ( const shared_ptr<LoopbackSocket>& socket : sockets )
+            reactor->remove ( socket->fd );
+
+        LOG ( "%s: %u sockets; %.3f us per wait; %.3f us per ready socket",
+              Reactor::getBackendName ( reactor->getBackend() ), STRESS_SOCKETS,
+              total / 1000.0 / waits, total / 1000.0 / ready );
+    }
+
+#ifdef _WIN32
+    SocketManager::get().deinitialize();
+#endif
+}
+
+TEST ( Reactor, Benchmark )
+{
+#ifdef _WIN32
+    SocketManager::get().initialize();
+#endif
+
+    // Sends each input with the time it was sent, at random times like a remote player
+    struct InputThread : public Thread
+    {
+        LoopbackSocket& receiver;
+
+        InputThread ( LoopbackSocket& receiver ) : receiver ( receiver ) {}
+
+        void run() override
+        {
+            LoopbackSocket sender;
+
+            for ( uint32_t i = 0; i < BENCHMARK_INPUTS; ++i )
+            {
+                Sleep ( 1 + ( i * 7 ) % 10 );
+                sender.sendTo ( receiver, nanoseconds() );
+            }
+        }
+    };
+
+    // The old poll kept polling until the timeout, the new one returns once sockets are handled
+    for ( bool untilTimeout : { true, false } )
+    {
+        shared_ptr<Reactor> reactor ( Reactor::create ( Reactor::getDefaultBackend() ) );
+
+        LoopbackSocket receiver;
+        reactor->add ( receiver.fd, REACTOR_READ, &receiver );
+
+        InputThread thread ( receiver );
+        thread.start();
+
+        vector<uint64_t> latencies;
+        vector<Reactor::Event> events;
+
+        // Frame loop like DllMain, poll until a remote input is ready, then release the frame
+        while ( latencies.size() < BENCHMARK_INPUTS )
+        {
+            // Times that the inputs released by this frame were sent
+            vector<uint64_t> sent;
+
+            while ( sent.empty() )
+            {
+                uint64_t now = nanoseconds();
+                const uint64_t end = now + BENCHMARK_POLL_TIMEOUT * 1000000ULL;
+
+                while ( now < end )
+                {
+                    events.clear();
+
+                    if ( reactor->wait ( ( end - now + 999999 ) / 1000000, events ) )
+                    {
+                        sent.push_back ( receiver.recv() );
+
+                        if ( ! untilTimeout )
+                            break;
+                    }
+
+                    now = nanoseconds();
+                }
+            }
+
+            const uint64_t released = nanoseconds();
+
+            for ( uint64_t time : sent )
+                latencies.push_back ( released - time );
+        }
+
+        thread.join();
+
+        uint64_t total = 0;
+
+        for ( uint64_t latency : latencies )
+            total += latency;
+
+        sort ( latencies.begin(), latencies.end() );
+
+        // Time from an input arriving to the frame being released
+        LOG ( "%s: mean=%.3f us; p99=%.3f us; max=%.3f us", untilTimeout ? "poll until timeout" : "poll until ready",
+              total / 1000.0 / latencies.size(), latencies [ latencies.size() * 99 / 100 ] / 1000.0,
+              latencies.back() / 1000.0 );
+    }
+
+#ifdef _WIN32
+    SocketManager::get().deinitialize();
+#endif
+}
+
+#endif // NOT RELEASE
@@ -0,0 +1,102 @@
+#ifndef RELEASE
+
+#include "ReadBufferPool.hpp"
+
+#include <gtest/gtest.h>
+
+#include <vector>
+#include <memory>
+
+using namespace std;
+
+
+TEST ( ReadBufferPool, Reuse )
+{
+    ReadBufferPool& pool = ReadBufferPool::get();
+
+    const size_t allocated = pool.getNumAllocated();
+
+    // Nested reads get different slabs
+    char *first, *second;
+    {
+        ReadBufferPool::Slab outer;
+        ReadBufferPool::Slab inner;
+
+        EXPECT_NE ( outer.data, inner.data );
+
+        first = outer.data;
+        second = inner.data;
+
+        // Every byte can be written
+        outer.data[READ_SLAB_SIZE - 1] = 1;
+        inner.data[READ_SLAB_SIZE - 1] = 2;
+    }
+
+    // Released slabs are reused, so reads don't allocate
+    for ( int i = 0; i < 100; ++i )
+    {
+        ReadBufferPool::Slab slab;
+
+        EXPECT_TRUE ( slab.data == first || slab.data == second );
+    }
+
+    EXPECT_LE ( pool.getNumAllocated(), allocated + 2 );
+
+    // Only up to READ_POOL_MAX_FREE slabs are kept after deep nesting
+    {
+        vector<shared_ptr<ReadBufferPool::Slab>> slabs;
+
+        for ( int i = 0; i < 3 * READ_POOL_MAX_FREE; ++i )
+            slabs.push_back ( make_shared<ReadBufferPool::Slab>() );
+
+        EXPECT_GE ( pool.getNumAllocated(), 3 * READ_POOL_MAX_FREE );
+    }
+
+    EXPECT_EQ ( READ_POOL_MAX_FREE, pool.getNumAllocated() );
+    EXPECT_EQ ( READ_POOL_MAX_FREE * READ_SLAB_SIZE + pool.getNumOversized() * READ_OVERSIZED_SIZE,
+                pool.getMemoryUsage() );
+}
+
+TEST ( ReadBufferPool, Oversized )
+{
+    ReadBufferPool& pool = ReadBufferPool::get();
+
+    // Datagrams that fit use normal slabs
+    {
+        ReadBufferPool::Slab slab ( READ_SLAB_SIZE );
+
+        EXPECT_EQ ( READ_SLAB_SIZE, slab.size );
+    }
+
+    // Larger datagrams use a separate oversized slab
+    char *first;
+    {
+        ReadBufferPool::Slab outer ( READ_SLAB_SIZE + 1 );
+        ReadBufferPool::Slab inner ( READ_SLAB_SIZE + 1 );
+
+        EXPECT_EQ ( READ_OVERSIZED_SIZE, outer.size );
+        EXPECT_NE ( outer.data, inner.data );
+        EXPECT_GE ( pool.getNumOversized(), 2 );
+
+        // The inner slab is released first, so it is the one that is kept
+        first = inner.data;
+
+        // Every byte can be written
+        outer.data[READ_OVERSIZED_SIZE - 1] = 1;
+        inner.data[READ_OVERSIZED_SIZE - 1] = 2;
+    }
+
+    // Only READ_POOL_MAX_OVERSIZED oversized slabs are kept
+    EXPECT_EQ ( READ_POOL_MAX_OVERSIZED, pool.getNumOversized() );
+
+    for ( int i = 0; i < 100; ++i )
+    {
+        ReadBufferPool::Slab slab ( READ_OVERSIZED_SIZE );
+
+        EXPECT_EQ ( first, slab.data );
+    }
+
+    EXPECT_EQ ( READ_POOL_MAX_OVERSIZED, pool.getNumOversized() );
+}
+
+#endif // NOT RELEASE
@@ -0,0 +1,301 @@
+#ifndef RELEASE
+
+#include "ReplayManager.hpp"
+#include "Messages.hpp"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <fstream>
+#include <random>
+#include <cstdio>
+
+using namespace std;
+
+
+// Hours of netplay in the benchmark replay
+#define BENCHMARK_HOURS ( 2 )
+
+#define TEXT_REPLAY_FILE "test_replay.txt"
+
+#define BINARY_REPLAY_FILE "test_replay.bin"
+
+
+// Write a text replay in the format of scripts/sync2replay, with the given number of matches.
+// Each match is chara select, loading, a round with rollbacks, and the retry menu.
+static void writeTextReplay ( const string& file, uint32_t numMatches, uint32_t inGameFrames )
+{
+    mt19937 rng ( 1234 );
+
+    ofstream fout ( file.c_str() );
+
+    uint32_t index = 0;
+
+    auto line = [&] ( uint32_t gameMode, const char *state, uint32_t frame, const char *tag, const string& str )
+    {
+        fout << gameMode << ' ' << state << ' ' << index << ' ' << frame << ' ' << tag << ' ' << str << '\n';
+    };
+
+    auto inputs = [&] ()
+    {
+        return format ( "0x%04x 0x%04x", rng() % 0x1000, rng() % 0x1000 );
+    };
+
+    auto rngState = [&] ()
+    {
+        RngState rngState ( 0 );
+        rngState.rngState0 = rng();
+        rngState.rngState1 = rng();
+        rngState.rngState2 = rng();
+
+        for ( char& c : rngState.rngState3 )
+            c = rng() % 256;
+
+        return rngState.dump();
+    };
+
+    for ( uint32_t i = 0; i < numMatches; ++i )
+    {
+        line ( CC_GAME_MODE_CHARA_SELECT, "CharaSelect", 0, "RngState", rngState() );
+
+        for ( uint32_t frame = 0; frame < 600; ++frame )
+            line ( CC_GAME_MODE_CHARA_SELECT, "CharaSelect", frame, "Inputs", inputs() );
+
+        ++index;
+
+        for ( uint32_t frame = 0; frame < 100; ++frame )
+            line ( CC_GAME_MODE_LOADING, "Loading", frame, "Inputs", inputs() );
+
+        ++index;
+
+        line ( CC_GAME_MODE_IN_GAME, "InGame", 0, "RngState", rngState() );
+        line ( CC_GAME_MODE_IN_GAME, "InGame", 0, "P1", format ( "%u %u %u", rng() % 32, rng() % 3, rng() % 36 ) );
+        line ( CC_GAME_MODE_IN_GAME, "InGame", 0, "P2", format ( "%u %u %u", rng() % 32, rng() % 3, rng() % 36 ) );
+
+        for ( uint32_t frame = 0; frame < inGameFrames; ++frame )
+        {
+            line ( CC_GAME_MODE_IN_GAME, "InGame", frame, "Inputs", inputs() );
+
+            if ( frame > 10 && rng() % 50 == 0 )
+            {
+                const uint32_t target = frame - 1 - rng() % 8;
+
+                line ( CC_GAME_MODE_IN_GAME, "InGame", frame, "Rollback", format ( "%u %u", index, target ) );
+                line ( CC_GAME_MODE_IN_GAME, "InGame", target, "Reinputs", inputs() );
+            }
+        }
+
+        ++index;
+
+        for ( uint32_t frame = 0; frame < 300; ++frame )
+            line ( CC_GAME_MODE_RETRY, "RetryMenu", frame, "Inputs", inputs() );
+
+        ++index;
+    }
+}
+
+static void expectSameReplay ( ReplayManager& text, ReplayManager& binary )
+{
+    ASSERT_EQ ( text.getLastIndex(), binary.getLastIndex() );
+    ASSERT_EQ ( text.getLastFrame(), binary.getLastFrame() );
+
+    for ( uint32_t index = 0; index <= text.getLastIndex() + 1; ++index )
+    {
+        const IndexedFrame start = {{ 0, index }};
+
+        EXPECT_EQ ( text.getGameMode ( start ), binary.getGameMode ( start ) );
+        EXPECT_EQ ( text.getStateStr ( start ), binary.getStateStr ( start ) );
+
+        MsgPtr textRngState = text.getRngState ( start ), binaryRngState = binary.getRngState ( start );
+
+        ASSERT_EQ ( ( bool ) textRngState, ( bool ) binaryRngState );
+
+        if ( textRngState )
+            EXPECT_EQ ( textRngState->getAs<RngState>().dump(), binaryRngState->getAs<RngState>().dump() );
+
+        MsgPtr textInitial = text.getInitialStateBefore ( index ), binaryInitial = binary.getInitialStateBefore ( index );
+
+        ASSERT_EQ ( ( bool ) textInitial, ( bool ) binaryInitial );
+
+        if ( textInitial )
+        {
+            const InitialGameState& a = textInitial->getAs<InitialGameState>();
+            const InitialGameState& b = binaryInitial->getAs<InitialGameState>();
+
+            EXPECT_EQ ( a.indexedFrame.value, b.indexedFrame.value );
+            EXPECT_TRUE ( a.chara == b.chara );
+            EXPECT_TRUE ( a.moon == b.moon );
+            EXPECT_TRUE ( a.color == b.color );
+        }
+
+        for ( uint32_t frame = 0; frame < 7000; ++frame )
+        {
+            const IndexedFrame indexedFrame = {{ frame, index }};
+
+            const ReplayManager::Inputs a = text.getInputs ( indexedFrame ), b = binary.getInputs ( indexedFrame );
+
+            ASSERT_EQ ( a.p1, b.p1 ) << "[" << indexedFrame << "]";
+            ASSERT_EQ ( a.p2, b.p2 ) << "[" << indexedFrame << "]";
+
+            ASSERT_EQ ( text.getRollbackTarget ( indexedFrame ).value, binary.getRollbackTarget ( indexedFrame ).value );
+
+            const vector<ReplayManager::Inputs> textReinputs = text.getReinputs ( indexedFrame );
+            const vector<ReplayManager::Inputs> binaryReinputs = binary.getReinputs ( indexedFrame );
+
+            ASSERT_EQ ( textReinputs.size(), binaryReinputs.size() );
+
+            for ( size_t i = 0; i < textReinputs.size(); ++i )
+            {
+                EXPECT_EQ ( textReinputs[i].indexedFrame.value, binaryReinputs[i].indexedFrame.value );
+                EXPECT_EQ ( textReinputs[i].p1, binaryReinputs[i].p1 );
+                EXPECT_EQ ( textReinputs[i].p2, binaryReinputs[i].p2 );
+            }
+        }
+    }
+}
+
+
+TEST ( ReplayManager, Convert )
+{
+    writeTextReplay ( TEXT_REPLAY_FILE, 3, 6000 );
+
+    ASSERT_TRUE ( ReplayManager::convert ( TEXT_REPLAY_FILE, BINARY_REPLAY_FILE ) );
+
+    for ( bool real : { false, true } )
+    {
+        ReplayManager text, binary;
+
+        ASSERT_TRUE ( text.load ( TEXT_REPLAY_FILE, real ) );
+        ASSERT_TRUE ( binary.load ( BINARY_REPLAY_FILE, real ) );
+
+        expectSameReplay ( text, binary );
+    }
+
+    remove ( TEXT_REPLAY_FILE );
+    remove ( BINARY_REPLAY_FILE );
+}
+
+TEST ( ReplayManager, Stream )
+{
+    writeTextReplay ( TEXT_REPLAY_FILE, 3, 6000 );
+
+    for ( bool real : { false, true } )
+    {
+        ReplayManager text, stream;
+
+        ASSERT_TRUE ( text.load ( TEXT_REPLAY_FILE, real ) );
+        ASSERT_TRUE ( stream.load ( TEXT_REPLAY_FILE, real, true ) );
+
+        expectSameReplay ( text, stream );
+
+        // Only the indices around the cursor are kept
+        EXPECT_LE ( stream.getNumStreamedIndices(), REPLAY_STREAM_BEHIND + REPLAY_STREAM_AHEAD + 1 );
+    }
+
+    // Seek to the second round, which starts replaying from its loading index
+    ReplayManager text, stream;
+
+    ASSERT_TRUE ( text.load ( TEXT_REPLAY_FILE, false ) );
+    ASSERT_TRUE ( stream.load ( TEXT_REPLAY_FILE, false, true ) );
+
+    const IndexedFrame target = {{ 100, 6 }};
+
+    MsgPtr initial = stream.seek ( target );
+
+    ASSERT_TRUE ( ( bool ) initial );
+    EXPECT_EQ ( 5, initial->getAs<InitialGameState>().indexedFrame.parts.index );
+
+    for ( uint32_t index = 5; index <= text.getLastIndex(); ++index )
+    {
+        for ( uint32_t frame = 0; frame < 7000; ++frame )
+        {
+            const IndexedFrame indexedFrame = {{ frame, index }};
+
+            ASSERT_EQ ( text.getInputs ( indexedFrame ).p1, stream.getInputs ( indexedFrame ).p1 );
+            ASSERT_EQ ( text.getRollbackTarget ( indexedFrame ).value, stream.getRollbackTarget ( indexedFrame ).value );
+            ASSERT_EQ ( text.getReinputs ( indexedFrame ).size(), stream.getReinputs ( indexedFrame ).size() );
+        }
+    }
+
+    remove ( TEXT_REPLAY_FILE );
+}
+
+TEST ( ReplayManager, Benchmark )
+{
+    // A 90 second round every 2 minutes
+    writeTextReplay ( TEXT_REPLAY_FILE, BENCHMARK_HOURS * 30, 90 * 60 );
+
+    auto start = chrono::steady_clock::now();
+
+    ReplayManager text;
+    ASSERT_TRUE ( text.load ( TEXT_REPLAY_FILE, false ) );
+
+    const uint64_t textMicroseconds = chrono::duration_cast<chrono::microseconds> (
+                                          chrono::steady_clock::now() - start ).count();
+
+    start = chrono::steady_clock::now();
+
+    ASSERT_TRUE ( ReplayManager::convert ( TEXT_REPLAY_FILE, BINARY_REPLAY_FILE ) );
+
+    const uint64_t convertMicroseconds = chrono::duration_cast<chrono::microseconds> (
+                                             chrono::steady_clock::now() - start ).count();
+
+    start = chrono::steady_clock::now();
+
+    ReplayManager stream;
+    ASSERT_TRUE ( stream.load ( TEXT_REPLAY_FILE, false, true ) );
+
+    const uint64_t streamMicroseconds = chrono::duration_cast<chrono::microseconds> (
+                                            chrono::steady_clock::now() - start ).count();
+
+    start = chrono::steady_clock::now();
+
+    ReplayManager binary;
+    ASSERT_TRUE ( binary.load ( BINARY_REPLAY_FILE, false ) );
+
+    const uint64_t binaryMicroseconds = chrono::duration_cast<chrono::microseconds> (
+                                            chrono::steady_clock::now() - start ).count();
+
+    // Replay every frame
+    uint64_t frames = 0, sum = 0;
+
+    auto replay = [&] ( ReplayManager& replayManager )
+    {
+        const auto start = chrono::steady_clock::now();
+
+        for ( uint32_t index = 0; index <= replayManager.getLastIndex(); ++index )
+        {
+            for ( uint32_t frame = 0; frame < 90 * 60; ++frame, ++frames )
+            {
+                const IndexedFrame indexedFrame = {{ frame, index }};
+                sum += replayManager.getInputs ( indexedFrame ).p1
+                       + replayManager.getRollbackTarget ( indexedFrame ).parts.frame;
+            }
+        }
+
+        return ( uint64_t ) chrono::duration_cast<chrono::microseconds> (
+                   chrono::steady_clock::now() - start ).count();
+    };
+
+    const uint64_t replayMicroseconds = replay ( binary );
+    const uint64_t binaryFrames = frames;
+    const uint64_t streamReplayMicroseconds = replay ( stream );
+
+    ifstream textFile ( TEXT_REPLAY_FILE, ifstream::binary | ifstream::ate );
+    ifstream binaryFile ( BINARY_REPLAY_FILE, ifstream::binary | ifstream::ate );
+
+    LOG ( "hours=%u; textSize=%u; binarySize=%u; textLoad=%llu us; convert=%llu us; binaryLoad=%llu us; "
+          "%.3f us/frame; sum=%llu", BENCHMARK_HOURS, ( size_t ) textFile.tellg(), ( size_t ) binaryFile.tellg(),
+          textMicroseconds, convertMicroseconds, binaryMicroseconds, double ( replayMicroseconds ) / binaryFrames, sum );
+
+    LOG ( "streamLoad=%llu us; stream %.3f us/frame; streamedIndices=%u", streamMicroseconds,
+          double ( streamReplayMicroseconds ) / ( frames - binaryFrames ), stream.getNumStreamedIndices() );
+
+    textFile.close();
+    binaryFile.close();
+
+    remove ( TEXT_REPLAY_FILE );
+    remove ( BINARY_REPLAY_FILE );
+}
+
+#endif // NOT RELEASE
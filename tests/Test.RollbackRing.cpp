@@ -0,0 +1,243 @@
+#ifndef RELEASE
+
+#include "RollbackRing.hpp"
+
+#include <gtest/gtest.h>
+
+#include <list>
+#include <random>
+
+using namespace std;
+
+
+struct FakeState
+{
+    IndexedFrame indexedFrame;
+    size_t id;
+};
+
+
+// Fake NetplayManager frame sequence, with transitions, remote inputs arriving late, and rollbacks
+class FakeNetplay
+{
+public:
+
+    IndexedFrame indexedFrame = {{ 0, 0 }};
+
+    uint32_t remoteFrame = 0;
+
+    FakeNetplay ( uint32_t seed ) : _rng ( seed ) {}
+
+    // Advance one frame, returns true if the remote inputs changed and the game should roll back to target
+    bool step ( IndexedFrame& target )
+    {
+        // Occasionally transition to the next index
+        if ( _rng() % 512 == 0 )
+        {
+            ++indexedFrame.parts.index;
+            indexedFrame.parts.frame = 0;
+            remoteFrame = 0;
+            return false;
+        }
+
+        ++indexedFrame.parts.frame;
+
+        // The remote inputs lag behind by a varying number of frames
+        const uint32_t lag = _rng() % 12;
+
+        if ( indexedFrame.parts.frame > lag && indexedFrame.parts.frame - lag > remoteFrame )
+            remoteFrame = indexedFrame.parts.frame - lag;
+
+        if ( _rng() % 6 )
+            return false;
+
+        // Roll back to just after the remote frame, or sometimes further back than any saved state
+        target = indexedFrame;
+        target.parts.frame = ( _rng() % 32 == 0 ? 0 : remoteFrame );
+        return true;
+    }
+
+private:
+
+    mt19937 _rng;
+};
+
+
+// The std::list implementation of DllRollbackManager that RollbackRing replaced
+class ListStates
+{
+public:
+
+    list<FakeState> states;
+
+    size_t capacity;
+
+    ListStates ( size_t capacity ) : capacity ( capacity ) {}
+
+    void save ( const FakeState& state, uint32_t remoteFrame )
+    {
+        if ( states.size() == capacity )
+        {
+            if ( states.front().indexedFrame.parts.frame <= remoteFrame )
+                states.erase ( ++states.begin() );
+            else
+                states.pop_front();
+        }
+
+        states.push_back ( state );
+    }
+
+    bool load ( IndexedFrame indexedFrame, FakeState& loaded )
+    {
+        for ( auto it = states.rbegin(); it != states.rend(); ++it )
+        {
+            if ( it->indexedFrame.value <= indexedFrame.value )
+            {
+                loaded = *it;
+                states.erase ( it.base(), states.end() );
+                return true;
+            }
+        }
+
+        return false;
+    }
+};
+
+
+static void checkSameStates ( const ListStates& expected, const RollbackRing<FakeState>& actual )
+{
+    ASSERT_EQ ( expected.states.size(), actual.size() );
+
+    size_t i = 0;
+
+    for ( const FakeState& state : expected.states )
+    {
+        EXPECT_EQ ( state.indexedFrame.value, actual[i].indexedFrame.value ) << "i=" << i;
+        EXPECT_EQ ( state.id, actual[i].id ) << "i=" << i;
+        ++i;
+    }
+}
+
+
+TEST ( RollbackRing, SameAsList )
+{
+    for ( size_t capacity : { 2, 8, NUM_ROLLBACK_STATES } )
+    {
+        FakeNetplay netplay ( 1234 );
+        ListStates expected ( capacity );
+        RollbackRing<FakeState> actual;
+
+        actual.allocate ( capacity );
+
+        // Ids of the evicted states, which should be released
+        vector<size_t> expectedEvicted, actualEvicted;
+
+        size_t nextId = 0;
+
+        for ( size_t frame = 0; frame < 20000; ++frame )
+        {
+            IndexedFrame target;
+
+            if ( netplay.step ( target ) )
+            {
+                FakeState loaded, saved;
+
+                const bool found = expected.load ( target, loaded );
+                const size_t pos = actual.find ( target );
+
+                ASSERT_EQ ( found, pos < actual.size() ) << "frame=" << frame;
+
+                if ( found )
+                {
+                    saved = actual[pos];
+                    actual.rollback ( pos );
+
+                    EXPECT_EQ ( loaded.id, saved.id );
+
+                    // The game re-runs from the loaded state, so the next state saved is the frame after it
+                    netplay.indexedFrame = loaded.indexedFrame;
+                    checkSameStates ( expected, actual );
+                    continue;
+                }
+            }
+
+            const FakeState state = { netplay.indexedFrame, nextId++ };
+
+            if ( expected.states.size() == capacity )
+            {
+                expectedEvicted.push_back ( expected.states.front().indexedFrame.parts.frame <= netplay.remoteFrame
+                                            ? ( ++expected.states.begin() )->id : expected.states.front().id );
+            }
+
+            expected.save ( state, netplay.remoteFrame );
+
+            if ( actual.full() )
+                actualEvicted.push_back ( actual.evict ( netplay.remoteFrame ).id );
+
+            actual.push ( state );
+
+            checkSameStates ( expected, actual );
+
+            if ( HasFatalFailure() )
+                return;
+        }
+
+        EXPECT_EQ ( expectedEvicted, actualEvicted );
+    }
+}
+
+TEST ( RollbackRing, Find )
+{
+    RollbackRing<FakeState> ring;
+    ring.allocate ( 8 );
+
+    // Frames 5 to 8 of index 1, then frames 0 to 2 of index 2, with a gap at frame 1
+    for ( uint32_t frame : { 5, 6, 7, 8 } )
+        ring.push ( { {{ frame, 1 }}, ring.size() } );
+
+    for ( uint32_t frame : { 0, 2 } )
+        ring.push ( { {{ frame, 2 }}, ring.size() } );
+
+    EXPECT_EQ ( ring.size(), ring.find ( {{ 4, 1 }} ) );
+    EXPECT_EQ ( 0u, ring.find ( {{ 5, 1 }} ) );
+    EXPECT_EQ ( 2u, ring.find ( {{ 7, 1 }} ) );
+    EXPECT_EQ ( 3u, ring.find ( {{ 100, 1 }} ) );
+    EXPECT_EQ ( 4u, ring.find ( {{ 0, 2 }} ) );
+    EXPECT_EQ ( 4u, ring.find ( {{ 1, 2 }} ) );
+    EXPECT_EQ ( 5u, ring.find ( {{ 2, 2 }} ) );
+    EXPECT_EQ ( 5u, ring.find ( {{ 0, 3 }} ) );
+}
+
+TEST ( RollbackRing, Stats )
+{
+    RollbackRing<FakeState> ring;
+    ring.allocate ( 4 );
+
+    for ( uint32_t frame = 1; frame <= 10; ++frame )
+    {
+        // The remote frame is before all the states, so the oldest state is evicted
+        if ( ring.full() )
+            ring.evict ( 0 );
+
+        ring.push ( { {{ frame, 0 }}, frame } );
+    }
+
+    // Frames 7 to 10, rolling back to frame 8 discards 2 states, and to frame 7 discards 1 state
+    ring.rollback ( ring.find ( {{ 8, 0 }} ) );
+    ring.addLoadTime ( 10 );
+    ring.rollback ( ring.find ( {{ 7, 0 }} ) );
+    ring.addLoadTime ( 20 );
+
+    const RollbackStats& stats = ring.getStats();
+
+    EXPECT_EQ ( 10u, stats.statesSaved );
+    EXPECT_EQ ( 6u, stats.statesReused );
+    EXPECT_EQ ( 2u, stats.rollbacks );
+    EXPECT_EQ ( 1.5, stats.getAverageRollbackDepth() );
+    EXPECT_EQ ( 15.0, stats.getAverageLoadMicroseconds() );
+
+    ASSERT_EQ ( 1u, ring.size() );
+    EXPECT_EQ ( 7u, ring.front().id );
+}
+
+#endif // NOT RELEASE
@@ -0,0 +1,239 @@
+#ifndef RELEASE
+
+#include "Test.MemDump.hpp"
+#include "SnapshotHistory.hpp"
+#include "Compression.hpp"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+
+using namespace std;
+
+
+// Number of records compressed in the benchmark
+#define BENCHMARK_RECORDS ( 60 )
+
+// Size of the records if res/rollback.bin can't be loaded
+#define DEFAULT_RECORD_SIZE ( 1200 * 1024 )
+
+
+// Fill a record with data that looks like game memory: mostly zeroes, arrays of small values that change slowly
+// between frames, and some noise.
+static void fillGameLike ( string& record, uint32_t frame )
+{
+    mt19937 rng ( 1234 );
+
+    for ( size_t i = 0; i < record.size(); )
+    {
+        const size_t len = min ( record.size() - i, ( size_t ) 1 + rng() % 4096 );
+
+        switch ( rng() % 8 )
+        {
+            case 0:
+            case 1:
+            case 2:
+            case 3:
+                memset ( &record[i], 0, len );
+                break;
+
+            case 4:
+            case 5:
+            case 6:
+            {
+                // Small 32-bit values, some of them are counters that change every frame
+                const uint32_t base = rng() % 1024;
+
+                for ( size_t j = 0; j + 4 <= len; j += 4 )
+                {
+                    const uint32_t value = base + ( j % 64 == 0 ? frame : rng() % 4 );
+                    memcpy ( &record[i + j], &value, 4 );
+                }
+                break;
+            }
+
+            default:
+            {
+                mt19937 noise ( frame * 7919 + i );
+
+                for ( size_t j = 0; j < len; ++j )
+                    record[i + j] = noise() % 256;
+                break;
+            }
+        }
+
+        i += len;
+    }
+}
+
+static void pushAndFlush ( SnapshotHistory& history, uint64_t key, const string& record )
+{
+    char *buffer = history.acquire();
+
+    ASSERT_TRUE ( buffer != 0 );
+
+    memcpy ( buffer, &record[0], record.size() );
+    history.push ( key );
+    history.flush();
+}
+
+
+TEST ( SnapshotHistory, LoadRecords )
+{
+    SnapshotHistory history;
+    history.start ( 64 * 1024, 64 * 1024 * 1024 );
+
+    vector<string> records;
+
+    for ( uint32_t i = 0; i < 20; ++i )
+    {
+        records.push_back ( string ( 64 * 1024, 0 ) );
+        fillGameLike ( records.back(), i );
+
+        // Keys 0, 10, 20, ...
+        pushAndFlush ( history, i * 10, records.back() );
+    }
+
+    EXPECT_EQ ( 20u, history.size() );
+
+    string record ( 64 * 1024, 0 );
+    uint64_t foundKey = 0;
+
+    // Exact keys, and keys in between load the newest record before
+    for ( uint32_t i = 0; i < 20; ++i )
+    {
+        ASSERT_TRUE ( history.load ( i * 10, &record[0], foundKey ) );
+        EXPECT_EQ ( i * 10, foundKey );
+        EXPECT_EQ ( records[i], record );
+
+        ASSERT_TRUE ( history.load ( i * 10 + 5, &record[0], foundKey ) );
+        EXPECT_EQ ( i * 10, foundKey );
+    }
+
+    // Discarding drops the newer records
+    history.discardAfter ( 55 );
+
+    EXPECT_EQ ( 6u, history.size() );
+    ASSERT_TRUE ( history.load ( 1000, &record[0], foundKey ) );
+    EXPECT_EQ ( 50u, foundKey );
+    EXPECT_EQ ( records[5], record );
+
+    history.stop();
+
+    EXPECT_FALSE ( history.isRunning() );
+    EXPECT_FALSE ( history.load ( 0, &record[0], foundKey ) );
+    EXPECT_TRUE ( history.acquire() == 0 );
+}
+
+TEST ( SnapshotHistory, Budget )
+{
+    const size_t budget = 256 * 1024;
+
+    SnapshotHistory history;
+    history.start ( 64 * 1024, budget );
+
+    // Random bytes don't compress, so only a few records fit in the budget
+    mt19937 rng ( 1234 );
+    string record ( 64 * 1024, 0 );
+
+    for ( uint32_t i = 0; i < 20; ++i )
+    {
+        for ( char& c : record )
+            c = rng() % 256;
+
+        pushAndFlush ( history, i, record );
+    }
+
+    const SnapshotHistory::Stats stats = history.getStats();
+
+    EXPECT_EQ ( 20u, stats.compressed );
+    EXPECT_EQ ( 20u, stats.dropped + history.size() );
+    EXPECT_LE ( history.size() * 64 * 1024, budget );
+
+    // The newest record is kept, and the oldest are dropped
+    uint64_t foundKey = 0;
+
+    ASSERT_TRUE ( history.load ( 19, &record[0], foundKey ) );
+    EXPECT_EQ ( 19u, foundKey );
+    EXPECT_FALSE ( history.load ( 0, &record[0], foundKey ) );
+}
+
+TEST ( SnapshotHistory, SkipsWhenBusy )
+{
+    SnapshotHistory history;
+    history.start ( 1024 * 1024, 64 * 1024 * 1024 );
+
+    string record ( 1024 * 1024, 0 );
+    fillGameLike ( record, 0 );
+
+    // Push as fast as possible, some records are skipped instead of waiting for the compression thread
+    for ( uint32_t i = 0; i < 100; ++i )
+    {
+        if ( char *buffer = history.acquire() )
+        {
+            memcpy ( buffer, &record[0], record.size() );
+            history.push ( i );
+        }
+    }
+
+    history.flush();
+
+    const SnapshotHistory::Stats stats = history.getStats();
+
+    EXPECT_EQ ( 100u, stats.compressed + stats.skipped );
+    EXPECT_EQ ( stats.compressed, history.size() );
+}
+
+TEST ( SnapshotHistory, Benchmark )
+{
+    RollbackLayout layout;
+    const size_t recordSize = ( layout.load ( "res/rollback.bin" ) ? layout.list.totalSize : DEFAULT_RECORD_SIZE );
+
+    string record ( recordSize, 0 );
+
+    // Compare the history level with the default zlib level
+    for ( int level : { SNAPSHOT_HISTORY_LEVEL, 6 } )
+    {
+        vector<char> compressed ( compressBound ( recordSize ) );
+        uint64_t bytesOut = 0, microseconds = 0;
+
+        for ( uint32_t i = 0; i < BENCHMARK_RECORDS; ++i )
+        {
+            fillGameLike ( record, i );
+
+            const auto start = chrono::steady_clock::now();
+
+            bytesOut += compress ( &record[0], recordSize, &compressed[0], compressed.size(), level );
+
+            microseconds += chrono::duration_cast<chrono::microseconds> (
+                                chrono::steady_clock::now() - start ).count();
+        }
+
+        const double bytesIn = double ( recordSize ) * BENCHMARK_RECORDS;
+
+        // Bytes per microsecond is MB/s
+        LOG ( "level=%d; recordSize=%u; ratio=%.3f; %.1f MB/s; %llu us/record",
+              level, recordSize, bytesOut / bytesIn, bytesIn / max ( microseconds, ( uint64_t ) 1 ),
+              microseconds / BENCHMARK_RECORDS );
+
+        EXPECT_LT ( bytesOut, bytesIn / 2 );
+    }
+
+    // Through the history, one second of states within a 16 MB budget
+    SnapshotHistory history;
+    history.start ( recordSize, 16 * 1024 * 1024 );
+
+    for ( uint32_t i = 0; i < BENCHMARK_RECORDS; ++i )
+    {
+        fillGameLike ( record, i );
+        pushAndFlush ( history, i, record );
+    }
+
+    const SnapshotHistory::Stats stats = history.getStats();
+
+    LOG ( "history: records=%u; memoryUsage=%u; ratio=%.3f; %llu us/record",
+          history.size(), history.getMemoryUsage(), double ( stats.bytesOut ) / stats.bytesIn,
+          stats.microseconds / max ( stats.compressed, ( uint64_t ) 1 ) );
+}
+
+#endif // NOT RELEASE
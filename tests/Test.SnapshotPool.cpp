@@ -0,0 +1,312 @@
+#ifndef RELEASE
+
+#include "SnapshotPool.hpp"
+#include "Constants.hpp"
+
+#include <gtest/gtest.h>
+
+#include <vector>
+#include <string>
+#include <random>
+#include <cstring>
+#include <chrono>
+
+using namespace std;
+
+
+#define HEAP_SIZE       ( 1024 * 1024 )
+
+// Mutations are limited to the first part of the heap, so they don't overwrite the pointers
+#define MUTABLE_SIZE    ( 512 * 1024 )
+
+#define NUM_OBJECTS     ( 64 )
+#define OBJECT_SIZE     ( 256 )
+
+
+// Synthetic game memory: a few static regions, a pointer table, and a heap the pointers point into
+class SyntheticMemory
+{
+public:
+
+    MemDumpList list;
+
+    SyntheticMemory() : _heap ( HEAP_SIZE, 0 ), _rng ( 1234 )
+    {
+        for ( char& c : _heap )
+            c = _rng() % 256;
+
+        // Adjacent regions are merged by update()
+        list.append ( { &_heap[0], 4096 } );
+        list.append ( { &_heap[4096], 4096 } );
+        list.append ( { &_heap[64 * 1024], 256 * 1024 } );
+
+        // A table of pointers, each pointing to an object with a nested pointer, and some are null
+        vector<MemDumpPtr> ptrs;
+
+        for ( size_t i = 0; i < NUM_OBJECTS; ++i )
+        {
+            ptrs.push_back ( MemDumpPtr ( i * sizeof ( char * ), 0, OBJECT_SIZE, {
+                MemDumpPtr ( OBJECT_SIZE - sizeof ( char * ), 16, 48 )
+            } ) );
+
+            repoint ( i );
+        }
+
+        list.append ( { table(), NUM_OBJECTS * sizeof ( char * ), ptrs } );
+        list.update();
+    }
+
+    // Mutate the memory like a frame of the game would
+    void step()
+    {
+        // Small scattered changes
+        for ( size_t i = 0; i < 32; ++i )
+            _heap[_rng() % MUTABLE_SIZE] = _rng() % 256;
+
+        // Occasionally a large contiguous change
+        if ( _rng() % 16 == 0 )
+        {
+            const size_t start = _rng() % ( MUTABLE_SIZE - 64 * 1024 );
+            for ( size_t i = 0; i < 64 * 1024; ++i )
+                _heap[start + i] = _rng() % 256;
+        }
+
+        // Objects are created and destroyed
+        if ( _rng() % 4 == 0 )
+            repoint ( _rng() % NUM_OBJECTS );
+    }
+
+    // Change all of the mutable memory, like loading a new scene
+    void scramble()
+    {
+        for ( size_t i = 0; i < MUTABLE_SIZE; ++i )
+            _heap[i] = _rng() % 256;
+    }
+
+    // Flatten the memory like a full snapshot
+    string dump() const
+    {
+        string bytes ( list.totalSize, 0 );
+        char *dump = &bytes[0];
+
+        for ( const MemDump& mem : list.addrs )
+            mem.saveDump ( dump );
+
+        return bytes;
+    }
+
+private:
+
+    vector<char> _heap;
+
+    mt19937 _rng;
+
+    char **table() { return ( char ** ) &_heap[MUTABLE_SIZE]; }
+
+    void repoint ( size_t i )
+    {
+        if ( _rng() % 8 == 0 )
+        {
+            table() [i] = 0;
+            return;
+        }
+
+        char *obj = &_heap[600 * 1024 + ( _rng() % 1024 ) * OBJECT_SIZE];
+        table() [i] = obj;
+
+        // The nested pointer
+        char *nested = ( _rng() % 8 ? &_heap[_rng() % ( HEAP_SIZE - 64 )] : 0 );
+        memcpy ( obj + OBJECT_SIZE - sizeof ( char * ), &nested, sizeof ( nested ) );
+    }
+};
+
+
+// Save a snapshot every frame and rollback at random, like DllRollbackManager does
+static void checkSnapshots ( size_t keyframeInterval )
+{
+    SyntheticMemory memory;
+    SnapshotPool pool;
+    mt19937 rng ( 1234 );
+
+    pool.allocate ( memory.list, 32, keyframeInterval, 0 );
+
+    // Saved snapshot ids and the expected memory of each
+    vector<pair<size_t, string>> states;
+
+    for ( size_t frame = 0; frame < 1000; ++frame )
+    {
+        memory.step();
+
+        while ( pool.full() )
+        {
+            // Usually release the oldest state, but sometimes keep it and release the next one
+            const size_t i = ( states.size() > 1 && rng() % 4 == 0 ? 1 : 0 );
+
+            pool.release ( states[i].first );
+            states.erase ( states.begin() + i );
+        }
+
+        states.push_back ( { pool.save(), memory.dump() } );
+
+        if ( rng() % 8 == 0 )
+        {
+            const size_t i = rng() % states.size();
+
+            memory.step();
+            pool.load ( states[i].first );
+
+            ASSERT_EQ ( states[i].second, memory.dump() ) << "frame=" << frame << "; i=" << i;
+
+            for ( size_t j = i + 1; j < states.size(); ++j )
+                pool.release ( states[j].first );
+
+            states.resize ( i + 1 );
+        }
+    }
+
+    // Every remaining state can still be copied and loaded
+    for ( const auto& state : states )
+    {
+        string copy ( memory.list.totalSize, 0 );
+        pool.copy ( state.first, &copy[0] );
+
+        ASSERT_EQ ( state.second, copy );
+
+        pool.load ( state.first );
+
+        ASSERT_EQ ( state.second, memory.dump() );
+    }
+}
+
+
+TEST ( SnapshotPool, FullSnapshots )
+{
+    checkSnapshots ( 1 );
+}
+
+TEST ( SnapshotPool, DeltaSnapshots )
+{
+    checkSnapshots ( 4 );
+    checkSnapshots ( ROLLBACK_KEYFRAME_INTERVAL );
+    checkSnapshots ( 1000 );
+}
+
+TEST ( SnapshotPool, LargeDelta )
+{
+    SyntheticMemory memory;
+    SnapshotPool pool;
+
+    pool.allocate ( memory.list, 32, ROLLBACK_KEYFRAME_INTERVAL, 0 );
+
+    const size_t memoryUsage = pool.getMemoryUsage();
+
+    const size_t first = pool.save();
+
+    memory.step();
+
+    const size_t second = pool.save();
+    const string expected = memory.dump();
+
+    EXPECT_TRUE ( pool.isKeyframe ( first ) );
+    EXPECT_FALSE ( pool.isKeyframe ( second ) );
+    EXPECT_GT ( pool.getDeltaSize ( second ), 0 );
+    EXPECT_LE ( pool.getDeltaSize ( second ), memory.list.totalSize / 2 );
+
+    // Changing most of the memory saves a keyframe instead of a delta
+    memory.scramble();
+
+    const size_t third = pool.save();
+
+    EXPECT_TRUE ( pool.isKeyframe ( third ) );
+    EXPECT_EQ ( 0, pool.getDeltaSize ( third ) );
+
+    pool.load ( second );
+
+    EXPECT_EQ ( expected, memory.dump() );
+
+    // The deltas are written to the preallocated arena, so saving doesn't allocate
+    EXPECT_EQ ( memoryUsage, pool.getMemoryUsage() );
+}
+
+TEST ( SnapshotPool, AllKeyframes )
+{
+    // The capacity in RELEASE, and the capacity of this build
+    for ( size_t capacity : { 60, NUM_ROLLBACK_STATES } )
+    {
+        SyntheticMemory memory;
+        SnapshotPool pool;
+
+        pool.allocate ( memory.list, capacity, ROLLBACK_KEYFRAME_INTERVAL, MAX_ROLLBACK + 2 );
+
+        // Saved snapshot ids and the expected memory of each, the oldest state is kept like RollbackRing::evict does
+        vector<pair<size_t, string>> states;
+
+        for ( size_t frame = 0; frame < 2 * MAX_ROLLBACK + 10; ++frame )
+        {
+            // Changing most of the memory every frame saves every snapshot as a keyframe
+            memory.scramble();
+
+            while ( pool.full() )
+            {
+                ASSERT_GT ( states.size(), 1 );
+
+                pool.release ( states[1].first );
+                states.erase ( states.begin() + 1 );
+            }
+
+            states.push_back ( { pool.save(), memory.dump() } );
+
+            EXPECT_TRUE ( pool.isKeyframe ( states.back().first ) );
+        }
+
+        // The pinned oldest state, and enough states to roll back MAX_ROLLBACK frames from the current one
+        ASSERT_GE ( states.size(), MAX_ROLLBACK + 2 );
+
+        for ( size_t i : { ( size_t ) 0, states.size() - 1 - MAX_ROLLBACK, states.size() - 1 } )
+        {
+            pool.load ( states[i].first );
+
+            EXPECT_EQ ( states[i].second, memory.dump() ) << "capacity=" << capacity << "; i=" << i;
+        }
+    }
+}
+
+TEST ( SnapshotPool, Benchmark )
+{
+    for ( size_t keyframeInterval : { 1, ROLLBACK_KEYFRAME_INTERVAL } )
+    {
+        SyntheticMemory memory;
+        SnapshotPool pool;
+        vector<size_t> ids;
+
+        pool.allocate ( memory.list, NUM_ROLLBACK_STATES, keyframeInterval, MAX_ROLLBACK + 2 );
+
+        uint64_t saveTime = 0;
+
+        for ( size_t frame = 0; frame < 1000; ++frame )
+        {
+            memory.step();
+
+            while ( pool.full() )
+            {
+                pool.release ( ids.front() );
+                ids.erase ( ids.begin() );
+            }
+
+            const auto start = chrono::steady_clock::now();
+            ids.push_back ( pool.save() );
+            saveTime += chrono::duration_cast<chrono::microseconds> ( chrono::steady_clock::now() - start ).count();
+        }
+
+        LOG ( "keyframeInterval=%u; saveTime=%llu us/frame; memoryUsage=%u; snapshotSize=%u",
+              keyframeInterval, saveTime / 1000, pool.getMemoryUsage(), memory.list.totalSize );
+
+        // The changes since the keyframe should be much smaller than the full snapshots
+        if ( keyframeInterval > 1 )
+        {
+            EXPECT_LT ( pool.getMemoryUsage(), NUM_ROLLBACK_STATES * memory.list.totalSize / 2 );
+        }
+    }
+}
+
+#endif // NOT RELEASE
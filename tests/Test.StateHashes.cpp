@@ -0,0 +1,144 @@
+#ifndef RELEASE
+
+#include "Test.MemDump.hpp"
+#include "StateHashes.hpp"
+
+#include <gtest/gtest.h>
+
+using namespace std;
+
+
+// If the last byte of the region isn't part of a pointer
+static bool canDiverge ( const MemDump& mem )
+{
+    for ( const MemDumpPtr& ptr : mem.ptrs )
+    {
+        if ( ptr.srcOffset + sizeof ( char * ) >= mem.size )
+            return false;
+    }
+
+    return true;
+}
+
+// Find the ranges that differ the same way two netplay clients would, by exchanging only the region hashes,
+// then the block hashes of the regions that differ.
+static vector<StateHashes::Range> bisect ( const StateHashes& local, const StateHashes& remote )
+{
+    vector<StateHashes::Range> ranges;
+
+    for ( uint32_t region : local.diffRegions ( remote.getRegionHashes() ) )
+    {
+        const vector<StateHashes::Range> diff = local.diffBlocks ( region, remote.getBlockHashes ( region ) );
+        ranges.insert ( ranges.end(), diff.begin(), diff.end() );
+    }
+
+    return ranges;
+}
+
+
+TEST ( StateHashes, SameState )
+{
+    // Same seed, so the same layout and contents, but the pointers point to different addresses
+    RandomMemory a ( 1234, 500 ), b ( 1234, 500 );
+
+    StateHashes hashesA, hashesB;
+    hashesA.compile ( a.list );
+    hashesB.compile ( b.list );
+
+    ASSERT_EQ ( a.list.addrs.size(), hashesA.getNumRegions() );
+
+    for ( size_t i = 0; i < 10; ++i )
+    {
+        a.step();
+        b.step();
+
+        const string dumpA = a.dump(), dumpB = b.dump();
+
+        ASSERT_NE ( dumpA, dumpB );
+
+        hashesA.compute ( &dumpA[0] );
+        hashesB.compute ( &dumpB[0] );
+
+        EXPECT_EQ ( hashesA.getHash(), hashesB.getHash() );
+        EXPECT_TRUE ( hashesA.diffRegions ( hashesB.getRegionHashes() ).empty() );
+        EXPECT_TRUE ( bisect ( hashesA, hashesB ).empty() );
+    }
+}
+
+TEST ( StateHashes, FindDivergence )
+{
+    mt19937 rng ( 1234 );
+
+    for ( uint32_t seed = 0; seed < 10; ++seed )
+    {
+        RandomMemory a ( seed, 500 ), b ( seed, 500 );
+
+        StateHashes hashesA, hashesB;
+        hashesA.compile ( a.list );
+        hashesB.compile ( b.list );
+
+        a.step();
+        b.step();
+
+        // Diverge the last byte of a few regions
+        vector<size_t> injected;
+        size_t offset = 0;
+
+        for ( uint32_t i = 0; i < hashesA.getNumRegions(); ++i )
+        {
+            const MemDump& mem = b.list.addrs[i];
+
+            if ( rng() % 64 == 0 && canDiverge ( mem ) )
+            {
+                ++mem.addr[mem.size - 1];
+                injected.push_back ( hashesA.getRegionOffset ( i ) + mem.size - 1 );
+            }
+
+            offset += hashesA.getRegionSize ( i );
+        }
+
+        ASSERT_EQ ( a.list.totalSize, offset );
+
+        const string dumpA = a.dump(), dumpB = b.dump();
+
+        hashesA.compute ( &dumpA[0] );
+        hashesB.compute ( &dumpB[0] );
+
+        EXPECT_EQ ( injected.empty(), hashesA.getHash() == hashesB.getHash() ) << "seed=" << seed;
+
+        const vector<StateHashes::Range> ranges = bisect ( hashesA, hashesB );
+
+        // Each divergence is found in its own block
+        ASSERT_EQ ( injected.size(), ranges.size() ) << "seed=" << seed;
+
+        for ( size_t i = 0; i < ranges.size(); ++i )
+        {
+            EXPECT_LE ( ranges[i].offset, injected[i] );
+            EXPECT_GT ( ranges[i].offset + ranges[i].size, injected[i] );
+            EXPECT_LE ( ranges[i].size, ( size_t ) STATE_HASH_BLOCK_SIZE );
+            EXPECT_NE ( dumpA[injected[i]], dumpB[injected[i]] );
+        }
+    }
+}
+
+TEST ( StateHashes, MissingRemoteHashes )
+{
+    RandomMemory memory ( 1234, 100 );
+
+    StateHashes hashes;
+    hashes.compile ( memory.list );
+
+    const string dump = memory.dump();
+    hashes.compute ( &dump[0] );
+
+    // Missing hashes are treated as different, eg if the remote has a different layout
+    EXPECT_EQ ( hashes.getNumRegions(), hashes.diffRegions ( {} ).size() );
+
+    const vector<StateHashes::Range> ranges = hashes.diffBlocks ( 0, {} );
+
+    ASSERT_EQ ( 1u, ranges.size() );
+    EXPECT_EQ ( hashes.getRegionOffset ( 0 ), ranges[0].offset );
+    EXPECT_EQ ( hashes.getRegionSize ( 0 ), ranges[0].size );
+}
+
+#endif // NOT RELEASE
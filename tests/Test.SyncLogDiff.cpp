@@ -0,0 +1,292 @@
+#ifndef RELEASE
+
+#include "SyncLogDiff.hpp"
+#include "Logger.hpp"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstdio>
+
+using namespace std;
+
+
+// Size of each log in the benchmark
+#define BENCHMARK_LOG_SIZE ( 1024ULL * 1024 * 1024 )
+
+#define FIRST_LOG_FILE "test_sync1.log"
+
+#define SECOND_LOG_FILE "test_sync2.log"
+
+
+struct SyncLogParams
+{
+    string sessionId = "test";
+
+    uint32_t numMatches = 3, inGameFrames = 600, loadingFrames = 50;
+
+    // Short format logs are made by scripts/sync2replay
+    bool isShort = false;
+
+    // Transition index and frame where the P1 hp is changed
+    uint32_t desyncIndex = UINT_MAX, desyncFrame = 0;
+
+    // Stop writing after the log reaches this size
+    uint64_t maxSize = ULLONG_MAX;
+};
+
+struct SyncLogInfo
+{
+    // Number of lines that are compared
+    uint64_t compared = 0;
+
+    // Line number of the desync
+    uint64_t desyncLine = 0;
+
+    uint64_t size = 0;
+
+    uint32_t numMatches = 0;
+};
+
+// Write a sync log in the format of LOG_SYNC in DllMain, with chara select, loading, a round, and the retry menu
+static SyncLogInfo writeSyncLog ( const string& file, const SyncLogParams& params )
+{
+    SyncLogInfo info;
+
+    FILE *fd = fopen ( file.c_str(), "wb" );
+
+    vector<char> buffer ( 1024 * 1024 );
+    setvbuf ( fd, &buffer[0], _IOFBF, buffer.size() );
+
+    uint64_t lineNumber = 0;
+
+    auto line = [&] ( const char *mode, uint32_t gameMode, const char *state, uint32_t index, uint32_t frame,
+                      const char *data, bool compared )
+    {
+        int n;
+
+        if ( params.isShort )
+            n = fprintf ( fd, "%s [%u:%u] %s\n", state, index, frame, data );
+        else
+            n = fprintf ( fd, "%s [%u] NetplayState::%s [%u:%u] %s\n", mode, gameMode, state, index, frame, data );
+
+        info.size += n;
+        ++lineNumber;
+
+        if ( compared )
+            ++info.compared;
+    };
+
+    fprintf ( fd, "LogId 'abcdef'\nVersion '3.0' { '3', '0', '' }\nRevision 'test' { isCustom=0 }\n"
+              "BuildTime 'now'\nBuildType 'logging'\nSessionId '%s'\n", params.sessionId.c_str() );
+
+    lineNumber = SYNC_LOG_HEADER_LENGTH + 1;
+
+    // RngState dumps are the longest lines
+    string rngState ( 695, '0' );
+
+    char data[1024];
+
+    auto frameLines = [&] ( const char *mode, uint32_t gameMode, const char *state, uint32_t index, uint32_t frame,
+                            bool compared )
+    {
+        if ( ! params.isShort )
+        {
+            snprintf ( &rngState[0], 9, "%08x", index * 100000 + frame );
+            rngState[8] = ' ';
+            snprintf ( data, sizeof ( data ), "RngState: %s", rngState.c_str() );
+            line ( mode, gameMode, state, index, frame, data, compared );
+        }
+
+        snprintf ( data, sizeof ( data ), "Inputs: 0x%04x 0x%04x", ( frame * 7 ) % 0x1000, ( frame * 13 ) % 0x1000 );
+        line ( mode, gameMode, state, index, frame, data, compared );
+    };
+
+    // Lines before chara select aren't compared, short format logs start at chara select
+    if ( ! params.isShort )
+        line ( "Startup", 65535, "Initial", 0, 0, "Inputs: 0x0000 0x0000", false );
+
+    uint32_t index = 0;
+
+    for ( uint32_t i = 0; i < params.numMatches && info.size < params.maxSize; ++i, ++info.numMatches )
+    {
+        for ( uint32_t frame = 0; frame < 300; ++frame )
+        {
+            frameLines ( "CharaSelect", 20, "CharaSelect", index, frame, true );
+
+            snprintf ( data, sizeof ( data ), "P1: sel=1; C=%u; M=0; c=0; P2: sel=1; C=%u; M=1; c=0", i % 30, 29 - i % 30 );
+            line ( "CharaSelect", 20, "CharaSelect", index, frame, data, true );
+        }
+
+        ++index;
+
+        for ( uint32_t frame = 0; frame < params.loadingFrames; ++frame )
+            frameLines ( "Loading", 8, "Loading", index, frame, false );
+
+        ++index;
+
+        for ( uint32_t frame = 0; frame < params.inGameFrames; ++frame )
+        {
+            frameLines ( "InGame", 1, "InGame", index, frame, true );
+
+            for ( uint32_t player = 1; player <= 2; ++player )
+            {
+                uint32_t hp = 11400 - frame;
+
+                if ( player == 1 && index == params.desyncIndex && frame == params.desyncFrame )
+                {
+                    info.desyncLine = lineNumber + 1;
+                    ++hp;
+                }
+
+                snprintf ( data, sizeof ( data ), "P%u: C=%u; M=0; c=0; seq=%u; st=%u; hp=%u; rh=%u; gb=7000.0; "
+                           "gq=1.0; mt=%u; ht=0; x=%d; y=0", player, i % 30, frame % 40, frame % 3, hp, hp,
+                           frame * 3 % 30000, ( int ) ( frame % 200 ) - 100 );
+                line ( "InGame", 1, "InGame", index, frame, data, true );
+            }
+
+            snprintf ( data, sizeof ( data ), "roundOverTimer=-1; introState=0; roundTimer=%u; realTimer=%u; "
+                       "hitsparks=0; camera={ 0, 0 }", frame, frame );
+            line ( "InGame", 1, "InGame", index, frame, data, true );
+        }
+
+        ++index;
+
+        for ( uint32_t frame = 0; frame < 150; ++frame )
+            frameLines ( "Retry", 5, "RetryMenu", index, frame, false );
+
+        ++index;
+    }
+
+    fclose ( fd );
+    return info;
+}
+
+static void removeLogs()
+{
+    remove ( FIRST_LOG_FILE );
+    remove ( SECOND_LOG_FILE );
+}
+
+
+TEST ( SyncLogDiff, Match )
+{
+    SyncLogParams params;
+    const SyncLogInfo info = writeSyncLog ( FIRST_LOG_FILE, params );
+
+    // Different number of frames in the skipped states
+    params.loadingFrames = 80;
+    writeSyncLog ( SECOND_LOG_FILE, params );
+
+    for ( size_t numThreads : { 1, 4 } )
+    {
+        SyncLogDiff diff;
+        diff.numThreads = numThreads;
+
+        const SyncLogDiff::Result result = diff.diff ( FIRST_LOG_FILE, SECOND_LOG_FILE );
+
+        EXPECT_EQ ( "", result.error );
+        EXPECT_FALSE ( result.mismatch );
+        EXPECT_EQ ( info.compared, result.matched );
+    }
+
+    // RngStates aren't compared against a short format log
+    params.isShort = true;
+    writeSyncLog ( SECOND_LOG_FILE, params );
+
+    const SyncLogDiff::Result result = SyncLogDiff().diff ( FIRST_LOG_FILE, SECOND_LOG_FILE );
+
+    EXPECT_EQ ( "", result.error );
+    EXPECT_FALSE ( result.mismatch );
+    EXPECT_GT ( result.matched, 0 );
+
+    removeLogs();
+}
+
+TEST ( SyncLogDiff, Mismatch )
+{
+    SyncLogParams params;
+    writeSyncLog ( FIRST_LOG_FILE, params );
+
+    params.desyncIndex = 6;
+    params.desyncFrame = 123;
+    const SyncLogInfo info = writeSyncLog ( SECOND_LOG_FILE, params );
+
+    for ( size_t numThreads : { 1, 4 } )
+    {
+        SyncLogDiff diff;
+        diff.numThreads = numThreads;
+
+        const SyncLogDiff::Result result = diff.diff ( FIRST_LOG_FILE, SECOND_LOG_FILE );
+
+        EXPECT_EQ ( "", result.error );
+        ASSERT_TRUE ( result.mismatch );
+        EXPECT_EQ ( 6, result.index );
+        EXPECT_EQ ( 123, result.frame );
+        EXPECT_EQ ( "P1: hp", result.field );
+        EXPECT_EQ ( info.desyncLine, result.lineNumbers[0] );
+        EXPECT_EQ ( info.desyncLine, result.lineNumbers[1] );
+        EXPECT_NE ( string::npos, result.lines[1].find ( "[6:123] P1:" ) );
+    }
+
+    // Different sessions
+    params.sessionId = "other";
+    writeSyncLog ( SECOND_LOG_FILE, params );
+
+    const SyncLogDiff::Result result = SyncLogDiff().diff ( FIRST_LOG_FILE, SECOND_LOG_FILE );
+
+    EXPECT_TRUE ( result.mismatch );
+    EXPECT_EQ ( "SessionId", result.field );
+
+    removeLogs();
+
+    EXPECT_EQ ( "Inputs", SyncLogDiff::getField ( "Inputs: 0x0001 0x0000", "Inputs: 0x0000 0x0000" ) );
+    EXPECT_EQ ( "P2: c", SyncLogDiff::getField ( "P2: C=1; M=0; c=1", "P2: C=1; M=0; c=0" ) );
+    EXPECT_EQ ( "P1", SyncLogDiff::getField ( "P1: C=1", "P2: C=1" ) );
+    EXPECT_EQ ( "P2: sel", SyncLogDiff::getField ( "P1: sel=1; C=1; P2: sel=1", "P1: sel=1; C=1; P2: sel=0" ) );
+    EXPECT_EQ ( "roundTimer", SyncLogDiff::getField ( "roundOverTimer=-1; roundTimer=5", "roundOverTimer=-1; roundTimer=6" ) );
+}
+
+TEST ( SyncLogDiff, Benchmark )
+{
+    // Desync on the last round, so the whole of both logs is compared
+    SyncLogParams params;
+    params.numMatches = UINT_MAX;
+    params.inGameFrames = 90 * 60;
+    params.maxSize = BENCHMARK_LOG_SIZE;
+
+    const SyncLogInfo first = writeSyncLog ( FIRST_LOG_FILE, params );
+
+    // Each match is 4 transition indices, and the round is the third
+    params.numMatches = first.numMatches;
+    params.desyncIndex = ( first.numMatches - 1 ) * 4 + 2;
+    params.desyncFrame = params.inGameFrames - 1;
+
+    const SyncLogInfo second = writeSyncLog ( SECOND_LOG_FILE, params );
+
+    for ( size_t numThreads : { ( size_t ) 1, ( size_t ) 0 } )
+    {
+        SyncLogDiff diff;
+        diff.numThreads = numThreads;
+
+        const auto start = chrono::steady_clock::now();
+
+        const SyncLogDiff::Result result = diff.diff ( FIRST_LOG_FILE, SECOND_LOG_FILE );
+
+        const uint64_t milliseconds = chrono::duration_cast<chrono::milliseconds> (
+                                          chrono::steady_clock::now() - start ).count();
+
+        EXPECT_EQ ( "", result.error );
+        ASSERT_TRUE ( result.mismatch );
+        EXPECT_EQ ( params.desyncIndex, result.index );
+        EXPECT_EQ ( second.desyncLine, result.lineNumbers[1] );
+
+        // Bytes per millisecond is KB/s
+        LOG ( "numThreads=%u; logSize=%llu; matched=%llu; %llu ms; %.1f MB/s", numThreads, first.size,
+              result.matched, milliseconds, ( first.size + second.size ) / 1000.0 / max ( milliseconds, ( uint64_t ) 1 ) );
+    }
+
+    removeLogs();
+}
+
+#endif // NOT RELEASE
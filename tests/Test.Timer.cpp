@@ -5,10 +5,15 @@
 #include "TimerManager.hpp"
 #include "Timer.hpp"
 
+#include "Logger.hpp"
+
 #include <gtest/gtest.h>
 
 #include <cstdlib>
 #include <vector>
+#include <memory>
+#include <chrono>
+#include <functional>
 
 using namespace std;
 
@@ -17,6 +22,12 @@ using namespace std;
 #define NUM_ITERATIONS          ( 10 )
 #define MAX_DELAY_MILLISECONDS  ( 2000 )
 
+// Number of timers in the benchmark, like the GoBackN timers of a host with many spectators
+#define BENCHMARK_TIMERS        ( 4000 )
+
+// Milliseconds of manual clock in the benchmark
+#define BENCHMARK_MILLISECONDS  ( 5000 )
+
 
 TEST ( Timer, RepeatRandom )
 {
@@ -71,4 +82,181 @@ TEST ( Timer, RepeatRandom )
     TimerManager::get().deinitialize();
 }
 
+TEST ( Timer, Order )
+{
+    struct TestTimers : public Timer::Owner
+    {
+        vector<shared_ptr<Timer>> timers;
+        vector<size_t> expired;
+
+        // Called when a timer expires, can start, stop, or delete timers
+        function<void ( size_t )> onExpired;
+
+        void timerExpired ( Timer *timer ) override
+        {
+            for ( size_t i = 0; i < timers.size(); ++i )
+            {
+                if ( timers[i].get() != timer )
+                    continue;
+
+                expired.push_back ( i );
+
+                if ( onExpired )
+                    onExpired ( i );
+                return;
+            }
+        }
+
+        TestTimers ( size_t count )
+        {
+            for ( size_t i = 0; i < count; ++i )
+                timers.push_back ( make_shared<Timer> ( this ) );
+        }
+    };
+
+    TimerManager::get().initialize();
+    TimerManager::get().setManualNow ( 1000 );
+
+    TestTimers test ( 5 );
+
+    // Timers start on the next check, and expire in order of expiry, then in order of being started
+    test.timers[0]->start ( 30 );
+    test.timers[1]->start ( 10 );
+    test.timers[2]->start ( 20 );
+    test.timers[3]->start ( 10 );
+    test.timers[4]->start ( 50 );
+    EXPECT_TRUE ( test.timers[0]->isStarted() );
+    EXPECT_EQ ( 0, TimerManager::get().getNumRunning() );
+
+    TimerManager::get().check();
+    EXPECT_EQ ( 5, TimerManager::get().getNumRunning() );
+    EXPECT_EQ ( 1010, TimerManager::get().getNextExpiry() );
+
+    // Stopped timers don't expire
+    test.timers[4]->stop();
+    EXPECT_FALSE ( test.timers[4]->isStarted() );
+    EXPECT_EQ ( 4, TimerManager::get().getNumRunning() );
+
+    TimerManager::get().setManualNow ( 1025 );
+    TimerManager::get().check();
+    EXPECT_EQ ( ( vector<size_t> { 1, 3, 2 } ), test.expired );
+    EXPECT_EQ ( 1030, TimerManager::get().getNextExpiry() );
+    EXPECT_FALSE ( test.timers[1]->isStarted() );
+
+    // Restarting a running timer replaces its expiry
+    test.timers[0]->start ( 100 );
+    TimerManager::get().setManualNow ( 1030 );
+    TimerManager::get().check();
+    EXPECT_EQ ( 3, test.expired.size() );
+    EXPECT_EQ ( 1130, TimerManager::get().getNextExpiry() );
+
+    // Timers restarted while expiring start from now
+    test.expired.clear();
+    test.onExpired = [&] ( size_t i )
+    {
+        if ( i == 0 )
+            test.timers[0]->start ( 1 );
+    };
+
+    TimerManager::get().setManualNow ( 1200 );
+    TimerManager::get().check();
+    EXPECT_EQ ( ( vector<size_t> { 0 } ), test.expired );
+    EXPECT_EQ ( 1201, TimerManager::get().getNextExpiry() );
+
+    // Timers deleted while another timer is expiring don't expire
+    test.expired.clear();
+    test.timers[1]->start ( 1 );
+    test.timers[2]->start ( 1 );
+    test.onExpired = [&] ( size_t i )
+    {
+        if ( i == 0 )
+            test.timers[1].reset();
+    };
+
+    TimerManager::get().setManualNow ( 1201 );
+    TimerManager::get().check();
+    TimerManager::get().setManualNow ( 1202 );
+    TimerManager::get().check();
+    EXPECT_EQ ( ( vector<size_t> { 0, 2 } ), test.expired );
+
+    // Timers deleted while expiring
+    test.expired.clear();
+    test.timers[2]->start ( 1 );
+    test.timers[3]->start ( 1 );
+    test.onExpired = [&] ( size_t i ) { test.timers[i].reset(); };
+
+    TimerManager::get().check();
+    TimerManager::get().setManualNow ( 1203 );
+    TimerManager::get().check();
+    EXPECT_EQ ( ( vector<size_t> { 2, 3 } ), test.expired );
+    EXPECT_EQ ( 0, TimerManager::get().getNumRunning() );
+    EXPECT_EQ ( UINT64_MAX, TimerManager::get().getNextExpiry() );
+
+    TimerManager::get().setManualNow ( 0 );
+    TimerManager::get().deinitialize();
+}
+
+TEST ( Timer, Benchmark )
+{
+    // Restarts itself on expiry with a fixed interval like the GoBackN keep alive and send timers
+    struct TestTimer : public Timer::Owner
+    {
+        Timer timer;
+        uint64_t interval;
+        size_t count = 0;
+
+        void timerExpired ( Timer *timer ) override
+        {
+            ++count;
+            timer->start ( interval );
+        }
+
+        TestTimer ( uint64_t interval ) : timer ( this ), interval ( interval )
+        {
+            timer.start ( interval );
+        }
+    };
+
+    TimerManager::get().initialize();
+    TimerManager::get().setManualNow ( 1 );
+
+    vector<shared_ptr<TestTimer>> timers;
+
+    for ( size_t i = 0; i < BENCHMARK_TIMERS; ++i )
+        timers.push_back ( make_shared<TestTimer> ( 10 + ( i * 7 ) % 1000 ) );
+
+    size_t expected = 0;
+
+    for ( const auto& timer : timers )
+        expected += ( BENCHMARK_MILLISECONDS - 1 ) / timer->interval;
+
+    TimerManager::get().check();
+
+    const auto start = chrono::steady_clock::now();
+
+    for ( uint64_t now = 2; now <= BENCHMARK_MILLISECONDS; ++now )
+    {
+        TimerManager::get().setManualNow ( now );
+        TimerManager::get().check();
+    }
+
+    const auto end = chrono::steady_clock::now();
+
+    size_t count = 0;
+
+    for ( const auto& timer : timers )
+        count += timer->count;
+
+    EXPECT_EQ ( expected, count );
+
+    LOG ( "%u timers; %u expiries; %.3f ns per check",
+          BENCHMARK_TIMERS, count,
+          chrono::duration<double, nano> ( end - start ).count() / ( BENCHMARK_MILLISECONDS - 1 ) );
+
+    timers.clear();
+
+    TimerManager::get().setManualNow ( 0 );
+    TimerManager::get().deinitialize();
+}
+
 #endif // NOT RELEASE
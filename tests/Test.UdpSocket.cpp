@@ -3,8 +3,15 @@
 #include "Test.Socket.hpp"
 #include "UdpSocket.hpp"
 #include "Timer.hpp"
+#include "ReadBufferPool.hpp"
+
+#include <windows.h>
+#include <psapi.h>
 
 #include <memory>
+#include <chrono>
+#include <unordered_map>
+#include <unordered_set>
 
 using namespace std;
 
@@ -13,6 +20,28 @@ using namespace std;
 #define CHECK_SUM_FAIL  50
 #define LONG_TIMEOUT    ( 120 * 1000 )
 
+// Ticks in the throughput benchmark, and messages sent each tick
+#define THROUGHPUT_TICKS    ( 2000 )
+#define THROUGHPUT_MESSAGES ( 16 )
+
+// Sockets created in the memory test
+#define MEMORY_SOCKETS      ( 256 )
+
+// Clients connected to one server in the stress test, and rounds where 1 to 4 of them send a message
+#define STRESS_CLIENTS      ( 300 )
+#define STRESS_ROUNDS       ( 1000 )
+
+// Clients that connect at the same time in the stress test
+#define STRESS_JOINING      ( 20 )
+
+
+static size_t getPrivateBytes()
+{
+    PROCESS_MEMORY_COUNTERS_EX counters;
+    GetProcessMemoryInfo ( GetCurrentProcess(), ( PROCESS_MEMORY_COUNTERS * ) &counters, sizeof ( counters ) );
+    return counters.PrivateUsage;
+}
+
 
 TEST_CONNECT                ( UdpSocket, PACKET_LOSS, CHECK_SUM_FAIL, LONG_TIMEOUT, LONG_TIMEOUT )
 
@@ -121,6 +150,368 @@ TEST ( UdpSocket, SendConnectionLess )
     TimerManager::get().deinitialize();
 }
 
+TEST ( UdpSocket, FastHash )
+{
+    struct TestSocket : public BaseTestSocket<UdpSocket, 0, 5000>
+    {
+        MsgPtr msg;
+
+        void socketAccepted ( Socket *serverSocket ) override
+        {
+            // Like MainApp and DllMain, only the accepted child socket switches to the negotiated hash type
+            accepted = serverSocket->accept ( this );
+            accepted->setHashType ( HashType::Xxh64 );
+        }
+
+        void socketConnected ( Socket *socket ) override
+        {
+            socket->setHashType ( HashType::Xxh64 );
+            socket->send ( new TestMessage ( "Hello server!" ) );
+        }
+
+        void socketRead ( Socket *socket, const MsgPtr& msg, const IpAddrPort& address ) override
+        {
+            this->msg = msg;
+
+            if ( socket == accepted.get() )
+                socket->send ( new TestMessage ( "Hello client!" ) );
+            else
+                EventManager::get().stop();
+        }
+
+        void timerExpired ( Timer *timer ) override
+        {
+            EventManager::get().stop();
+        }
+
+        TestSocket ( uint16_t port ) : BaseTestSocket ( port ) {}
+        TestSocket ( const string& address, uint16_t port ) : BaseTestSocket ( address, port ) {}
+    };
+
+    TimerManager::get().initialize();
+    SocketManager::get().initialize();
+
+    TestSocket server ( 0 );
+    TestSocket client ( "127.0.0.1", server.socket->address.port );
+
+    EventManager::get().start();
+
+    // The server socket still uses the default hash type for new connections
+    EXPECT_EQ ( HashType::Md5, server.socket->getHashType() );
+
+    ASSERT_TRUE ( server.accepted.get() );
+    EXPECT_EQ ( HashType::Xxh64, server.accepted->getHashType() );
+
+    ASSERT_TRUE ( server.msg.get() );
+    EXPECT_EQ ( "Hello server!", server.msg->getAs<TestMessage>().str );
+
+    ASSERT_TRUE ( client.msg.get() );
+    EXPECT_EQ ( "Hello client!", client.msg->getAs<TestMessage>().str );
+
+    SocketManager::get().deinitialize();
+    TimerManager::get().deinitialize();
+}
+
+TEST ( UdpSocket, ReadOversized )
+{
+    struct TestSocket : public Socket::Owner, public Timer::Owner
+    {
+        SocketPtr socket;
+        Timer timer;
+        vector<MsgPtr> msgs;
+
+        void socketAccepted ( Socket *socket ) override {}
+        void socketConnected ( Socket *socket ) override {}
+        void socketDisconnected ( Socket *socket ) override {}
+
+        void socketRead ( Socket *socket, const MsgPtr& msg, const IpAddrPort& address ) override
+        {
+            msgs.push_back ( msg );
+
+            if ( msgs.size() == 3 )
+                EventManager::get().stop();
+        }
+
+        void timerExpired ( Timer *timer ) override
+        {
+            EventManager::get().stop();
+        }
+
+        TestSocket ( uint16_t port ) : socket ( UdpSocket::bind ( this, port ) ), timer ( this )
+        {
+            timer.start ( 5000 );
+        }
+    };
+
+    TimerManager::get().initialize();
+    SocketManager::get().initialize();
+
+    TestSocket server ( 0 ), client ( 0 );
+
+    // Random bytes, so the message isn't compressed to fit a slab
+    string large ( 8 * READ_SLAB_SIZE, ' ' );
+    for ( char& c : large )
+        c = rand();
+
+    const IpAddrPort address ( "127.0.0.1", server.socket->address.port );
+
+    // Small datagrams are queued around the oversized one
+    client.socket->send ( new TestMessage ( "Before" ), address );
+    client.socket->send ( new TestMessage ( large ), address );
+    client.socket->send ( new TestMessage ( "After" ), address );
+
+    EventManager::get().start();
+
+    ASSERT_EQ ( 3, server.msgs.size() );
+
+    EXPECT_EQ ( "Before", server.msgs[0]->getAs<TestMessage>().str );
+    EXPECT_EQ ( large, server.msgs[1]->getAs<TestMessage>().str );
+    EXPECT_EQ ( "After", server.msgs[2]->getAs<TestMessage>().str );
+
+    SocketManager::get().deinitialize();
+    TimerManager::get().deinitialize();
+}
+
+TEST ( UdpSocket, Throughput )
+{
+    struct TestSocket : public Socket::Owner
+    {
+        SocketPtr socket;
+        size_t count = 0;
+
+        void socketAccepted ( Socket *socket ) override {}
+        void socketConnected ( Socket *socket ) override {}
+        void socketDisconnected ( Socket *socket ) override {}
+
+        void socketRead ( Socket *socket, const MsgPtr& msg, const IpAddrPort& address ) override
+        {
+            ++count;
+        }
+    };
+
+    TimerManager::get().initialize();
+    SocketManager::get().initialize();
+
+    // Send each message in its own datagram, then batch the messages of each tick
+    for ( bool batched : { false, true } )
+    {
+        TestSocket receiver, sender;
+        receiver.socket = UdpSocket::bind ( &receiver, 0 );
+        sender.socket = UdpSocket::bind ( &sender, IpAddrPort ( "127.0.0.1", receiver.socket->address.port ) );
+
+        size_t sent = 0;
+
+        const auto start = chrono::steady_clock::now();
+
+        for ( uint32_t tick = 0; tick < THROUGHPUT_TICKS; ++tick )
+        {
+            if ( batched )
+                SocketManager::get().beginBatch();
+
+            for ( uint32_t i = 0; i < THROUGHPUT_MESSAGES; ++i, ++sent )
+                sender.socket->send ( new TestMessage ( "Input" ) );
+
+            if ( batched )
+                SocketManager::get().endBatch();
+
+            // Read until everything sent so far has arrived, or nothing more arrives
+            while ( receiver.count < sent && SocketManager::get().check ( 100 ) )
+                ;
+        }
+
+        const double seconds = chrono::duration<double> ( chrono::steady_clock::now() - start ).count();
+
+        // Loopback datagrams can still be dropped if the receive buffer is full
+        EXPECT_GE ( receiver.count, sent * 99 / 100 );
+
+        LOG ( "%s: %u messages; %.0f messages per second", batched ? "batched" : "unbatched",
+              receiver.count, receiver.count / seconds );
+    }
+
+    SocketManager::get().deinitialize();
+    TimerManager::get().deinitialize();
+}
+
+TEST ( UdpSocket, StressChildren )
+{
+    // Like a host with hundreds of spectators, every message is read by the server and dispatched to a child socket
+    struct ServerSocket : public Socket::Owner
+    {
+        SocketPtr socket;
+        vector<SocketPtr> children;
+
+        // The client each child socket read messages from, each child must only read the messages of its own client
+        unordered_map<Socket *, string> senders;
+        unordered_set<string> seen;
+        size_t count = 0;
+
+        void socketAccepted ( Socket *serverSocket ) override { children.push_back ( serverSocket->accept ( this ) ); }
+        void socketConnected ( Socket *socket ) override {}
+        void socketDisconnected ( Socket *socket ) override {}
+
+        void socketRead ( Socket *socket, const MsgPtr& msg, const IpAddrPort& address ) override
+        {
+            ++count;
+
+            ASSERT_TRUE ( msg.get() );
+
+            const string& str = msg->getAs<TestMessage>().str;
+            const auto it = senders.find ( socket );
+
+            if ( it == senders.end() )
+            {
+                EXPECT_TRUE ( seen.insert ( str ).second ) << "Two children read the messages of " << str;
+                senders[socket] = str;
+            }
+            else
+            {
+                EXPECT_EQ ( it->second, str );
+            }
+        }
+    };
+
+    struct ClientSocket : public Socket::Owner
+    {
+        vector<SocketPtr> sockets;
+        size_t connected = 0;
+
+        void socketAccepted ( Socket *socket ) override {}
+        void socketConnected ( Socket *socket ) override { ++connected; }
+        void socketDisconnected ( Socket *socket ) override {}
+        void socketRead ( Socket *socket, const MsgPtr& msg, const IpAddrPort& address ) override {}
+    };
+
+    // Like EventManager::checkEvents, the timers send the GoBackN keep alives and retries
+    auto check = [] ( uint64_t timeout )
+    {
+        {
+            SocketManager::Batch batch;
+            TimerManager::get().check();
+        }
+
+        return SocketManager::get().check ( timeout );
+    };
+
+    TimerManager::get().initialize();
+
+    for ( Reactor::Backend backend : { Reactor::Select, Reactor::Poll, Reactor::Epoll } )
+    {
+        SocketManager::get().setBackend ( backend );
+        SocketManager::get().initialize();
+
+        if ( SocketManager::get().getBackend() != backend )
+        {
+            SocketManager::get().deinitialize();
+            continue;
+        }
+
+        ServerSocket server;
+        ClientSocket clients;
+
+        server.socket = UdpSocket::listen ( &server, 0 );
+
+        // GoBackN recovers anything dropped, this only stops the test from hanging if it can't
+        const auto deadline = chrono::steady_clock::now() + chrono::seconds ( 30 );
+
+        // Clients join a few at a time like spectators do, since hundreds of connect requests at once overflow the
+        // receive buffer of the server, while the clients that already connected keep it full with keep alives.
+        for ( uint32_t i = 0; i < STRESS_CLIENTS; ++i )
+        {
+            clients.sockets.push_back ( UdpSocket::connect ( &clients,
+                                        IpAddrPort ( "127.0.0.1", server.socket->address.port ) ) );
+
+            if ( ( i + 1 ) % STRESS_JOINING != 0 && i + 1 < STRESS_CLIENTS )
+                continue;
+
+            while ( ( clients.connected <= i || server.children.size() <= i )
+                    && chrono::steady_clock::now() < deadline )
+            {
+                check ( 100 );
+            }
+        }
+
+        ASSERT_EQ ( STRESS_CLIENTS, clients.connected );
+        ASSERT_EQ ( STRESS_CLIENTS, server.children.size() );
+
+        uint64_t total = 0, checks = 0;
+        size_t sent = 0;
+
+        for ( uint32_t round = 0; round < STRESS_ROUNDS; ++round )
+        {
+            for ( uint32_t j = 0; j <= round % 4; ++j, ++sent )
+            {
+                const uint32_t i = ( round * 37 + j * 101 ) % STRESS_CLIENTS;
+                clients.sockets[i]->send ( new TestMessage ( format ( "client %u", i ) ) );
+            }
+
+            while ( server.count < sent && chrono::steady_clock::now() < deadline )
+            {
+                const auto start = chrono::steady_clock::now();
+                check ( 100 );
+                total += chrono::duration_cast<chrono::nanoseconds> ( chrono::steady_clock::now() - start ).count();
+                ++checks;
+            }
+        }
+
+        // The messages are sent with GoBackN, so none are lost
+        EXPECT_EQ ( sent, server.count );
+
+        // Every client sent at least once, and each one was read by its own child socket
+        EXPECT_EQ ( STRESS_CLIENTS, server.senders.size() );
+
+        LOG ( "%s: %u children; %.3f us per check; %.3f us per message",
+              Reactor::getBackendName ( backend ), STRESS_CLIENTS, total / 1000.0 / checks,
+              total / 1000.0 / server.count );
+
+        server.children.clear();
+        clients.sockets.clear();
+        server.socket.reset();
+
+        SocketManager::get().deinitialize();
+    }
+
+    SocketManager::get().setBackend ( Reactor::getDefaultBackend() );
+
+    TimerManager::get().deinitialize();
+}
+
+TEST ( UdpSocket, Memory )
+{
+    struct TestSocket : public Socket::Owner
+    {
+        void socketAccepted ( Socket *socket ) override {}
+        void socketConnected ( Socket *socket ) override {}
+        void socketDisconnected ( Socket *socket ) override {}
+        void socketRead ( Socket *socket, const MsgPtr& msg, const IpAddrPort& address ) override {}
+    };
+
+    TimerManager::get().initialize();
+    SocketManager::get().initialize();
+
+    TestSocket owner;
+    vector<SocketPtr> sockets;
+
+    const size_t before = getPrivateBytes();
+    const auto start = chrono::steady_clock::now();
+
+    for ( uint32_t i = 0; i < MEMORY_SOCKETS; ++i )
+        sockets.push_back ( UdpSocket::bind ( &owner, 0 ) );
+
+    const double seconds = chrono::duration<double> ( chrono::steady_clock::now() - start ).count();
+    const size_t bytes = ( getPrivateBytes() - before ) / MEMORY_SOCKETS;
+
+    // Each socket used to have a 4 MB read buffer
+    EXPECT_LT ( bytes, 1024 * 1024 );
+
+    LOG ( "%u sockets; %.3f us per socket; %u bytes per socket", MEMORY_SOCKETS,
+          seconds * 1000000 / MEMORY_SOCKETS, bytes );
+
+    sockets.clear();
+
+    SocketManager::get().deinitialize();
+    TimerManager::get().deinitialize();
+}
+
 TEST ( UdpSocket, BindThenConnect )
 {
     static int done = 0;
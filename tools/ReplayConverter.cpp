@@ -0,0 +1,29 @@
+#include "ReplayManager.hpp"
+#include "Logger.hpp"
+
+using namespace std;
+
+
+#define LOG_FILE "replay_converter.log"
+
+
+int main ( int argc, char *argv[] )
+{
+    if ( argc < 3 )
+    {
+        PRINT ( "Usage: %s <text replay file> <binary replay file>", argv[0] );
+        return -1;
+    }
+
+    Logger::get().initialize ( LOG_FILE, 0 );
+
+    const bool good = ReplayManager::convert ( argv[1], argv[2] );
+
+    if ( good )
+        PRINT ( "Converted '%s' to '%s'", argv[1], argv[2] );
+    else
+        PRINT ( "Failed to convert '%s'", argv[1] );
+
+    Logger::get().deinitialize();
+    return ( good ? 0 : -1 );
+}
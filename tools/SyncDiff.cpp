@@ -0,0 +1,63 @@
+#include "SyncLogDiff.hpp"
+#include "StringUtils.hpp"
+#include "Logger.hpp"
+
+#include <chrono>
+
+using namespace std;
+
+
+#define LOG_FILE "sync_diff.log"
+
+
+int main ( int argc, char *argv[] )
+{
+    if ( argc < 3 )
+    {
+        PRINT ( "Usage: %s sync-logs...", argv[0] );
+        PRINT ( "Compares the first sync log against each of the others" );
+        return -1;
+    }
+
+    Logger::get().initialize ( LOG_FILE, 0 );
+
+    const vector<string> logs ( argv + 1, argv + argc );
+
+    const auto start = chrono::steady_clock::now();
+
+    const vector<SyncLogDiff::Result> results = SyncLogDiff().diff ( logs );
+
+    const uint64_t milliseconds = chrono::duration_cast<chrono::milliseconds> (
+                                      chrono::steady_clock::now() - start ).count();
+
+    int ret = 0;
+
+    for ( size_t i = 0; i < results.size(); ++i )
+    {
+        const SyncLogDiff::Result& result = results[i];
+
+        if ( ! result.error.empty() )
+        {
+            PRINT ( "%s", result.error );
+            ret = -1;
+            continue;
+        }
+
+        if ( result.mismatch )
+        {
+            PRINT ( "Line %llu in %s", result.lineNumbers[0], logs[0] );
+            PRINT ( "< %s", result.lines[0] );
+            PRINT ( "Line %llu in %s", result.lineNumbers[1], logs[i + 1] );
+            PRINT ( "> %s", result.lines[1] );
+            PRINT ( "First mismatch at [%u:%u] in %s", result.index, result.frame, result.field );
+            ret = -1;
+        }
+
+        PRINT ( "Successfully matched %llu lines (%s vs %s)", result.matched, logs[0], logs[i + 1] );
+    }
+
+    LOG ( "Compared %u logs in %llu ms", logs.size(), milliseconds );
+
+    Logger::get().deinitialize();
+    return ret;
+}
@@ -0,0 +1,42 @@
+#include "BinarySyncLog.hpp"
+#include "Logger.hpp"
+
+using namespace std;
+
+
+#define LOG_FILE "sync_decoder.log"
+
+
+int main ( int argc, char *argv[] )
+{
+    if ( argc < 2 )
+    {
+        PRINT ( "Usage: %s <binary sync log> [text sync log]", argv[0] );
+        return -1;
+    }
+
+    Logger::get().initialize ( LOG_FILE, 0 );
+
+    // The text sync log is next to the binary one by default
+    string textFile;
+
+    if ( argc >= 3 )
+    {
+        textFile = argv[2];
+    }
+    else
+    {
+        textFile = argv[1];
+        textFile = textFile.substr ( 0, textFile.find_last_of ( '.' ) ) + ".log";
+    }
+
+    const bool good = BinarySyncLog::decode ( argv[1], textFile );
+
+    if ( good )
+        PRINT ( "Decoded '%s' to '%s'", argv[1], textFile );
+    else
+        PRINT ( "Failed to decode '%s'", argv[1] );
+
+    Logger::get().deinitialize();
+    return ( good ? 0 : -1 );
+}